@@ -700,6 +700,12 @@ package riscv_instr;
   localparam logic [31:0] P_MINU             = 32'b0000010??????????101?????0110011;
   localparam logic [31:0] P_MAX              = 32'b0000010??????????110?????0110011;
   localparam logic [31:0] P_MAXU             = 32'b0000010??????????111?????0110011;
+  localparam logic [31:0] LP_STARTI          = 32'b????????????000000000000?1111011;
+  localparam logic [31:0] LP_ENDI            = 32'b????????????000000010000?1111011;
+  localparam logic [31:0] LP_COUNT           = 32'b000000000000?????0100000?1111011;
+  localparam logic [31:0] LP_COUNTI          = 32'b????????????000000110000?1111011;
+  localparam logic [31:0] LP_SETUP           = 32'b?????????????????1000000?1111011;
+  localparam logic [31:0] LP_SETUPI          = 32'b?????????????????1010000?1111011;
   localparam logic [31:0] P_ADDN             = 32'b00???????????????010?????1011011;
   localparam logic [31:0] P_ADDUN            = 32'b10???????????????010?????1011011;
   localparam logic [31:0] P_LB_IRPOST        = 32'b?????????????????000?????0001011;
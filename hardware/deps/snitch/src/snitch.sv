@@ -205,11 +205,24 @@ module snitch
   logic [31:0] csr_rvalue;
   logic csr_en;
 
+  // Hardware loops (Xpulpimg)
+  localparam int NumHwLoops = 2;
+  logic [NumHwLoops-1:0][31:0] lp_start_d, lp_start_q;
+  logic [NumHwLoops-1:0][31:0] lp_end_d, lp_end_q;
+  logic [NumHwLoops-1:0][31:0] lp_count_d, lp_count_q;
+  logic lp_start_we, lp_end_we, lp_count_we; // written by the lp.* instruction
+  logic [31:0] lp_start_wdata, lp_end_wdata, lp_count_wdata;
+  logic lp_jump; // the instruction ends a loop with iterations left
+  logic [31:0] lp_target;
+
   // Registers
   `FFAR(pc_q, pc_d, BootAddr, clk_i, rst_i)
   `FFAR(wfi_q, wfi_d, '0, clk_i, rst_i)
   `FFAR(wake_up_q, wake_up_d, '0, clk_i, rst_i)
   `FFAR(sb_q, sb_d, '0, clk_i, rst_i)
+  `FFAR(lp_start_q, lp_start_d, '0, clk_i, rst_i)
+  `FFAR(lp_end_q, lp_end_d, '0, clk_i, rst_i)
+  `FFAR(lp_count_q, lp_count_d, '0, clk_i, rst_i)
 
   always_comb begin
     core_events_o = '0;
@@ -277,13 +290,44 @@ module snitch
     // if we got a valid instruction word increment the PC unless we are waiting for an event
     if (!stall && !wfi_q) begin
       casez (next_pc)
-        Consec: pc_d = consec_pc;
+        Consec: pc_d = lp_jump ? lp_target : consec_pc;
         Alu: pc_d = alu_result & {{31{1'b1}}, ~zero_lsb};
         Exception: pc_d = MTVEC;
       endcase
     end
   end
 
+  // --------------------
+  // Hardware Loops
+  // --------------------
+  // An instruction that falls through to the end address (exclusive) of a
+  // loop with iterations left continues at the loop's start instead. Loop 0
+  // is the inner one; the outer loop is only checked if loop 0 does not jump.
+  always_comb begin
+    lp_start_d = lp_start_q;
+    lp_end_d = lp_end_q;
+    lp_count_d = lp_count_q;
+    lp_jump = 1'b0;
+    lp_target = consec_pc;
+    if (!stall && !wfi_q && next_pc == Consec && !(is_branch & alu_result[0])) begin
+      for (int i = 0; i < NumHwLoops; i++) begin
+        if (!lp_jump && lp_count_q[i] != '0 && consec_pc == lp_end_q[i]) begin
+          lp_count_d[i] = lp_count_q[i] - 1;
+          if (lp_count_q[i] != 32'd1) begin
+            lp_jump = 1'b1;
+            lp_target = lp_start_q[i];
+          end
+        end
+      end
+    end
+    // The lp.* instructions are never the last one of a loop body
+    if (!stall && !exception) begin
+      if (lp_start_we) lp_start_d[inst_data_i[7]] = lp_start_wdata;
+      if (lp_end_we) lp_end_d[inst_data_i[7]] = lp_end_wdata;
+      if (lp_count_we) lp_count_d[inst_data_i[7]] = lp_count_wdata;
+    end
+  end
+
   // --------------------
   // Performance Counter
   // --------------------
@@ -344,6 +388,13 @@ module snitch
     acc_register_rd = 1'b0;
 
     csr_en = 1'b0;
+
+    lp_start_we = 1'b0;
+    lp_end_we = 1'b0;
+    lp_count_we = 1'b0;
+    lp_start_wdata = pc_q + 'd4;
+    lp_end_wdata = pc_q + {19'b0, inst_data_i[31:20], 1'b0};
+    lp_count_wdata = gpr_rdata[0];
     // Wake up if a wake-up is incoming or pending
     wfi_d = (wake_up_q || wake_up_sync_i) ? 1'b0 : wfi_q;
     // Only store a pending wake-up if we are not asleep
@@ -1145,6 +1196,65 @@ module snitch
           illegal_inst = 1'b1;
         end
       end
+      // Hardware loops
+      riscv_instr::LP_STARTI: begin // Xpulpimg: lp.starti
+        if (snitch_pkg::XPULPIMG) begin
+          write_rd = 1'b0;
+          lp_start_we = 1'b1;
+          lp_start_wdata = pc_q + {19'b0, inst_data_i[31:20], 1'b0};
+        end else begin
+          illegal_inst = 1'b1;
+        end
+      end
+      riscv_instr::LP_ENDI: begin // Xpulpimg: lp.endi
+        if (snitch_pkg::XPULPIMG) begin
+          write_rd = 1'b0;
+          lp_end_we = 1'b1;
+        end else begin
+          illegal_inst = 1'b1;
+        end
+      end
+      riscv_instr::LP_COUNT: begin // Xpulpimg: lp.count
+        if (snitch_pkg::XPULPIMG) begin
+          write_rd = 1'b0;
+          opa_select = Reg;
+          lp_count_we = 1'b1;
+        end else begin
+          illegal_inst = 1'b1;
+        end
+      end
+      riscv_instr::LP_COUNTI: begin // Xpulpimg: lp.counti
+        if (snitch_pkg::XPULPIMG) begin
+          write_rd = 1'b0;
+          lp_count_we = 1'b1;
+          lp_count_wdata = {20'b0, inst_data_i[31:20]};
+        end else begin
+          illegal_inst = 1'b1;
+        end
+      end
+      riscv_instr::LP_SETUP: begin // Xpulpimg: lp.setup
+        if (snitch_pkg::XPULPIMG) begin
+          write_rd = 1'b0;
+          opa_select = Reg;
+          lp_start_we = 1'b1;
+          lp_end_we = 1'b1;
+          lp_count_we = 1'b1;
+        end else begin
+          illegal_inst = 1'b1;
+        end
+      end
+      riscv_instr::LP_SETUPI: begin // Xpulpimg: lp.setupi
+        if (snitch_pkg::XPULPIMG) begin
+          write_rd = 1'b0;
+          lp_start_we = 1'b1;
+          lp_end_we = 1'b1;
+          lp_end_wdata = pc_q + {26'b0, inst_data_i[19:15], 1'b0};
+          lp_count_we = 1'b1;
+          lp_count_wdata = {20'b0, inst_data_i[31:20]};
+        end else begin
+          illegal_inst = 1'b1;
+        end
+      end
       // Off-load to IPU coprocessor
       // 1 source register (rs1)
       riscv_instr::P_ABS,                // Xpulpimg: p.abs
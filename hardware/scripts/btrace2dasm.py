@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+
+# Copyright 2021 ETH Zurich and University of Bologna.
+# Solderpad Hardware License, Version 0.51, see LICENSE for details.
+# SPDX-License-Identifier: SHL-0.51
+
+# This script converts the binary traces the DPI trace sink of the Verilator
+# model writes (`make verilate binary_trace=1`) to the .dasm traces the RTL
+# tracer writes otherwise, so they can be annotated with snitch-trace or
+# gen_trace.py. The record layout is defined in
+# tb/verilator/trace_sink/cpp/trace_sink.h and src/mempool_cc.sv.
+
+import argparse
+import glob
+import multiprocessing
+import operator
+import os
+import struct
+import sys
+
+MAGIC = b'MPBTRACE'
+VERSION = 1
+HEADER = struct.Struct('<8sII')
+RECORD = struct.Struct('<QQ16IH12BH')
+
+# Fields of a record, followed by the bits of its flags
+FLAGS = ('stall', 'is_load', 'is_store', 'is_branch', 'write_rd',
+         'retire_load', 'retire_acc')
+FIELDS = (
+    'time', 'cycle', 'pc', 'insn', 'stall_tot', 'stall_ins', 'stall_raw',
+    'stall_lsu', 'stall_acc', 'pc_d', 'opa', 'opb', 'writeback',
+    'gpr_rdata_1', 'gpr_rdata_2', 'ld_result_32', 'alu_result',
+    'acc_pdata_32', 'csr_addr', 'source', 'rs1', 'rs2', 'rd', 'opa_select',
+    'opb_select', 'opc_select', 'ls_size', 'lsu_rd', 'ls_amo', 'acc_pid',
+    'flags', 'reserved') + FLAGS
+FLAG_BITS = [tuple(f >> i & 1 for i in range(len(FLAGS))) for f in range(256)]
+FLAGS_INDEX = FIELDS.index('flags')
+
+# The annotations of mempool_cc in their order, with their number of digits
+TRACE_KEYS = (
+    ('source', 8), ('stall', 1), ('stall_tot', 8), ('stall_ins', 8),
+    ('stall_raw', 8), ('stall_lsu', 8), ('stall_acc', 8), ('rs1', 8),
+    ('rs2', 8), ('rd', 8), ('is_load', 1), ('is_store', 1),
+    ('is_branch', 1), ('pc_d', 8), ('opa', 8), ('opb', 8),
+    ('opa_select', 1), ('opb_select', 1), ('opc_select', 1),
+    ('write_rd', 1), ('csr_addr', 3), ('writeback', 8),
+    ('gpr_rdata_1', 8), ('gpr_rdata_2', 8), ('ls_size', 1),
+    ('ld_result_32', 8), ('lsu_rd', 2), ('retire_load', 1),
+    ('alu_result', 8), ('ls_amo', 1), ('retire_acc', 1), ('acc_pid', 2),
+    ('acc_pdata_32', 8))
+
+LINE = '%10d %8d 0x%08x DASM(%08x) #; {' + ''.join(
+    "'{}': 0x%0{}x, ".format(key, width) for key, width in TRACE_KEYS) + '}\n'
+LINE_FIELDS = operator.itemgetter(
+    *(FIELDS.index(key)
+      for key in ('time', 'cycle', 'pc', 'insn') +
+      tuple(key for key, _ in TRACE_KEYS)))
+
+# Records converted at once
+CHUNK_RECORDS = 1 << 14
+
+
+def convert(paths):
+    infile, outfile = paths
+    with open(infile, 'rb') as fin:
+        header = fin.read(HEADER.size)
+        if len(header) == HEADER.size:
+            magic, version, size = HEADER.unpack(header)
+        if len(header) != HEADER.size or magic != MAGIC or \
+                version != VERSION or size != RECORD.size:
+            return '{}: not a binary trace of version {}'.format(
+                infile, VERSION)
+        with open(outfile, 'w') as fout:
+            while True:
+                chunk = fin.read(CHUNK_RECORDS * RECORD.size)
+                # A simulation that was killed may leave a partial record
+                chunk = chunk[:len(chunk) - len(chunk) % RECORD.size]
+                if not chunk:
+                    break
+                fout.write(''.join(
+                    LINE % LINE_FIELDS(r + FLAG_BITS[r[FLAGS_INDEX]])
+                    for r in RECORD.iter_unpack(chunk)))
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        'paths',
+        metavar='path',
+        nargs='+',
+        help='A binary trace, or a folder of them')
+    parser.add_argument(
+        '-o',
+        '--out-dir',
+        help='Write the .dasm traces to this folder, next to the binary '
+        'traces by default')
+    parser.add_argument(
+        '-j',
+        '--jobs',
+        type=int,
+        default=os.cpu_count(),
+        help='Convert this many traces in parallel')
+    args = parser.parse_args()
+
+    jobs = []
+    for path in args.paths:
+        files = [path]
+        if os.path.isdir(path):
+            files = sorted(glob.glob(os.path.join(path, '*.btrace')))
+        for infile in files:
+            outdir = args.out_dir or os.path.dirname(infile)
+            name = os.path.splitext(os.path.basename(infile))[0] + '.dasm'
+            jobs.append((infile, os.path.join(outdir, name)))
+
+    errors = 0
+    with multiprocessing.Pool(max(1, min(args.jobs, len(jobs)))) as pool:
+        for error in pool.imap_unordered(convert, jobs):
+            if error:
+                print(error, file=sys.stderr)
+                errors += 1
+    print('Converted {} binary traces'.format(len(jobs) - errors))
+    return 1 if errors else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+
+# Copyright 2021 ETH Zurich and University of Bologna.
+# Solderpad Hardware License, Version 0.51, see LICENSE for details.
+# SPDX-License-Identifier: SHL-0.51
+
+# This script checks that snitch-trace produces the same traces, CSV and
+# warnings as gen_trace.py. It generates random annotated traces like the
+# ones of the RTL tracer, runs spike-dasm and gen_trace.py on each of them,
+# as well as snitch-trace on all of them, and compares the outputs.
+
+import argparse
+import difflib
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+INSTALL_DIR = os.path.abspath(
+    os.path.join(SCRIPT_DIR, '..', '..', 'install', 'riscv-isa-sim', 'bin'))
+
+TRACE_KEYS = (
+    ('source', 8), ('stall', 1), ('stall_tot', 8), ('stall_ins', 8),
+    ('stall_raw', 8), ('stall_lsu', 8), ('stall_acc', 8), ('rs1', 8),
+    ('rs2', 8), ('rd', 8), ('is_load', 1), ('is_store', 1),
+    ('is_branch', 1), ('pc_d', 8), ('opa', 8), ('opb', 8),
+    ('opa_select', 1), ('opb_select', 1), ('opc_select', 1),
+    ('write_rd', 1), ('csr_addr', 3), ('writeback', 8),
+    ('gpr_rdata_1', 8), ('gpr_rdata_2', 8), ('ls_size', 1),
+    ('ld_result_32', 8), ('lsu_rd', 2), ('retire_load', 1),
+    ('alu_result', 8), ('ls_amo', 1), ('retire_acc', 1), ('acc_pid', 2),
+    ('acc_pdata_32', 8))
+
+NUM_CORES = int(os.environ.get('num_cores', 256))
+SEQ_MEM_SIZE = 4 * int(os.environ.get('seq_mem_size', 1024))
+TCDM_SIZE = 16 * 1024 * NUM_CORES // 4
+
+# -------------------- Trace generation --------------------
+
+
+def addi(rd, rs1, imm):
+    return (imm & 0xfff) << 20 | rs1 << 15 | rd << 7 | 0x13
+
+
+def lw(rd, rs1):
+    return rs1 << 15 | 2 << 12 | rd << 7 | 0x03
+
+
+def sw(rs2, rs1):
+    return rs2 << 20 | rs1 << 15 | 2 << 12 | 0x23
+
+
+def beq(rs1, rs2):
+    return rs2 << 20 | rs1 << 15 | 8 << 7 | 0x63
+
+
+def csrr(rd, csr):
+    return csr << 20 | 2 << 12 | rd << 7 | 0x73
+
+
+WFI = 0x10500073
+
+
+def random_address(rng, hart):
+    tile = hart // 4
+    kind = rng.randrange(4)
+    if kind == 0:
+        # Sequential region of the own tile
+        return tile * SEQ_MEM_SIZE + 4 * rng.randrange(SEQ_MEM_SIZE // 4)
+    if kind == 1:
+        return 4 * rng.randrange(SEQ_MEM_SIZE * NUM_CORES // 16)
+    if kind == 2:
+        return 4 * rng.randrange(SEQ_MEM_SIZE * NUM_CORES // 16,
+                                 TCDM_SIZE // 4)
+    return 0x80000000 + 4 * rng.randrange(1 << 16)
+
+
+def trace_line(time, cycle, pc, insn, extras):
+    annot = ''
+    for key, width in TRACE_KEYS:
+        val = extras.get(key, 0)
+        # Strings are values with X bits
+        if not isinstance(val, str):
+            val = '{:0{}x}'.format(val, width)
+        annot += "'{}': 0x{}, ".format(key, val)
+    return '{:>10} {:>8} 0x{:08x} DASM({:08x}) #; {{{}}}\n'.format(
+        time, cycle, pc, insn, annot)
+
+
+def gen_trace(rng, hart, num_insns):
+    lines = []
+    cycle = rng.randrange(1, 100)
+    pc = 0x80000000
+    # Loads in flight: [(rd, cycle it returns)]
+    in_flight = []
+
+    def retire(extras, now):
+        ready = [i for i, (_, t) in enumerate(in_flight) if t <= now]
+        if ready and rng.random() < 0.8:
+            rd, _ = in_flight.pop(ready[0])
+            extras.update(retire_load=1, lsu_rd=rd,
+                          ld_result_32=rng.getrandbits(32))
+            if rng.random() < 0.01:
+                extras['ld_result_32'] = 'xxxxxxxx'
+        elif rng.random() < 0.005:
+            # Spurious writeback, accepted in permissive mode
+            extras.update(retire_load=1, lsu_rd=rng.randrange(1, 32))
+
+    for _ in range(num_insns):
+        # Stall cycles before the next issue, some with retiring loads
+        stalls = rng.choice((0, 0, 0, 1, 2, 5, 20))
+        for s in range(stalls):
+            extras = {'stall': 1}
+            retire(extras, cycle + s)
+            if extras.get('retire_load'):
+                lines.append((cycle + s, pc, addi(0, 0, 0), extras))
+        cycle += stalls
+
+        kind = rng.choices(
+            ('alu', 'load', 'store', 'branch', 'mcycle', 'csr', 'wfi',
+             'vanilla'),
+            (40, 20, 15, 10, 2, 1, 1, 1))[0]
+        # gen_trace.py fails on sections without any retired load, so only
+        # start a section once all loads are back, like benchmarks do
+        if kind == 'mcycle' and in_flight:
+            kind = 'alu'
+        rd, rs1, rs2 = (rng.randrange(32) for _ in range(3))
+        extras = {
+            'stall_tot': stalls, 'rs1': rs1, 'rs2': rs2, 'rd': rd,
+            'pc_d': pc + 4, 'opa': rng.getrandbits(32),
+            'opb': rng.getrandbits(rng.choice((4, 16, 32))),
+            'gpr_rdata_1': rng.getrandbits(32),
+            'gpr_rdata_2': rng.getrandbits(32),
+            'alu_result': rng.getrandbits(32)}
+        # Split the stalls among the causes, not always consistently
+        rest = stalls
+        for cause in ('stall_ins', 'stall_raw', 'stall_lsu', 'stall_acc'):
+            n = rng.randint(0, rest)
+            extras[cause] = n
+            rest -= n
+        extras['stall_raw'] += rest if rng.random() < 0.9 else 0
+        if rng.random() < 0.02:
+            extras['stall_tot'] = 0
+
+        if kind == 'alu':
+            insn = addi(rd, rs1, rng.randrange(-2048, 2048))
+            extras.update(opa_select=1, write_rd=1,
+                          writeback=rng.getrandbits(32))
+        elif kind == 'load':
+            insn = lw(rd, rs1)
+            extras.update(opa_select=1, is_load=1, ls_size=2,
+                          alu_result=random_address(rng, hart))
+            in_flight.append((rd, cycle + rng.randrange(1, 12)))
+        elif kind == 'store':
+            insn = sw(rs2, rs1)
+            extras.update(opa_select=1, opb_select=1, is_store=1,
+                          ls_size=rng.randrange(3),
+                          alu_result=random_address(rng, hart))
+        elif kind == 'branch':
+            insn = beq(rs1, rs2)
+            taken = rng.random() < 0.5
+            extras.update(opa_select=1, opb_select=1, is_branch=1,
+                          alu_result=int(taken),
+                          pc_d=pc + (8 if taken else 4))
+        elif kind == 'mcycle':
+            insn = csrr(rd, 0xb00)
+            extras.update(opb_select=8, csr_addr=0xb00, opb=cycle,
+                          write_rd=1, writeback=cycle)
+        elif kind == 'csr':
+            csr = rng.choice((0xf14, 0x345))
+            insn = csrr(rd, csr)
+            extras.update(opb_select=8, csr_addr=csr, write_rd=1,
+                          writeback=extras['opb'])
+        else:
+            insn = WFI
+        if kind != 'vanilla':
+            retire(extras, cycle)
+        lines.append((cycle, pc, insn, None if kind == 'vanilla' else extras))
+        pc = extras['pc_d']
+        cycle += 1 if kind != 'wfi' else rng.randrange(1, 50)
+    # Retire all loads but one, so that the trace ends like a cut-off one
+    # and its last section has retired a load
+    for rd, _ in in_flight:
+        lines.append((cycle, pc, addi(0, 0, 0),
+                      {'stall': 1, 'retire_load': 1, 'lsu_rd': rd}))
+        cycle += 1
+    for rd in (5, 6):
+        lines.append((cycle, pc, lw(rd, 10),
+                      {'rd': rd, 'rs1': 10, 'opa_select': 1, 'is_load': 1,
+                       'ls_size': 2, 'pc_d': pc + 4,
+                       'alu_result': random_address(rng, hart)}))
+        pc += 4
+        cycle += 1
+    lines.append((cycle, pc, addi(0, 0, 0),
+                  {'stall': 1, 'retire_load': 1, 'lsu_rd': 5}))
+
+    out = []
+    for cycle, pc, insn, extras in lines:
+        time = 2 * cycle + 1
+        if extras is None:
+            out.append('{:>10} {:>8} 0x{:08x} DASM({:08x})\n'.format(
+                time, cycle, pc, insn))
+        else:
+            out.append(trace_line(time, cycle, pc, insn, extras))
+    return ''.join(out)
+
+# -------------------- Comparison --------------------
+
+
+def run(cmd, cwd, stdout=subprocess.PIPE):
+    proc = subprocess.run(cmd, cwd=cwd, stdout=stdout,
+                          stderr=subprocess.PIPE, universal_newlines=True)
+    return proc.returncode, proc.stdout, proc.stderr
+
+
+def compare(name, ref, dut):
+    if ref == dut:
+        return True
+    print('MISMATCH in {}:'.format(name))
+    sys.stdout.writelines(list(difflib.unified_diff(
+        ref.splitlines(True), dut.splitlines(True),
+        'gen_trace.py', 'snitch-trace', n=2))[:40])
+    return False
+
+
+def read(path):
+    with open(path, newline='') as f:
+        return f.read()
+
+
+def check(work, names, bin_dir):
+    gen_trace_py = os.path.join(SCRIPT_DIR, 'gen_trace.py')
+    spike_dasm = os.path.join(bin_dir, 'spike-dasm')
+    snitch_trace = os.path.join(bin_dir, 'snitch-trace')
+    ref_dir, dut_dir = os.path.join(work, 'ref'), os.path.join(work, 'dut')
+    dasm_files = [name + '.dasm' for name in names]
+
+    # Reference: spike-dasm, then gen_trace.py on each hart
+    ref_err = ''
+    ret, _, err = run([spike_dasm, '--out-dir=.'] + dasm_files, ref_dir)
+    if ret != 0:
+        print('spike-dasm failed:\n' + err)
+        return False
+    for name in names:
+        with open(os.path.join(ref_dir, name + '.trace'), 'w') as out:
+            ret, _, err = run([sys.executable, gen_trace_py, '-p', '--csv',
+                               'results.csv', name], ref_dir, stdout=out)
+        ref_err += err
+        if ret != 0:
+            print('gen_trace.py failed on {}:\n{}'.format(name, err))
+            return False
+
+    # Under test: snitch-trace on all harts at once
+    ret, _, dut_err = run([snitch_trace, '-p', '--csv=results.csv']
+                          + dasm_files, dut_dir)
+    if ret != 0:
+        print('snitch-trace failed:\n' + dut_err)
+        return False
+
+    ok = True
+    for name in names:
+        ok &= compare(name + '.trace',
+                      read(os.path.join(ref_dir, name + '.trace')),
+                      read(os.path.join(dut_dir, name + '.trace')))
+    ok &= compare('results.csv', read(os.path.join(ref_dir, 'results.csv')),
+                  read(os.path.join(dut_dir, 'results.csv')))
+    # gen_trace.py only sees the traces after spike-dasm
+    ok &= compare('warnings', ref_err, dut_err.replace('.dasm)', ')'))
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-n', '--harts', type=int, default=16,
+                        help='Number of hart traces to generate')
+    parser.add_argument('-l', '--length', type=int, default=3000,
+                        help='Instructions per hart')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--bin', default=INSTALL_DIR,
+                        help='Directory of spike-dasm and snitch-trace')
+    parser.add_argument('-k', '--keep', action='store_true',
+                        help='Keep the generated files, even if passing')
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    work = tempfile.mkdtemp(prefix='gen_trace_test.')
+    names = ['trace_hart_0x{:08x}'.format(h) for h in range(args.harts)]
+    for hart, name in enumerate(names):
+        # The last hart has not traced anything
+        trace = (gen_trace(rng, hart, args.length)
+                 if hart != args.harts - 1 else '')
+        for d in ('ref', 'dut'):
+            os.makedirs(os.path.join(work, d), exist_ok=True)
+            with open(os.path.join(work, d, name + '.dasm'), 'w') as f:
+                f.write(trace)
+
+    ok = check(work, names, args.bin)
+    if args.keep or not ok:
+        print('Kept the traces in {}'.format(work))
+    else:
+        shutil.rmtree(work)
+    print('{}: {} harts of {} instructions'.format(
+        'PASSED' if ok else 'FAILED', args.harts, args.length))
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
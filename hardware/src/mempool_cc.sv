@@ -200,11 +200,61 @@ module mempool_cc
   // Tracer
   // --------------------------
   // pragma translate_off
-  int f;
-  string fn;
   logic [63:0] cycle;
   int unsigned stall, stall_ins, stall_raw, stall_lsu, stall_acc;
 
+  typedef enum logic [1:0] {SrcSnitch =  0, SrcFpu = 1, SrcFpuSeq = 2} trace_src_e;
+  localparam int SnitchTrace = `ifdef SNITCH_TRACE `SNITCH_TRACE `else 0 `endif;
+
+`ifdef BINARY_TRACE
+  // Pass the raw fields to the binary trace sink of the Verilator testbench
+  // instead of formatting them, see tb/verilator/trace_sink. The first byte of
+  // a record is its least significant one, so the fields are listed from the
+  // end of the record.
+  typedef struct packed {
+    logic [15:0] reserved;
+    // {retire_acc, retire_load, write_rd, is_branch, is_store, is_load, stall}
+    logic [7:0]  flags;
+    logic [7:0]  acc_pid;
+    logic [7:0]  ls_amo;
+    logic [7:0]  lsu_rd;
+    logic [7:0]  ls_size;
+    logic [7:0]  opc_select;
+    logic [7:0]  opb_select;
+    logic [7:0]  opa_select;
+    logic [7:0]  rd;
+    logic [7:0]  rs2;
+    logic [7:0]  rs1;
+    logic [7:0]  source;
+    logic [15:0] csr_addr;
+    logic [31:0] acc_pdata_32;
+    logic [31:0] alu_result;
+    logic [31:0] ld_result_32;
+    logic [31:0] gpr_rdata_2;
+    logic [31:0] gpr_rdata_1;
+    logic [31:0] writeback;
+    logic [31:0] opb;
+    logic [31:0] opa;
+    logic [31:0] pc_d;
+    logic [31:0] stall_acc;
+    logic [31:0] stall_lsu;
+    logic [31:0] stall_raw;
+    logic [31:0] stall_ins;
+    logic [31:0] stall_tot;
+    logic [31:0] insn;
+    logic [31:0] pc;
+    logic [63:0] cycle;
+    logic [63:0] timestamp;
+  } trace_record_t;
+
+  import "DPI-C" function void mempool_trace_insn(
+    input bit [31:0]                      hart_id,
+    input bit [$bits(trace_record_t)-1:0] record
+  );
+`else
+  int f;
+  string fn;
+
   always_ff @(posedge rst_i) begin
     if(rst_i) begin
       // Format in hex because vcs and vsim treat decimal differently
@@ -214,13 +264,15 @@ module mempool_cc
       $display("[Tracer] Logging Hart %d to %s", hart_id_i, fn);
     end
   end
-
-  typedef enum logic [1:0] {SrcSnitch =  0, SrcFpu = 1, SrcFpuSeq = 2} trace_src_e;
-  localparam int SnitchTrace = `ifdef SNITCH_TRACE `SNITCH_TRACE `else 0 `endif;
+`endif
 
   always_ff @(posedge clk_i or posedge rst_i) begin
+`ifdef BINARY_TRACE
+      automatic trace_record_t trace_record;
+`else
       automatic string trace_entry;
       automatic string extras_str;
+`endif
 
       if (!rst_i) begin
         cycle <= cycle + 1;
@@ -229,6 +281,50 @@ module mempool_cc
         // we are not stalled <==> we have issued and processed an instruction (including offloads)
         // OR we are retiring (issuing a writeback from) a load or accelerator instruction
         if ((i_snitch.csr_trace_q || SnitchTrace) && (!i_snitch.stall || i_snitch.retire_load || i_snitch.retire_acc)) begin
+`ifdef BINARY_TRACE
+          trace_record              = '0;
+          trace_record.timestamp    = $time;
+          trace_record.cycle        = cycle;
+          trace_record.pc           = i_snitch.pc_q;
+          trace_record.insn         = i_snitch.inst_data_i;
+          // State
+          trace_record.source       = SrcSnitch;
+          trace_record.stall_tot    = stall;
+          trace_record.stall_ins    = stall_ins;
+          trace_record.stall_raw    = stall_raw;
+          trace_record.stall_lsu    = stall_lsu;
+          trace_record.stall_acc    = stall_acc;
+          // Decoding
+          trace_record.rs1          = i_snitch.rs1;
+          trace_record.rs2          = i_snitch.rs2;
+          trace_record.rd           = i_snitch.rd;
+          trace_record.pc_d         = i_snitch.pc_d;
+          // Operands
+          trace_record.opa          = i_snitch.opa;
+          trace_record.opb          = i_snitch.opb;
+          trace_record.opa_select   = i_snitch.opa_select;
+          trace_record.opb_select   = i_snitch.opb_select;
+          trace_record.opc_select   = i_snitch.opc_select;
+          trace_record.csr_addr     = i_snitch.inst_data_i[31:20];
+          // Pipeline writeback
+          trace_record.writeback    = i_snitch.alu_writeback;
+          // Load/Store
+          trace_record.gpr_rdata_1  = i_snitch.gpr_rdata[1];
+          trace_record.gpr_rdata_2  = i_snitch.gpr_rdata[2];
+          trace_record.ls_size      = i_snitch.ls_size;
+          trace_record.ld_result_32 = i_snitch.ld_result[31:0];
+          trace_record.lsu_rd       = i_snitch.lsu_rd;
+          trace_record.alu_result   = i_snitch.alu_result;
+          // Atomics
+          trace_record.ls_amo       = i_snitch.ls_amo;
+          // Accumulator
+          trace_record.acc_pid      = i_snitch.acc_pid_i;
+          trace_record.acc_pdata_32 = i_snitch.acc_pdata_i[31:0];
+          trace_record.flags        = {1'b0, i_snitch.retire_acc, i_snitch.retire_load,
+                                       i_snitch.write_rd, i_snitch.is_branch,
+                                       i_snitch.is_store, i_snitch.is_load, i_snitch.stall};
+          mempool_trace_insn(hart_id_i, trace_record);
+`else
           // Manual loop unrolling for Verilator
           // Data type keys for arrays are currently not supported in Verilator
           extras_str = "{";
@@ -278,6 +374,7 @@ module mempool_cc
           $sformat(trace_entry, "%t %8d 0x%h DASM(%h) #; %s\n",
               $time, cycle, i_snitch.pc_q, i_snitch.inst_data_i, extras_str);
           $fwrite(f, trace_entry);
+`endif
         end
 
         // Reset all stalls when we execute an instruction
@@ -315,9 +412,51 @@ module mempool_cc
       end
     end
 
+`ifndef BINARY_TRACE
   final begin
     $fclose(f);
   end
+`endif
+
+`ifdef SPIKE_COSIM
+  // --------------------------
+  // Co-simulation
+  // --------------------------
+  // Steps the core's Spike hart on every issued instruction and checks the
+  // register writes and the stores against it
+  import "DPI-C" function void spike_cosim_issue(input bit [31:0] hart_id,
+                                                 input bit [31:0] pc,
+                                                 input bit [31:0] insn);
+  import "DPI-C" function void spike_cosim_writeback(input bit [31:0] hart_id,
+                                                     input bit [31:0] rd,
+                                                     input bit [31:0] value);
+  import "DPI-C" function void spike_cosim_store(input bit [31:0] hart_id,
+                                                 input bit [31:0] addr,
+                                                 input bit [31:0] data,
+                                                 input bit [31:0] size);
+
+  always_ff @(posedge clk_i) begin
+    if (!rst_i) begin
+      // Issue first: the ALU writes back in the cycle it issues
+      if (!i_snitch.stall) begin
+        spike_cosim_issue(hart_id_i, i_snitch.pc_q, i_snitch.inst_data_i);
+      end
+      // Plain stores only (ls_amo is AMONone): whether an SC stores depends
+      // on its reservation, which the harts do not model
+      if (!i_snitch.stall && i_snitch.lsu_qvalid && i_snitch.is_store &&
+          i_snitch.ls_amo == '0) begin
+        spike_cosim_store(hart_id_i, i_snitch.lsu_qaddr, i_snitch.gpr_rdata[1],
+                          32'(1 << i_snitch.ls_size));
+      end
+      for (int i = 0; i < $bits(i_snitch.gpr_we); i++) begin
+        if (i_snitch.gpr_we[i] && i_snitch.gpr_waddr[i] != '0) begin
+          spike_cosim_writeback(hart_id_i, 32'(i_snitch.gpr_waddr[i]),
+                                i_snitch.gpr_wdata[i]);
+        end
+      end
+    end
+  end
+`endif
   // pragma translate_on
 
 endmodule
@@ -8,6 +8,12 @@
 #include "verilated_toplevel.h"
 #include "verilator_memutil.h"
 #include "verilator_sim_ctrl.h"
+#ifdef SPIKE_COSIM
+#include "spike_cosim.h"
+#endif
+#ifdef BINARY_TRACE
+#include "trace_sink.h"
+#endif
 
 // Please define the following parameters with sensible values
 #ifndef L2_BASE
@@ -44,6 +50,16 @@ int main(int argc, char **argv) {
   simctrl.RegisterExtension(&memutil);
 #endif
 
+#ifdef SPIKE_COSIM
+  SpikeCosim cosim;
+  simctrl.RegisterExtension(&cosim);
+#endif
+
+#ifdef BINARY_TRACE
+  TraceSink trace_sink;
+  simctrl.RegisterExtension(&trace_sink);
+#endif
+
   simctrl.SetInitialResetDelay(1);
   simctrl.SetResetDuration(4);
 
@@ -0,0 +1,420 @@
+// Copyright 2021 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifdef SPIKE_COSIM
+
+#include "spike_cosim.h"
+
+#include <cstring>
+#include <getopt.h>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+#include "devices.h"
+#include "disasm.h"
+#include "elfloader.h"
+#include "memif.h"
+#include "memtracer.h"
+#include "mmu.h"
+#include "processor.h"
+#include "simif.h"
+#include "verilator_sim_ctrl.h"
+
+// Please define the following parameters with sensible values
+#ifndef L2_BASE
+#define L2_BASE (-1)
+#endif
+#ifndef L2_SIZE
+#define L2_SIZE (-1)
+#endif
+
+// The TCDM and its sequential regions, from address 0 up to the control
+// registers. Only the pages the program touches take host memory.
+#define TCDM_REGION_SIZE 0x40000000
+
+// Function declarations
+extern "C" {
+void spike_cosim_issue(const uint32_t *hart_id, const uint32_t *pc,
+                       const uint32_t *insn);
+void spike_cosim_writeback(const uint32_t *hart_id, const uint32_t *rd,
+                           const uint32_t *value);
+void spike_cosim_store(const uint32_t *hart_id, const uint32_t *addr,
+                       const uint32_t *data, const uint32_t *size);
+}
+
+static SpikeCosim *cosim = nullptr;
+// Multi-threaded models call the DPI functions from several threads
+static std::mutex cosim_mutex;
+
+// The memory the Spike harts share. Accesses outside the TCDM and the L2
+// memory (the control registers) read as zero and are not checked.
+class SpikeCosimMemory : public simif_t, public chunked_memif_t {
+public:
+  SpikeCosimMemory() : tcdm_(TCDM_REGION_SIZE), l2_(L2_SIZE), mmio_(false) {
+    bus_.add_device(0, &tcdm_);
+    bus_.add_device(L2_BASE, &l2_);
+  }
+
+  char *addr_to_mem(reg_t addr) override {
+    auto desc = bus_.find_device(addr);
+    if (auto mem = dynamic_cast<mem_t *>(desc.second))
+      if (addr - desc.first < mem->size())
+        return mem->contents() + (addr - desc.first);
+    return nullptr;
+  }
+  bool mmio_load(reg_t addr, size_t len, uint8_t *bytes) override {
+    memset(bytes, 0, len);
+    mmio_ = true;
+    return true;
+  }
+  bool mmio_store(reg_t addr, size_t len, const uint8_t *bytes) override {
+    mmio_ = true;
+    return true;
+  }
+  void proc_reset(unsigned id) override {}
+  const char *get_symbol(uint64_t addr) override { return nullptr; }
+
+  void read_chunk(addr_t taddr, size_t len, void *dst) override {
+    memcpy(dst, Host(taddr, len), len);
+  }
+  void write_chunk(addr_t taddr, size_t len, const void *src) override {
+    memcpy(Host(taddr, len), src, len);
+  }
+  void clear_chunk(addr_t taddr, size_t len) override {
+    memset(Host(taddr, len), 0, len);
+  }
+  size_t chunk_align() override { return 8; }
+  size_t chunk_max_size() override { return 8; }
+
+  // Whether an access went to the control registers since the last call
+  bool TakeMmio() {
+    bool mmio = mmio_;
+    mmio_ = false;
+    return mmio;
+  }
+
+private:
+  bus_t bus_;
+  mem_t tcdm_;
+  mem_t l2_;
+  bool mmio_;
+
+  char *Host(addr_t taddr, size_t len) {
+    char *host = addr_to_mem(taddr);
+    if (!host || addr_to_mem(taddr + len - 1) != host + len - 1) {
+      std::ostringstream oss;
+      oss << "ELF segment at 0x" << std::hex << taddr
+          << " is outside the TCDM and the L2 memory";
+      throw std::runtime_error(oss.str());
+    }
+    return host;
+  }
+};
+
+// One core's golden model. Records the memory accesses of the instruction
+// it executes to classify the register the instruction loads.
+class SpikeCosimHart : public memtracer_t {
+public:
+  // How a write of the core to a register is checked
+  enum Kind {
+    kCompare, // must match the hart's register
+    kLoad,    // from memory: another core may have stored to it meanwhile
+    kAtomic,  // from an AMO or LR/SC, whose order the harts do not model
+    kAdopt    // from a counter CSR or the control registers: taken as is
+  };
+
+  SpikeCosimHart(const char *isa, SpikeCosimMemory *mem, uint32_t hart_id)
+      : proc(isa, "M", DEFAULT_VARCH, mem, hart_id, false), hart_id(hart_id),
+        started(false), pc(0), insn(0), loaded_(false), stored_(false),
+        load_addr_(0), store_addr_(0), store_size_(0) {
+    for (int i = 0; i < NXPR; i++)
+      kinds[i] = kCompare;
+    proc.get_mmu()->register_memtracer(this);
+  }
+
+  bool interested_in_range(uint64_t begin, uint64_t end,
+                           access_type type) override {
+    return type != FETCH;
+  }
+  void trace(uint64_t addr, size_t bytes, access_type type) override {
+    if (type == LOAD) {
+      loaded_ = true;
+      load_addr_ = addr;
+    } else if (type == STORE) {
+      stored_ = true;
+      store_addr_ = addr;
+      store_size_ = bytes;
+      for (uint64_t a = addr & ~3ull; a < addr + bytes; a += 4)
+        cosim->SetLastWriter(a, hart_id);
+    }
+  }
+
+  // Executes the instruction at the hart's pc
+  void Step(uint32_t issued_pc, uint32_t issued_insn) {
+    pc = issued_pc;
+    insn = issued_insn;
+    loaded_ = stored_ = false;
+    proc.step(1);
+
+    // Stores, branches and the like have no rd; only classify the writes of
+    // the instructions that read memory or CSRs
+    uint32_t rd = (insn >> 7) & 0x1f;
+    uint32_t opcode = insn & 0x7f;
+    if (rd == 0)
+      return;
+    if (opcode == 0x73 && ((insn >> 12) & 7)) {
+      kinds[rd] = kAdopt;
+    } else if (opcode == 0x2f) {
+      kinds[rd] = kAtomic;
+    } else if (loaded_) {
+      kinds[rd] = kLoad;
+      load_addrs[rd] = load_addr_;
+    }
+  }
+
+  bool Stored(uint64_t *addr, size_t *size) const {
+    *addr = store_addr_;
+    *size = store_size_;
+    return stored_;
+  }
+
+  processor_t proc;
+  uint32_t hart_id;
+  bool started;
+  uint32_t pc;
+  uint32_t insn;
+  Kind kinds[NXPR];
+  uint64_t load_addrs[NXPR];
+
+private:
+  bool loaded_;
+  bool stored_;
+  uint64_t load_addr_;
+  uint64_t store_addr_;
+  size_t store_size_;
+};
+
+SpikeCosim::SpikeCosim()
+    : isa_("RV32IMA"), failed_(false), checked_(0), adopted_(0) {
+  cosim = this;
+}
+
+SpikeCosim::~SpikeCosim() { cosim = nullptr; }
+
+bool SpikeCosim::ParseCLIArguments(int argc, char **argv, bool &exit_app) {
+  const struct option long_options[] = {
+      {"cosim", required_argument, nullptr, 'c'},
+      {"cosim-isa", required_argument, nullptr, 'i'},
+      {nullptr, no_argument, nullptr, 0}};
+
+  // Reset the command parsing index in-case other utils have already parsed
+  // some arguments
+  optind = 1;
+  while (1) {
+    int c = getopt_long(argc, argv, "", long_options, nullptr);
+    if (c == -1) {
+      break;
+    }
+
+    // Disable error reporting by getopt
+    opterr = 0;
+
+    switch (c) {
+    case 'c':
+      elf_ = optarg;
+      break;
+    case 'i':
+      isa_ = optarg;
+      break;
+    default:;
+      // Ignore unrecognized options since they might be consumed by other
+      // extensions or Verilator
+    }
+  }
+  return true;
+}
+
+void SpikeCosim::PreExec() {
+  if (elf_.empty()) {
+    std::cout << "[Cosim] No --cosim=<elf> given, co-simulation is off"
+              << std::endl;
+    return;
+  }
+
+  reg_t entry;
+  try {
+    mem_.reset(new SpikeCosimMemory);
+    memif_t memif(mem_.get());
+    load_elf(elf_.c_str(), &memif, &entry);
+  } catch (std::exception &e) {
+    std::cerr << "[Cosim] Failed to set up " << elf_ << ": " << e.what()
+              << std::endl;
+    mem_.reset();
+    VerilatorSimCtrl::GetInstance().RequestStop(false);
+    return;
+  }
+  std::cout << "[Cosim] Checking the cores against Spike (" << isa_
+            << ") running " << elf_ << std::endl;
+}
+
+void SpikeCosim::PostExec() {
+  if (!mem_)
+    return;
+  std::cout << "[Cosim] " << harts_.size() << " harts, " << checked_
+            << " register writes checked, " << adopted_
+            << " racy or unchecked values taken from the RTL" << std::endl;
+  if (!failed_)
+    std::cout << "[Cosim] No divergence" << std::endl;
+}
+
+SpikeCosimHart &SpikeCosim::GetHart(uint32_t hart_id) {
+  auto it = harts_.find(hart_id);
+  if (it == harts_.end())
+    it = harts_
+             .emplace(hart_id, std::unique_ptr<SpikeCosimHart>(
+                                   new SpikeCosimHart(isa_.c_str(), mem_.get(),
+                                                      hart_id)))
+             .first;
+  return *it->second;
+}
+
+int SpikeCosim::LastWriter(uint64_t addr) const {
+  auto it = last_writer_.find(addr & ~3ull);
+  return it == last_writer_.end() ? -1 : it->second;
+}
+
+void SpikeCosim::SetLastWriter(uint64_t addr, int hart) {
+  last_writer_[addr & ~3ull] = hart;
+}
+
+void SpikeCosim::Fail(SpikeCosimHart &hart, const std::string &what) {
+  disassembler_t disasm(32);
+  std::cerr << "[Cosim] Hart 0x" << std::hex << hart.hart_id
+            << " diverged from Spike at pc 0x" << hart.pc << " (0x" << hart.insn
+            << " " << disasm.disassemble(insn_t(hart.insn)) << "): " << what
+            << std::dec << std::endl;
+  failed_ = true;
+  VerilatorSimCtrl::GetInstance().RequestStop(false);
+}
+
+void SpikeCosim::Issue(uint32_t hart_id, uint32_t pc, uint32_t insn) {
+  if (!mem_ || failed_)
+    return;
+
+  SpikeCosimHart &hart = GetHart(hart_id);
+  state_t *state = hart.proc.get_state();
+  // Spike starts where the core does
+  if (!hart.started) {
+    state->pc = sext32(pc);
+    hart.started = true;
+  }
+  if ((uint32_t)state->pc != pc) {
+    std::ostringstream oss;
+    oss << "the core issued 0x" << std::hex << insn << " at pc 0x" << pc
+        << ", Spike is at pc 0x" << (uint32_t)state->pc;
+    hart.pc = (uint32_t)state->pc;
+    hart.insn = insn;
+    Fail(hart, oss.str());
+    return;
+  }
+
+  mem_->TakeMmio();
+  hart.Step(pc, insn);
+  if (mem_->TakeMmio()) {
+    uint32_t rd = (insn >> 7) & 0x1f;
+    if (rd)
+      hart.kinds[rd] = SpikeCosimHart::kAdopt;
+  }
+}
+
+void SpikeCosim::Writeback(uint32_t hart_id, uint32_t rd, uint32_t value) {
+  if (!mem_ || failed_ || rd == 0 || rd >= NXPR)
+    return;
+
+  SpikeCosimHart &hart = GetHart(hart_id);
+  state_t *state = hart.proc.get_state();
+  SpikeCosimHart::Kind kind = hart.kinds[rd];
+  hart.kinds[rd] = SpikeCosimHart::kCompare;
+  checked_++;
+
+  uint32_t expected = (uint32_t)state->XPR[rd];
+  if (expected == value)
+    return;
+
+  int writer = kind == SpikeCosimHart::kLoad
+                   ? LastWriter(hart.load_addrs[rd])
+                   : -1;
+  if (kind == SpikeCosimHart::kAdopt || kind == SpikeCosimHart::kAtomic ||
+      (writer >= 0 && (uint32_t)writer != hart_id)) {
+    state->XPR.write(rd, sext32(value));
+    adopted_++;
+    return;
+  }
+
+  std::ostringstream oss;
+  oss << "the core wrote 0x" << std::hex << value << " to x" << std::dec << rd
+      << ", Spike has 0x" << std::hex << expected;
+  Fail(hart, oss.str());
+}
+
+void SpikeCosim::Store(uint32_t hart_id, uint32_t addr, uint32_t data,
+                       uint32_t size) {
+  if (!mem_ || failed_)
+    return;
+
+  SpikeCosimHart &hart = GetHart(hart_id);
+  uint64_t spike_addr;
+  size_t spike_size;
+  std::ostringstream oss;
+  oss << std::hex;
+  if (!hart.Stored(&spike_addr, &spike_size)) {
+    oss << "the core stored to 0x" << addr << ", Spike did not store";
+    Fail(hart, oss.str());
+    return;
+  }
+  if ((uint32_t)spike_addr != addr || spike_size != size) {
+    oss << "the core stored " << size << " bytes to 0x" << addr
+        << ", Spike stored " << spike_size << " bytes to 0x"
+        << (uint32_t)spike_addr;
+    Fail(hart, oss.str());
+    return;
+  }
+
+  const char *host = mem_->addr_to_mem(spike_addr);
+  if (!host)
+    return;
+  uint32_t stored = 0;
+  memcpy(&stored, host, size);
+  uint32_t mask = size >= 4 ? 0xffffffff : (1u << (8 * size)) - 1;
+  if (stored != (data & mask)) {
+    oss << "the core stored 0x" << (data & mask) << " to 0x" << addr
+        << ", Spike stored 0x" << stored;
+    Fail(hart, oss.str());
+  }
+}
+
+void spike_cosim_issue(const uint32_t *hart_id, const uint32_t *pc,
+                       const uint32_t *insn) {
+  std::lock_guard<std::mutex> lock(cosim_mutex);
+  if (cosim)
+    cosim->Issue(*hart_id, *pc, *insn);
+}
+
+void spike_cosim_writeback(const uint32_t *hart_id, const uint32_t *rd,
+                           const uint32_t *value) {
+  std::lock_guard<std::mutex> lock(cosim_mutex);
+  if (cosim)
+    cosim->Writeback(*hart_id, *rd, *value);
+}
+
+void spike_cosim_store(const uint32_t *hart_id, const uint32_t *addr,
+                       const uint32_t *data, const uint32_t *size) {
+  std::lock_guard<std::mutex> lock(cosim_mutex);
+  if (cosim)
+    cosim->Store(*hart_id, *addr, *data, *size);
+}
+
+#endif // SPIKE_COSIM
@@ -0,0 +1,72 @@
+// Copyright 2021 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Lockstep co-simulation of the Snitch cores against Spike
+//
+// Every core of the RTL model gets a Spike hart running the same ELF. When a
+// core issues an instruction, its hart executes it; when the core writes a
+// register or issues a store, the value is compared with the hart's. The
+// simulation stops at the first divergence.
+//
+// Values the harts cannot predict are taken from the core instead: loads
+// from words another hart stored to last, AMOs, LR/SCs, CSRs and the control
+// registers. Enabled with the SPIKE_COSIM define (`make verilate cosim=1`).
+
+#ifndef SPIKE_COSIM_H_
+#define SPIKE_COSIM_H_
+
+#ifdef SPIKE_COSIM
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sim_ctrl_extension.h"
+
+class SpikeCosimMemory;
+class SpikeCosimHart;
+
+class SpikeCosim : public SimCtrlExtension {
+public:
+  SpikeCosim();
+  ~SpikeCosim();
+
+  /**
+   * --cosim=<elf> enables the co-simulation of <elf>, which must be the
+   * program the RTL model runs; --cosim-isa=<isa> sets Spike's ISA string
+   */
+  bool ParseCLIArguments(int argc, char **argv, bool &exit_app) override;
+  void PreExec() override;
+  void PostExec() override;
+
+  // The core issued the instruction insn at pc
+  void Issue(uint32_t hart_id, uint32_t pc, uint32_t insn);
+  // The core wrote value to register rd
+  void Writeback(uint32_t hart_id, uint32_t rd, uint32_t value);
+  // The core issued a store of the size lower bytes of data to addr
+  void Store(uint32_t hart_id, uint32_t addr, uint32_t data, uint32_t size);
+
+  // The hart that last stored to the word at addr, or -1
+  int LastWriter(uint64_t addr) const;
+  void SetLastWriter(uint64_t addr, int hart);
+
+private:
+  std::string elf_;
+  std::string isa_;
+  std::unique_ptr<SpikeCosimMemory> mem_;
+  std::unordered_map<uint32_t, std::unique_ptr<SpikeCosimHart>> harts_;
+  std::unordered_map<uint64_t, int> last_writer_;
+  bool failed_;
+  uint64_t checked_;
+  uint64_t adopted_;
+
+  SpikeCosimHart &GetHart(uint32_t hart_id);
+  void Fail(SpikeCosimHart &hart, const std::string &what);
+};
+
+#endif // SPIKE_COSIM
+
+#endif // SPIKE_COSIM_H_
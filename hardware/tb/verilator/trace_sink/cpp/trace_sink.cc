@@ -0,0 +1,157 @@
+// Copyright 2021 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifdef BINARY_TRACE
+
+#include "trace_sink.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "verilator_sim_ctrl.h"
+
+// Records per buffer and full buffers in flight. When the disk cannot keep
+// up, the simulation waits for the writer thread rather than growing.
+#define TRACE_BUFFER_RECORDS 8192
+#define TRACE_MAX_QUEUED 64
+
+// Function declarations
+extern "C" {
+void mempool_trace_insn(const uint32_t *hart_id, const uint32_t *record);
+}
+
+static TraceSink *sink = nullptr;
+// Multi-threaded models call the DPI functions from several threads
+static std::mutex sink_mutex;
+
+TraceSink::TraceSink() : records_(0), stop_(false) {
+  sink = this;
+  writer_ = std::thread(&TraceSink::Write, this);
+}
+
+TraceSink::~TraceSink() {
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  sink = nullptr;
+  Close();
+}
+
+void TraceSink::PostExec() {
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  Close();
+}
+
+TraceSink::Hart &TraceSink::GetHart(uint32_t hart_id) {
+  auto it = harts_.find(hart_id);
+  if (it != harts_.end())
+    return *it->second;
+
+  std::unique_ptr<Hart> hart(new Hart);
+  hart->hart_id = hart_id;
+  hart->buffer.reserve(TRACE_BUFFER_RECORDS * sizeof(TraceRecord));
+  // Same name as the text trace, see mempool_cc
+  char fn[32];
+  snprintf(fn, sizeof(fn), "trace_hart_0x%08x.btrace", hart_id);
+  hart->file = fopen(fn, "wb");
+  if (hart->file) {
+    const uint32_t header[2] = {TRACE_VERSION, sizeof(TraceRecord)};
+    fwrite("MPBTRACE", 1, 8, hart->file);
+    fwrite(header, sizeof(header), 1, hart->file);
+    std::cout << "[Tracer] Logging Hart " << hart_id << " to " << fn
+              << std::endl;
+  } else {
+    std::cerr << "[Tracer] Failed to open " << fn << ": " << strerror(errno)
+              << std::endl;
+    VerilatorSimCtrl::GetInstance().RequestStop(false);
+  }
+  return *(harts_[hart_id] = std::move(hart));
+}
+
+void TraceSink::Append(uint32_t hart_id, const void *record) {
+  if (stop_)
+    return;
+  Hart &hart = GetHart(hart_id);
+  const uint8_t *bytes = static_cast<const uint8_t *>(record);
+  hart.buffer.insert(hart.buffer.end(), bytes, bytes + sizeof(TraceRecord));
+  records_++;
+  if (hart.buffer.size() >= TRACE_BUFFER_RECORDS * sizeof(TraceRecord))
+    Submit(hart);
+}
+
+void TraceSink::Submit(Hart &hart) {
+  Buffer next;
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    drained_cv_.wait(lock,
+                     [this] { return queue_.size() < TRACE_MAX_QUEUED; });
+    queue_.emplace_back(&hart, std::move(hart.buffer));
+    if (!free_.empty()) {
+      next = std::move(free_.back());
+      free_.pop_back();
+    }
+  }
+  queue_cv_.notify_one();
+  next.clear();
+  next.reserve(TRACE_BUFFER_RECORDS * sizeof(TraceRecord));
+  hart.buffer = std::move(next);
+}
+
+void TraceSink::Write() {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  while (true) {
+    queue_cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+    if (queue_.empty())
+      break;
+    std::pair<Hart *, Buffer> item = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    drained_cv_.notify_one();
+
+    FILE *file = item.first->file;
+    size_t size = item.second.size();
+    if (file && fwrite(item.second.data(), 1, size, file) != size) {
+      std::cerr << "[Tracer] Failed to write the trace of Hart "
+                << item.first->hart_id << ": " << strerror(errno)
+                << std::endl;
+      fclose(file);
+      item.first->file = nullptr;
+    }
+
+    lock.lock();
+    if (free_.size() < TRACE_MAX_QUEUED)
+      free_.push_back(std::move(item.second));
+  }
+}
+
+void TraceSink::Close() {
+  if (!writer_.joinable())
+    return;
+  for (auto &it : harts_)
+    if (!it.second->buffer.empty())
+      Submit(*it.second);
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stop_ = true;
+  }
+  queue_cv_.notify_one();
+  writer_.join();
+  for (auto &it : harts_)
+    if (it.second->file)
+      fclose(it.second->file);
+  if (!harts_.empty())
+    std::cout << "[Tracer] Traced " << records_ << " instructions of "
+              << harts_.size()
+              << " harts, convert them with scripts/btrace2dasm.py"
+              << std::endl;
+}
+
+void mempool_trace_insn(const uint32_t *hart_id, const uint32_t *record) {
+  // The record is a packed vector of 32-bit words, least significant first,
+  // which on a little-endian host is laid out as a TraceRecord
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  if (sink)
+    sink->Append(*hart_id, record);
+}
+
+#endif // BINARY_TRACE
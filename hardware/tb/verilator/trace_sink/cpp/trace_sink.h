@@ -0,0 +1,117 @@
+// Copyright 2021 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Binary sink of the instruction tracer of the Snitch cores
+//
+// Instead of formatting a text line per traced instruction, the tracer of
+// mempool_cc passes the raw fields to mempool_trace_insn as a fixed-size
+// record. The records are appended to a buffer per hart, and full buffers
+// are written to trace_hart_0x<hart>.btrace by a writer thread while the
+// simulation goes on. scripts/btrace2dasm.py converts these files to the
+// .dasm traces the tracer writes otherwise. Enabled with the BINARY_TRACE
+// define (`make verilate binary_trace=1`).
+//
+// A file starts with a header of 16 bytes: the magic "MPBTRACE", the format
+// version and the size of a record, both as 32-bit words. The records follow
+// back to back. All values are little-endian.
+
+#ifndef TRACE_SINK_H_
+#define TRACE_SINK_H_
+
+#ifdef BINARY_TRACE
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "sim_ctrl_extension.h"
+
+#define TRACE_VERSION 1
+
+// A traced instruction, as packed by mempool_cc
+struct TraceRecord {
+  uint64_t time;
+  uint64_t cycle;
+  uint32_t pc;
+  uint32_t insn;
+  uint32_t stall_tot;
+  uint32_t stall_ins;
+  uint32_t stall_raw;
+  uint32_t stall_lsu;
+  uint32_t stall_acc;
+  uint32_t pc_d;
+  uint32_t opa;
+  uint32_t opb;
+  uint32_t writeback;
+  uint32_t gpr_rdata_1;
+  uint32_t gpr_rdata_2;
+  uint32_t ld_result_32;
+  uint32_t alu_result;
+  uint32_t acc_pdata_32;
+  uint16_t csr_addr;
+  uint8_t source;
+  uint8_t rs1;
+  uint8_t rs2;
+  uint8_t rd;
+  uint8_t opa_select;
+  uint8_t opb_select;
+  uint8_t opc_select;
+  uint8_t ls_size;
+  uint8_t lsu_rd;
+  uint8_t ls_amo;
+  uint8_t acc_pid;
+  // stall, is_load, is_store, is_branch, write_rd, retire_load and
+  // retire_acc, from bit 0 up
+  uint8_t flags;
+  uint16_t reserved;
+} __attribute__((packed));
+
+static_assert(sizeof(TraceRecord) == 96, "TraceRecord must match mempool_cc");
+
+class TraceSink : public SimCtrlExtension {
+public:
+  TraceSink();
+  ~TraceSink();
+
+  void PostExec() override;
+
+  // The tracer of the core hart_id traced an instruction
+  void Append(uint32_t hart_id, const void *record);
+
+private:
+  typedef std::vector<uint8_t> Buffer;
+
+  struct Hart {
+    uint32_t hart_id;
+    FILE *file;
+    Buffer buffer;
+  };
+
+  std::unordered_map<uint32_t, std::unique_ptr<Hart>> harts_;
+  uint64_t records_;
+
+  // Full buffers, written out by the writer thread in order
+  std::deque<std::pair<Hart *, Buffer>> queue_;
+  std::vector<Buffer> free_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::condition_variable drained_cv_;
+  std::thread writer_;
+  bool stop_;
+
+  Hart &GetHart(uint32_t hart_id);
+  void Submit(Hart &hart);
+  void Write();
+  void Close();
+};
+
+#endif // BINARY_TRACE
+
+#endif // TRACE_SINK_H_
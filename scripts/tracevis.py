@@ -9,6 +9,10 @@
 # [Trace-Viewer](https://github.com/catapult-project/catapult/tree/master/tracing)
 # In Chrome, open `about:tracing` and load the JSON file to view it.
 #
+# The traces are streamed line by line and the events written as they are
+# parsed, so memory use does not grow with the length of the traces. Every
+# PC is resolved only once, with batched `addr2line` calls.
+#
 # This script is inspired by https://github.com/SalvatoreDiGirolamo/tracevis
 # Author: Noah Huetter <huettern@student.ethz.ch>
 #         Samuel Riedel <sriedel@iis.ee.ethz.ch>
@@ -16,8 +20,10 @@
 import re
 import os
 import sys
-from functools import lru_cache
+from json.encoder import encode_basestring_ascii as json_str
 import argparse
+import subprocess
+from itertools import islice
 
 has_progressbar = True
 try:
@@ -57,58 +63,183 @@ BANSHEE_REGEX = r' *(\d+) (\d+) (\d+) ([0-9a-f]+) *.+ +.+# ([\w\.]*)( +)(.*)'
 # 3 -> comment
 ACC_LINE_REGEX = r' *(\d+) +(\d+) +([3M1S0U]?) *#; (.*)'
 
-buf = []
-
-
-@lru_cache(maxsize=1024)
-def addr2line_cache(addr):
-    cmd = f'{addr2line} -e {elf} -f -a -i {addr:x}'
-    return os.popen(cmd).read().split('\n')
-
-
-def flush(buf, hartid):
-    global output_file
-    # get function names
-    pcs = [x[3] for x in buf]
-    a2ls = []
-
-    if cache:
-        for addr in pcs:
-            a2ls += addr2line_cache(int(addr, base=16))[:-1]
-    else:
-        a2ls = os.popen(
-            f'{addr2line} -e {elf} -f -a -i {" ".join(pcs)}'
-        ).read().split('\n')[:-1]
-
-    for i in range(len(buf)-1):
-        (time, cyc, priv, pc, instr, args, cmt) = buf.pop(0)
-
-        if use_time:
-            next_time = int(buf[0][0])
-            time = int(time)
-        else:
-            next_time = int(buf[0][1])
-            time = int(cyc)
-
-        # Have lookahead time to this instruction?
-        next_time = lah[time] if time in lah else next_time
-
-        # print(f'time "{time}", cyc "{cyc}", priv "{priv}", pc "{pc}"'
-        #       f', instr "{instr}", args "{args}"', file=sys.stderr)
-
-        [pc, func, file] = a2ls.pop(0), a2ls.pop(0), a2ls.pop(0)
-
-        # check for more output of a2l
-        inlined = ''
-        while not a2ls[0].startswith('0x'):
-            inlined += '(inlined by) ' + a2ls.pop(0)
-        # print(f'pc "{pc}", func "{func}", file "{file}"')
+# regex matches the destination of a load in the comment of a trace line
+LOAD_REGEX = r'([a-z]*[0-9]*|zero) *<~~ Word'
+
+# Addresses per `addr2line` call
+ADDR2LINE_BATCH = 1024
+
+# Loads the offload lookahead waits for at most. The LSU has far fewer in
+# flight; older ones have lost their writeback, e.g., at a trace window.
+MAX_OPEN_SEARCHES = 64
+
+
+def parse_cores(spec):
+    # '0-3,8' -> {0, 1, 2, 3, 8}
+    cores = set()
+    for part in spec.split(','):
+        first, _, last = part.partition('-')
+        cores.update(range(int(first, 0), int(last or first, 0) + 1))
+    return cores
+
+
+def trace_hartid(filename, prev_hartid):
+    hartid_hex = re.search(r'(0x[0-9a-fA-F]+)', os.path.basename(filename))
+    hartid_dec = re.search(r'([\d]+)', os.path.basename(filename))
+    if hartid_hex:
+        return int(hartid_hex.group(1), 16)
+    elif hartid_dec:
+        return int(hartid_dec.group(1))
+    return prev_hartid + 1
+
+
+class Trace:
+    """The instructions of one trace file, within the line and time window.
+
+    Yields (time, cyc, priv, pc, instr, args, cmt) with the stripped fields
+    of a trace line, and accelerator-only lines as None when the offload
+    lookahead needs them.
+    """
+
+    def __init__(self, filename, args, re_line, re_acc_line):
+        self.filename = filename
+        self.args = args
+        self.re_line = re_line
+        self.re_acc_line = re_acc_line
+        # Updated by the iteration: the time of the last acc-only line
+        self.acc_time = None
+        self.acc_cmt = ''
+
+    def lines(self):
+        end = self.args.end if self.args.end >= 0 else None
+        with open(self.filename, 'rb') as f:
+            lines = islice(f, self.args.start, end)
+            if has_progressbar:
+                lines = progressbar.progressbar(
+                    lines, max_value=progressbar.UnknownLength)
+            for line in lines:
+                yield line.decode(errors='replace')
+
+    def __iter__(self):
+        args = self.args
+        for line in self.lines():
+            match = self.re_line.match(line)
+            if match:
+                fields = tuple(g.strip() for g in match.groups())
+                yield fields
+                # RTL traces are ordered in time: stop after the first
+                # instruction past the window, which ends the previous one
+                time = int(fields[0] if args.time else fields[1])
+                if (args.to_ts is not None and time > args.to_ts
+                        and not args.banshee):
+                    return
+            elif args.overlap_instructions:
+                match = self.re_acc_line.match(line)
+                if match:
+                    (time, cyc, priv, cmt) = tuple(
+                        g.strip() for g in match.groups())
+                    self.acc_time = int(time if args.time else cyc)
+                    self.acc_cmt = cmt
+                    yield None
+
+
+class Symbols:
+    """The functions and source coordinates of PCs, from `addr2line`.
+
+    Holds [pc, func, file, inlined] per PC, and their JSON strings.
+    """
+
+    def __init__(self, addr2line, elf):
+        self.addr2line = addr2line
+        self.elf = elf
+        self.table = {}
+        self.json = {}
+
+    def resolve(self, pcs):
+        pcs = sorted(pc for pc in pcs if pc not in self.table)
+        for i in range(0, len(pcs), ADDR2LINE_BATCH):
+            batch = pcs[i:i+ADDR2LINE_BATCH]
+            out = subprocess.run(
+                [self.addr2line, '-e', self.elf, '-f', '-a', '-i'] +
+                [f'{pc:x}' for pc in batch],
+                stdout=subprocess.PIPE, universal_newlines=True,
+                check=True).stdout.split('\n')[:-1]
+            # Per address: the address, then function and file of the
+            # instruction, then function and file of each inlining call site
+            entry = None
+            for line in out:
+                if line.startswith('0x'):
+                    entry = [line]
+                    self.table[int(line, 16)] = entry
+                elif len(entry) < 3:
+                    entry.append(line)
+                elif len(entry) == 3:
+                    entry.append('(inlined by) ' + line)
+                else:
+                    entry[3] += '(inlined by) ' + line
+            for pc in batch:
+                entry = self.table.setdefault(pc, [f'0x{pc:08x}', '??', '??'])
+                if len(entry) == 3:
+                    entry.append('')
+                self.json[pc] = [json_str(x) for x in entry]
+
+
+class EventWriter:
+    """Writes the Trace-Viewer events of instructions.
+
+    Events of PCs not resolved yet wait in a buffer until a batch of PCs is
+    looked up together.
+    """
+
+    def __init__(self, output_file, symbols, args):
+        self.output_file = output_file
+        self.symbols = symbols
+        self.args = args
+        self.pids = {}
+        self.unresolved = []
+        self.missing = set()
+
+    def selected(self, hartid, time):
+        args = self.args
+        return ((args.cores is None or hartid in args.cores) and
+                (args.from_ts is None or time >= args.from_ts) and
+                (args.to_ts is None or time <= args.to_ts))
+
+    def event(self, hartid, ins, time, next_time):
+        if self.args.banshee:
+            # Banshee stores all traces in a single file
+            hartid = int(ins[2])
+        if not self.selected(hartid, time):
+            return
+        pc = int(ins[3], 16)
+        if pc in self.symbols.table:
+            self.write(hartid, ins, pc, time, next_time)
+            return
+        self.unresolved.append((hartid, ins, pc, time, next_time))
+        self.missing.add(pc)
+        if (len(self.missing) >= ADDR2LINE_BATCH or
+                len(self.unresolved) >= 4 * ADDR2LINE_BATCH):
+            self.flush()
+
+    def flush(self):
+        self.symbols.resolve(self.missing)
+        for event in self.unresolved:
+            self.write(*event)
+        self.unresolved = []
+        self.missing = set()
+
+    def write(self, hartid, ins, pc, time, next_time):
+        (_, cyc, priv, _, instr, ins_args, cmt) = ins
+        func = self.symbols.table[pc][1]
+        if self.args.function and not self.args.function.search(func):
+            return
+        [pc, func, file, inlined] = self.symbols.json[pc]
 
         # assemble values for json
         # Doc: https://docs.google.com/document/d/
         # 1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU/preview
         # The name of the event, as displayed in Trace Viewer
-        name = instr
+        name = json_str(instr)
         # The event categories. This is a comma separated list of categories
         # for the event. The categories can be used to hide events in the Trace
         # Viewer UI.
@@ -118,224 +249,209 @@ def flush(buf, hartid):
         ts = time
         # There is an extra parameter dur to specify the tracing clock duration
         # of complete events in microseconds.
-        duration = next_time - time
-
-        if banshee:
-            # Banshee stores all traces in a single file
-            hartid = priv
-            # In Banshee, each instruction takes one cycle
-            duration = 1
-
-        pid = elf+':hartid'+str(hartid)
-        funcname = func
-
-        # args
-        arg_pc = pc
-        arg_instr = instr
-        arg_args = args
-        arg_cycles = cyc
-        arg_coords = file
-        arg_inlined = inlined
-
-        output_file.write((
-            f'{{"name": "{name}", "cat": "{cat}", "ph": "X", '
-            f'"ts": {ts}, "dur": {duration}, "pid": "{pid}", '
-            f'"tid": "{funcname}", "args": {{"pc": "{arg_pc}", '
-            f'"instr": "{arg_instr} {arg_args}", "time": "{arg_cycles}", '
-            f'"Origin": "{arg_coords}", "inline": "{arg_inlined}"'
+        # In Banshee, each instruction takes one cycle
+        duration = 1 if self.args.banshee else next_time - time
+        if hartid not in self.pids:
+            self.pids[hartid] = json_str(self.args.elf + ':hartid' +
+                                         str(hartid))
+        pid = self.pids[hartid]
+
+        self.output_file.write((
+            f'{{"name": {name}, "cat": "{cat}", "ph": "X", '
+            f'"ts": {ts}, "dur": {duration}, "pid": {pid}, '
+            f'"tid": {func}, "args": {{"pc": {pc}, '
+            f'"instr": {json_str(instr + " " + ins_args)}, '
+            f'"time": {json_str(cyc)}, '
+            f'"Origin": {file}, "inline": {inlined}'
             f'}}}},\n'))
 
 
-def parse_line(line, hartid):
-    global last_time, last_cyc
-    # print(line)
-    match = re_line.match(line)
-    if match:
-        (time, cyc, priv, pc, instr, args, cmt) = tuple(
-            [match.group(i+1).strip() for i in range(re_line.groups)])
-        buf.append((time, cyc, priv, pc, instr, args, cmt))
-        last_time, last_cyc = time, cyc
-
-    if len(buf) > 10:
-        flush(buf, hartid)
-    return 0
-
-
-# Argument parsing
-parser = argparse.ArgumentParser('tracevis', allow_abbrev=True)
-parser.add_argument(
-    'elf',
-    metavar='<elf>',
-    help='The binary executed to generate the traces',
-
-
-)
-parser.add_argument(
-    'traces',
-    metavar='<trace>',
-    nargs='+',
-    help='Snitch traces to visualize')
-parser.add_argument(
-    '-o',
-    '--output',
-    metavar='<json>',
-    nargs='?',
-    default='chrome.json',
-    help='Output JSON file')
-parser.add_argument(
-    '--addr2line',
-    metavar='<path>',
-    nargs='?',
-    default='addr2line',
-    help='`addr2line` binary to use for parsing')
-parser.add_argument(
-    '-t',
-    '--time',
-    action='store_true',
-    help='Use the traces time instead of cycles')
-parser.add_argument(
-    '-b',
-    '--banshee',
-    action='store_true',
-    help='Parse Banshee traces')
-parser.add_argument(
-    '--no-cache',
-    action='store_true',
-    help='Disable addr2line caching'
-    ' (slow but might give better traces in some cases)')
-parser.add_argument(
-    '--overlap-instructions',
-    action='store_true',
-    help='Lookahead for instruction duration and report their full duration')
-parser.add_argument(
-    '-s',
-    '--start',
-    metavar='<line>',
-    nargs='?',
-    type=int,
-    default=0,
-    help='First line to parse')
-parser.add_argument(
-    '-e',
-    '--end',
-    metavar='<line>',
-    nargs='?',
-    type=int,
-    default=-1,
-    help='Last line to parse')
-
-args = parser.parse_args()
-
-elf = args.elf
-traces = args.traces
-output = args.output
-use_time = args.time
-banshee = args.banshee
-addr2line = args.addr2line
-cache = not args.no_cache
-lookahead = args.overlap_instructions
-
-print('elf:', elf, file=sys.stderr)
-print('traces:', traces, file=sys.stderr)
-print('output:', output, file=sys.stderr)
-print('addr2line:', addr2line, file=sys.stderr)
-print('cache:', cache, file=sys.stderr)
-
-# Compile regex
-if banshee:
-    re_line = re.compile(BANSHEE_REGEX)
-else:
-    re_line = re.compile(RTL_REGEX)
-
-re_acc_line = re.compile(ACC_LINE_REGEX)
-
-
-def offload_lookahead(lines):
-    # dict mapping time stamp of retired instruction to time stamp of
-    # accelerator complete
-    lah = {}
-    searches = []
-    re_load = re.compile(r'([a-z]*[0-9]*|zero) *<~~ Word')
-
-    for line in lines:
-        match = re_line.match(line)
-        if match:
-            (time, cyc, priv, pc, instr, args, cmt) = tuple(
-                [match.group(i+1).strip() for i in range(re_line.groups)])
-            time = int(time) if use_time else int(cyc)
-
-            # register searchers
-            if '<~~ Word' in cmt:
-                if re_load.search(cmt):
-                    dst_reg = re_load.search(cmt).group(1)
-                    pat = f'(lsu) {dst_reg}  <--'
-                    searches.append({'pat': pat, 'start': time})
-                else:
-                    print(f'unsupported load lah: {cmt}')
-
-        # If this line is an acc-only line, get the data
-        if not match:
-            match = re_acc_line.match(line)
-            if match:
-                (time, cyc, priv, cmt) = tuple(
-                    [match.group(i+1).strip()
-                     for i in range(re_acc_line.groups)])
-
-        time = int(time) if use_time else int(cyc)
-
-        # Check for any open searches
-        removes = []
-        for s in searches:
-            if s['pat'] in cmt:
-                lah[s['start']] = time
-                removes.append(s)
-        [searches.remove(r) for r in removes]
-
-    # for l in lah:
-    #     print(f'{l} -> {lah[l]}')
-    return lah
-
-
-lah = {}
-
-with open(output, 'w') as output_file:
-    # JSON header
-    output_file.write('{"traceEvents": [\n')
+def main():
+    # Argument parsing
+    parser = argparse.ArgumentParser('tracevis', allow_abbrev=True)
+    parser.add_argument(
+        'elf',
+        metavar='<elf>',
+        help='The binary executed to generate the traces',
+    )
+    parser.add_argument(
+        'traces',
+        metavar='<trace>',
+        nargs='+',
+        help='Snitch traces to visualize')
+    parser.add_argument(
+        '-o',
+        '--output',
+        metavar='<json>',
+        nargs='?',
+        default='chrome.json',
+        help='Output JSON file')
+    parser.add_argument(
+        '--addr2line',
+        metavar='<path>',
+        nargs='?',
+        default='addr2line',
+        help='`addr2line` binary to use for parsing')
+    parser.add_argument(
+        '-t',
+        '--time',
+        action='store_true',
+        help='Use the traces time instead of cycles')
+    parser.add_argument(
+        '-b',
+        '--banshee',
+        action='store_true',
+        help='Parse Banshee traces')
+    parser.add_argument(
+        '--no-cache',
+        action='store_true',
+        help='Ignored, every PC is resolved exactly once')
+    parser.add_argument(
+        '--overlap-instructions',
+        action='store_true',
+        help='Lookahead for instruction duration and report their full '
+        'duration')
+    parser.add_argument(
+        '-s',
+        '--start',
+        metavar='<line>',
+        nargs='?',
+        type=int,
+        default=0,
+        help='First line to parse')
+    parser.add_argument(
+        '-e',
+        '--end',
+        metavar='<line>',
+        nargs='?',
+        type=int,
+        default=-1,
+        help='Last line to parse')
+    parser.add_argument(
+        '--from',
+        dest='from_ts',
+        metavar='<cycle>',
+        type=int,
+        help='Only show instructions from this cycle (or time with --time)')
+    parser.add_argument(
+        '--to',
+        dest='to_ts',
+        metavar='<cycle>',
+        type=int,
+        help='Only show instructions up to this cycle (or time with --time)')
+    parser.add_argument(
+        '-c',
+        '--cores',
+        metavar='<list>',
+        type=parse_cores,
+        help='Only show these cores, e.g. 0-3,8')
+    parser.add_argument(
+        '-f',
+        '--function',
+        metavar='<regex>',
+        type=re.compile,
+        help='Only show instructions of functions matching <regex>')
+
+    args = parser.parse_args()
+
+    print('elf:', args.elf, file=sys.stderr)
+    print('traces:', args.traces, file=sys.stderr)
+    print('output:', args.output, file=sys.stderr)
+    print('addr2line:', args.addr2line, file=sys.stderr)
+
+    # Compile regex
+    if args.banshee:
+        re_line = re.compile(BANSHEE_REGEX)
+    else:
+        re_line = re.compile(RTL_REGEX)
+    re_acc_line = re.compile(ACC_LINE_REGEX)
+    re_load = re.compile(LOAD_REGEX)
 
+    # Pick the traces of the selected cores
+    traces = []
     hartid = 0
-    for filename in traces:
-        hartid_hex = re.search(r'(0x[0-9a-fA-F]+)', filename)
-        hartid_dec = re.search(r'([\d]+)', filename)
-        if hartid_hex:
-            hartid = int(hartid_hex.group(1), 16)
-        elif hartid_dec:
-            hartid = int(hartid_dec.group(1))
-        else:
-            hartid = hartid+1
-        fails = lines = 0
-        last_time = last_cyc = 0
-
-        print(
-            f'parsing hartid {hartid} with trace {filename}', file=sys.stderr)
-        tot_lines = len(open(filename).readlines())
-        with open(filename) as f:
-            all_lines = f.readlines()[args.start:args.end]
-            # offload lookahead
-            if lookahead:
-                lah = offload_lookahead(all_lines)
-            if has_progressbar:
-                for lino, line in progressbar.progressbar(
-                        enumerate(all_lines),
-                        max_value=tot_lines):
-                    fails += parse_line(line, hartid)
-                    lines += 1
-            else:
-                for lino, line in enumerate(
-                        all_lines):
-                    fails += parse_line(line, hartid)
+    for filename in args.traces:
+        hartid = trace_hartid(filename, hartid)
+        if args.banshee or args.cores is None or hartid in args.cores:
+            traces.append((hartid, filename))
+
+    with open(args.output, 'w') as output_file:
+        # JSON header
+        output_file.write('{"traceEvents": [\n')
+        writer = EventWriter(
+            output_file, Symbols(args.addr2line, args.elf), args)
+        emit = writer.event
+
+        # Emit each instruction once the next one gives its duration. With
+        # the offload lookahead, loads are held back until their data returns.
+        for hartid, filename in traces:
+            print(f'parsing hartid {hartid} with trace {filename}',
+                  file=sys.stderr)
+            trace = Trace(filename, args, re_line, re_acc_line)
+            prev = prev_time = None
+            lines = 0
+            # Open offload searches: [pattern, start time]
+            searches = []
+            # Instructions waiting for their search: start -> (ins, time)
+            held = {}
+            # End times of the searches that ended before their load left
+            lah = {}
+            for fields in trace:
+                if fields is None:
+                    time, cmt = trace.acc_time, trace.acc_cmt
+                else:
                     lines += 1
-            flush(buf, hartid)
-            print(f' parsed {lines-fails} of {lines} lines', file=sys.stderr)
-
-    # JSON footer
-    output_file.write(r'{}]}''\n')
+                    time = int(fields[0] if args.time else fields[1])
+                    cmt = fields[6]
+                    if prev is not None:
+                        if (prev_time not in held and
+                                any(s[1] == prev_time for s in searches)):
+                            held[prev_time] = (prev, time)
+                        else:
+                            emit(hartid, prev, prev_time,
+                                 lah.pop(prev_time, time))
+                    prev, prev_time = fields, time
+
+                    # Register searchers
+                    if args.overlap_instructions and '<~~ Word' in cmt:
+                        load = re_load.search(cmt)
+                        if load:
+                            dst_reg = load.group(1)
+                            # The LSU pads the register to three characters.
+                            # An unpadded pattern never matched `zero` or
+                            # registers like `s10`, whose loads then ended
+                            # with the next instruction instead.
+                            searches.append(
+                                [f'(lsu) {dst_reg:<3} <--', time])
+                            if len(searches) > MAX_OPEN_SEARCHES:
+                                s = searches.pop(0)
+                                if s[1] in held:
+                                    ins, next_time = held.pop(s[1])
+                                    emit(hartid, ins, s[1], next_time)
+                        else:
+                            print(f'unsupported load lah: {cmt}',
+                                  file=sys.stderr)
+
+                # Check for any open searches
+                for s in [s for s in searches if s[0] in cmt]:
+                    searches.remove(s)
+                    if s[1] in held:
+                        ins, _ = held.pop(s[1])
+                        emit(hartid, ins, s[1], time)
+                    else:
+                        lah[s[1]] = time
+            # Loads that never returned end with the next instruction
+            for start, (ins, next_time) in held.items():
+                emit(hartid, ins, start, next_time)
+            # The last instruction has no known duration and is omitted. It
+            # used to end at the first instruction of the next trace, which
+            # could give it a negative duration.
+            writer.flush()
+            print(f' parsed {lines} instructions', file=sys.stderr)
+
+        # JSON footer
+        output_file.write(r'{}]}''\n')
+
+
+if __name__ == '__main__':
+    main()
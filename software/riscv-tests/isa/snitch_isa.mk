@@ -71,6 +71,7 @@ ifeq ($(xpulpimg),1)
 		pv_shuffle2 \
 		pv_pack \
 		pv_pack_h \
+		lp_setup \
 
 endif
 
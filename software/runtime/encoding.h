@@ -1678,6 +1678,18 @@
 #define MASK_P_MAX  0xfe00707f
 #define MATCH_P_MAXU 0x4007033
 #define MASK_P_MAXU  0xfe00707f
+#define MATCH_LP_STARTI 0x7b
+#define MASK_LP_STARTI  0xfff7f
+#define MATCH_LP_ENDI 0x107b
+#define MASK_LP_ENDI  0xfff7f
+#define MATCH_LP_COUNT 0x207b
+#define MASK_LP_COUNT  0xfff07f7f
+#define MATCH_LP_COUNTI 0x307b
+#define MASK_LP_COUNTI  0xfff7f
+#define MATCH_LP_SETUP 0x407b
+#define MASK_LP_SETUP  0x7f7f
+#define MATCH_LP_SETUPI 0x507b
+#define MASK_LP_SETUPI  0x7f7f
 #define MATCH_P_ADDN 0x205b
 #define MASK_P_ADDN  0xc000707f
 #define MATCH_P_ADDUN 0x8000205b
@@ -3145,6 +3157,12 @@ DECLARE_INSN(p_min, MATCH_P_MIN, MASK_P_MIN)
 DECLARE_INSN(p_minu, MATCH_P_MINU, MASK_P_MINU)
 DECLARE_INSN(p_max, MATCH_P_MAX, MASK_P_MAX)
 DECLARE_INSN(p_maxu, MATCH_P_MAXU, MASK_P_MAXU)
+DECLARE_INSN(lp_starti, MATCH_LP_STARTI, MASK_LP_STARTI)
+DECLARE_INSN(lp_endi, MATCH_LP_ENDI, MASK_LP_ENDI)
+DECLARE_INSN(lp_count, MATCH_LP_COUNT, MASK_LP_COUNT)
+DECLARE_INSN(lp_counti, MATCH_LP_COUNTI, MASK_LP_COUNTI)
+DECLARE_INSN(lp_setup, MATCH_LP_SETUP, MASK_LP_SETUP)
+DECLARE_INSN(lp_setupi, MATCH_LP_SETUPI, MASK_LP_SETUPI)
 DECLARE_INSN(p_addN, MATCH_P_ADDN, MASK_P_ADDN)
 DECLARE_INSN(p_adduN, MATCH_P_ADDUN, MASK_P_ADDUN)
 DECLARE_INSN(p_lb_irpost, MATCH_P_LB_IRPOST, MASK_P_LB_IRPOST)
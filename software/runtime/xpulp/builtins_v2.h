@@ -316,6 +316,28 @@ __ExtInsMaskSafe(unsigned int Size, unsigned int Offset) {
   __builtin_pulp_addRN((x), 0, (scale), (1 << ((scale)-1)))
 #define __ROUNDNORM_REG(x, scale) __builtin_pulp_addRN_r((x), 0, (scale))
 
+/* Hardware loops
+ *
+ * The compiler does not emit hardware loops, so their bodies are written in
+ * inline assembly. __LP_SETUP(L, count, n) expands to the assembly of an
+ * lp.setup that repeats the n instructions following it count times on loop
+ * L, where count names an asm operand holding at least 1. Loop 0 is the
+ * inner loop. __LP_END(L, n) closes the body, and the assembler fails if the
+ * body is not n instructions long. The body is assembled without compressed
+ * instructions and must not end in a branch. */
+#define __LP_SETUP(L, count, n)                                                \
+  ".option push \n\t"                                                          \
+  ".option norvc \n\t"                                                         \
+  ".option norelax \n\t"                                                       \
+  ".insn i 0x7b, 4, x" #L ", %[" #count "], 2 * (" #n ") + 2 \n\t"             \
+  "1" #L "0: \n\t"
+#define __LP_END(L, n)                                                         \
+  "1" #L "1: \n\t"                                                             \
+  ".if 1" #L "1b - 1" #L "0b != 4 * (" #n ") \n\t"                             \
+  ".error \"body of hardware loop " #L " is not " #n " instructions\" \n\t"    \
+  ".endif \n\t"                                                                \
+  ".option pop \n\t"
+
 #define __COREID() __builtin_pulp_CoreId()
 #define __CLUSTERID() __builtin_pulp_ClusterId()
 #define __NCORE() __builtin_pulp_CoreCount()
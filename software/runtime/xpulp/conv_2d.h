@@ -126,8 +126,7 @@ void conv2d_3x3_unrolled_i8_xpulpv2(
     uint8_t const volatile *__restrict__ Kernel) {
   v4u coeff_0, coeff_1, coeff_2;
   v4s Img_0, Img_1, Img_2;
-  v4s new_data;
-  uint32_t r, c, t;
+  uint32_t c;
   int32_t S;
 
   uint32_t weight = 0;
@@ -147,21 +146,36 @@ void conv2d_3x3_unrolled_i8_xpulpv2(
     Img_2 = (v4s){In_Img[c - 1 + R * 2], In_Img[c + R * 2],
                   In_Img[c + 1 + R * 2], 0};
 
-    for (r = 1; r < R - 1; r++) {
-      t = r * R + c;
-      S = __builtin_pulp_dotsp4(Img_0, coeff_0);
-      S = __builtin_pulp_sdotsp4(Img_1, coeff_1, S);
-      S = __builtin_pulp_sdotsp4(Img_2, coeff_2, S);
-
-      Out_Img[t] = S / (int)weight;
-
-      // load a new rod
-      new_data = (v4s){In_Img[(r + 2) * R + c - 1], In_Img[(r + 2) * R + c],
-                       In_Img[(r + 2) * R + c + 1], 0};
-      // move the window: move each vector one line down
-      Img_0 = Img_1;
-      Img_1 = Img_2;
-      Img_2 = new_data;
+    // Walk down the column in a hardware loop: each iteration computes one
+    // output pixel, loads the rod two rows below it and moves the window
+    if (R > 2) {
+      int8_t const volatile *idx_in = &In_Img[3 * R + c - 1];
+      int32_t volatile *idx_out = &Out_Img[R + c];
+      uint32_t const n_iter = R - 2;
+      int32_t t0, t1, t2;
+      __asm__ volatile(
+          __LP_SETUP(0, n_iter, 13)
+          "pv.dotsp.b %[S], %[img0], %[c0] \n\t"
+          "pv.sdotsp.b %[S], %[img1], %[c1] \n\t"
+          "pv.sdotsp.b %[S], %[img2], %[c2] \n\t"
+          "div %[S], %[S], %[w] \n\t"
+          "p.sw %[S], %[out_incr](%[addr_out]!) \n\t"
+          "p.lb %[t0], 1(%[addr_in]!) \n\t"
+          "p.lb %[t1], 1(%[addr_in]!) \n\t"
+          "p.lb %[t2], %[in_incr](%[addr_in]!) \n\t"
+          "mv %[img0], %[img1] \n\t"
+          "mv %[img1], %[img2] \n\t"
+          "mv %[img2], %[t0] \n\t"
+          "pv.insert.b %[img2], %[t1], 1 \n\t"
+          "pv.insert.b %[img2], %[t2], 2 \n\t"
+          __LP_END(0, 13)
+          : [S] "=&r"(S), [img0] "+&r"(Img_0), [img1] "+&r"(Img_1),
+            [img2] "+&r"(Img_2), [t0] "=&r"(t0), [t1] "=&r"(t1),
+            [t2] "=&r"(t2), [addr_in] "+&r"(idx_in), [addr_out] "+&r"(idx_out)
+          : [n_iter] "r"(n_iter), [c0] "r"(coeff_0), [c1] "r"(coeff_1),
+            [c2] "r"(coeff_2), [w] "r"(weight), [out_incr] "r"(R * 4),
+            [in_incr] "r"(R - 2)
+          : "memory");
     }
   }
 }
@@ -185,8 +199,7 @@ void conv2d_3x3_unrolled2_i8_xpulpv2(
   v4u coeff_0, coeff_1, coeff_2;
   v4s Img_00, Img_10, Img_20;
   v4s Img_01, Img_11, Img_21;
-  v4s new_data_0, new_data_1;
-  uint32_t r, c;
+  uint32_t c;
   int32_t S_0, S_1;
 
   uint32_t weight = 0;
@@ -213,36 +226,51 @@ void conv2d_3x3_unrolled2_i8_xpulpv2(
     Img_21 = (v4s){In_Img[2 * c - 1 + R * 2], In_Img[2 * c + R * 2],
                    In_Img[2 * c + 1 + R * 2], 0};
 
-    for (r = 1; r < R - 1; r++) {
-      S_0 = __builtin_pulp_dotsp4(Img_00, coeff_0);
-      S_1 = __builtin_pulp_dotsp4(Img_01, coeff_0);
-
-      S_0 = __builtin_pulp_sdotsp4(Img_10, coeff_1, S_0);
-      S_1 = __builtin_pulp_sdotsp4(Img_11, coeff_1, S_1);
-
-      S_0 = __builtin_pulp_sdotsp4(Img_20, coeff_2, S_0);
-      S_1 = __builtin_pulp_sdotsp4(Img_21, coeff_2, S_1);
-
-      int32_t res_0 = S_0 / (int)weight;
-      int32_t res_1 = S_1 / (int)weight;
-
-      // load a new rod
-      new_data_0 = (v4s){In_Img[(r + 2) * R + (2 * c - 1) - 1],
-                         In_Img[(r + 2) * R + (2 * c - 1)],
-                         In_Img[(r + 2) * R + (2 * c - 1) + 1], 0};
-      new_data_1 =
-          (v4s){In_Img[(r + 2) * R + 2 * c - 1], In_Img[(r + 2) * R + 2 * c],
-                In_Img[(r + 2) * R + 2 * c + 1], 0};
-      // move the window: move each vector one line down
-      Img_00 = Img_10;
-      Img_10 = Img_20;
-      Img_20 = new_data_0;
-      Img_01 = Img_11;
-      Img_11 = Img_21;
-      Img_21 = new_data_1;
-
-      Out_Img[r * R + (2 * c - 1)] = res_0;
-      Out_Img[r * R + 2 * c] = res_1;
+    // Walk down the two columns in a hardware loop: each iteration computes
+    // two output pixels, loads the rods two rows below them and moves the
+    // windows
+    if (R > 2) {
+      int8_t const volatile *idx_in = &In_Img[3 * R + 2 * c - 2];
+      int32_t volatile *idx_out = &Out_Img[R + 2 * c - 1];
+      uint32_t const n_iter = R - 2;
+      int32_t t0, t1, t2, t3;
+      __asm__ volatile(
+          __LP_SETUP(0, n_iter, 24)
+          "pv.dotsp.b %[S0], %[img00], %[c0] \n\t"
+          "pv.dotsp.b %[S1], %[img01], %[c0] \n\t"
+          "pv.sdotsp.b %[S0], %[img10], %[c1] \n\t"
+          "pv.sdotsp.b %[S1], %[img11], %[c1] \n\t"
+          "pv.sdotsp.b %[S0], %[img20], %[c2] \n\t"
+          "pv.sdotsp.b %[S1], %[img21], %[c2] \n\t"
+          "div %[S0], %[S0], %[w] \n\t"
+          "div %[S1], %[S1], %[w] \n\t"
+          "p.sw %[S0], 4(%[addr_out]!) \n\t"
+          "p.sw %[S1], %[out_incr](%[addr_out]!) \n\t"
+          "p.lb %[t0], 1(%[addr_in]!) \n\t"
+          "p.lb %[t1], 1(%[addr_in]!) \n\t"
+          "p.lb %[t2], 1(%[addr_in]!) \n\t"
+          "p.lb %[t3], %[in_incr](%[addr_in]!) \n\t"
+          "mv %[img00], %[img10] \n\t"
+          "mv %[img10], %[img20] \n\t"
+          "mv %[img20], %[t0] \n\t"
+          "pv.insert.b %[img20], %[t1], 1 \n\t"
+          "pv.insert.b %[img20], %[t2], 2 \n\t"
+          "mv %[img01], %[img11] \n\t"
+          "mv %[img11], %[img21] \n\t"
+          "mv %[img21], %[t1] \n\t"
+          "pv.insert.b %[img21], %[t2], 1 \n\t"
+          "pv.insert.b %[img21], %[t3], 2 \n\t"
+          __LP_END(0, 24)
+          : [S0] "=&r"(S_0), [S1] "=&r"(S_1), [img00] "+&r"(Img_00),
+            [img10] "+&r"(Img_10), [img20] "+&r"(Img_20),
+            [img01] "+&r"(Img_01), [img11] "+&r"(Img_11),
+            [img21] "+&r"(Img_21), [t0] "=&r"(t0), [t1] "=&r"(t1),
+            [t2] "=&r"(t2), [t3] "=&r"(t3), [addr_in] "+&r"(idx_in),
+            [addr_out] "+&r"(idx_out)
+          : [n_iter] "r"(n_iter), [c0] "r"(coeff_0), [c1] "r"(coeff_1),
+            [c2] "r"(coeff_2), [w] "r"(weight), [out_incr] "r"(R * 4 - 4),
+            [in_incr] "r"(R - 3)
+          : "memory");
     }
   }
 }
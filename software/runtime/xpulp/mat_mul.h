@@ -118,6 +118,63 @@ void matmul_unrolled_2x2_parallel_i16_rv32im(int16_t const *__restrict__ A,
   }
 }
 
+#ifdef __XPULPIMG
+/*
+ * Inner loop of the 2x4 i8 kernels as a hardware loop. Accumulates two rows
+ * of A starting at idx_a and four columns of B starting at idx_b over the N
+ * elements of a row into sum00-sum13. Each iteration loads a 2x4 chunk of A
+ * and a 4x4 chunk of B, transposes the latter with shuffles and adds the
+ * eight dot products. Afterwards idx_a has moved N elements to the right and
+ * idx_b N rows down.
+ */
+#define MATMUL_2X4_I8_HWLOOP(idx_a, idx_b, N, P, mask0, mask1, mask2, mask3)  \
+  do {                                                                         \
+    uint32_t const n_iter = (N) / 4;                                           \
+    int32_t const N_decr = -(int)(N) + 4;                                      \
+    v4s aVec0, aVec1, t0, t1, t2, t3, t4, t5;                                  \
+    if (n_iter)                                                                \
+      __asm__ volatile(                                                        \
+          __LP_SETUP(0, n_iter, 26)                                            \
+          "p.lw %[a0], %[a_incr](%[addr_a]!) \n\t"                             \
+          "p.lw %[a1], %[a_decr](%[addr_a]!) \n\t"                             \
+          "p.lw %[t0], %[b_incr](%[addr_b]!) \n\t"                             \
+          "p.lw %[t1], %[b_incr](%[addr_b]!) \n\t"                             \
+          "p.lw %[t2], %[b_incr](%[addr_b]!) \n\t"                             \
+          "p.lw %[t3], %[b_incr](%[addr_b]!) \n\t"                             \
+          "mv %[t4], %[t0] \n\t"                                               \
+          "pv.shuffle2.b %[t4], %[t1], %[m0] \n\t"                             \
+          "mv %[t5], %[t2] \n\t"                                               \
+          "pv.shuffle2.b %[t5], %[t3], %[m0] \n\t"                             \
+          "pv.shuffle2.b %[t0], %[t1], %[m1] \n\t"                             \
+          "pv.shuffle2.b %[t2], %[t3], %[m1] \n\t"                             \
+          "mv %[t1], %[t4] \n\t"                                               \
+          "pv.shuffle2.b %[t1], %[t5], %[m2] \n\t"                             \
+          "pv.shuffle2.b %[t4], %[t5], %[m3] \n\t"                             \
+          "mv %[t3], %[t0] \n\t"                                               \
+          "pv.shuffle2.b %[t3], %[t2], %[m2] \n\t"                             \
+          "pv.shuffle2.b %[t0], %[t2], %[m3] \n\t"                             \
+          "pv.sdotsp.b %[s00], %[a0], %[t1] \n\t"                              \
+          "pv.sdotsp.b %[s01], %[a0], %[t4] \n\t"                              \
+          "pv.sdotsp.b %[s02], %[a0], %[t3] \n\t"                              \
+          "pv.sdotsp.b %[s03], %[a0], %[t0] \n\t"                              \
+          "pv.sdotsp.b %[s10], %[a1], %[t1] \n\t"                              \
+          "pv.sdotsp.b %[s11], %[a1], %[t4] \n\t"                              \
+          "pv.sdotsp.b %[s12], %[a1], %[t3] \n\t"                              \
+          "pv.sdotsp.b %[s13], %[a1], %[t0] \n\t"                              \
+          __LP_END(0, 26)                                                      \
+          : [a0] "=&r"(aVec0), [a1] "=&r"(aVec1), [t0] "=&r"(t0),              \
+            [t1] "=&r"(t1), [t2] "=&r"(t2), [t3] "=&r"(t3), [t4] "=&r"(t4),    \
+            [t5] "=&r"(t5), [s00] "+&r"(sum00), [s01] "+&r"(sum01),            \
+            [s02] "+&r"(sum02), [s03] "+&r"(sum03), [s10] "+&r"(sum10),        \
+            [s11] "+&r"(sum11), [s12] "+&r"(sum12), [s13] "+&r"(sum13),        \
+            [addr_a] "+&r"(idx_a), [addr_b] "+&r"(idx_b)                       \
+          : [n_iter] "r"(n_iter), [a_incr] "r"(N), [a_decr] "r"(N_decr),       \
+            [b_incr] "r"(P), [m0] "r"(mask0), [m1] "r"(mask1),                 \
+            [m2] "r"(mask2), [m3] "r"(mask3)                                   \
+          : "memory");                                                         \
+  } while (0)
+#endif
+
 /*
  * Matrix multiplication ----------------------------------
  * kernel     = matmul_unrolled_2x4_i8_xpulpv2
@@ -139,7 +196,6 @@ void matmul_unrolled_2x4_i8_xpulpv2(const int8_t *__restrict__ pSrcA,
   static v4s mask3 = {1, 3, 5, 7};
 
   uint32_t i = 0; // loop counter for M
-  uint32_t j = 0; // loop counter for N
   uint32_t k = 0; // loop counter for P
 
   for (i = 0; i < M / 2; i++) {
@@ -154,35 +210,9 @@ void matmul_unrolled_2x4_i8_xpulpv2(const int8_t *__restrict__ pSrcA,
       int32_t sum12 = 0;
       int32_t sum13 = 0;
 
-      for (j = 0; j < N / 4; j++) {
-
-        v4s aVec0 = *((v4s *)&(pSrcA[(i * 2) * N + (j * 4)]));
-        v4s aVec1 = *((v4s *)&(pSrcA[(i * 2 + 1) * N + (j * 4)]));
-
-        v4s temp0 = *((v4s *)&(pSrcB[(j * 4) * P + (k * 4)]));
-        v4s temp1 = *((v4s *)&(pSrcB[(j * 4 + 1) * P + (k * 4)]));
-        v4s temp2 = *((v4s *)&(pSrcB[(j * 4 + 2) * P + (k * 4)]));
-        v4s temp3 = *((v4s *)&(pSrcB[(j * 4 + 3) * P + (k * 4)]));
-
-        v4s temp4 = __builtin_shuffle(temp0, temp1, mask0); // 0,1,4,5
-        v4s temp5 = __builtin_shuffle(temp2, temp3, mask0); // 8,9,12,13
-        v4s temp6 = __builtin_shuffle(temp0, temp1, mask1); // 2,3,6,7
-        v4s temp7 = __builtin_shuffle(temp2, temp3, mask1); // 3,7,11,15
-
-        v4s bVec0 = __builtin_shuffle(temp4, temp5, mask2); // 0,4,8,12
-        v4s bVec1 = __builtin_shuffle(temp4, temp5, mask3); // 1,5,9,13
-        v4s bVec2 = __builtin_shuffle(temp6, temp7, mask2); // 2,6,10,14
-        v4s bVec3 = __builtin_shuffle(temp6, temp7, mask3); // 3,7,11,15
-
-        sum00 = __SUMDOTP4(aVec0, bVec0, sum00);
-        sum01 = __SUMDOTP4(aVec0, bVec1, sum01);
-        sum02 = __SUMDOTP4(aVec0, bVec2, sum02);
-        sum03 = __SUMDOTP4(aVec0, bVec3, sum03);
-        sum10 = __SUMDOTP4(aVec1, bVec0, sum10);
-        sum11 = __SUMDOTP4(aVec1, bVec1, sum11);
-        sum12 = __SUMDOTP4(aVec1, bVec2, sum12);
-        sum13 = __SUMDOTP4(aVec1, bVec3, sum13);
-      }
+      const int8_t *idx_a = &pSrcA[(i * 2) * N];
+      const int8_t *idx_b = &pSrcB[k * 4];
+      MATMUL_2X4_I8_HWLOOP(idx_a, idx_b, N, P, mask0, mask1, mask2, mask3);
 
       pDstC[(i * 2) * P + (k * 4)] = sum00;
       pDstC[(i * 2) * P + (k * 4 + 1)] = sum01;
@@ -220,7 +250,6 @@ void matmul_unrolled_2x4_parallel_i8_xpulpv2(const int8_t *__restrict__ pSrcA,
   static v4s mask3 = {1, 3, 5, 7};
 
   uint32_t i = 0; // loop counter for M
-  uint32_t j = 0; // loop counter for N
   uint32_t k = 0; // loop counter for P
 
   for (k = core_id; k < P / 4; k += numThreads) {
@@ -235,35 +264,9 @@ void matmul_unrolled_2x4_parallel_i8_xpulpv2(const int8_t *__restrict__ pSrcA,
       int32_t sum12 = 0;
       int32_t sum13 = 0;
 
-      for (j = 0; j < N / 4; j++) {
-
-        v4s aVec0 = *((v4s *)&(pSrcA[(i * 2) * N + (j * 4)]));
-        v4s aVec1 = *((v4s *)&(pSrcA[(i * 2 + 1) * N + (j * 4)]));
-
-        v4s temp0 = *((v4s *)&(pSrcB[(j * 4) * P + (k * 4)]));
-        v4s temp1 = *((v4s *)&(pSrcB[(j * 4 + 1) * P + (k * 4)]));
-        v4s temp2 = *((v4s *)&(pSrcB[(j * 4 + 2) * P + (k * 4)]));
-        v4s temp3 = *((v4s *)&(pSrcB[(j * 4 + 3) * P + (k * 4)]));
-
-        v4s temp4 = __builtin_shuffle(temp0, temp1, mask0); // 0,1,4,5
-        v4s temp5 = __builtin_shuffle(temp2, temp3, mask0); // 8,9,12,13
-        v4s temp6 = __builtin_shuffle(temp0, temp1, mask1); // 2,3,6,7
-        v4s temp7 = __builtin_shuffle(temp2, temp3, mask1); // 3,7,11,15
-
-        v4s bVec0 = __builtin_shuffle(temp4, temp5, mask2); // 0,4,8,12
-        v4s bVec1 = __builtin_shuffle(temp4, temp5, mask3); // 1,5,9,13
-        v4s bVec2 = __builtin_shuffle(temp6, temp7, mask2); // 2,6,10,14
-        v4s bVec3 = __builtin_shuffle(temp6, temp7, mask3); // 3,7,11,15
-
-        sum00 = __SUMDOTP4(aVec0, bVec0, sum00);
-        sum01 = __SUMDOTP4(aVec0, bVec1, sum01);
-        sum02 = __SUMDOTP4(aVec0, bVec2, sum02);
-        sum03 = __SUMDOTP4(aVec0, bVec3, sum03);
-        sum10 = __SUMDOTP4(aVec1, bVec0, sum10);
-        sum11 = __SUMDOTP4(aVec1, bVec1, sum11);
-        sum12 = __SUMDOTP4(aVec1, bVec2, sum12);
-        sum13 = __SUMDOTP4(aVec1, bVec3, sum13);
-      }
+      const int8_t *idx_a = &pSrcA[(i * 2) * N];
+      const int8_t *idx_b = &pSrcB[k * 4];
+      MATMUL_2X4_I8_HWLOOP(idx_a, idx_b, N, P, mask0, mask1, mask2, mask3);
 
       pDstC[(i * 2) * P + (k * 4)] = sum00;
       pDstC[(i * 2) * P + (k * 4 + 1)] = sum01;
@@ -304,8 +307,6 @@ void matmul_unrolled_2x4_pincr_asm_parallel_i8_xpulpv2(
 
   // Loop counter for P
   uint32_t k = 0;
-  // Row decrement for A matrix
-  int32_t const N_decr = -(int)N + 4;
   // Row increment for C matrix
   uint32_t const P_incr = (P * 4) - 12;
 
@@ -324,58 +325,8 @@ void matmul_unrolled_2x4_pincr_asm_parallel_i8_xpulpv2(
       int32_t sum12 = 0;
       int32_t sum13 = 0;
 
-      int8_t const *end_a = idx_a + N;
       const int8_t *idx_b = &pSrcB[k * 4]; // start_b
-      while (idx_a < end_a) {
-
-        v4s aVec0, aVec1;
-        v4s temp0, temp1, temp2, temp3;
-
-        __asm__ volatile(
-            "p.lw %[a0], %[a_incr](%[addr_a]!) \n\t"
-            "p.lw %[a1], %[a_decr](%[addr_a]!) \n\t"
-            "p.lw %[t0], %[b_incr](%[addr_b]!) \n\t"
-            "p.lw %[t1], %[b_incr](%[addr_b]!) \n\t"
-            "p.lw %[t2], %[b_incr](%[addr_b]!) \n\t"
-            "p.lw %[t3], %[b_incr](%[addr_b]!) \n\t"
-            : [a0] "=&r"(aVec0), [a1] "=&r"(aVec1), [t0] "=&r"(temp0),
-              [t1] "=&r"(temp1), [t2] "=&r"(temp2), [t3] "=&r"(temp3),
-              [addr_a] "+&r"(idx_a), [addr_b] "+&r"(idx_b)
-            : [a_incr] "r"(N), [a_decr] "r"(N_decr), [b_incr] "r"(P)
-            : "memory");
-        /* The asm code above implements the following commented C code */
-        // go to next row, same column
-        // v4s aVec0 = *((v4s *)idx_a); idx_a += N;
-        // go to previous row, one column forward
-        // v4s aVec1 = *((v4s *)idx_a); idx_a -= N - 4;
-        // v4s temp0 = *((v4s *)idx_b); idx_b += P;
-        // v4s temp1 = *((v4s *)idx_b); idx_b += P;
-        // v4s temp2 = *((v4s *)idx_b); idx_b += P;
-        // v4s temp3 = *((v4s *)idx_b); idx_b += P;
-
-        // Shuffles to transpose at runtime the chunk extracted from B before
-        // multiplying with A chunk temp0-3 variables needed because shuffles
-        // use rD as source, but also modify it, thus we need a copy of their
-        // content to use it twice in their original form
-        v4s temp4 = __builtin_shuffle(temp0, temp1, mask0); // 0,1,4,5
-        v4s temp5 = __builtin_shuffle(temp2, temp3, mask0); // 8,9,12,13
-        v4s temp6 = __builtin_shuffle(temp0, temp1, mask1); // 2,3,6,7
-        v4s temp7 = __builtin_shuffle(temp2, temp3, mask1); // 3,7,11,15
-
-        v4s bVec0 = __builtin_shuffle(temp4, temp5, mask2); // 0,4,8,12
-        v4s bVec1 = __builtin_shuffle(temp4, temp5, mask3); // 1,5,9,13
-        v4s bVec2 = __builtin_shuffle(temp6, temp7, mask2); // 2,6,10,14
-        v4s bVec3 = __builtin_shuffle(temp6, temp7, mask3); // 3,7,11,15
-
-        sum00 = __SUMDOTP4(aVec0, bVec0, sum00);
-        sum01 = __SUMDOTP4(aVec0, bVec1, sum01);
-        sum02 = __SUMDOTP4(aVec0, bVec2, sum02);
-        sum03 = __SUMDOTP4(aVec0, bVec3, sum03);
-        sum10 = __SUMDOTP4(aVec1, bVec0, sum10);
-        sum11 = __SUMDOTP4(aVec1, bVec1, sum11);
-        sum12 = __SUMDOTP4(aVec1, bVec2, sum12);
-        sum13 = __SUMDOTP4(aVec1, bVec3, sum13);
-      }
+      MATMUL_2X4_I8_HWLOOP(idx_a, idx_b, N, P, mask0, mask1, mask2, mask3);
 
       __asm__ volatile(
           "p.sw %[s00], 4(%[addr_c]!) \n\t"
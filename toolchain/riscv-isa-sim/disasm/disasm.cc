@@ -1,6 +1,7 @@
 // See LICENSE for license details.
 
 #include "disasm.h"
+#include <algorithm>
 #include <cassert>
 #include <string>
 #include <vector>
@@ -415,6 +416,30 @@ struct : public arg_t {
   }
 } store_address_rr;
 
+struct : public arg_t {
+  std::string to_string(insn_t insn) const {
+    return "x" + std::to_string((int)insn.p_loop());
+  }
+} p_loop;
+
+struct : public arg_t {
+  std::string to_string(insn_t insn) const {
+    return std::to_string((uint32_t)insn.p_uimm12());
+  }
+} p_uimm12;
+
+struct : public arg_t {
+  std::string to_string(insn_t insn) const {
+    return "pc + " + std::to_string((uint32_t)insn.p_uimm12() << 1);
+  }
+} p_loop_target;
+
+struct : public arg_t {
+  std::string to_string(insn_t insn) const {
+    return "pc + " + std::to_string((uint32_t)insn.p_uimm5() << 1);
+  }
+} p_loop_target_short;
+
 
 typedef struct {
   reg_t match;
@@ -1381,6 +1406,12 @@ disassembler_t::disassembler_t(int xlen)
   DEFINE_PBTYPE(p_bneimm);
   DEFINE_RTYPE(p_mac);
   DEFINE_RTYPE(p_msu);
+  DISASM_INSN("lp.starti", lp_starti, 0, {&p_loop, &p_loop_target});
+  DISASM_INSN("lp.endi", lp_endi, 0, {&p_loop, &p_loop_target});
+  DISASM_INSN("lp.count", lp_count, 0, {&p_loop, &xrs1});
+  DISASM_INSN("lp.counti", lp_counti, 0, {&p_loop, &p_uimm12});
+  DISASM_INSN("lp.setup", lp_setup, 0, {&p_loop, &xrs1, &p_loop_target});
+  DISASM_INSN("lp.setupi", lp_setupi, 0, {&p_loop, &p_uimm12, &p_loop_target_short});
 
   DEFINE_RTYPE(pv_add_h);
   DEFINE_RTYPE(pv_add_sc_h);
@@ -1524,32 +1555,137 @@ disassembler_t::disassembler_t(int xlen)
   #undef DECLARE_INSN
 }
 
+// The first level decodes the major opcode and funct3 (bits 14:12), the
+// second one funct7 (bits 31:25). Compressed instructions are decoded by
+// their quadrant and funct3 (bits 15:13), then by bits 12:10.
+static const uint32_t DECODE_ROOT_MASK = 0x0000707f;
+static const uint32_t DECODE_SUB_MASK = 0xfe000000;
+static const uint32_t DECODE_RVC_ROOT_MASK = 0x0000e003;
+static const uint32_t DECODE_RVC_SUB_MASK = 0x00001c00;
+static const size_t DECODE_ROOT_SIZE = 256 + 32;
+static const uint32_t DECODE_SUB = 1U << 31;
+// Cells with fewer candidates are not worth a second level
+static const size_t DECODE_SUB_MIN_CANDIDATES = 4;
+
+static inline size_t decode_root(insn_bits_t bits)
+{
+  if ((bits & 3) == 3)
+    return (bits >> 2 & 0x1f) | (bits >> 12 & 7) << 5;
+  return 256 + ((bits & 3) | (bits >> 13 & 7) << 2);
+}
+
+static inline size_t decode_sub(insn_bits_t bits)
+{
+  return (bits & 3) == 3 ? bits >> 25 & 0x7f : bits >> 10 & 7;
+}
+
+// Whether insn matches some instruction with the given bits under mask
+static bool decode_candidate(const disasm_insn_t* insn, uint32_t bits,
+                             uint32_t mask)
+{
+  return ((insn->get_match() ^ bits) & insn->get_mask() & mask) == 0;
+}
+
 const disasm_insn_t* disassembler_t::lookup(insn_t insn) const
 {
-  size_t idx = insn.bits() % HASH_SIZE;
-  for (size_t j = 0; j < chain[idx].size(); j++)
-    if(*chain[idx][j] == insn)
-      return chain[idx][j];
+  if (!decode_ready.load(std::memory_order_acquire))
+    build_decode_table();
 
-  idx = HASH_SIZE;
-  for (size_t j = 0; j < chain[idx].size(); j++)
-    if(*chain[idx][j] == insn)
-      return chain[idx][j];
+  insn_bits_t bits = insn.bits();
+  uint32_t cell = decode_cells[decode_root(bits)];
+  if (cell & DECODE_SUB)
+    cell = decode_cells[(cell & ~DECODE_SUB) + decode_sub(bits)];
+  for (const disasm_insn_t* const* p = &decode_lists[cell]; *p; p++)
+    if (**p == insn)
+      return *p;
 
   return NULL;
 }
 
+void disassembler_t::build_decode_table() const
+{
+  std::lock_guard<std::mutex> lock(decode_lock);
+  if (decode_ready.load(std::memory_order_relaxed))
+    return;
+
+  // Instructions which decode the whole low byte take precedence over the
+  // others, then the one added first wins
+  std::vector<const disasm_insn_t*> order;
+  for (int low_byte = 1; low_byte >= 0; low_byte--)
+    for (auto insn : insns)
+      if ((insn->get_mask() % 256 == 255) == low_byte)
+        order.push_back(insn);
+
+  // Neighbouring cells often share their candidates, so they share the list
+  size_t last_list = 0, last_size = 0;
+  auto add_list = [&](const std::vector<const disasm_insn_t*>& list) {
+    if (list.empty())
+      return (uint32_t)0;
+    if (list.size() != last_size ||
+        !std::equal(list.begin(), list.end(), &decode_lists[last_list])) {
+      last_list = decode_lists.size();
+      last_size = list.size();
+      decode_lists.insert(decode_lists.end(), list.begin(), list.end());
+      decode_lists.push_back(NULL);
+    }
+    return (uint32_t)last_list;
+  };
+
+  decode_cells.assign(DECODE_ROOT_SIZE, 0);
+  decode_lists.assign(1, NULL);
+  std::vector<const disasm_insn_t*> list, sub_list;
+  for (size_t root = 0; root < DECODE_ROOT_SIZE; root++) {
+    uint32_t bits, root_mask, sub_mask;
+    if (root < 256) {
+      bits = 3 | (root & 0x1f) << 2 | (root >> 5) << 12;
+      root_mask = DECODE_ROOT_MASK;
+      sub_mask = DECODE_SUB_MASK;
+    } else {
+      bits = (root - 256) & 3;
+      if (bits == 3)
+        continue;
+      bits |= (root - 256) >> 2 << 13;
+      root_mask = DECODE_RVC_ROOT_MASK;
+      sub_mask = DECODE_RVC_SUB_MASK;
+    }
+
+    list.clear();
+    bool decodes_sub = false;
+    for (auto insn : order) {
+      if (decode_candidate(insn, bits, root_mask)) {
+        list.push_back(insn);
+        decodes_sub |= (insn->get_mask() & sub_mask) != 0;
+      }
+    }
+    if (!decodes_sub || list.size() < DECODE_SUB_MIN_CANDIDATES) {
+      decode_cells[root] = add_list(list);
+      continue;
+    }
+
+    int sub_shift = __builtin_ctz(sub_mask);
+    size_t sub = decode_cells.size();
+    decode_cells[root] = DECODE_SUB | sub;
+    decode_cells.resize(sub + (sub_mask >> sub_shift) + 1);
+    for (size_t i = 0; i <= sub_mask >> sub_shift; i++) {
+      sub_list.clear();
+      for (auto insn : list)
+        if (decode_candidate(insn, i << sub_shift, sub_mask))
+          sub_list.push_back(insn);
+      decode_cells[sub + i] = add_list(sub_list);
+    }
+  }
+
+  decode_ready.store(true, std::memory_order_release);
+}
+
 void NOINLINE disassembler_t::add_insn(disasm_insn_t* insn)
 {
-  size_t idx = HASH_SIZE;
-  if (insn->get_mask() % HASH_SIZE == HASH_SIZE - 1)
-    idx = insn->get_match() % HASH_SIZE;
-  chain[idx].push_back(insn);
+  insns.push_back(insn);
+  decode_ready = false;
 }
 
 disassembler_t::~disassembler_t()
 {
-  for (size_t i = 0; i < HASH_SIZE+1; i++)
-    for (size_t j = 0; j < chain[i].size(); j++)
-      delete chain[i][j];
+  for (size_t i = 0; i < insns.size(); i++)
+    delete insns[i];
 }
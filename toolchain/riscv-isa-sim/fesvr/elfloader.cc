@@ -3,38 +3,35 @@
 #include "elf.h"
 #include "memif.h"
 #include "byteorder.h"
+#include <cerrno>
 #include <cstring>
+#include <stdexcept>
 #include <string>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
-#include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <vector>
 #include <map>
 
-std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t* entry)
-{
-  int fd = open(fn, O_RDONLY);
-  struct stat s;
-  assert(fd != -1);
-  if (fstat(fd, &s) < 0)
-    abort();
-  size_t size = s.st_size;
+// A bad ELF file fails the load, not the process, which may run other
+// simulations
+#define elf_check(cond) do { \
+    if (!(cond)) \
+      throw std::runtime_error(std::string(fn) + ": malformed ELF file"); \
+  } while (0)
 
-  char* buf = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-  assert(buf != MAP_FAILED);
-  close(fd);
-
-  assert(size >= sizeof(Elf64_Ehdr));
+static std::map<std::string, uint64_t> load_elf_mapped(const char* fn, char* buf, size_t size, int fd, memif_t* memif, reg_t* entry)
+{
+  elf_check(size >= sizeof(Elf64_Ehdr));
   const Elf64_Ehdr* eh64 = (const Elf64_Ehdr*)buf;
-  assert(IS_ELF32(*eh64) || IS_ELF64(*eh64));
-  assert(IS_ELFLE(*eh64));
-  assert(IS_ELF_EXEC(*eh64));
-  assert(IS_ELF_RISCV(*eh64) || IS_ELF_EM_NONE(*eh64));
-  assert(IS_ELF_VCURRENT(*eh64));
+  elf_check(IS_ELF32(*eh64) || IS_ELF64(*eh64));
+  elf_check(IS_ELFLE(*eh64));
+  elf_check(IS_ELF_EXEC(*eh64));
+  elf_check(IS_ELF_RISCV(*eh64) || IS_ELF_EM_NONE(*eh64));
+  elf_check(IS_ELF_VCURRENT(*eh64));
 
   std::vector<uint8_t> zeros;
   std::map<std::string, uint64_t> symbols;
@@ -43,29 +40,29 @@ std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t*
     ehdr_t* eh = (ehdr_t*)buf; \
     phdr_t* ph = (phdr_t*)(buf + bswap(eh->e_phoff)); \
     *entry = bswap(eh->e_entry); \
-    assert(size >= bswap(eh->e_phoff) + bswap(eh->e_phnum)*sizeof(*ph)); \
+    elf_check(size >= bswap(eh->e_phoff) + bswap(eh->e_phnum)*sizeof(*ph)); \
     for (unsigned i = 0; i < bswap(eh->e_phnum); i++) {			\
       if(bswap(ph[i].p_type) == PT_LOAD && bswap(ph[i].p_memsz)) {	\
         if (bswap(ph[i].p_filesz)) {					\
-          assert(size >= bswap(ph[i].p_offset) + bswap(ph[i].p_filesz)); \
-          memif->write(bswap(ph[i].p_paddr), bswap(ph[i].p_filesz), (uint8_t*)buf + bswap(ph[i].p_offset)); \
+          elf_check(size >= bswap(ph[i].p_offset) + bswap(ph[i].p_filesz)); \
+          memif->write_file(bswap(ph[i].p_paddr), bswap(ph[i].p_filesz), (uint8_t*)buf + bswap(ph[i].p_offset), fd, bswap(ph[i].p_offset)); \
         } \
         zeros.resize(bswap(ph[i].p_memsz) - bswap(ph[i].p_filesz)); \
         memif->write(bswap(ph[i].p_paddr) + bswap(ph[i].p_filesz), bswap(ph[i].p_memsz) - bswap(ph[i].p_filesz), &zeros[0]); \
       } \
     } \
     shdr_t* sh = (shdr_t*)(buf + bswap(eh->e_shoff)); \
-    assert(size >= bswap(eh->e_shoff) + bswap(eh->e_shnum)*sizeof(*sh)); \
-    assert(bswap(eh->e_shstrndx) < bswap(eh->e_shnum)); \
-    assert(size >= bswap(sh[bswap(eh->e_shstrndx)].sh_offset) + bswap(sh[bswap(eh->e_shstrndx)].sh_size)); \
+    elf_check(size >= bswap(eh->e_shoff) + bswap(eh->e_shnum)*sizeof(*sh)); \
+    elf_check(bswap(eh->e_shstrndx) < bswap(eh->e_shnum)); \
+    elf_check(size >= bswap(sh[bswap(eh->e_shstrndx)].sh_offset) + bswap(sh[bswap(eh->e_shstrndx)].sh_size)); \
     char *shstrtab = buf + bswap(sh[bswap(eh->e_shstrndx)].sh_offset);	\
     unsigned strtabidx = 0, symtabidx = 0; \
     for (unsigned i = 0; i < bswap(eh->e_shnum); i++) {		     \
       unsigned max_len = bswap(sh[bswap(eh->e_shstrndx)].sh_size) - bswap(sh[i].sh_name); \
-      assert(bswap(sh[i].sh_name) < bswap(sh[bswap(eh->e_shstrndx)].sh_size));	\
-      assert(strnlen(shstrtab + bswap(sh[i].sh_name), max_len) < max_len); \
+      elf_check(bswap(sh[i].sh_name) < bswap(sh[bswap(eh->e_shstrndx)].sh_size));	\
+      elf_check(strnlen(shstrtab + bswap(sh[i].sh_name), max_len) < max_len); \
       if (bswap(sh[i].sh_type) & SHT_NOBITS) continue; \
-      assert(size >= bswap(sh[i].sh_offset) + bswap(sh[i].sh_size)); \
+      elf_check(size >= bswap(sh[i].sh_offset) + bswap(sh[i].sh_size)); \
       if (strcmp(shstrtab + bswap(sh[i].sh_name), ".strtab") == 0) \
         strtabidx = i; \
       if (strcmp(shstrtab + bswap(sh[i].sh_name), ".symtab") == 0) \
@@ -76,8 +73,8 @@ std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t*
       sym_t* sym = (sym_t*)(buf + bswap(sh[symtabidx].sh_offset)); \
       for (unsigned i = 0; i < bswap(sh[symtabidx].sh_size)/sizeof(sym_t); i++) { \
         unsigned max_len = bswap(sh[strtabidx].sh_size) - bswap(sym[i].st_name); \
-        assert(bswap(sym[i].st_name) < bswap(sh[strtabidx].sh_size));	\
-        assert(strnlen(strtab + bswap(sym[i].st_name), max_len) < max_len); \
+        elf_check(bswap(sym[i].st_name) < bswap(sh[strtabidx].sh_size));	\
+        elf_check(strnlen(strtab + bswap(sym[i].st_name), max_len) < max_len); \
         symbols[strtab + bswap(sym[i].st_name)] = bswap(sym[i].st_value); \
       } \
     } \
@@ -88,7 +85,33 @@ std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t*
   else
     LOAD_ELF(Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Sym, from_le);
 
-  munmap(buf, size);
-
   return symbols;
 }
+
+std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t* entry)
+{
+  int fd = open(fn, O_RDONLY);
+  if (fd == -1)
+    throw std::runtime_error(std::string("can't open ") + fn + ": " + strerror(errno));
+  struct stat s;
+  char* buf = (char*)MAP_FAILED;
+  std::string error = std::string(fn) + ": malformed ELF file";
+  if (fstat(fd, &s) < 0 || (s.st_size > 0 &&
+      (buf = (char*)mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED))
+    error = std::string("can't read ") + fn + ": " + strerror(errno);
+  if (buf == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error(error);
+  }
+
+  try {
+    auto symbols = load_elf_mapped(fn, buf, s.st_size, fd, memif, entry);
+    munmap(buf, s.st_size);
+    close(fd);
+    return symbols;
+  } catch (...) {
+    munmap(buf, s.st_size);
+    close(fd);
+    throw;
+  }
+}
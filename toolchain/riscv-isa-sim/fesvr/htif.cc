@@ -12,6 +12,8 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <stdexcept>
+#include <string>
 #include <stdio.h>
 #include <unistd.h>
 #include <signal.h>
@@ -32,6 +34,7 @@
 #endif
 
 static volatile bool signal_exit = false;
+static bool signal_handlers = true;
 static void handle_signal(int sig)
 {
   if (sig == SIGABRT || signal_exit) // someone set up us the bomb!
@@ -45,9 +48,21 @@ htif_t::htif_t()
     tohost_addr(0), fromhost_addr(0), exitcode(0), stopped(false),
     syscall_proxy(this)
 {
-  signal(SIGINT, &handle_signal);
-  signal(SIGTERM, &handle_signal);
-  signal(SIGABRT, &handle_signal); // we still want to call static destructors
+  if (signal_handlers) {
+    signal(SIGINT, &handle_signal);
+    signal(SIGTERM, &handle_signal);
+    signal(SIGABRT, &handle_signal); // we still want to call static destructors
+  }
+}
+
+void htif_t::set_signal_handlers(bool enabled)
+{
+  signal_handlers = enabled;
+}
+
+bool htif_t::signal_handlers_enabled()
+{
+  return signal_handlers;
 }
 
 htif_t::htif_t(int argc, char** argv) : htif_t()
@@ -112,6 +127,13 @@ std::map<std::string, uint64_t> htif_t::load_payload(const std::string& payload,
         memif_t::write(taddr, len, src);
     }
 
+    void write_file(addr_t taddr, size_t len, const void* src, int fd,
+                    off_t offset) override
+    {
+      if (!htif->is_address_preloaded(taddr, len))
+        memif_t::write_file(taddr, len, src, fd, offset);
+    }
+
    private:
     htif_t* htif;
   } preload_aware_memif(this);
@@ -163,6 +185,18 @@ const char* htif_t::get_symbol(uint64_t addr)
   return it->second.c_str();
 }
 
+const char* htif_t::get_symbol_before(uint64_t addr, uint64_t* start)
+{
+  auto it = addr2symbol.upper_bound(addr);
+
+  if(it == addr2symbol.begin())
+      return nullptr;
+
+  --it;
+  *start = it->first;
+  return it->second.c_str();
+}
+
 void htif_t::stop()
 {
   if (!sig_file.empty() && sig_len) // print final torture test signature
@@ -171,7 +205,8 @@ void htif_t::stop()
     mem.read(sig_addr, sig_len, &buf[0]);
 
     std::ofstream sigs(sig_file);
-    assert(sigs && "can't open signature file!");
+    if (!sigs)
+      throw std::runtime_error("can't open signature file " + sig_file);
     sigs << std::setfill('0') << std::hex;
 
     const addr_t incr = 16;
@@ -208,7 +243,7 @@ int htif_t::run()
     std::bind(enq_func, &fromhost_queue, std::placeholders::_1);
 
   if (tohost_addr == 0) {
-    while (true)
+    while (!signal_exit && exitcode == 0)
       idle();
   }
 
@@ -25,6 +25,12 @@ class htif_t : public chunked_memif_t
   bool done();
   int exit_code();
 
+  // Whether simulations created from now on take over SIGINT, SIGTERM and
+  // SIGABRT, which end or interrupt the whole process; a host that runs
+  // several of them at once turns this off
+  static void set_signal_handlers(bool enabled);
+  static bool signal_handlers_enabled();
+
   virtual memif_t& memif() { return mem; }
 
  protected:
@@ -52,6 +58,15 @@ class htif_t : public chunked_memif_t
   // Given an address, return symbol from addr2symbol map
   const char* get_symbol(uint64_t addr);
 
+  // Given an address, return the closest symbol at or below it
+  const char* get_symbol_before(uint64_t addr, uint64_t* start);
+
+  // All symbols of the program, by address
+  const std::map<uint64_t, std::string>& get_symbols() { return addr2symbol; }
+
+  // end the simulation as if the target had reported code through tohost
+  void set_exit_code(int code) { exitcode = code << 1 | 1; }
+
  private:
   void parse_arguments(int argc, char ** argv);
   void register_devices();
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdexcept>
+#include <unistd.h>
 #include "memif.h"
 
 void memif_t::read(addr_t addr, size_t len, void* bytes)
@@ -83,6 +84,26 @@ void memif_t::write(addr_t addr, size_t len, const void* bytes)
   }
 }
 
+void memif_t::write_file(addr_t addr, size_t len, const void* bytes,
+                         int fd, off_t offset)
+{
+  // Only the pages of the target address and the file offset line up
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t head = (page - (addr & (page-1))) & (page-1);
+  if (((addr - offset) & (page-1)) == 0 && len >= head + page)
+  {
+    size_t body = (len - head) & ~(page-1);
+    if (cmemif->map_chunk(addr + head, body, fd, offset + head))
+    {
+      write(addr, head, bytes);
+      write(addr + head + body, len - head - body, (const char*)bytes + head + body);
+      return;
+    }
+  }
+
+  write(addr, len, bytes);
+}
+
 #define MEMIF_READ_FUNC \
   if(addr & (sizeof(val)-1)) \
     throw std::runtime_error("misaligned address"); \
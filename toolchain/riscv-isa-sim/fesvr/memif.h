@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/types.h>
 
 typedef uint64_t reg_t;
 typedef int64_t sreg_t;
@@ -16,6 +17,10 @@ public:
   virtual void read_chunk(addr_t taddr, size_t len, void* dst) = 0;
   virtual void write_chunk(addr_t taddr, size_t len, const void* src) = 0;
   virtual void clear_chunk(addr_t taddr, size_t len) = 0;
+  // Maps len bytes of the file fd at offset to taddr copy-on-write instead
+  // of writing them, if the target memory can; taddr, len and offset are
+  // multiples of the host page size
+  virtual bool map_chunk(addr_t taddr, size_t len, int fd, off_t offset) { return false; }
 
   virtual size_t chunk_align() = 0;
   virtual size_t chunk_max_size() = 0;
@@ -30,6 +35,10 @@ public:
   // read and write byte arrays
   virtual void read(addr_t addr, size_t len, void* bytes);
   virtual void write(addr_t addr, size_t len, const void* bytes);
+  // write the bytes, which are len bytes of the file fd at offset; whole
+  // pages may be mapped from the file instead
+  virtual void write_file(addr_t addr, size_t len, const void* bytes,
+                          int fd, off_t offset);
 
   // read and write 8-bit words
   virtual uint8_t read_uint8(addr_t addr);
@@ -0,0 +1,112 @@
+// See LICENSE for license details.
+
+#include "amo_profiler.h"
+#include "processor.h"
+#include <algorithm>
+#include <cinttypes>
+#include <map>
+#include <string>
+
+static const size_t num_hot_addrs = 32;
+
+amo_profiler_t::amo_profiler_t(const std::vector<processor_t*>& procs)
+{
+  for (auto p : procs)
+    harts.emplace_back(p->get_xlen() == 32 ? 0xffffffff : reg_t(-1));
+}
+
+static void print_header(FILE* out, const char* first)
+{
+  fprintf(out, "%-24s %12s %12s %12s %12s %12s", first, "amos", "lrs", "scs",
+          "sc-fails", "yields");
+}
+
+static void print_counts(FILE* out, const char* name,
+                         const hart_amo_profiler_t::counts_t& c)
+{
+  fprintf(out, "%-24s", name);
+  for (size_t i = 0; i < hart_amo_profiler_t::NUM_EVENTS; i++)
+    fprintf(out, " %12" PRIu64, c.events[i]);
+}
+
+static uint64_t accesses(const hart_amo_profiler_t::counts_t& c)
+{
+  return c.events[hart_amo_profiler_t::AMOS] + c.events[hart_amo_profiler_t::LRS] +
+         c.events[hart_amo_profiler_t::SCS];
+}
+
+void amo_profiler_t::print_harts(FILE* out) const
+{
+  hart_amo_profiler_t::counts_t sum = {};
+
+  print_header(out, "hart");
+  fprintf(out, " %12s\n", "addresses");
+  for (size_t i = 0; i < harts.size(); i++) {
+    hart_amo_profiler_t::counts_t c = {};
+    for (auto& a : harts[i].addrs)
+      for (size_t j = 0; j < hart_amo_profiler_t::NUM_EVENTS; j++)
+        c.events[j] += a.second.events[j];
+    for (size_t j = 0; j < hart_amo_profiler_t::NUM_EVENTS; j++)
+      sum.events[j] += c.events[j];
+    print_counts(out, std::to_string(i).c_str(), c);
+    fprintf(out, " %12zu\n", harts[i].addrs.size());
+  }
+  print_counts(out, "total", sum);
+  fprintf(out, "\n");
+}
+
+void amo_profiler_t::print_addresses(FILE* out, const symbolizer_t& symbolize) const
+{
+  struct addr_t
+  {
+    hart_amo_profiler_t::counts_t counts;
+    size_t harts;
+  };
+
+  std::map<reg_t, addr_t> addrs;
+  for (auto& h : harts) {
+    for (auto& a : h.addrs) {
+      addr_t& addr = addrs[a.first];
+      for (size_t i = 0; i < hart_amo_profiler_t::NUM_EVENTS; i++)
+        addr.counts.events[i] += a.second.events[i];
+      addr.harts++;
+    }
+  }
+
+  // Most accessed first, then by the number of harts contending
+  std::vector<std::pair<reg_t, addr_t>> sorted(addrs.begin(), addrs.end());
+  std::stable_sort(sorted.begin(), sorted.end(), [](
+      const std::pair<reg_t, addr_t>& a, const std::pair<reg_t, addr_t>& b) {
+    uint64_t x = accesses(a.second.counts), y = accesses(b.second.counts);
+    return x != y ? x > y : a.second.harts > b.second.harts;
+  });
+
+  fprintf(out, "%zu addresses, the %zu most contended:\n\n", sorted.size(),
+          std::min(num_hot_addrs, sorted.size()));
+  print_header(out, "address");
+  fprintf(out, " %8s  %s\n", "harts", "symbol");
+  for (size_t i = 0; i < std::min(num_hot_addrs, sorted.size()); i++) {
+    reg_t addr = sorted[i].first;
+    char name[32];
+    snprintf(name, sizeof(name), "0x%08" PRIx64, (uint64_t)addr);
+    print_counts(out, name, sorted[i].second.counts);
+    fprintf(out, " %8zu  ", sorted[i].second.harts);
+
+    reg_t start;
+    const char* symbol = symbolize(addr, &start);
+    if (!symbol)
+      fprintf(out, "[unknown]\n");
+    else if (addr == start)
+      fprintf(out, "%s\n", symbol);
+    else
+      fprintf(out, "%s+0x%" PRIx64 "\n", symbol, (uint64_t)(addr - start));
+  }
+}
+
+void amo_profiler_t::print_report(FILE* out, const symbolizer_t& symbolize) const
+{
+  fprintf(out, "Atomic accesses of %zu harts\n\n", harts.size());
+  print_harts(out);
+  fprintf(out, "\n");
+  print_addresses(out, symbolize);
+}
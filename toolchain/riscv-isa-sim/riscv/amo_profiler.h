@@ -0,0 +1,63 @@
+// See LICENSE for license details.
+#ifndef _RISCV_AMO_PROFILER_H
+#define _RISCV_AMO_PROFILER_H
+
+#include "decode.h"
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class processor_t;
+
+// Atomic accesses of one hart, by target address. The hart's MMU counts
+// into it, so harts stepped on different host threads never share counters.
+class hart_amo_profiler_t
+{
+public:
+  // A yield is a reservation the hart lost before its SC: to a switch to
+  // another hart, the end of a quantum of parallel harts, a store of
+  // another hart replayed at that end, or a restore
+  enum event_t { AMOS, LRS, SCS, SC_FAILS, YIELDS, NUM_EVENTS };
+
+  struct counts_t
+  {
+    uint64_t events[NUM_EVENTS];
+  };
+
+  hart_amo_profiler_t(reg_t addr_mask) : addr_mask(addr_mask) {}
+
+  void count(reg_t addr, event_t event) { addrs[addr & addr_mask].events[event]++; }
+
+private:
+  friend class amo_profiler_t;
+  // RV32 addresses are kept sign-extended, the symbols are not
+  reg_t addr_mask;
+  std::unordered_map<reg_t, counts_t> addrs;
+};
+
+// Finds the words the harts synchronize on. Counts the AMOs, LRs, SCs,
+// failed SCs and lost reservations of every hart per address and ranks the
+// addresses by their atomic accesses, with the harts that contend for them
+// and the ELF symbol they belong to.
+class amo_profiler_t
+{
+public:
+  // Looks up the symbol at or below an address and returns its name
+  typedef std::function<const char*(reg_t addr, reg_t* start)> symbolizer_t;
+
+  amo_profiler_t(const std::vector<processor_t*>& procs);
+
+  hart_amo_profiler_t* get_hart(size_t i) { return &harts[i]; }
+
+  void print_report(FILE* out, const symbolizer_t& symbolize) const;
+
+private:
+  std::vector<hart_amo_profiler_t> harts;
+
+  void print_harts(FILE* out) const;
+  void print_addresses(FILE* out, const symbolizer_t& symbolize) const;
+};
+
+#endif
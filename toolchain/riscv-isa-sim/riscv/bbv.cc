@@ -0,0 +1,78 @@
+// See LICENSE for license details.
+
+#include "bbv.h"
+#include "processor.h"
+#include <cinttypes>
+#include <stdexcept>
+
+hart_bbv_t::hart_bbv_t(const char* path, reg_t interval, reg_t pc_mask)
+  : out(path), interval(interval), interval_left(interval), pc_mask(pc_mask),
+    block(NO_BLOCK), block_insns(0)
+{
+  if (interval == 0)
+    throw std::invalid_argument("the interval must not be empty");
+}
+
+void hart_bbv_t::end_block(reg_t next)
+{
+  auto it = ids.find(block);
+  uint32_t id;
+  if (it != ids.end()) {
+    id = it->second;
+  } else {
+    id = counts.size();
+    ids[block] = id;
+    counts.push_back(0);
+  }
+
+  if (counts[id] == 0)
+    touched.push_back(id);
+  counts[id] += block_insns;
+
+  block = next;
+  block_insns = 0;
+}
+
+void hart_bbv_t::end_interval()
+{
+  // The block continues in the next interval under the same id
+  reg_t start = block;
+  if (block_insns)
+    end_block(start);
+  interval_left = interval;
+
+  if (touched.empty())
+    return;
+
+  FILE* f = out.get();
+  fputc('T', f);
+  for (auto id : touched) {
+    fprintf(f, ":%" PRIu32 ":%" PRIu64 " ", id + 1, counts[id]);
+    counts[id] = 0;
+  }
+  fputc('\n', f);
+  touched.clear();
+}
+
+void hart_bbv_t::finish()
+{
+  if (interval_left != interval)
+    end_interval();
+  fflush(out.get());
+}
+
+bbv_profiler_t::bbv_profiler_t(const std::vector<processor_t*>& procs,
+                               const std::string& prefix, reg_t interval)
+{
+  for (size_t i = 0; i < procs.size(); i++) {
+    std::string path = prefix + "." + std::to_string(i) + ".bb";
+    reg_t pc_mask = procs[i]->get_max_xlen() == 32 ? 0xffffffff : -1;
+    harts.emplace_back(new hart_bbv_t(path.c_str(), interval, pc_mask));
+  }
+}
+
+void bbv_profiler_t::finish()
+{
+  for (auto& h : harts)
+    h->finish();
+}
@@ -0,0 +1,88 @@
+// See LICENSE for license details.
+#ifndef _RISCV_BBV_H
+#define _RISCV_BBV_H
+
+#include "decode.h"
+#include "log_file.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class processor_t;
+
+// Basic-block vector of one hart. A block runs from the target of a taken
+// branch, jump, trap or xRET to the next one, so counting an instruction is an
+// increment and a comparison, and only taken control transfers look the
+// block up. PCs are compared and recorded in XLEN bits: an RV32 hart runs on
+// zero-extended PCs after a trap or xRET and sign-extended ones otherwise.
+class hart_bbv_t
+{
+public:
+  hart_bbv_t(const char* path, reg_t interval, reg_t pc_mask);
+
+  // Counts the instruction insn at pc, which the hart just retired and which
+  // continues at npc
+  void retire(reg_t pc, insn_t insn, reg_t npc)
+  {
+    if (unlikely(block_insns++ == 0 && block == NO_BLOCK))
+      block = pc & pc_mask;
+    if (unlikely((npc - pc - insn.length()) & pc_mask))
+      end_block(npc & pc_mask);
+    if (unlikely(--interval_left == 0))
+      end_interval();
+  }
+
+  // Ends the block at a trap, which continues at handler
+  void trap(reg_t handler)
+  {
+    if (block_insns)
+      end_block(handler & pc_mask);
+    else
+      block = handler & pc_mask;
+  }
+
+  // Writes the counts of the last, partial interval
+  void finish();
+
+private:
+  static const reg_t NO_BLOCK = -1;
+
+  log_file_t out;
+  reg_t interval;
+  reg_t interval_left;
+  reg_t pc_mask;
+
+  reg_t block;
+  uint64_t block_insns;
+
+  std::unordered_map<reg_t, uint32_t> ids;
+  std::vector<uint64_t> counts;
+  std::vector<uint32_t> touched;
+
+  void end_block(reg_t next);
+  void end_interval();
+};
+
+// Writes a basic-block vector per hart and interval of its instructions, in
+// the format SimPoint reads (and Valgrind's exp-bbv writes):
+//   T:<block>:<instructions> :<block>:<instructions> ...
+// one line per interval, so interval k starts k * interval instructions
+// into the hart's execution. The block ids of a hart are numbered from 1 in
+// order of first execution.
+class bbv_profiler_t
+{
+public:
+  // Writes hart i's vectors to <prefix>.<i>.bb
+  bbv_profiler_t(const std::vector<processor_t*>& procs,
+                 const std::string& prefix, reg_t interval);
+
+  hart_bbv_t* get_hart(size_t i) { return harts[i].get(); }
+  void finish();
+
+private:
+  std::vector<std::unique_ptr<hart_bbv_t>> harts;
+};
+
+#endif
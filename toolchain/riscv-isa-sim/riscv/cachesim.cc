@@ -7,7 +7,8 @@
 #include <iomanip>
 
 cache_sim_t::cache_sim_t(size_t _sets, size_t _ways, size_t _linesz, const char* _name)
-: sets(_sets), ways(_ways), linesz(_linesz), name(_name), log(false)
+: sets(_sets), ways(_ways), linesz(_linesz), name(_name), log(false),
+  print_on_exit(true)
 {
   init();
 }
@@ -62,7 +63,8 @@ void cache_sim_t::init()
 
 cache_sim_t::cache_sim_t(const cache_sim_t& rhs)
  : sets(rhs.sets), ways(rhs.ways), linesz(rhs.linesz),
-   idx_shift(rhs.idx_shift), name(rhs.name), log(false)
+   idx_shift(rhs.idx_shift), name(rhs.name), log(false),
+   print_on_exit(rhs.print_on_exit)
 {
   tags = new uint64_t[sets*ways];
   memcpy(tags, rhs.tags, sets*ways*sizeof(uint64_t));
@@ -70,7 +72,8 @@ cache_sim_t::cache_sim_t(const cache_sim_t& rhs)
 
 cache_sim_t::~cache_sim_t()
 {
-  print_stats();
+  if (print_on_exit)
+    print_stats();
   delete [] tags;
 }
 
@@ -121,7 +124,7 @@ uint64_t cache_sim_t::victimize(uint64_t addr)
   return victim;
 }
 
-void cache_sim_t::access(uint64_t addr, size_t bytes, bool store)
+bool cache_sim_t::access(uint64_t addr, size_t bytes, bool store)
 {
   store ? write_accesses++ : read_accesses++;
   (store ? bytes_written : bytes_read) += bytes;
@@ -131,7 +134,7 @@ void cache_sim_t::access(uint64_t addr, size_t bytes, bool store)
   {
     if (store)
       *hit_way |= DIRTY;
-    return;
+    return true;
   }
 
   store ? write_misses++ : read_misses++;
@@ -157,6 +160,7 @@ void cache_sim_t::access(uint64_t addr, size_t bytes, bool store)
 
   if (store)
     *check_tag(addr) |= DIRTY;
+  return false;
 }
 
 fa_cache_sim_t::fa_cache_sim_t(size_t ways, size_t linesz, const char* name)
@@ -183,3 +187,61 @@ uint64_t fa_cache_sim_t::victimize(uint64_t addr)
   tags[addr >> idx_shift] = (addr >> idx_shift) | VALID;
   return old_tag;
 }
+
+lru_cache_sim_t::lru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name)
+  : cache_sim_t(sets, ways, linesz, name),
+    prev(sets * ways + sets), next(sets * ways + sets)
+{
+  slots.reserve(sets * ways);
+  flush();
+}
+
+void lru_cache_sim_t::flush()
+{
+  slots.clear();
+  memset(tags, 0, sets * ways * sizeof(*tags));
+  for (size_t set = 0; set < sets; set++) {
+    size_t head = sets * ways + set;
+    size_t last = head;
+    for (size_t slot = set * ways; slot < (set + 1) * ways; slot++) {
+      next[last] = slot;
+      prev[slot] = last;
+      last = slot;
+    }
+    next[last] = head;
+    prev[head] = last;
+  }
+}
+
+void lru_cache_sim_t::touch(size_t slot)
+{
+  size_t head = sets * ways + slot / ways;
+  next[prev[slot]] = next[slot];
+  prev[next[slot]] = prev[slot];
+  prev[slot] = head;
+  next[slot] = next[head];
+  prev[next[head]] = slot;
+  next[head] = slot;
+}
+
+uint64_t* lru_cache_sim_t::check_tag(uint64_t addr)
+{
+  auto it = slots.find(addr >> idx_shift);
+  if (it == slots.end())
+    return NULL;
+  touch(it->second);
+  return &tags[it->second];
+}
+
+uint64_t lru_cache_sim_t::victimize(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  size_t slot = prev[sets * ways + idx];
+  uint64_t victim = tags[slot];
+  if (victim & VALID)
+    slots.erase(victim & ~(VALID | DIRTY));
+  tags[slot] = (addr >> idx_shift) | VALID;
+  slots[addr >> idx_shift] = slot;
+  touch(slot);
+  return victim;
+}
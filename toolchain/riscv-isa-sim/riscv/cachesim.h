@@ -7,6 +7,8 @@
 #include <cstring>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <cstdint>
 
 class lfsr_t
@@ -26,10 +28,17 @@ class cache_sim_t
   cache_sim_t(const cache_sim_t& rhs);
   virtual ~cache_sim_t();
 
-  void access(uint64_t addr, size_t bytes, bool store);
+  // Returns whether the access hit
+  bool access(uint64_t addr, size_t bytes, bool store);
   void print_stats();
   void set_miss_handler(cache_sim_t* mh) { miss_handler = mh; }
   void set_log(bool _log) { log = _log; }
+  void set_print_stats(bool print) { print_on_exit = print; }
+
+  size_t get_linesz() const { return linesz; }
+  uint64_t get_accesses() const { return read_accesses + write_accesses; }
+  uint64_t get_misses() const { return read_misses + write_misses; }
+  uint64_t get_writebacks() const { return writebacks; }
 
   static cache_sim_t* construct(const char* config, const char* name);
 
@@ -60,6 +69,7 @@ class cache_sim_t
 
   std::string name;
   bool log;
+  bool print_on_exit;
 
   void init();
 };
@@ -75,6 +85,31 @@ class fa_cache_sim_t : public cache_sim_t
   std::map<uint64_t, uint64_t> tags;
 };
 
+// A cache with true LRU replacement. A hash table maps each resident line to
+// its slot in tags, so a lookup takes constant time whatever the number of
+// ways, and the ways of each set form a list from the most to the least
+// recently used one.
+class lru_cache_sim_t : public cache_sim_t
+{
+ public:
+  lru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name);
+  uint64_t* check_tag(uint64_t addr);
+  uint64_t victimize(uint64_t addr);
+
+  // Invalidates all lines without writing them back
+  void flush();
+
+ private:
+  std::unordered_map<uint64_t, size_t> slots;
+
+  // Links of the LRU list of each set. Slot s belongs to set s / ways, and
+  // entry sets * ways + i is the head of the list of set i.
+  std::vector<size_t> prev;
+  std::vector<size_t> next;
+
+  void touch(size_t slot);
+};
+
 class cache_memtracer_t : public memtracer_t
 {
  public:
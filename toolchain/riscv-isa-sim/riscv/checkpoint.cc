@@ -0,0 +1,121 @@
+// See LICENSE for license details.
+
+#include "checkpoint.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+struct checkpoint_header_t
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+checkpoint_t::checkpoint_t(const char* path, mode_t mode)
+  : path(path), mode(mode)
+{
+  file = fopen(path, mode == SAVE ? "wb" : "rb");
+  if (!file)
+    throw std::runtime_error("can't open checkpoint `" + this->path + "': " +
+                             strerror(errno));
+
+  checkpoint_header_t header, expected;
+  memset(&expected, 0, sizeof(expected));
+  memcpy(expected.magic, CHECKPOINT_MAGIC, sizeof(expected.magic));
+  expected.version = CHECKPOINT_VERSION;
+
+  if (saving() ? fwrite(&expected, sizeof(expected), 1, file) != 1 :
+      fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(&header, &expected, sizeof(header)) != 0) {
+    fclose(file);
+    throw std::runtime_error(saving() ? "can't write checkpoint `" + this->path + "'" :
+                             "`" + this->path + "' is not a checkpoint of this version of Spike");
+  }
+}
+
+checkpoint_t::~checkpoint_t()
+{
+  fclose(file);
+}
+
+void checkpoint_t::bytes(void* data, size_t len)
+{
+  size_t done = saving() ? fwrite(data, 1, len, file) : fread(data, 1, len, file);
+  if (done != len)
+    throw std::runtime_error(std::string(saving() ? "can't write" : "truncated") +
+                             " checkpoint `" + path + "'");
+}
+
+void checkpoint_t::check(uint64_t value, const char* what)
+{
+  uint64_t saved = value;
+  io(saved);
+  if (saved != value)
+    throw std::runtime_error("checkpoint `" + path + "' has " + what + " " +
+                             std::to_string(saved) + ", expected " +
+                             std::to_string(value));
+}
+
+void checkpoint_t::section(const char* tag)
+{
+  char saved[4];
+  memcpy(saved, tag, sizeof(saved));
+  io(saved);
+  if (memcmp(saved, tag, sizeof(saved)) != 0)
+    throw std::runtime_error("checkpoint `" + path + "' lacks the " +
+                             std::string(tag, sizeof(saved)) + " section of "
+                             "this configuration");
+}
+
+// A memory is saved as (page index, page) pairs of its nonzero pages, ended
+// by the index -1. Most of a simulated memory is never touched.
+void checkpoint_t::memory(char* data, size_t len)
+{
+  const uint64_t end = -1;
+  size_t pages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+
+  if (saving()) {
+    static const char zero[PAGE_SIZE] = {};
+    for (uint64_t i = 0; i < pages; i++) {
+      size_t size = std::min(PAGE_SIZE, len - i * PAGE_SIZE);
+      if (memcmp(data + i * PAGE_SIZE, zero, size) == 0)
+        continue;
+      io(i);
+      bytes(data + i * PAGE_SIZE, size);
+    }
+    uint64_t i = end;
+    io(i);
+    return;
+  }
+
+  std::vector<bool> restored(pages);
+  for (;;) {
+    uint64_t i;
+    io(i);
+    if (i == end)
+      break;
+    if (i >= pages)
+      throw std::runtime_error("checkpoint `" + path + "' has a page beyond "
+                               "the end of memory");
+    bytes(data + i * PAGE_SIZE, std::min(PAGE_SIZE, len - i * PAGE_SIZE));
+    restored[i] = true;
+  }
+
+  // Clear what the program loader put where the checkpoint has zeros,
+  // without writing (and allocating) the pages that are zero already
+  for (size_t i = 0; i < pages; i++) {
+    if (restored[i])
+      continue;
+    char* page = data + i * PAGE_SIZE;
+    size_t size = std::min(PAGE_SIZE, len - i * PAGE_SIZE);
+    for (size_t j = 0; j < size; j++) {
+      if (page[j]) {
+        memset(page, 0, size);
+        break;
+      }
+    }
+  }
+}
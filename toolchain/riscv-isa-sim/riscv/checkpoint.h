@@ -0,0 +1,52 @@
+// See LICENSE for license details.
+#ifndef _RISCV_CHECKPOINT_H
+#define _RISCV_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// A checkpoint file holds the state of a whole simulation: the harts, the
+// memories and the devices. The same code walks the state to save and to
+// restore it, so every component implements a single
+//   void checkpoint(checkpoint_t& c);
+// that passes its fields to c.io() in a fixed order. Sections tag each
+// component, so that a file taken with a different configuration is
+// rejected instead of silently misread. All errors throw
+// std::runtime_error.
+
+#define CHECKPOINT_MAGIC "SPIKECKP"
+#define CHECKPOINT_VERSION 2
+
+class checkpoint_t
+{
+public:
+  enum mode_t { SAVE, RESTORE };
+
+  checkpoint_t(const char* path, mode_t mode);
+  ~checkpoint_t();
+
+  bool saving() const { return mode == SAVE; }
+
+  // Saves or restores a plain-data value
+  template<class T> void io(T& x) { bytes(&x, sizeof(x)); }
+  void bytes(void* data, size_t len);
+
+  // Saves a value, or checks that the restored one matches it
+  void check(uint64_t value, const char* what);
+
+  // Starts the section of a component, tag has four characters
+  void section(const char* tag);
+
+  // Saves or restores a memory, skipping the pages that are zero
+  void memory(char* data, size_t len);
+
+private:
+  static const size_t PAGE_SIZE = 4096;
+  std::string path;
+  mode_t mode;
+  FILE* file;
+};
+
+#endif
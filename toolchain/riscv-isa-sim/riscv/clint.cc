@@ -1,6 +1,7 @@
 #include <sys/time.h>
 #include "devices.h"
 #include "processor.h"
+#include "checkpoint.h"
 
 clint_t::clint_t(std::vector<processor_t*>& procs, uint64_t freq_hz, bool real_time)
   : procs(procs), freq_hz(freq_hz), real_time(real_time), mtime(0), mtimecmp(procs.size())
@@ -87,3 +88,12 @@ void clint_t::increment(reg_t inc)
       procs[i]->state.mip |= MIP_MTIP;
   }
 }
+
+void clint_t::checkpoint(checkpoint_t& c)
+{
+  c.section("CLNT");
+  c.check(mtimecmp.size(), "timer compare registers");
+  c.io(mtime);
+  for (auto& x : mtimecmp)
+    c.io(x);
+}
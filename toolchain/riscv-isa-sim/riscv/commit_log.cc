@@ -0,0 +1,287 @@
+// See LICENSE for license details.
+
+#include "commit_log.h"
+#include "processor.h"
+#include "disasm.h"
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstring>
+#include <stdexcept>
+
+static void append(std::vector<uint8_t>& buf, const void* data, size_t len)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  buf.insert(buf.end(), bytes, bytes + len);
+}
+
+#ifdef RISCV_ENABLE_COMMITLOG
+void commit_log_serialize(processor_t* p, uint64_t pc, uint64_t bits,
+                          unsigned length, std::vector<uint8_t>& buf)
+{
+  state_t* state = p->get_state();
+  size_t start = buf.size();
+
+  commit_log_insn_t insn;
+  memset(&insn, 0, sizeof(insn));
+  insn.pc = pc;
+  insn.bits = bits;
+  insn.hartid = p->get_csr(CSR_MHARTID);
+  insn.priv = state->last_inst_priv;
+  insn.xlen = state->last_inst_xlen;
+  insn.length = length;
+  insn.nloads = state->log_mem_read.size();
+  insn.nstores = state->log_mem_write.size();
+  append(buf, &insn, sizeof(insn));
+
+  for (auto& item : state->log_reg_write) {
+    if ((item.first & 0xf) == 2 || (item.first & 0xf) == 3) {
+      commit_log_vec_t vec;
+      vec.vsew = p->VU.vsew;
+      vec.vl = p->VU.vl;
+      vec.fractional = p->VU.vflmul < 1;
+      vec.lmul = vec.fractional ? (reg_t)(1 / p->VU.vflmul) : (reg_t)p->VU.vflmul;
+      append(buf, &vec, sizeof(vec));
+      ((commit_log_insn_t*)&buf[start])->vec = 1;
+      break;
+    }
+  }
+
+  uint16_t nregs = 0;
+  for (auto& item : state->log_reg_write) {
+    if (item.first == 0)
+      continue;
+
+    commit_log_reg_write_t reg;
+    reg.key = item.first;
+    const void* value = item.second.v;
+    switch (item.first & 0xf) {
+    case 0:
+    case 4:
+      reg.width = state->last_inst_xlen;
+      break;
+    case 1:
+      reg.width = state->last_inst_flen;
+      break;
+    case 2:
+      reg.width = p->VU.VLEN;
+      value = &p->VU.elt<uint8_t>(item.first >> 4, 0);
+      break;
+    case 3:
+      reg.width = 0;
+      break;
+    default:
+      assert("can't been here" && 0);
+      break;
+    }
+    append(buf, &reg, sizeof(reg));
+    append(buf, value, reg.width / 8);
+    nregs++;
+  }
+  ((commit_log_insn_t*)&buf[start])->nregs = nregs;
+
+  for (auto& item : state->log_mem_read) {
+    commit_log_load_t load = {std::get<0>(item)};
+    append(buf, &load, sizeof(load));
+  }
+
+  for (auto& item : state->log_mem_write) {
+    commit_log_store_t store = {std::get<0>(item), std::get<1>(item), std::get<2>(item)};
+    append(buf, &store, sizeof(store));
+  }
+}
+#endif
+
+size_t commit_log_record_size(const uint8_t* rec, size_t avail)
+{
+  if (avail < sizeof(commit_log_insn_t))
+    return 0;
+
+  commit_log_insn_t insn;
+  memcpy(&insn, rec, sizeof(insn));
+  size_t size = sizeof(insn) + (insn.vec ? sizeof(commit_log_vec_t) : 0);
+
+  for (unsigned i = 0; i < insn.nregs; i++) {
+    if (avail < size + sizeof(commit_log_reg_write_t))
+      return 0;
+    commit_log_reg_write_t reg;
+    memcpy(&reg, rec + size, sizeof(reg));
+    size += sizeof(reg) + reg.width / 8;
+  }
+
+  size += insn.nloads * sizeof(commit_log_load_t) +
+          insn.nstores * sizeof(commit_log_store_t);
+  return size <= avail ? size : 0;
+}
+
+static void print_value(FILE *log_file, int width, const void *data)
+{
+  switch (width) {
+    case 8:
+      fprintf(log_file, "0x%01" PRIx8, *(const uint8_t *)data);
+      break;
+    case 16:
+      fprintf(log_file, "0x%04" PRIx16, *(const uint16_t *)data);
+      break;
+    case 32:
+      fprintf(log_file, "0x%08" PRIx32, *(const uint32_t *)data);
+      break;
+    case 64:
+      fprintf(log_file, "0x%016" PRIx64, *(const uint64_t *)data);
+      break;
+    default:
+      // max lengh of vector
+      if (((width - 1) & width) == 0) {
+        const uint64_t *arr = (const uint64_t *)data;
+
+        fprintf(log_file, "0x");
+        for (int idx = width / 64 - 1; idx >= 0; --idx) {
+          fprintf(log_file, "%016" PRIx64, arr[idx]);
+        }
+      } else {
+        abort();
+      }
+      break;
+  }
+}
+
+static void print_value(FILE *log_file, int width, uint64_t val)
+{
+  print_value(log_file, width, &val);
+}
+
+void commit_log_print(FILE* log_file, const uint8_t* rec)
+{
+  commit_log_insn_t insn;
+  memcpy(&insn, rec, sizeof(insn));
+  rec += sizeof(insn);
+  int xlen = insn.xlen;
+
+  commit_log_vec_t vec;
+  if (insn.vec) {
+    memcpy(&vec, rec, sizeof(vec));
+    rec += sizeof(vec);
+  }
+
+  // print core id on all lines so it is easy to grep
+  fprintf(log_file, "core%4" PRId64 ": ", (int64_t)insn.hartid);
+
+  fprintf(log_file, "%1d ", insn.priv);
+  print_value(log_file, xlen, insn.pc);
+  fprintf(log_file, " (");
+  print_value(log_file, insn.length * 8, insn.bits);
+  fprintf(log_file, ")");
+  bool show_vec = false;
+
+  // Values wider than 64 bits are read as arrays of uint64_t
+  uint64_t value[4096 / 64];
+  for (unsigned i = 0; i < insn.nregs; i++) {
+    commit_log_reg_write_t reg;
+    memcpy(&reg, rec, sizeof(reg));
+    rec += sizeof(reg);
+    memset(value, 0, sizeof(value));
+    memcpy(value, rec, std::min<size_t>(reg.width / 8, sizeof(value)));
+    rec += reg.width / 8;
+
+    char prefix;
+    int rd = reg.key >> 4;
+    bool is_vec = false;
+    bool is_vreg = false;
+    switch (reg.key & 0xf) {
+    case 0:
+      prefix = 'x';
+      break;
+    case 1:
+      prefix = 'f';
+      break;
+    case 2:
+      prefix = 'v';
+      is_vreg = true;
+      break;
+    case 3:
+      is_vec = true;
+      break;
+    case 4:
+      prefix = 'c';
+      break;
+    default:
+      assert("can't been here" && 0);
+      break;
+    }
+
+    if (!show_vec && (is_vreg || is_vec)) {
+        fprintf(log_file, " e%ld %s%ld l%ld",
+                (long)vec.vsew,
+                vec.fractional ? "mf" : "m",
+                (long)vec.lmul,
+                (long)vec.vl);
+        show_vec = true;
+    }
+
+    if (!is_vec) {
+      if (prefix == 'c')
+        fprintf(log_file, " c%d_%s ", rd, csr_name(rd));
+      else
+        fprintf(log_file, " %c%2d ", prefix, rd);
+      print_value(log_file, reg.width, value);
+    }
+  }
+
+  for (unsigned i = 0; i < insn.nloads; i++) {
+    commit_log_load_t load;
+    memcpy(&load, rec, sizeof(load));
+    rec += sizeof(load);
+    fprintf(log_file, " mem ");
+    print_value(log_file, xlen, load.addr);
+  }
+
+  for (unsigned i = 0; i < insn.nstores; i++) {
+    commit_log_store_t store;
+    memcpy(&store, rec, sizeof(store));
+    rec += sizeof(store);
+    fprintf(log_file, " mem ");
+    print_value(log_file, xlen, store.addr);
+    fprintf(log_file, " ");
+    print_value(log_file, store.size << 3, store.value);
+  }
+  fprintf(log_file, "\n");
+}
+
+void commit_log_write_header(FILE* file)
+{
+  commit_log_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COMMIT_LOG_MAGIC, sizeof(header.magic));
+  header.version = COMMIT_LOG_VERSION;
+  fwrite(&header, sizeof(header), 1, file);
+}
+
+bool commit_log_reader_t::check_header(const commit_log_header_t& header)
+{
+  return memcmp(header.magic, COMMIT_LOG_MAGIC, sizeof(header.magic)) == 0 &&
+         header.version == COMMIT_LOG_VERSION;
+}
+
+const uint8_t* commit_log_reader_t::next()
+{
+  while (true) {
+    size_t size = commit_log_record_size(buf.data() + pos, buf.size() - pos);
+    if (size) {
+      pos += size;
+      return buf.data() + pos - size;
+    }
+
+    // Move the partial record to the front and read more behind it
+    buf.erase(buf.begin(), buf.begin() + pos);
+    pos = 0;
+    size_t have = buf.size();
+    buf.resize(have + READ_SIZE);
+    size_t got = fread(&buf[have], 1, READ_SIZE, file);
+    buf.resize(have + got);
+    if (got == 0) {
+      if (have)
+        throw std::runtime_error("commit log ends in the middle of a record");
+      return NULL;
+    }
+  }
+}
@@ -0,0 +1,107 @@
+// See LICENSE for license details.
+#ifndef _RISCV_COMMIT_LOG_H
+#define _RISCV_COMMIT_LOG_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+class processor_t;
+
+// Binary commit log
+//
+// The file starts with a commit_log_header_t. Every retired instruction then
+// adds a commit_log_insn_t, followed by
+//  - a commit_log_vec_t if the instruction wrote vector state,
+//  - nregs commit_log_reg_write_t, each followed by width / 8 bytes of value,
+//  - nloads commit_log_load_t,
+//  - nstores commit_log_store_t,
+// in this order. All fields are in host byte order. Records of different
+// harts can interleave at buffer boundaries, but a record is never split.
+
+#define COMMIT_LOG_MAGIC "SPIKECLG"
+#define COMMIT_LOG_VERSION 1
+
+struct commit_log_header_t
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct commit_log_insn_t
+{
+  uint64_t pc;
+  uint64_t bits;
+  uint32_t hartid;
+  uint8_t priv;
+  uint8_t xlen;
+  uint8_t length;
+  uint8_t vec;
+  uint16_t nregs;
+  uint16_t nloads;
+  uint16_t nstores;
+  uint16_t reserved;
+};
+
+struct commit_log_vec_t
+{
+  uint64_t vsew;
+  uint64_t vl;
+  uint32_t lmul;
+  uint32_t fractional;
+};
+
+struct commit_log_reg_write_t
+{
+  uint32_t key;      // as in state_t::log_reg_write
+  uint32_t width;    // in bits; the value follows the record
+};
+
+struct commit_log_load_t
+{
+  uint64_t addr;
+};
+
+struct commit_log_store_t
+{
+  uint64_t addr;
+  uint64_t value;
+  uint64_t size;
+};
+
+// Appends the record of the instruction the hart just retired to buf
+void commit_log_serialize(processor_t* p, uint64_t pc, uint64_t bits,
+                          unsigned length, std::vector<uint8_t>& buf);
+
+// Returns the size of the record at rec, or 0 if it does not fit in avail
+size_t commit_log_record_size(const uint8_t* rec, size_t avail);
+
+// Prints a record in the text format of --log-commits
+void commit_log_print(FILE* out, const uint8_t* rec);
+
+// Writes the commit_log_header_t that starts a binary commit log
+void commit_log_write_header(FILE* file);
+
+// Reads the records of a binary commit log
+class commit_log_reader_t
+{
+public:
+  // The header must have been read and checked already
+  commit_log_reader_t(FILE* file) : file(file), pos(0) {}
+
+  static bool check_header(const commit_log_header_t& header);
+
+  // Returns the next record, or NULL at the end of the file. Throws
+  // std::runtime_error if the file ends in the middle of a record.
+  const uint8_t* next();
+
+private:
+  static const size_t READ_SIZE = 1 << 20;
+  FILE* file;
+  std::vector<uint8_t> buf;
+  size_t pos;
+};
+
+#endif
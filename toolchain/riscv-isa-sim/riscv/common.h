@@ -7,5 +7,6 @@
 #define unlikely(x) __builtin_expect(x, 0)
 
 #define NOINLINE __attribute__ ((noinline))
+#define ALWAYS_INLINE __attribute__ ((always_inline))
 
 #endif
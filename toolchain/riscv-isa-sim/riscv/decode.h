@@ -134,6 +134,9 @@ public:
   uint64_t p_rs3() { return x(7, 5); }
   uint64_t p_zimm6() { return x(25,1) + (x(20, 5) << 1); }
   int64_t p_simm6() { return x(25,1) + (xs(20, 5) << 1); }
+  uint64_t p_loop() { return x(7, 1); }
+  uint64_t p_uimm12() { return x(20, 12); }
+  uint64_t p_uimm5() { return x(15, 5); }
 
 
 private:
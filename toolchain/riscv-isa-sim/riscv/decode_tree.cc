@@ -0,0 +1,65 @@
+// See LICENSE for license details.
+
+#include "decode_tree.h"
+#include "processor.h"
+#include <stdexcept>
+
+void decode_tree_t::build(const std::vector<insn_desc_t>& insns)
+{
+  nodes.clear();
+  leaves.clear();
+  fallback = insns.size();
+
+  std::vector<size_t> candidates;
+  for (size_t i = 0; i < insns.size(); i++) {
+    if (insns[i].mask != 0)
+      candidates.push_back(i);
+    else if (fallback == insns.size())
+      fallback = i;
+  }
+  if (fallback == insns.size())
+    throw std::logic_error("no instruction to decode illegal encodings to");
+
+  nodes.push_back(node_t());
+  build_node(0, insns, candidates, 0);
+}
+
+void decode_tree_t::build_node(size_t node, const std::vector<insn_desc_t>& insns,
+                               const std::vector<size_t>& candidates,
+                               insn_bits_t decided)
+{
+  insn_bits_t common = ~decided;
+  for (size_t i : candidates)
+    common &= insns[i].mask;
+
+  if (candidates.size() <= 1 || common == 0) {
+    nodes[node] = {0, 0, uint32_t(leaves.size()), uint32_t(candidates.size())};
+    for (size_t i : candidates)
+      leaves.push_back({insns[i].match, insns[i].mask, i});
+    return;
+  }
+
+  // Index the children with the longest run of bits all candidates fix
+  unsigned shift = 0, width = 0;
+  for (unsigned lo = 0; lo < 64; lo++) {
+    unsigned len = 0;
+    while (lo + len < 64 && ((common >> (lo + len)) & 1))
+      len++;
+    if (len > width)
+      shift = lo, width = len;
+    lo += len;
+  }
+  if (width > MAX_WIDTH)
+    width = MAX_WIDTH;
+  insn_bits_t field = ((insn_bits_t(1) << width) - 1) << shift;
+
+  size_t first = nodes.size();
+  nodes[node] = {uint8_t(shift), uint8_t(width), uint32_t(first), 0};
+  nodes.resize(first + (size_t(1) << width));
+
+  std::vector<std::vector<size_t>> children(size_t(1) << width);
+  for (size_t i : candidates)
+    children[(insns[i].match & field) >> shift].push_back(i);
+  for (size_t i = 0; i < children.size(); i++)
+    build_node(first + i, insns, children[i], decided | field);
+}
@@ -0,0 +1,61 @@
+// See LICENSE for license details.
+#ifndef _RISCV_DECODE_TREE_H
+#define _RISCV_DECODE_TREE_H
+
+#include "decode.h"
+#include <vector>
+
+struct insn_desc_t;
+
+// Decodes an instruction in a few table lookups, however many instructions
+// are registered. Each inner node indexes its children with a field of the
+// instruction that every encoding below it fixes (the major opcode, funct3,
+// funct7, ...). Leaves hold the few encodings the fields could not tell
+// apart, such as hints inside another instruction, in priority order.
+class decode_tree_t
+{
+public:
+  // Returns the index of the first instruction of insns that matches the
+  // bits given to lookup(). Instructions with an empty mask match anything
+  // and are returned when no other one matches.
+  void build(const std::vector<insn_desc_t>& insns);
+
+  size_t lookup(insn_bits_t bits) const
+  {
+    const node_t* n = &nodes[0];
+    while (n->width)
+      n = &nodes[n->first + ((bits >> n->shift) & ((1 << n->width) - 1))];
+    const leaf_t* l = leaves.data() + n->first;
+    for (const leaf_t* end = l + n->count; l < end; l++)
+      if ((bits & l->mask) == l->match)
+        return l->index;
+    return fallback;
+  }
+
+private:
+  static const unsigned MAX_WIDTH = 8;
+
+  struct node_t
+  {
+    uint8_t shift;
+    uint8_t width;  // 0 for leaves
+    uint32_t first; // of the children in nodes, or of the entries in leaves
+    uint32_t count;
+  };
+
+  struct leaf_t
+  {
+    insn_bits_t match;
+    insn_bits_t mask;
+    size_t index;
+  };
+
+  std::vector<node_t> nodes;
+  std::vector<leaf_t> leaves;
+  size_t fallback;
+
+  void build_node(size_t node, const std::vector<insn_desc_t>& insns,
+                  const std::vector<size_t>& candidates, insn_bits_t decided);
+};
+
+#endif
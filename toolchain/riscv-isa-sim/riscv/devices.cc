@@ -1,4 +1,56 @@
 #include "devices.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const int MEM_FLAGS = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+mem_t::mem_t(size_t size) : len(size)
+{
+  if (!size)
+    throw std::runtime_error("zero bytes of target memory requested");
+  void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MEM_FLAGS, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("couldn't allocate " + std::to_string(size) + " bytes of target memory");
+  data = (char*)p;
+}
+
+mem_t::~mem_t()
+{
+  munmap(data, len);
+}
+
+bool mem_t::map_file(reg_t addr, size_t len, int fd, off_t file_offset)
+{
+  reg_t page = sysconf(_SC_PAGESIZE);
+  if ((addr | len | file_offset) & (page - 1))
+    return false;
+  if (addr > this->len || len > this->len - addr)
+    return false;
+
+  void* p = mmap(data + addr, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, fd, file_offset);
+  return p != MAP_FAILED;
+}
+
+void mem_t::zero(reg_t addr, size_t len)
+{
+  if (addr > this->len || len > this->len - addr)
+    throw std::out_of_range("zeroing past the end of target memory");
+
+  // Replace the whole pages with fresh ones, which also drops mapped files
+  reg_t page = sysconf(_SC_PAGESIZE);
+  reg_t begin = (addr + page - 1) & -page;
+  reg_t end = (addr + len) & -page;
+  if (begin < end &&
+      mmap(data + begin, end - begin, PROT_READ | PROT_WRITE,
+           MEM_FLAGS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+    memset(data + addr, 0, begin - addr);
+    memset(data + end, 0, addr + len - end);
+  } else {
+    memset(data + addr, 0, len);
+  }
+}
 
 void bus_t::add_device(reg_t addr, abstract_device_t* dev)
 {
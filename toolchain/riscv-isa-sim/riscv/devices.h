@@ -8,8 +8,10 @@
 #include <map>
 #include <vector>
 #include <stdexcept>
+#include <sys/types.h>
 
 class processor_t;
+class checkpoint_t;
 
 class abstract_device_t {
  public:
@@ -42,21 +44,25 @@ class rom_device_t : public abstract_device_t {
 
 class mem_t : public abstract_device_t {
  public:
-  mem_t(size_t size) : len(size) {
-    if (!size)
-      throw std::runtime_error("zero bytes of target memory requested");
-    data = (char*)calloc(1, size);
-    if (!data)
-      throw std::runtime_error("couldn't allocate " + std::to_string(size) + " bytes of target memory");
-  }
+  // The memory is reserved but not committed, so that only the pages the
+  // simulation touches take host memory
+  mem_t(size_t size);
   mem_t(const mem_t& that) = delete;
-  ~mem_t() { free(data); }
+  ~mem_t();
 
   bool load(reg_t addr, size_t len, uint8_t* bytes) { return false; }
   bool store(reg_t addr, size_t len, const uint8_t* bytes) { return false; }
   char* contents() { return data; }
   size_t size() { return len; }
 
+  // Maps len bytes of the file fd at file_offset to addr copy-on-write.
+  // Fails unless addr, len and file_offset are multiples of the host page
+  // size. Until the pages are written, they follow changes to the file, and
+  // reading them past the end of a truncated file raises SIGBUS.
+  bool map_file(reg_t addr, size_t len, int fd, off_t file_offset);
+  // Zeroes len bytes at addr, releasing the host pages they cover
+  void zero(reg_t addr, size_t len);
+
  private:
   char* data;
   size_t len;
@@ -69,6 +75,7 @@ class clint_t : public abstract_device_t {
   bool store(reg_t addr, size_t len, const uint8_t* bytes);
   size_t size() { return CLINT_SIZE; }
   void increment(reg_t inc);
+  void checkpoint(checkpoint_t& c);
  private:
   typedef uint64_t mtime_t;
   typedef uint64_t mtimecmp_t;
@@ -82,6 +89,62 @@ class clint_t : public abstract_device_t {
   std::vector<mtimecmp_t> mtimecmp;
 };
 
+// MemPool memory map (software/runtime/arch.ld.c)
+#define MEMPOOL_CTRL_BASE  0x40000000
+#define MEMPOOL_UART_BASE  0xC0000000
+#define MEMPOOL_TCDM_BASE  0x00000000
+#define MEMPOOL_BANK_SIZE  0x400
+#define MEMPOOL_BOOT_ADDR  0xA0000000
+
+// Control registers of the MemPool cluster (hardware/src/ctrl_registers.sv)
+class mempool_ctrl_t : public abstract_device_t {
+ public:
+  mempool_ctrl_t(std::vector<processor_t*>& procs, size_t num_groups,
+                 size_t num_cores_per_tile, reg_t tcdm_base, reg_t tcdm_size);
+  bool load(reg_t addr, size_t len, uint8_t* bytes);
+  bool store(reg_t addr, size_t len, const uint8_t* bytes);
+  size_t size() { return sizeof(regs); }
+
+  bool eoc_valid() { return regs[EOC] & 1; }
+  uint32_t eoc() { return regs[EOC] >> 1; }
+
+  static const size_t NUM_RO_CACHE_REGIONS = 4;
+  bool ro_cache_enabled() { return regs[RO_CACHE_ENABLE] & 1; }
+  bool ro_cache_cacheable(reg_t addr);
+  // Number of times the program flushed the read-only caches
+  uint64_t ro_cache_flushes() { return flushes; }
+
+  void checkpoint(checkpoint_t& c);
+
+ private:
+  enum {
+    EOC, WAKE_UP, WAKE_UP_GROUP,
+    TCDM_START_ADDRESS, TCDM_END_ADDRESS, NR_CORES,
+    RO_CACHE_ENABLE, RO_CACHE_FLUSH, RO_CACHE_START_0,
+    WAKE_UP_TILE_G0 = RO_CACHE_START_0 + 2 * NUM_RO_CACHE_REGIONS,
+    MAX_NUM_GROUPS = 8,
+    NUM_REGS = WAKE_UP_TILE_G0 + MAX_NUM_GROUPS
+  };
+
+  std::vector<processor_t*>& procs;
+  size_t num_groups;
+  size_t num_cores_per_group;
+  size_t num_cores_per_tile;
+  uint32_t regs[NUM_REGS];
+  uint64_t flushes;
+
+  void wake_up(size_t first, size_t count);
+  void wake_up_write(size_t reg);
+};
+
+// Character sink of the MemPool runtime's _putchar (fake_uart)
+class mempool_uart_t : public abstract_device_t {
+ public:
+  bool load(reg_t addr, size_t len, uint8_t* bytes);
+  bool store(reg_t addr, size_t len, const uint8_t* bytes);
+  size_t size() { return 4; }
+};
+
 class mmio_plugin_device_t : public abstract_device_t {
  public:
   mmio_plugin_device_t(const std::string& name, const std::string& args);
@@ -4,6 +4,8 @@
 #define _RISCV_DISASM_H
 
 #include "decode.h"
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -95,8 +97,20 @@ class disassembler_t
   void add_insn(disasm_insn_t* insn);
 
  private:
-  static const int HASH_SIZE = 256;
-  std::vector<const disasm_insn_t*> chain[HASH_SIZE+1];
+  // Instructions in the order they were added
+  std::vector<const disasm_insn_t*> insns;
+
+  // Decision table over the major opcode and funct3 (quadrant and funct3 in
+  // bits 15:13 for compressed instructions), refined by funct7 (bits 31:25),
+  // or by bits 12:10 of compressed instructions, where that narrows the
+  // candidates down. Cells are offsets into the NULL-terminated candidate
+  // lists, or into decode_cells for refined ones. It is built on the first
+  // lookup after an instruction was added.
+  void build_decode_table() const;
+  mutable std::vector<uint32_t> decode_cells;
+  mutable std::vector<const disasm_insn_t*> decode_lists;
+  mutable std::atomic<bool> decode_ready{false};
+  mutable std::mutex decode_lock;
 };
 
 #endif
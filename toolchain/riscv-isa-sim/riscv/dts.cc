@@ -4,6 +4,8 @@
 #include "libfdt.h"
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
+#include <string>
 #include <signal.h>
 #include <unistd.h>
 #include <sys/wait.h>
@@ -106,8 +108,8 @@ std::string dts_compile(const std::string& dts)
 
   fflush(NULL); // flush stdout/stderr before forking
   if (pipe(dts_pipe) != 0 || (dts_pid = fork()) < 0) {
-    std::cerr << "Failed to fork dts child: " << strerror(errno) << std::endl;
-    exit(1);
+    throw std::runtime_error(std::string("Failed to fork dts child: ") +
+                             strerror(errno));
   }
 
   // Child process to output dts
@@ -119,18 +121,18 @@ std::string dts_compile(const std::string& dts)
       step = write(dts_pipe[1], buf+done, len-done);
       if (step == -1) {
         std::cerr << "Failed to write dts: " << strerror(errno) << std::endl;
-        exit(1);
+        _exit(1);
       }
     }
     close(dts_pipe[1]);
-    exit(0);
+    _exit(0);
   }
 
   pid_t dtb_pid;
   int dtb_pipe[2];
   if (pipe(dtb_pipe) != 0 || (dtb_pid = fork()) < 0) {
-    std::cerr << "Failed to fork dtb child: " << strerror(errno) << std::endl;
-    exit(1);
+    throw std::runtime_error(std::string("Failed to fork dtb child: ") +
+                             strerror(errno));
   }
 
   // Child process to output dtb
@@ -143,7 +145,7 @@ std::string dts_compile(const std::string& dts)
     close(dtb_pipe[1]);
     execlp(DTC, DTC, "-O", "dtb", 0);
     std::cerr << "Failed to run " DTC ": " << strerror(errno) << std::endl;
-    exit(1);
+    _exit(1);
   }
 
   close(dts_pipe[1]);
@@ -159,8 +161,8 @@ std::string dts_compile(const std::string& dts)
     dtb.write(buf, got);
   }
   if (got == -1) {
-    std::cerr << "Failed to read dtb: " << strerror(errno) << std::endl;
-    exit(1);
+    throw std::runtime_error(std::string("Failed to read dtb: ") +
+                             strerror(errno));
   }
   close(dtb_pipe[0]);
 
@@ -168,13 +170,11 @@ std::string dts_compile(const std::string& dts)
   int status;
   waitpid(dts_pid, &status, 0);
   if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-    std::cerr << "Child dts process failed" << std::endl;
-    exit(1);
+    throw std::runtime_error("Child dts process failed");
   }
   waitpid(dtb_pid, &status, 0);
   if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-    std::cerr << "Child dtb process failed" << std::endl;
-    exit(1);
+    throw std::runtime_error("Child dtb process failed");
   }
 
   return dtb.str();
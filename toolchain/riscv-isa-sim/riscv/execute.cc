@@ -3,7 +3,10 @@
 #include "processor.h"
 #include "mmu.h"
 #include "disasm.h"
+#include "func_profiler.h"
+#include "bbv.h"
 #include <cassert>
+#include <algorithm>
 
 #ifdef RISCV_ENABLE_COMMITLOG
 static void commit_log_reset(processor_t* p)
@@ -21,144 +24,39 @@ static void commit_log_stash_privilege(processor_t* p)
   state->last_inst_flen = p->get_flen();
 }
 
-static void commit_log_print_value(FILE *log_file, int width, const void *data)
-{
-  assert(log_file);
-
-  switch (width) {
-    case 8:
-      fprintf(log_file, "0x%01" PRIx8, *(const uint8_t *)data);
-      break;
-    case 16:
-      fprintf(log_file, "0x%04" PRIx16, *(const uint16_t *)data);
-      break;
-    case 32:
-      fprintf(log_file, "0x%08" PRIx32, *(const uint32_t *)data);
-      break;
-    case 64:
-      fprintf(log_file, "0x%016" PRIx64, *(const uint64_t *)data);
-      break;
-    default:
-      // max lengh of vector
-      if (((width - 1) & width) == 0) {
-        const uint64_t *arr = (const uint64_t *)data;
-
-        fprintf(log_file, "0x");
-        for (int idx = width / 64 - 1; idx >= 0; --idx) {
-          fprintf(log_file, "%016" PRIx64, arr[idx]);
-        }
-      } else {
-        abort();
-      }
-      break;
-  }
-}
-
-static void commit_log_print_value(FILE *log_file, int width, uint64_t val)
-{
-  commit_log_print_value(log_file, width, &val);
-}
-
 const char* processor_t::get_symbol(uint64_t addr)
 {
   return sim->get_symbol(addr);
 }
 
-static void commit_log_print_insn(processor_t *p, reg_t pc, insn_t insn)
+static void commit_log_stash_operands(processor_t* p, insn_t insn)
 {
-  FILE *log_file = p->get_log_file();
-
-  auto& reg = p->get_state()->log_reg_write;
-  auto& load = p->get_state()->log_mem_read;
-  auto& store = p->get_state()->log_mem_write;
-  int priv = p->get_state()->last_inst_priv;
-  int xlen = p->get_state()->last_inst_xlen;
-  int flen = p->get_state()->last_inst_flen;
-
-  // print core id on all lines so it is easy to grep
-  uint64_t id = p->get_csr(CSR_MHARTID);
-  fprintf(log_file, "core%4" PRId64 ": ", id);
-
-  fprintf(log_file, "%1d ", priv);
-  commit_log_print_value(log_file, xlen, pc);
-  fprintf(log_file, " (");
-  commit_log_print_value(log_file, insn.length() * 8, insn.bits());
-  fprintf(log_file, ")");
-  bool show_vec = false;
-
-  for (auto item : reg) {
-    if (item.first == 0)
-      continue;
-
-    char prefix;
-    int size;
-    int rd = item.first >> 4;
-    bool is_vec = false;
-    bool is_vreg = false;
-    switch (item.first & 0xf) {
-    case 0:
-      size = xlen;
-      prefix = 'x';
-      break;
-    case 1:
-      size = flen;
-      prefix = 'f';
-      break;
-    case 2:
-      size = p->VU.VLEN;
-      prefix = 'v';
-      is_vreg = true;
-      break;
-    case 3:
-      is_vec = true;
-      break;
-    case 4:
-      size = xlen;
-      prefix = 'c';
-      break;
-    default:
-      assert("can't been here" && 0);
-      break;
-    }
-
-    if (!show_vec && (is_vreg || is_vec)) {
-        fprintf(log_file, " e%ld %s%ld l%ld",
-                p->VU.vsew,
-                p->VU.vflmul < 1 ? "mf" : "m",
-                p->VU.vflmul < 1 ? (reg_t)(1 / p->VU.vflmul) : (reg_t)p->VU.vflmul,
-                p->VU.vl);
-        show_vec = true;
-    }
+  if (!p->get_dasm_trace_enabled())
+    return;
 
-    if (!is_vec) {
-      if (prefix == 'c')
-        fprintf(log_file, " c%d_%s ", rd, csr_name(rd));
-      else
-        fprintf(log_file, " %c%2d ", prefix, rd);
-      if (is_vreg)
-        commit_log_print_value(log_file, size, &p->VU.elt<uint8_t>(rd, 0));
-      else
-        commit_log_print_value(log_file, size, item.second.v);
-    }
-  }
-
-  for (auto item : load) {
-    fprintf(log_file, " mem ");
-    commit_log_print_value(log_file, xlen, std::get<0>(item));
-  }
+  state_t* state = p->get_state();
+  state->last_inst_opa = state->XPR[insn.rs1()];
+  state->last_inst_opb = state->XPR[insn.rs2()];
+}
 
-  for (auto item : store) {
-    fprintf(log_file, " mem ");
-    commit_log_print_value(log_file, xlen, std::get<0>(item));
-    fprintf(log_file, " ");
-    commit_log_print_value(log_file, std::get<2>(item) << 3, std::get<1>(item));
-  }
-  fprintf(log_file, "\n");
+static void commit_log_print_insn(processor_t *p, reg_t pc, reg_t npc,
+                                  insn_t insn, unsigned dest)
+{
+  state_t* state = p->get_state();
+  hart_trace_t* trace = p->get_trace();
+  std::vector<uint8_t>& buf = trace->begin_record(TRACE_COMMIT, dest);
+  trace_commit_t commit;
+  commit.npc = invalid_pc(npc) ? state->pc : npc;
+  commit.opa = state->last_inst_opa;
+  commit.opb = state->last_inst_opb;
+  buf.insert(buf.end(), (uint8_t*)&commit, (uint8_t*)(&commit + 1));
+  commit_log_serialize(p, pc, insn.bits(), insn.length(), buf);
+  trace->end_record();
 }
 #else
 static void commit_log_reset(processor_t* p) {}
 static void commit_log_stash_privilege(processor_t* p) {}
-static void commit_log_print_insn(processor_t* p, reg_t pc, insn_t insn) {}
+static void commit_log_stash_operands(processor_t* p, insn_t insn) {}
 #endif
 
 inline void processor_t::update_histogram(reg_t pc)
@@ -168,22 +66,27 @@ inline void processor_t::update_histogram(reg_t pc)
 #endif
 }
 
-// This is expected to be inlined by the compiler so each use of execute_insn
-// includes a duplicated body of the function to get separate fetch.func
-// function calls.
-static reg_t execute_insn(processor_t* p, reg_t pc, insn_fetch_t fetch)
+// This is inlined so each use of execute_insn includes a duplicated body of
+// the function to get separate fetch.func function calls. GCC does not inline
+// it by itself at a thousand call sites, which leaves a single indirect call
+// for every instruction.
+static inline ALWAYS_INLINE reg_t execute_insn(processor_t* p, reg_t pc,
+                                               insn_fetch_t fetch)
 {
   commit_log_reset(p);
   commit_log_stash_privilege(p);
+  commit_log_stash_operands(p, fetch.insn);
   reg_t npc;
 
   try {
     npc = fetch.func(p, fetch.insn, pc);
+    if (unlikely(p->hwloops_active()) && npc == pc + fetch.insn.length())
+      npc = p->hwloop_next(npc);
     if (npc != PC_SERIALIZE_BEFORE) {
 
 #ifdef RISCV_ENABLE_COMMITLOG
-      if (p->get_log_commits_enabled()) {
-        commit_log_print_insn(p, pc, fetch.insn);
+      if (unsigned dest = p->get_commit_log_dest()) {
+        commit_log_print_insn(p, pc, npc, fetch.insn, dest);
       }
 #endif
 
@@ -191,10 +94,10 @@ static reg_t execute_insn(processor_t* p, reg_t pc, insn_fetch_t fetch)
 #ifdef RISCV_ENABLE_COMMITLOG
   } catch(mem_trap_t& t) {
       //handle segfault in midlle of vector load/store
-      if (p->get_log_commits_enabled()) {
+      if (unsigned dest = p->get_commit_log_dest()) {
         for (auto item : p->get_state()->log_reg_write) {
           if ((item.first & 3) == 3) {
-            commit_log_print_insn(p, pc, fetch.insn);
+            commit_log_print_insn(p, pc, pc, fetch.insn, dest);
             break;
           }
         }
@@ -211,11 +114,12 @@ static reg_t execute_insn(processor_t* p, reg_t pc, insn_fetch_t fetch)
 
 bool processor_t::slow_path()
 {
-  return debug || state.single_step != state.STEP_NONE || state.debug_mode;
+  return debug || state.single_step != state.STEP_NONE || state.debug_mode ||
+         profiler || bbv;
 }
 
 // fetch/decode/execute loop
-void processor_t::step(size_t n)
+size_t processor_t::step(size_t n)
 {
   if (!state.debug_mode) {
     if (halt_request == HR_REGULAR) {
@@ -228,6 +132,13 @@ void processor_t::step(size_t n)
     }
   }
 
+  if (unlikely(wfi_parked)) {
+    if (!state.debug_mode && !(state.mip & state.mie))
+      return 0;
+    wfi_parked = false;
+  }
+
+  size_t retired = 0;
   while (n > 0) {
     size_t instret = 0;
     reg_t pc = state.pc;
@@ -272,7 +183,49 @@ void processor_t::step(size_t n)
           insn_fetch_t fetch = mmu->load_insn(pc);
           if (debug && !state.serialized)
             disasm(fetch.insn);
+          reg_t insn_pc = pc;
           pc = execute_insn(this, pc, fetch);
+          if ((profiler || bbv) && pc != PC_SERIALIZE_BEFORE) {
+            // A serializing instruction, such as an xRET, left its next pc
+            // in the state
+            reg_t npc = invalid_pc(pc) ? state.pc : pc;
+            if (profiler)
+              profiler->retire(insn_pc, fetch.insn, npc);
+            if (bbv)
+              bbv->retire(insn_pc, fetch.insn, npc);
+          }
+          advance_pc();
+        }
+      }
+      else if (likely(_mmu->block_cache_usable())) while (instret < n)
+      {
+        // Execute whole basic blocks from the block cache. A block is left
+        // early when an instruction does not fall through to the next one,
+        // e.g. a taken branch or a PC serialization sentinel.
+        insn_block_t* block = _mmu->access_block(pc);
+        size_t count = std::min(block->size, n - instret);
+        insn_fetch_t* fetch = block->insns;
+        bool fell_through = true;
+
+        // Each slot of a block has its own call site, which helps the host's
+        // indirect branch predictor like the Duff's device below.
+        #define BLOCK_ACCESS(i) \
+          if (i < count) { \
+            reg_t fallthrough = pc + fetch[i].insn.length(); \
+            pc = execute_insn(this, pc, fetch[i]); \
+            if (unlikely(pc != fallthrough)) { fell_through = false; break; } \
+            state.pc = pc; \
+            instret++; \
+          }
+
+        do {
+          BLOCK_ACCESS(0) BLOCK_ACCESS(1) BLOCK_ACCESS(2) BLOCK_ACCESS(3)
+          BLOCK_ACCESS(4) BLOCK_ACCESS(5) BLOCK_ACCESS(6) BLOCK_ACCESS(7)
+          BLOCK_ACCESS(8) BLOCK_ACCESS(9) BLOCK_ACCESS(10) BLOCK_ACCESS(11)
+          BLOCK_ACCESS(12) BLOCK_ACCESS(13) BLOCK_ACCESS(14) BLOCK_ACCESS(15)
+        } while (0);
+
+        if (!fell_through) {
           advance_pc();
         }
       }
@@ -373,9 +326,26 @@ void processor_t::step(size_t n)
       // allows us to switch to other threads only once per idle loop in case
       // there is activity.
       n = instret;
+      if (profiler)
+        profiler->wait(pc);
+
+      if (wfi_sleeps) {
+        if (wake_ups > 0)
+          wake_ups--;
+        else
+          wfi_parked = true;
+      }
+    }
+    catch (shared_access_deferred_t &t)
+    {
+      // The instruction at pc accesses state shared with other harts, which
+      // the simulator performs later in hart order. Stop in front of it.
+      n = instret;
     }
 
     state.minstret += instret;
+    retired += instret;
     n -= instret;
   }
+  return retired;
 }
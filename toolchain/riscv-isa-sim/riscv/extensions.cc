@@ -3,6 +3,7 @@
 #include "extension.h"
 #include <string>
 #include <map>
+#include <stdexcept>
 #include <dlfcn.h>
 
 static std::map<std::string, std::function<extension_t*()>>& extensions()
@@ -27,18 +28,17 @@ std::function<extension_t*()> find_extension(const char* name)
     if (!dlh) {
       dlh = dlopen(libdefault.c_str(), RTLD_LAZY);
       if (!dlh) {
-        fprintf(stderr, "couldn't find shared library either '%s' or '%s')\n",
-                libname.c_str(), libdefault.c_str());
-        exit(-1);
+        throw std::invalid_argument("couldn't find shared library either '" +
+                                    libname + "' or '" + libdefault + "'");
       }
 
       is_default = true;
     }
 
     if (!extensions().count(name)) {
-      fprintf(stderr, "couldn't find extension '%s' in shared library '%s'\n",
-              name, is_default ? libdefault.c_str() : libname.c_str());
-      exit(-1);
+      throw std::invalid_argument(std::string("couldn't find extension '") +
+                                  name + "' in shared library '" +
+                                  (is_default ? libdefault : libname) + "'");
     }
   }
 
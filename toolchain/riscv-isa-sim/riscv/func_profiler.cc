@@ -0,0 +1,183 @@
+// See LICENSE for license details.
+
+#include "func_profiler.h"
+#include "processor.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+static const char* counter_names[hart_profiler_t::NUM_COUNTERS] = {
+  "insns", "loads", "stores", "amos", "wfis"
+};
+
+static bool is_link(unsigned reg)
+{
+  return reg == 1 || reg == 5;
+}
+
+hart_profiler_t::hart_profiler_t(const func_profiler_t& profiler, processor_t* proc)
+  : profiler(profiler), pc_mask(proc->get_max_xlen() == 32 ? 0xffffffff : -1),
+    rv32(proc->get_max_xlen() == 32), lo(0), hi(0), context(0)
+{
+  std::fill(major_kinds, major_kinds + 32, uint8_t(NONE));
+  major_kinds[0x03 >> 2] = LOADS;   // LOAD
+  major_kinds[0x07 >> 2] = LOADS;   // LOAD-FP, vector loads
+  major_kinds[0x0b >> 2] = LOADS;   // Xpulpimg post-increment loads
+  major_kinds[0x23 >> 2] = STORES;  // STORE
+  major_kinds[0x27 >> 2] = STORES;  // STORE-FP, vector stores
+  major_kinds[0x2b >> 2] = STORES;  // Xpulpimg post-increment stores
+  major_kinds[0x2f >> 2] = AMOS;    // AMO, lr, sc
+  major_kinds[0x6f >> 2] = JAL;
+  major_kinds[0x67 >> 2] = JALR;
+  major_kinds[0x73 >> 2] = SYSTEM;  // mret, sret, CSR accesses
+
+  contexts.push_back({0, UINT32_MAX});
+  counts.resize(NUM_COUNTERS);
+}
+
+unsigned hart_profiler_t::compressed_kind(insn_bits_t bits) const
+{
+  unsigned funct3 = (bits >> 13) & 7;
+  switch (bits & 3) {
+    case 0:
+      if (funct3 == 0 || funct3 == 4)
+        return NONE;
+      return funct3 < 4 ? LOADS : STORES;
+    case 1:
+      return funct3 == 1 && rv32 ? COMPRESSED_JAL : NONE;
+    default:
+      if (funct3 == 0)
+        return NONE;
+      if (funct3 != 4)
+        return funct3 < 4 ? LOADS : STORES;
+      // c.jr and c.jalr have rs1 != 0 and rs2 == 0
+      return ((bits >> 2) & 0x1f) == 0 && ((bits >> 7) & 0x1f) != 0 ?
+             COMPRESSED_JR : NONE;
+  }
+}
+
+uint32_t hart_profiler_t::child(uint32_t parent, uint32_t func)
+{
+  uint64_t key = uint64_t(parent) << 32 | func;
+  auto it = children.find(key);
+  if (it != children.end())
+    return it->second;
+
+  uint32_t id = contexts.size();
+  contexts.push_back({parent, func});
+  counts.resize(contexts.size() * NUM_COUNTERS);
+  children[key] = id;
+  return id;
+}
+
+void hart_profiler_t::jump(reg_t pc)
+{
+  uint32_t func = profiler.lookup(pc, &lo, &hi);
+  if (func != contexts[context].func)
+    context = child(contexts[context].parent, func);
+}
+
+void hart_profiler_t::transfer(unsigned kind, insn_t insn, reg_t npc)
+{
+  bool call = false, ret = false;
+  switch (kind) {
+    case JAL:
+      call = is_link(insn.rd());
+      break;
+    case JALR:
+      call = is_link(insn.rd());
+      ret = insn.rd() == 0 && is_link(insn.rs1());
+      break;
+    case COMPRESSED_JR:
+      call = (insn.bits() >> 12) & 1;
+      ret = !call && is_link(insn.rvc_rs1());
+      break;
+    case COMPRESSED_JAL:
+      call = true;
+      break;
+    case SYSTEM:
+      ret = insn.bits() == MATCH_MRET || insn.bits() == MATCH_SRET;
+      break;
+  }
+
+  if (call && stack.size() < MAX_DEPTH) {
+    stack.push_back(context);
+    context = child(context, profiler.lookup(npc, &lo, &hi));
+  } else if (ret && !stack.empty()) {
+    // The range is looked up again at the next instruction
+    context = stack.back();
+    stack.pop_back();
+    lo = hi = 0;
+  }
+}
+
+void hart_profiler_t::trap(reg_t handler)
+{
+  if (stack.size() < MAX_DEPTH) {
+    stack.push_back(context);
+    context = child(context, profiler.lookup(handler & pc_mask, &lo, &hi));
+  }
+}
+
+func_profiler_t::func_profiler_t(const std::vector<processor_t*>& procs)
+  : starts(1, 0), names(1, "[unknown]")
+{
+  for (auto p : procs)
+    harts.emplace_back(new hart_profiler_t(*this, p));
+}
+
+void func_profiler_t::set_symbols(const std::map<uint64_t, std::string>& symbols)
+{
+  starts.assign(1, 0);
+  names.assign(1, "[unknown]");
+  for (auto& s : symbols) {
+    if (s.second.empty())
+      continue;
+    if (s.first == 0) {
+      names[0] = s.second;
+    } else {
+      starts.push_back(s.first);
+      names.push_back(s.second);
+    }
+  }
+}
+
+uint32_t func_profiler_t::lookup(reg_t pc, reg_t* lo, reg_t* hi) const
+{
+  size_t i = std::upper_bound(starts.begin(), starts.end(), pc) - starts.begin() - 1;
+  *lo = starts[i];
+  *hi = i + 1 < starts.size() ? starts[i + 1] : reg_t(-1);
+  return i;
+}
+
+void func_profiler_t::write(const std::string& prefix) const
+{
+  for (size_t c = 0; c < hart_profiler_t::NUM_COUNTERS; c++) {
+    std::string path = prefix + "." + counter_names[c] + ".folded";
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out)
+      throw std::runtime_error("can't open `" + path + "': " + strerror(errno));
+
+    for (size_t h = 0; h < harts.size(); h++) {
+      const hart_profiler_t& hart = *harts[h];
+      for (size_t x = 1; x < hart.contexts.size(); x++) {
+        uint64_t n = hart.counts[x * hart_profiler_t::NUM_COUNTERS + c];
+        if (n == 0)
+          continue;
+
+        std::vector<uint32_t> frames;
+        for (uint32_t y = x; y != 0; y = hart.contexts[y].parent)
+          frames.push_back(hart.contexts[y].func);
+
+        fprintf(out, "hart%zu", h);
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+          fprintf(out, ";%s", names[*it].c_str());
+        fprintf(out, " %" PRIu64 "\n", n);
+      }
+    }
+    fclose(out);
+  }
+}
@@ -0,0 +1,124 @@
+// See LICENSE for license details.
+#ifndef _RISCV_FUNC_PROFILER_H
+#define _RISCV_FUNC_PROFILER_H
+
+#include "decode.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class processor_t;
+class func_profiler_t;
+
+// Profile of one hart. The hart keeps a tree of the calling contexts it ran
+// in and, for each context, a row of counters in a flat array, so counting
+// an instruction is an array increment. Only calls, returns and jumps into
+// another function look anything up.
+class hart_profiler_t
+{
+public:
+  enum counter_t { INSNS, LOADS, STORES, AMOS, WFIS, NUM_COUNTERS };
+
+  hart_profiler_t(const func_profiler_t& profiler, processor_t* proc);
+
+  // Counts the instruction insn at pc, which the hart just retired and which
+  // continues at npc
+  void retire(reg_t pc, insn_t insn, reg_t npc)
+  {
+    pc &= pc_mask;
+    if (unlikely(pc - lo >= hi - lo))
+      jump(pc);
+
+    uint64_t* row = &counts[context * NUM_COUNTERS];
+    row[INSNS]++;
+
+    insn_bits_t bits = insn.bits();
+    unsigned kind = (bits & 3) == 3 ? major_kinds[(bits >> 2) & 0x1f] :
+                    compressed_kind(bits);
+    if (likely(kind == NONE))
+      return;
+    if (kind < NUM_COUNTERS)
+      row[kind]++;
+    else
+      transfer(kind, insn, npc & pc_mask);
+  }
+
+  // Counts a wfi at pc, which leaves the instruction loop without retiring
+  void wait(reg_t pc)
+  {
+    pc &= pc_mask;
+    if (unlikely(pc - lo >= hi - lo))
+      jump(pc);
+    counts[context * NUM_COUNTERS + INSNS]++;
+    counts[context * NUM_COUNTERS + WFIS]++;
+  }
+
+  // Enters the handler of a trap as a call, which mret or sret returns from
+  void trap(reg_t handler);
+
+private:
+  friend class func_profiler_t;
+
+  // Kinds of instructions besides the counters
+  enum { JAL = NUM_COUNTERS, JALR, COMPRESSED_JR, COMPRESSED_JAL, SYSTEM, NONE };
+  static const size_t MAX_DEPTH = 256;
+
+  struct context_t
+  {
+    uint32_t parent;
+    uint32_t func;
+  };
+
+  const func_profiler_t& profiler;
+  reg_t pc_mask;
+  bool rv32;
+  uint8_t major_kinds[32];
+
+  // The function the hart is in and its address range
+  reg_t lo, hi;
+  uint32_t context;
+  std::vector<uint32_t> stack;
+
+  std::vector<context_t> contexts;
+  std::unordered_map<uint64_t, uint32_t> children;
+  std::vector<uint64_t> counts;
+
+  unsigned compressed_kind(insn_bits_t bits) const;
+  uint32_t child(uint32_t parent, uint32_t func);
+  void jump(reg_t pc);
+  void transfer(unsigned kind, insn_t insn, reg_t npc);
+};
+
+// Attributes the instructions, loads and stores, AMOs and wfis of every hart
+// to the chain of ELF functions it executed them in. Calls and returns are
+// the jal and jalr that the ISA hints as such through their link registers,
+// and traps and the mret and sret that end them; any other jump to another
+// function replaces the innermost frame, as a tail call does.
+class func_profiler_t
+{
+public:
+  func_profiler_t(const std::vector<processor_t*>& procs);
+
+  // Takes the functions from the symbol table of the program
+  void set_symbols(const std::map<uint64_t, std::string>& symbols);
+
+  // Writes one file in the folded-stack format of flame graph tools per
+  // counter, named <prefix>.<counter>.folded, with lines such as
+  //   hart0;main;foo 42
+  void write(const std::string& prefix) const;
+
+  hart_profiler_t* get_hart(size_t i) { return harts[i].get(); }
+
+  // Returns the function at pc and its address range
+  uint32_t lookup(reg_t pc, reg_t* lo, reg_t* hi) const;
+
+private:
+  std::vector<std::unique_ptr<hart_profiler_t>> harts;
+  std::vector<reg_t> starts;
+  std::vector<std::string> names;
+};
+
+#endif
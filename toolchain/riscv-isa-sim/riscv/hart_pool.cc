@@ -0,0 +1,142 @@
+// See LICENSE for license details.
+
+#include "hart_pool.h"
+#include "processor.h"
+#include "mmu.h"
+#include <algorithm>
+
+hart_pool_t::hart_pool_t(const std::vector<processor_t*>& procs,
+                         size_t nthreads, bool ordered)
+  : procs(procs), ordered(ordered), generation(0), running(0),
+    shutdown(false), left(procs.size()), deferred(procs.size())
+{
+  nthreads = std::max<size_t>(1, std::min(nthreads, procs.size()));
+  stride = ordered ? 1 : nthreads;
+
+  // The calling thread acts as thread 0
+  if (!ordered)
+    for (size_t tid = 1; tid < nthreads; tid++)
+      threads.emplace_back(&hart_pool_t::thread_main, this, tid);
+}
+
+hart_pool_t::~hart_pool_t()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    shutdown = true;
+  }
+  start_cond.notify_all();
+  for (auto& t : threads)
+    t.join();
+}
+
+void hart_pool_t::thread_main(size_t tid)
+{
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      start_cond.wait(guard, [&]{ return shutdown || generation != seen; });
+      if (shutdown)
+        return;
+      seen = generation;
+    }
+
+    step_harts(tid);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (--running == 0)
+      done_cond.notify_one();
+  }
+}
+
+void hart_pool_t::step_harts(size_t tid)
+{
+  for (size_t i = tid; i < procs.size(); i += stride) {
+    if (!left[i])
+      continue;
+    size_t retired = procs[i]->step(left[i]);
+    deferred[i] = procs[i]->get_mmu()->shared_access_pending();
+    // A hart that trapped or waits ends its quantum, as it ends its slice in
+    // serial mode
+    left[i] = deferred[i] ? left[i] - retired : 0;
+  }
+}
+
+void hart_pool_t::set_defer(bool value)
+{
+  for (auto p : procs)
+    p->get_mmu()->set_shared_access_mode(value ? mmu_t::SHARED_DEFER
+                                               : mmu_t::SHARED_DIRECT);
+}
+
+void hart_pool_t::run(size_t n)
+{
+  std::fill(left.begin(), left.end(), n);
+
+  do {
+    set_defer(true);
+
+    if (threads.empty()) {
+      step_harts(0);
+    } else {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        running = threads.size();
+        generation++;
+      }
+      start_cond.notify_all();
+
+      step_harts(0);
+
+      std::unique_lock<std::mutex> guard(lock);
+      done_cond.wait(guard, [&]{ return running == 0; });
+    }
+
+    set_defer(false);
+  } while (replay_deferred());
+}
+
+bool hart_pool_t::replay_deferred()
+{
+  bool more = false;
+  for (size_t i = 0; i < procs.size(); i++) {
+    if (!deferred[i])
+      continue;
+    deferred[i] = false;
+
+    mmu_t* mmu = procs[i]->get_mmu();
+    mmu->set_shared_access_mode(mmu_t::SHARED_REPLAY);
+    // An LR reserves its address only until the end of the round, so the
+    // hart runs on up to its SC while no other hart can store in between.
+    // Every step counts against the quantum, so that rounds always end.
+    for (size_t steps = 0; steps < LR_SC_STEPS; steps++) {
+      procs[i]->step(1);
+      replayed_store(i);
+      if (left[i])
+        left[i]--;
+      if (!mmu->has_load_reservation())
+        break;
+    }
+    mmu->set_shared_access_mode(mmu_t::SHARED_DIRECT);
+    more |= left[i] != 0;
+  }
+
+  // Plain stores of the next round are not seen by the reservations, so
+  // they end here, as on a hart switch in serial mode
+  for (auto p : procs)
+    p->get_mmu()->yield_load_reservation();
+  return more;
+}
+
+void hart_pool_t::replayed_store(size_t i)
+{
+  // A store breaks the reservations other harts hold on the same address
+  reg_t len;
+  reg_t paddr = procs[i]->get_mmu()->take_replay_store(&len);
+  if (paddr == reg_t(-1))
+    return;
+  for (size_t j = 0; j < procs.size(); j++)
+    if (j != i)
+      procs[j]->get_mmu()->yield_load_reservation(paddr, len);
+}
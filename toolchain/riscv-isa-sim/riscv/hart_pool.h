@@ -0,0 +1,78 @@
+// See LICENSE for license details.
+#ifndef _RISCV_HART_POOL_H
+#define _RISCV_HART_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+class processor_t;
+
+// Instructions a hart may run from an LR up to its SC while it is replayed,
+// the bound of a constrained LR/SC loop
+#define LR_SC_STEPS 16
+
+// Steps a set of harts on a pool of host threads.
+//
+// Every call to run() executes one quantum: each hart runs for up to n
+// instructions, with hart i assigned to host thread i % nthreads. The
+// quantum is run in rounds. While a round is in flight, accesses to state
+// shared between harts (AMOs, LR/SC and MMIO) are not performed; the hart
+// stops in front of such an instruction instead. Once all threads have
+// reached the end of the round, the pending instructions are executed one
+// hart at a time in hart order, so the order of atomic operations never
+// depends on host scheduling. The harts that stopped then run the rest of
+// their quantum in the next round, so a spin lock or barrier can take many
+// AMOs per quantum.
+//
+// Reservations do not outlive a round, as they do not outlive a hart switch
+// in serial mode. A hart whose pending instruction is an LR therefore runs on
+// up to its SC, for at most LR_SC_STEPS instructions, while it is replayed.
+// Any store replayed, plain or atomic, breaks the matching reservations of
+// the other harts.
+//
+// Plain loads and stores of harts on different threads are relaxed atomic
+// accesses of the host (see mmu_t), so racing ones are well-defined but may
+// be observed in any order. In ordered mode the harts of a round are stepped
+// in hart order on the calling thread. The schedule is the same as with
+// several threads, so an ordered run reproduces a parallel run bit-exactly
+// for programs whose plain loads and stores do not race within a round, and
+// is always reproducible.
+class hart_pool_t
+{
+public:
+  hart_pool_t(const std::vector<processor_t*>& procs, size_t nthreads,
+              bool ordered);
+  ~hart_pool_t();
+
+  void run(size_t n);
+  size_t nthreads() const { return threads.size() + 1; }
+
+private:
+  const std::vector<processor_t*>& procs;
+  bool ordered;
+  size_t stride;
+  std::vector<std::thread> threads;
+
+  std::mutex lock;
+  std::condition_variable start_cond;
+  std::condition_variable done_cond;
+  uint64_t generation;
+  size_t running;
+  bool shutdown;
+  // Instructions each hart has left in the quantum, and whether it stopped
+  // in front of a shared access in this round
+  std::vector<size_t> left;
+  std::vector<uint8_t> deferred;
+
+  void thread_main(size_t tid);
+  void step_harts(size_t tid);
+  void set_defer(bool value);
+  bool replay_deferred();
+  void replayed_store(size_t i);
+};
+
+#endif
@@ -6,4 +6,5 @@
 #include "internals.h"
 #include "specialize.h"
 #include "tracer.h"
+#include "xpulp_simd.h"
 #include <assert.h>
@@ -0,0 +1 @@
+STATE.lpcount[insn.p_loop()] = RS1;
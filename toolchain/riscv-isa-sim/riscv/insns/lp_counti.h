@@ -0,0 +1 @@
+STATE.lpcount[insn.p_loop()] = insn.p_uimm12();
@@ -0,0 +1 @@
+STATE.lpend[insn.p_loop()] = pc + (insn.p_uimm12() << 1);
@@ -0,0 +1,3 @@
+STATE.lpstart[insn.p_loop()] = pc + 4;
+STATE.lpend[insn.p_loop()] = pc + (insn.p_uimm5() << 1);
+STATE.lpcount[insn.p_loop()] = insn.p_uimm12();
@@ -1,5 +1,6 @@
 require_extension('A');
 require_rv64;
+MMU.defer_shared_access(RS1);
 auto res = MMU.load_int64(RS1);
 MMU.acquire_load_reservation(RS1);
 WRITE_RD(res);
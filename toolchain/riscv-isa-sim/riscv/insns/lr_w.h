@@ -1,4 +1,5 @@
 require_extension('A');
+MMU.defer_shared_access(RS1);
 auto res = MMU.load_int32(RS1);
 MMU.acquire_load_reservation(RS1);
 WRITE_RD(res);
@@ -1,9 +1 @@
-uint8_t temp;
-uint32_t simd_rd = 0;
-
-for(int i = xlen/8 - 1; i >= 0; i--){
-  temp = zext8(zext8(RS1_B(i)) + insn.p_zimm6()) >> 1;
-  simd_rd <<= 8;
-  simd_rd += (uint32_t)temp & 0x000000FF;
-}
-WRITE_RD(sext_xlen(simd_rd));
+WRITE_RD(sext_xlen(simd_avgu_b(RS1, simd_splat_b(insn.p_zimm6()))));
@@ -1,6 +1 @@
-int32_t acc = 0;
-
-for(int i = xlen/8 - 1; i >= 0; i--)
-  acc += sext8(RS1_B(i)) * sext8(RS2_B(i));
-
-WRITE_RD(sext_xlen(acc));
+WRITE_RD(sext_xlen(simd_dotsp_b(RS1, RS2)));
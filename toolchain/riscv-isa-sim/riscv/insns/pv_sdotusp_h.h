@@ -1,6 +1 @@
-int32_t acc = RD;
-
-for(int i = xlen/16 - 1; i >= 0; i--)
-  acc += sreg_t(zext16(RS1_H(i))) * sext16(RS2_H(i));
-
-WRITE_RD(sext_xlen(acc));
+WRITE_RD(sext_xlen(RD + simd_dotusp_h(RS1, RS2)));
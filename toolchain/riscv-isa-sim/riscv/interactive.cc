@@ -85,6 +85,7 @@ void sim_t::interactive()
 
   while (!done())
   {
+    trace_writer->flush();
     std::cerr << ": " << std::flush;
     std::string s = readline(2);
 
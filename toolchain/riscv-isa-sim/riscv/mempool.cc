@@ -0,0 +1,140 @@
+#include "devices.h"
+#include "processor.h"
+#include "checkpoint.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+/* 0000 eoc                  0020 ro_cache_start_0    0040 wake_up_tile_g0
+ * 0004 wake_up              0024 ro_cache_end_0      ...
+ * 0008 wake_up_group        ...                      005c wake_up_tile_g7
+ * 000c tcdm_start_address   0038 ro_cache_start_3
+ * 0010 tcdm_end_address     003c ro_cache_end_3
+ * 0014 nr_cores
+ * 0018 ro_cache_enable
+ * 001c ro_cache_flush
+ */
+
+mempool_ctrl_t::mempool_ctrl_t(std::vector<processor_t*>& procs,
+                               size_t num_groups, size_t num_cores_per_tile,
+                               reg_t tcdm_base, reg_t tcdm_size)
+  : procs(procs), num_groups(num_groups),
+    num_cores_per_group(procs.size() / num_groups),
+    num_cores_per_tile(num_cores_per_tile), flushes(0)
+{
+  if (num_groups == 0 || num_groups > MAX_NUM_GROUPS ||
+      procs.size() % num_groups != 0 || num_cores_per_tile == 0 ||
+      num_cores_per_group % num_cores_per_tile != 0)
+    throw std::invalid_argument("MemPool configuration does not match the number of harts");
+
+  // Reset values of ctrl_registers
+  static const uint32_t ro_cache_regions[2 * NUM_RO_CACHE_REGIONS] = {
+    0x80000000, 0x80001000, 0xA0000000, 0xA0001000, 0x8, 0xC, 0xC, 0x10
+  };
+  memset(regs, 0, sizeof(regs));
+  regs[TCDM_START_ADDRESS] = tcdm_base;
+  regs[TCDM_END_ADDRESS] = tcdm_base + tcdm_size;
+  regs[NR_CORES] = procs.size();
+  regs[RO_CACHE_ENABLE] = 1;
+  memcpy(&regs[RO_CACHE_START_0], ro_cache_regions, sizeof(ro_cache_regions));
+
+  for (auto p : procs)
+    p->set_wfi_sleeps(true);
+}
+
+bool mempool_ctrl_t::load(reg_t addr, size_t len, uint8_t* bytes)
+{
+  if (addr + len > sizeof(regs))
+    return false;
+  memcpy(bytes, (uint8_t*)regs + addr, len);
+  return true;
+}
+
+bool mempool_ctrl_t::store(reg_t addr, size_t len, const uint8_t* bytes)
+{
+  if (addr + len > sizeof(regs))
+    return false;
+
+  for (size_t reg = addr / 4; reg * 4 < addr + len; reg++) {
+    // Merge the written bytes into the register, read-only ones stay as is
+    size_t lo = std::max<size_t>(addr, reg * 4), hi = std::min(addr + len, reg * 4 + 4);
+    if (reg < TCDM_START_ADDRESS || reg > NR_CORES)
+      memcpy((uint8_t*)&regs[reg] + lo - reg * 4, bytes + lo - addr, hi - lo);
+    if (reg == RO_CACHE_FLUSH && (regs[reg] & 1))
+      flushes++;
+    wake_up_write(reg);
+  }
+  return true;
+}
+
+void mempool_ctrl_t::wake_up(size_t first, size_t count)
+{
+  for (size_t i = first; i < first + count && i < procs.size(); i++)
+    procs[i]->wake_up();
+}
+
+void mempool_ctrl_t::wake_up_write(size_t reg)
+{
+  const uint32_t all = 0xFFFFFFFF;
+  size_t num_tiles_per_group = num_cores_per_group / num_cores_per_tile;
+  uint32_t val = regs[reg];
+
+  if (reg == WAKE_UP) {
+    if (val < procs.size())
+      wake_up(val, 1);
+    else if (val == all)
+      wake_up(0, procs.size());
+  } else if (reg == WAKE_UP_GROUP) {
+    if (val <= (uint64_t(1) << num_groups) - 1) {
+      for (size_t g = 0; g < num_groups; g++)
+        if ((val >> g) & 1)
+          wake_up(g * num_cores_per_group, num_cores_per_group);
+    } else if (val == all) {
+      wake_up(0, procs.size());
+    }
+  } else if (reg >= WAKE_UP_TILE_G0 && reg - WAKE_UP_TILE_G0 < num_groups) {
+    size_t g = reg - WAKE_UP_TILE_G0;
+    if (val <= (uint64_t(1) << num_tiles_per_group) - 1)
+      for (size_t t = 0; t < num_tiles_per_group; t++)
+        if ((val >> t) & 1)
+          wake_up(g * num_cores_per_group + t * num_cores_per_tile,
+                  num_cores_per_tile);
+  }
+}
+
+bool mempool_ctrl_t::ro_cache_cacheable(reg_t addr)
+{
+  for (size_t i = 0; i < NUM_RO_CACHE_REGIONS; i++)
+    if (addr >= regs[RO_CACHE_START_0 + 2 * i] &&
+        addr < regs[RO_CACHE_START_0 + 2 * i + 1])
+      return true;
+  return false;
+}
+
+void mempool_ctrl_t::checkpoint(checkpoint_t& c)
+{
+  c.section("MPCT");
+  c.check(num_groups, "groups");
+  c.check(num_cores_per_tile, "cores per tile");
+  c.io(regs);
+}
+
+bool mempool_uart_t::load(reg_t addr, size_t len, uint8_t* bytes)
+{
+  if (addr + len > size())
+    return false;
+  memset(bytes, 0, len);
+  return true;
+}
+
+bool mempool_uart_t::store(reg_t addr, size_t len, const uint8_t* bytes)
+{
+  if (addr + len > size())
+    return false;
+  if (addr == 0) {
+    putchar(bytes[0]);
+    if (bytes[0] == '\n')
+      fflush(stdout);
+  }
+  return true;
+}
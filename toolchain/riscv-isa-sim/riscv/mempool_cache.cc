@@ -0,0 +1,207 @@
+// See LICENSE for license details.
+
+#include "mempool_cache.h"
+#include "devices.h"
+#include "processor.h"
+#include "mmu.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+static bool is_pow2(size_t x)
+{
+  return x && !(x & (x - 1));
+}
+
+mempool_cache_t::geometry_t mempool_cache_t::parse(const char* config, bool l0)
+{
+  geometry_t g = {};
+  size_t* fields[] = {&g.sets, &g.ways, &g.linesz, &g.l0_lines};
+  size_t num_fields = l0 ? 4 : 3;
+
+  const char* p = config;
+  for (size_t i = 0; i < num_fields; i++) {
+    char* end;
+    *fields[i] = strtoull(p, &end, 0);
+    if (end == p || *end != (i + 1 < num_fields ? ':' : '\0'))
+      throw std::invalid_argument(std::string("expected ") +
+          (l0 ? "<sets>:<ways>:<line bytes>:<L0 lines>" : "<sets>:<ways>:<line bytes>") +
+          ", got `" + config + "'");
+    p = end + 1;
+  }
+
+  if (!is_pow2(g.sets) || !g.ways || !is_pow2(g.linesz) || g.linesz < 8 ||
+      (l0 && !g.l0_lines))
+    throw std::invalid_argument("the sets and line size must be powers of two, "
+                                "the line size at least 8 bytes");
+  return g;
+}
+
+mempool_cache_t::hart_tracer_t::hart_tracer_t(mempool_cache_t& caches, size_t hartid)
+  : caches(caches), l1(NULL), ro(NULL)
+{
+  size_t tile = caches.map.tile_of_hart(hartid);
+  if (!caches.tiles.empty()) {
+    l0.reset(new lru_cache_sim_t(1, caches.icache.l0_lines, caches.icache.linesz, "L0 I$"));
+    l0->set_print_stats(false);
+    l1 = caches.tiles[tile].get();
+  }
+  if (!caches.groups.empty())
+    ro = caches.groups[caches.map.group_of_tile(tile)].get();
+}
+
+bool mempool_cache_t::hart_tracer_t::interested_in_range(uint64_t begin, uint64_t end, access_type type)
+{
+  // Everything but the TCDM and MMIO is in the L2 memory
+  if (type == FETCH)
+    return l0 != nullptr;
+  return ro && !(begin >= caches.map.get_base() &&
+                 end <= caches.map.get_base() + caches.map.get_size());
+}
+
+void mempool_cache_t::hart_tracer_t::trace(uint64_t addr, size_t bytes, access_type type)
+{
+  if (type == FETCH) {
+    if (!l0 || l0->access(addr, bytes, false))
+      return;
+    uint64_t line = addr & ~uint64_t(caches.icache.linesz - 1);
+    bool hit;
+    {
+      std::lock_guard<std::mutex> guard(l1->lock);
+      hit = l1->cache->access(line, caches.icache.linesz, false);
+    }
+    if (!hit && ro)
+      caches.read_l2(ro, line, caches.icache.linesz);
+  } else if (ro && !caches.map.contains(addr)) {
+    if (type == LOAD) {
+      caches.read_l2(ro, addr, bytes);
+    } else {
+      std::lock_guard<std::mutex> guard(ro->lock);
+      ro->writes++;
+    }
+  }
+}
+
+void mempool_cache_t::read_l2(shared_cache_t* ro, uint64_t addr, size_t bytes)
+{
+  std::lock_guard<std::mutex> guard(ro->lock);
+  if (ctrl.ro_cache_flushes() != ro->flushes) {
+    ro->cache->flush();
+    ro->flushes = ctrl.ro_cache_flushes();
+  }
+
+  if (!ctrl.ro_cache_enabled() || !ctrl.ro_cache_cacheable(addr)) {
+    ro->bypassed_reads++;
+    return;
+  }
+
+  // An instruction cache line may span several lines of the read-only cache
+  uint64_t linesz = ro_cache.linesz;
+  for (uint64_t a = addr & ~(linesz - 1); a < addr + bytes; a += linesz)
+    ro->cache->access(a, std::min<uint64_t>(bytes, linesz), false);
+}
+
+mempool_cache_t::mempool_cache_t(const tcdm_map_t& map, mempool_ctrl_t& ctrl,
+                                 const std::vector<processor_t*>& procs,
+                                 const char* icache_config,
+                                 const char* ro_cache_config)
+  : map(map), ctrl(ctrl), icache(), ro_cache()
+{
+  if (icache_config) {
+    icache = parse(icache_config, true);
+    for (size_t i = 0; i < map.get_num_tiles(); i++) {
+      tiles.emplace_back(new shared_cache_t());
+      tiles.back()->cache.reset(new lru_cache_sim_t(icache.sets, icache.ways, icache.linesz, "L1 I$"));
+      tiles.back()->cache->set_print_stats(false);
+    }
+  }
+  if (ro_cache_config) {
+    ro_cache = parse(ro_cache_config, false);
+    for (size_t i = 0; i < map.get_num_groups(); i++) {
+      groups.emplace_back(new shared_cache_t());
+      groups.back()->cache.reset(new lru_cache_sim_t(ro_cache.sets, ro_cache.ways, ro_cache.linesz, "RO$"));
+      groups.back()->cache->set_print_stats(false);
+      groups.back()->flushes = ctrl.ro_cache_flushes();
+    }
+  }
+
+  for (size_t i = 0; i < procs.size(); i++) {
+    tracers.emplace_back(new hart_tracer_t(*this, i));
+    procs[i]->get_mmu()->register_memtracer(tracers.back().get());
+  }
+}
+
+static double miss_rate(uint64_t misses, uint64_t accesses)
+{
+  return accesses ? 100.0 * misses / accesses : 0.0;
+}
+
+void mempool_cache_t::print_icache(FILE* out) const
+{
+  fprintf(out, "instruction caches: L0 of %zu x %zu B per core, "
+          "L1 of %zu sets x %zu ways x %zu B per tile\n",
+          icache.l0_lines, icache.linesz, icache.sets, icache.ways, icache.linesz);
+  fprintf(out, "%-8s %12s %12s %7s %12s %7s %14s\n", "tile", "fetches",
+          "L0 misses", "rate", "L1 misses", "rate", "refill bytes");
+
+  size_t per_tile = tracers.size() / tiles.size();
+  uint64_t fetches = 0, l0_misses = 0, l1_misses = 0;
+  for (size_t t = 0; t < tiles.size(); t++) {
+    uint64_t f = 0, m0 = 0;
+    for (size_t i = t * per_tile; i < (t + 1) * per_tile; i++) {
+      f += tracers[i]->l0->get_accesses();
+      m0 += tracers[i]->l0->get_misses();
+    }
+    uint64_t m1 = tiles[t]->cache->get_misses();
+    fprintf(out, "%-8zu %12" PRIu64 " %12" PRIu64 " %6.2f%% %12" PRIu64
+            " %6.2f%% %14" PRIu64 "\n", t, f, m0, miss_rate(m0, f), m1,
+            miss_rate(m1, m0), m1 * icache.linesz);
+    fetches += f;
+    l0_misses += m0;
+    l1_misses += m1;
+  }
+  fprintf(out, "%-8s %12" PRIu64 " %12" PRIu64 " %6.2f%% %12" PRIu64
+          " %6.2f%% %14" PRIu64 "\n", "total", fetches, l0_misses,
+          miss_rate(l0_misses, fetches), l1_misses,
+          miss_rate(l1_misses, l0_misses), l1_misses * icache.linesz);
+}
+
+void mempool_cache_t::print_ro_cache(FILE* out) const
+{
+  fprintf(out, "read-only caches: %zu sets x %zu ways x %zu B per group\n",
+          ro_cache.sets, ro_cache.ways, ro_cache.linesz);
+  fprintf(out, "%-8s %12s %12s %7s %12s %12s %8s\n", "group", "reads",
+          "misses", "rate", "bypassed", "writes", "flushes");
+
+  uint64_t reads = 0, misses = 0, bypassed = 0, writes = 0;
+  for (size_t g = 0; g < groups.size(); g++) {
+    const shared_cache_t& ro = *groups[g];
+    uint64_t r = ro.cache->get_accesses(), m = ro.cache->get_misses();
+    fprintf(out, "%-8zu %12" PRIu64 " %12" PRIu64 " %6.2f%% %12" PRIu64
+            " %12" PRIu64 " %8" PRIu64 "\n", g, r, m, miss_rate(m, r),
+            ro.bypassed_reads, ro.writes, ro.flushes);
+    reads += r;
+    misses += m;
+    bypassed += ro.bypassed_reads;
+    writes += ro.writes;
+  }
+  fprintf(out, "%-8s %12" PRIu64 " %12" PRIu64 " %6.2f%% %12" PRIu64
+          " %12" PRIu64 "\n", "total", reads, misses, miss_rate(misses, reads),
+          bypassed, writes);
+}
+
+void mempool_cache_t::print_report(FILE* out) const
+{
+  fprintf(out, "MemPool caches of %zu harts, %zu tiles, %zu groups\n",
+          tracers.size(), map.get_num_tiles(), map.get_num_groups());
+  if (!tiles.empty()) {
+    fprintf(out, "\n");
+    print_icache(out);
+  }
+  if (!groups.empty()) {
+    fprintf(out, "\n");
+    print_ro_cache(out);
+  }
+}
@@ -0,0 +1,88 @@
+// See LICENSE for license details.
+#ifndef _RISCV_MEMPOOL_CACHE_H
+#define _RISCV_MEMPOOL_CACHE_H
+
+#include "cachesim.h"
+#include "memtracer.h"
+#include "tcdm_map.h"
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class processor_t;
+class mempool_ctrl_t;
+
+// Caches of a MemPool cluster in front of its L2 memory.
+//
+// Each core fetches through a small fully associative L0 cache of its own,
+// which refills from an L1 instruction cache shared by the cores of its tile
+// (snitch_icache in mempool_tile.sv). Each group reaches the L2 memory
+// through a read-only cache (snitch_read_only_cache in axi_hier_interco.sv)
+// that serves the reads, L1 refills included, falling into one of the
+// ro_cache_start_N/ro_cache_end_N windows while ro_cache_enable is set.
+// Writes and all other reads bypass it, and ro_cache_flush invalidates it.
+//
+// Every cache replaces its least recently used line. The shared caches are
+// locked, so harts may be stepped on several host threads, although the
+// interleaving of their accesses then depends on the host.
+class mempool_cache_t
+{
+public:
+  // Geometries are <sets>:<ways>:<line bytes>, followed by :<L0 lines> for
+  // the instruction cache. Either may be null to leave that cache out.
+  mempool_cache_t(const tcdm_map_t& map, mempool_ctrl_t& ctrl,
+                  const std::vector<processor_t*>& procs,
+                  const char* icache_config, const char* ro_cache_config);
+
+  void print_report(FILE* out) const;
+
+private:
+  struct geometry_t
+  {
+    size_t sets;
+    size_t ways;
+    size_t linesz;
+    size_t l0_lines;
+  };
+
+  // Cache shared by the harts of a tile or a group
+  struct shared_cache_t
+  {
+    std::mutex lock;
+    std::unique_ptr<lru_cache_sim_t> cache;
+    uint64_t bypassed_reads;
+    uint64_t writes;
+    uint64_t flushes;
+  };
+
+  class hart_tracer_t : public memtracer_t
+  {
+  public:
+    hart_tracer_t(mempool_cache_t& caches, size_t hartid);
+    bool interested_in_range(uint64_t begin, uint64_t end, access_type type);
+    void trace(uint64_t addr, size_t bytes, access_type type);
+
+    std::unique_ptr<lru_cache_sim_t> l0;
+
+  private:
+    mempool_cache_t& caches;
+    shared_cache_t* l1;
+    shared_cache_t* ro;
+  };
+
+  const tcdm_map_t& map;
+  mempool_ctrl_t& ctrl;
+  geometry_t icache;
+  geometry_t ro_cache;
+  std::vector<std::unique_ptr<shared_cache_t>> tiles;
+  std::vector<std::unique_ptr<shared_cache_t>> groups;
+  std::vector<std::unique_ptr<hart_tracer_t>> tracers;
+
+  static geometry_t parse(const char* config, bool l0);
+  void read_l2(shared_cache_t* ro, uint64_t addr, size_t bytes);
+  void print_icache(FILE* out) const;
+  void print_ro_cache(FILE* out) const;
+};
+
+#endif
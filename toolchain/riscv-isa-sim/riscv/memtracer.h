@@ -26,9 +26,12 @@ class memtracer_t
 class memtracer_list_t : public memtracer_t
 {
  public:
-  bool empty() { return list.empty(); }
+  memtracer_list_t() : enabled(true) {}
+  bool empty() { return list.empty() || !enabled; }
   bool interested_in_range(uint64_t begin, uint64_t end, access_type type)
   {
+    if (!enabled)
+      return false;
     for (std::vector<memtracer_t*>::iterator it = list.begin(); it != list.end(); ++it)
       if ((*it)->interested_in_range(begin, end, type))
         return true;
@@ -43,8 +46,14 @@ class memtracer_list_t : public memtracer_t
   {
     list.push_back(h);
   }
+  // A disabled list traces nothing, as if it were empty
+  void set_enabled(bool value)
+  {
+    enabled = value;
+  }
  private:
   std::vector<memtracer_t*> list;
+  bool enabled;
 };
 
 #endif
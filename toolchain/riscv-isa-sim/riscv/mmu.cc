@@ -5,7 +5,12 @@
 #include "processor.h"
 
 mmu_t::mmu_t(simif_t* sim, processor_t* proc)
- : sim(sim), proc(proc),
+ : sim(sim), proc(proc), amo_profiler(NULL),
+  shared_access_mode(SHARED_DIRECT),
+  shared_access_deferred(false),
+  replay_store_paddr(-1),
+  replay_store_len(0),
+  bare_map(NULL),
   check_triggers_fetch(false),
   check_triggers_load(false),
   check_triggers_store(false),
@@ -19,10 +24,188 @@ mmu_t::~mmu_t()
 {
 }
 
+bare_map_t::bare_map_t(reg_t end)
+  : npages((std::min(end, reg_t(LIMIT)) + PGSIZE - 1) >> PGSHIFT),
+    load_pages((char**)calloc(npages, sizeof(char*))),
+    store_pages((char**)calloc(npages, sizeof(char*)))
+{
+  if (npages && (!load_pages || !store_pages))
+    throw std::bad_alloc();
+}
+
+bare_map_t::~bare_map_t()
+{
+  free(load_pages);
+  free(store_pages);
+}
+
+void bare_map_t::map(reg_t paddr, char* host, bool writable)
+{
+  reg_t ppn = paddr >> PGSHIFT;
+  if (ppn >= npages)
+    return;
+
+  load_pages[ppn] = host;
+  store_pages[ppn] = writable ? host : NULL;
+
+  if (!ranges.empty() && ranges.back().second == paddr)
+    ranges.back().second += PGSIZE;
+  else
+    ranges.push_back(std::make_pair(paddr, paddr + PGSIZE));
+}
+
+bool bare_map_t::traced(memtracer_t& t, access_type type)
+{
+  for (auto& r : ranges)
+    if (t.interested_in_range(r.first, r.second, type))
+      return true;
+  return false;
+}
+
+void mmu_t::set_bare_map(bare_map_t* map)
+{
+  bare_map = map;
+  flush_tlb();
+}
+
+void mmu_t::update_bare()
+{
+  bare_stale = false;
+  bare_load = bare_store = false;
+  if (!proc || !bare_map || proc->state.v)
+    return;
+
+  // Loads and stores are translated as in translate()
+  reg_t mode = proc->state.prv;
+  if (!proc->state.debug_mode && get_field(proc->state.mstatus, MSTATUS_MPRV)) {
+    if (get_field(proc->state.mstatus, MSTATUS_MPV))
+      return;
+    mode = get_field(proc->state.mstatus, MSTATUS_MPP);
+  }
+  if (decode_vm_info(proc->max_xlen, false, mode, proc->state.satp).levels != 0)
+    return;
+
+  // Without active PMP entries, only M-mode may access memory. Otherwise the
+  // first active entry must match all of the map, as the one that reset()
+  // sets up does.
+  bool load_ok = proc->n_pmp == 0 || mode == PRV_M;
+  bool store_ok = load_ok;
+  for (size_t i = 0; i < proc->n_pmp; i++) {
+    uint8_t cfg = proc->state.pmpcfg[i];
+    if (!(cfg & PMP_A))
+      continue;
+    if ((cfg & PMP_A) != PMP_NAPOT)
+      return;
+
+    reg_t tor = (proc->state.pmpaddr[i] & proc->pmp_tor_mask()) << PMP_SHIFT;
+    reg_t mask = (proc->state.pmpaddr[i] << 1) | 1 | ~proc->pmp_tor_mask();
+    mask = ~(mask & ~(mask + 1)) << PMP_SHIFT;
+    if ((mask & (bare_map_t::LIMIT - 1)) || (tor & mask))
+      return;
+
+    bool m_ok = mode == PRV_M && !(cfg & PMP_L);
+    load_ok = m_ok || (cfg & PMP_R);
+    store_ok = m_ok || (cfg & PMP_W);
+    break;
+  }
+
+  bare_addr_mask = (reg_t(2) << (proc->xlen - 1)) - 1; // zero-extend from xlen
+  bare_load = load_ok && !check_triggers_load &&
+              !bare_map->traced(tracer, LOAD);
+  bare_store = store_ok && !check_triggers_store &&
+               !bare_map->traced(tracer, STORE);
+}
+
 void mmu_t::flush_icache()
 {
   for (size_t i = 0; i < ICACHE_ENTRIES; i++)
     icache[i].tag = -1;
+  for (size_t i = 0; i < BLOCK_CACHE_ENTRIES; i++)
+    block_cache[i].tag = -1;
+  code_pages.clear();
+}
+
+// Whether an instruction may transfer control, so that a block ends with it.
+static bool ends_block(insn_bits_t insn)
+{
+  if ((insn & 0x3) == 0x3) {
+    switch (insn & 0x7f) {
+      case 0x63: // branches
+      case 0x67: // jalr
+      case 0x6f: // jal
+      case 0x73: // system
+      case 0x0f: // fence.i
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  int funct3 = (insn >> 13) & 0x7;
+  switch (insn & 0x3) {
+    case 0x1: // c.jal, c.j, c.beqz, c.bnez
+      return funct3 == 1 || funct3 == 5 || funct3 == 6 || funct3 == 7;
+    case 0x2: // c.jr, c.jalr, c.ebreak
+      return funct3 == 4;
+    default:
+      return false;
+  }
+}
+
+insn_block_t* mmu_t::refill_block(reg_t addr, insn_block_t* block)
+{
+  block->tag = -1;
+  block->size = 0;
+
+  reg_t pc = addr;
+  do {
+    icache_entry_t entry;
+    try {
+      refill_icache(pc, &entry);
+    } catch (trap_t&) {
+      // The fetch fault is taken when the hart gets to the instruction
+      if (block->size == 0)
+        throw;
+      break;
+    }
+    block->insns[block->size++] = entry.data;
+    pc += entry.data.insn.length();
+    if (ends_block(entry.data.insn.bits()))
+      break;
+  } while (block->size < insn_block_t::MAX_INSNS &&
+           (pc + MAX_INSN_LENGTH - 1) >> PGSHIFT == addr >> PGSHIFT);
+
+  // Make stores to this page take the slow path, which invalidates blocks
+  reg_t paddr = translate_insn_addr(addr).target_offset + addr;
+  if (code_pages.insert(paddr >> PGSHIFT).second) {
+    if (bare_map)
+      bare_map->protect(paddr);
+    reg_t idx = (addr >> PGSHIFT) % TLB_ENTRIES;
+    if ((tlb_store_tag[idx] & ~TLB_CHECK_TRIGGERS) == addr >> PGSHIFT)
+      tlb_store_tag[idx] = -1;
+  }
+
+  block->tag = addr;
+  return block;
+}
+
+void mmu_t::invalidate_code(reg_t addr, reg_t paddr, reg_t len)
+{
+  if (code_pages.find(paddr >> PGSHIFT) == code_pages.end())
+    return;
+
+  // Drop every cached instruction of this hart that overlaps the stored
+  // bytes. Other harts may run stale code until they execute fence.i, which
+  // is all the ISA guarantees without it.
+  reg_t reach = insn_block_t::MAX_INSNS * MAX_INSN_LENGTH;
+  for (reg_t pc = addr - std::min(addr, reach); pc < addr + len; pc += PC_ALIGN) {
+    insn_block_t* block = &block_cache[block_cache_index(pc)];
+    if (block->tag == pc)
+      block->tag = -1;
+    icache_entry_t* entry = &icache[icache_index(pc)];
+    if (entry->tag == pc)
+      entry->tag = -1;
+  }
 }
 
 void mmu_t::flush_tlb()
@@ -30,6 +213,8 @@ void mmu_t::flush_tlb()
   memset(tlb_insn_tag, -1, sizeof(tlb_insn_tag));
   memset(tlb_load_tag, -1, sizeof(tlb_load_tag));
   memset(tlb_store_tag, -1, sizeof(tlb_store_tag));
+  bare_load = bare_store = false;
+  bare_stale = true;
 
   flush_icache();
 }
@@ -122,6 +307,27 @@ bool mmu_t::mmio_ok(reg_t addr, access_type type)
   return true;
 }
 
+void mmu_t::shared_access(reg_t vaddr, reg_t len, bool store)
+{
+  if (shared_access_mode == SHARED_DEFER) {
+    shared_access_deferred = true;
+    throw shared_access_deferred_t();
+  }
+
+  if (store && shared_access_mode == SHARED_REPLAY) {
+    // A misaligned store arrives one byte at a time; cover all of them
+    reg_t paddr = translate(vaddr, len, STORE, 0);
+    if (replay_store_paddr == reg_t(-1)) {
+      replay_store_paddr = paddr;
+      replay_store_len = len;
+    } else {
+      reg_t end = std::max(replay_store_paddr + replay_store_len, paddr + len);
+      replay_store_paddr = std::min(replay_store_paddr, paddr);
+      replay_store_len = end - replay_store_paddr;
+    }
+  }
+}
+
 bool mmu_t::mmio_load(reg_t addr, size_t len, uint8_t* bytes)
 {
   if (!mmio_ok(addr, LOAD))
@@ -138,18 +344,38 @@ bool mmu_t::mmio_store(reg_t addr, size_t len, const uint8_t* bytes)
   return sim->mmio_store(addr, len, bytes);
 }
 
+// Copies an access between target memory and a buffer, as one relaxed
+// atomic when it is a single aligned word (see host_load())
+static void host_copy(char* dst, const char* src, reg_t len)
+{
+  bool aligned = !(((uintptr_t)dst | (uintptr_t)src) & (len - 1));
+  switch (aligned ? len : 0) {
+    case 1: host_store(dst, host_load<uint8_t>(src)); break;
+    case 2: host_store(dst, host_load<uint16_t>(src)); break;
+    case 4: host_store(dst, host_load<uint32_t>(src)); break;
+    case 8: host_store(dst, host_load<uint64_t>(src)); break;
+    default: memcpy(dst, src, len);
+  }
+}
+
 void mmu_t::load_slow_path(reg_t addr, reg_t len, uint8_t* bytes, uint32_t xlate_flags)
 {
+  if (unlikely(bare_stale))
+    update_bare();
+
   reg_t paddr = translate(addr, len, LOAD, xlate_flags);
 
   if (auto host_addr = sim->addr_to_mem(paddr)) {
-    memcpy(bytes, host_addr, len);
+    host_copy((char*)bytes, host_addr, len);
     if (tracer.interested_in_range(paddr, paddr + PGSIZE, LOAD))
       tracer.trace(paddr, len, LOAD);
     else
       refill_tlb(addr, paddr, host_addr, LOAD);
-  } else if (!mmio_load(paddr, len, bytes)) {
-    throw trap_load_access_fault(addr, 0, 0);
+  } else {
+    if (unlikely(shared_access_mode == SHARED_DEFER))
+      shared_access(addr, len, false);
+    if (!mmio_load(paddr, len, bytes))
+      throw trap_load_access_fault(addr, 0, 0);
   }
 
   if (!matched_trigger) {
@@ -162,6 +388,9 @@ void mmu_t::load_slow_path(reg_t addr, reg_t len, uint8_t* bytes, uint32_t xlate
 
 void mmu_t::store_slow_path(reg_t addr, reg_t len, const uint8_t* bytes, uint32_t xlate_flags)
 {
+  if (unlikely(bare_stale))
+    update_bare();
+
   reg_t paddr = translate(addr, len, STORE, xlate_flags);
 
   if (!matched_trigger) {
@@ -172,13 +401,18 @@ void mmu_t::store_slow_path(reg_t addr, reg_t len, const uint8_t* bytes, uint32_
   }
 
   if (auto host_addr = sim->addr_to_mem(paddr)) {
-    memcpy(host_addr, bytes, len);
+    host_copy(host_addr, (const char*)bytes, len);
+    if (unlikely(!code_pages.empty()))
+      invalidate_code(addr, paddr, len);
     if (tracer.interested_in_range(paddr, paddr + PGSIZE, STORE))
       tracer.trace(paddr, len, STORE);
     else
       refill_tlb(addr, paddr, host_addr, STORE);
-  } else if (!mmio_store(paddr, len, bytes)) {
-    throw trap_store_access_fault(addr, 0, 0);
+  } else {
+    if (unlikely(shared_access_mode == SHARED_DEFER))
+      shared_access(addr, len, true);
+    if (!mmio_store(paddr, len, bytes))
+      throw trap_store_access_fault(addr, 0, 0);
   }
 }
 
@@ -201,7 +435,10 @@ tlb_entry_t mmu_t::refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_
 
   if (pmp_homogeneous(paddr & ~reg_t(PGSIZE - 1), PGSIZE)) {
     if (type == FETCH) tlb_insn_tag[idx] = expected_tag;
-    else if (type == STORE) tlb_store_tag[idx] = expected_tag;
+    else if (type == STORE) {
+      if (code_pages.empty() || !code_pages.count(paddr >> PGSHIFT))
+        tlb_store_tag[idx] = expected_tag;
+    }
     else tlb_load_tag[idx] = expected_tag;
   }
 
@@ -442,3 +679,9 @@ void mmu_t::register_memtracer(memtracer_t* t)
   flush_tlb();
   tracer.hook(t);
 }
+
+void mmu_t::set_memtracers_enabled(bool enabled)
+{
+  flush_tlb();
+  tracer.set_enabled(enabled);
+}
@@ -11,8 +11,10 @@
 #include "processor.h"
 #include "memtracer.h"
 #include "byteorder.h"
+#include "amo_profiler.h"
 #include <stdlib.h>
 #include <vector>
+#include <unordered_set>
 
 // virtual memory configuration
 #define PGSHIFT 12
@@ -32,11 +34,86 @@ struct icache_entry_t {
   insn_fetch_t data;
 };
 
+// a straight-line run of pre-decoded instructions, entered at tag
+struct insn_block_t {
+  static const size_t MAX_INSNS = 16;
+  reg_t tag;
+  size_t size;
+  insn_fetch_t insns[MAX_INSNS];
+};
+
+// Harts on other host threads may access the same target memory, so its
+// words are read and written as relaxed atomics, which are plain moves on
+// the usual hosts
+template<class T> static inline T host_load(const char* p)
+{
+  return __atomic_load_n((const T*)p, __ATOMIC_RELAXED);
+}
+
+template<class T> static inline void host_store(char* p, T val)
+{
+  __atomic_store_n((T*)p, val, __ATOMIC_RELAXED);
+}
+
 struct tlb_entry_t {
   char* host_offset;
   reg_t target_offset;
 };
 
+// Host addresses of the memories by physical page, for harts that access
+// physical memory without translation, protection, triggers or memtracers
+// (see mmu_t::update_bare). Pages of devices, and pages beyond the table,
+// are null and take the TLB.
+class bare_map_t
+{
+public:
+  static const reg_t LIMIT = reg_t(1) << 32;
+
+  // Covers the physical addresses below end, but at most LIMIT
+  bare_map_t(reg_t end);
+  ~bare_map_t();
+
+  // Maps the page at paddr to host; stores are only mapped if writable
+  void map(reg_t paddr, char* host, bool writable);
+  // Makes stores to the page at paddr take the TLB, e.g. because the page
+  // holds decoded instructions
+  void protect(reg_t paddr)
+  {
+    if ((paddr >> PGSHIFT) < npages)
+      store_pages[paddr >> PGSHIFT] = NULL;
+  }
+
+  // Whether t traces accesses of type to the mapped pages
+  bool traced(memtracer_t& t, access_type type);
+
+  char* load_host(reg_t paddr)
+  {
+    reg_t ppn = paddr >> PGSHIFT;
+    if (ppn < npages && load_pages[ppn])
+      return load_pages[ppn] + (paddr & (PGSIZE-1));
+    return NULL;
+  }
+
+  char* store_host(reg_t paddr)
+  {
+    reg_t ppn = paddr >> PGSHIFT;
+    if (ppn < npages && store_pages[ppn])
+      return store_pages[ppn] + (paddr & (PGSIZE-1));
+    return NULL;
+  }
+
+private:
+  reg_t npages;
+  // calloc'd, so that the host only backs the parts that map memory
+  char** load_pages;
+  char** store_pages;
+  std::vector<std::pair<reg_t, reg_t>> ranges;
+};
+
+// Thrown in front of an instruction that accesses state shared between harts
+// while such accesses are being deferred (see hart_pool_t).
+class shared_access_deferred_t {};
+
 class trigger_matched_t
 {
   public:
@@ -99,12 +176,18 @@ public:
         return misaligned_load(addr, sizeof(type##_t)); \
       reg_t vpn = addr >> PGSHIFT; \
       size_t size = sizeof(type##_t); \
+      if (!(xlate_flags) && likely(bare_load)) { \
+        if (char* host_addr = bare_map->load_host(addr & bare_addr_mask)) { \
+          READ_MEM(addr, size); \
+          return from_le(host_load<type##_t>(host_addr)); \
+        } \
+      } \
       if (likely(tlb_load_tag[vpn % TLB_ENTRIES] == vpn)) { \
         if (proc) READ_MEM(addr, size); \
-        return from_le(*(type##_t*)(tlb_data[vpn % TLB_ENTRIES].host_offset + addr)); \
+        return from_le(host_load<type##_t>(tlb_data[vpn % TLB_ENTRIES].host_offset + addr)); \
       } \
       if (unlikely(tlb_load_tag[vpn % TLB_ENTRIES] == (vpn | TLB_CHECK_TRIGGERS))) { \
-        type##_t data = from_le(*(type##_t*)(tlb_data[vpn % TLB_ENTRIES].host_offset + addr)); \
+        type##_t data = from_le(host_load<type##_t>(tlb_data[vpn % TLB_ENTRIES].host_offset + addr)); \
         if (!matched_trigger) { \
           matched_trigger = trigger_exception(OPERATION_LOAD, addr, data); \
           if (matched_trigger) \
@@ -161,11 +244,20 @@ public:
         flush_tlb(); \
       if (unlikely(addr & (sizeof(type##_t)-1))) \
         return misaligned_store(addr, val, sizeof(type##_t)); \
+      if (unlikely(shared_access_mode == SHARED_REPLAY)) \
+        shared_access(addr, sizeof(type##_t), true); \
       reg_t vpn = addr >> PGSHIFT; \
       size_t size = sizeof(type##_t); \
+      if (!(xlate_flags) && likely(bare_store)) { \
+        if (char* host_addr = bare_map->store_host(addr & bare_addr_mask)) { \
+          WRITE_MEM(addr, val, size); \
+          host_store<type##_t>(host_addr, to_le(val)); \
+          return; \
+        } \
+      } \
       if (likely(tlb_store_tag[vpn % TLB_ENTRIES] == vpn)) { \
         if (proc) WRITE_MEM(addr, val, size); \
-        *(type##_t*)(tlb_data[vpn % TLB_ENTRIES].host_offset + addr) = to_le(val); \
+        host_store<type##_t>(tlb_data[vpn % TLB_ENTRIES].host_offset + addr, to_le(val)); \
       } \
       else if (unlikely(tlb_store_tag[vpn % TLB_ENTRIES] == (vpn | TLB_CHECK_TRIGGERS))) { \
         if (!matched_trigger) { \
@@ -174,7 +266,7 @@ public:
             throw *matched_trigger; \
         } \
         if (proc) WRITE_MEM(addr, val, size); \
-        *(type##_t*)(tlb_data[vpn % TLB_ENTRIES].host_offset + addr) = to_le(val); \
+        host_store<type##_t>(tlb_data[vpn % TLB_ENTRIES].host_offset + addr, to_le(val)); \
       } \
       else { \
         type##_t le_val = to_le(val); \
@@ -191,9 +283,13 @@ public:
     type##_t amo_##type(reg_t addr, op f) { \
       if (addr & (sizeof(type##_t)-1)) \
         throw trap_store_address_misaligned(addr, 0, 0); \
+      if (unlikely(shared_access_mode != SHARED_DIRECT)) \
+        shared_access(addr, sizeof(type##_t), true); \
       try { \
         auto lhs = load_##type(addr); \
         store_##type(addr, f(lhs)); \
+        if (unlikely(amo_profiler != NULL)) \
+          amo_profiler->count(addr, hart_amo_profiler_t::AMOS); \
         return lhs; \
       } catch (trap_load_page_fault& t) { \
         /* AMO faults should be reported as store faults */ \
@@ -241,15 +337,44 @@ public:
 
   inline void yield_load_reservation()
   {
+    if (unlikely(amo_profiler != NULL) && load_reservation_address != (reg_t)-1)
+      amo_profiler->count(load_reservation_address, hart_amo_profiler_t::YIELDS);
     load_reservation_address = (reg_t)-1;
   }
 
+  // A store to paddr of len bytes breaks a reservation of the 8-byte
+  // granule it overlaps
+  inline void yield_load_reservation(reg_t paddr, reg_t len)
+  {
+    if (load_reservation_address != (reg_t)-1 &&
+        paddr < load_reservation_address + 8 &&
+        load_reservation_address < paddr + len)
+      yield_load_reservation();
+  }
+
+  bool has_load_reservation()
+  {
+    return load_reservation_address != (reg_t)-1;
+  }
+
+  // Stops in front of an instruction that accesses state shared between
+  // harts while such accesses are deferred, before any of its side effects
+  inline void defer_shared_access(reg_t vaddr)
+  {
+    if (unlikely(shared_access_mode == SHARED_DEFER))
+      shared_access(vaddr, 0, false);
+  }
+
   inline void acquire_load_reservation(reg_t vaddr)
   {
+    if (unlikely(shared_access_mode != SHARED_DIRECT))
+      shared_access(vaddr, 0, false);
     reg_t paddr = translate(vaddr, 1, LOAD, 0);
-    if (auto host_addr = sim->addr_to_mem(paddr))
+    if (auto host_addr = sim->addr_to_mem(paddr)) {
       load_reservation_address = refill_tlb(vaddr, paddr, host_addr, LOAD).target_offset + vaddr;
-    else
+      if (unlikely(amo_profiler != NULL))
+        amo_profiler->count(vaddr, hart_amo_profiler_t::LRS);
+    } else
       throw trap_load_access_fault(vaddr, 0, 0); // disallow LR to I/O space
   }
 
@@ -258,10 +383,22 @@ public:
     if (vaddr & (size-1))
       throw trap_store_address_misaligned(vaddr, 0, 0);
 
+    if (unlikely(shared_access_mode != SHARED_DIRECT))
+      shared_access(vaddr, 0, false);
+
     reg_t paddr = translate(vaddr, 1, STORE, 0);
-    if (auto host_addr = sim->addr_to_mem(paddr))
-      return load_reservation_address == refill_tlb(vaddr, paddr, host_addr, STORE).target_offset + vaddr;
-    else
+    if (auto host_addr = sim->addr_to_mem(paddr)) {
+      paddr = refill_tlb(vaddr, paddr, host_addr, STORE).target_offset + vaddr;
+      bool success = load_reservation_address == paddr;
+      if (unlikely(amo_profiler != NULL)) {
+        amo_profiler->count(vaddr, hart_amo_profiler_t::SCS);
+        if (!success)
+          amo_profiler->count(vaddr, hart_amo_profiler_t::SC_FAILS);
+        // The SC consumes the reservation, it is not lost
+        load_reservation_address = (reg_t)-1;
+      }
+      return success;
+    } else
       throw trap_store_access_fault(vaddr, 0, 0); // disallow SC to I/O space
   }
 
@@ -313,6 +450,31 @@ public:
     return refill_icache(addr, entry);
   }
 
+  static const reg_t BLOCK_CACHE_ENTRIES = 256;
+
+  inline size_t block_cache_index(reg_t addr)
+  {
+    // Straight-line code starts a block every few dozen bytes; fold in the
+    // higher bits so that consecutive blocks do not collide.
+    reg_t idx = addr / PC_ALIGN;
+    return (idx + idx / BLOCK_CACHE_ENTRIES) % BLOCK_CACHE_ENTRIES;
+  }
+
+  // The block cache bypasses the fetch path, so it may only be used when
+  // no memtracer observes fetches and no trigger matches on execution.
+  inline bool block_cache_usable()
+  {
+    return tracer.empty() && !check_triggers_fetch;
+  }
+
+  inline insn_block_t* access_block(reg_t addr)
+  {
+    insn_block_t* block = &block_cache[block_cache_index(addr)];
+    if (likely(block->tag == addr))
+      return block;
+    return refill_block(addr, block);
+  }
+
   inline insn_fetch_t load_insn(reg_t addr)
   {
     icache_entry_t entry;
@@ -323,6 +485,44 @@ public:
   void flush_icache();
 
   void register_memtracer(memtracer_t*);
+  void set_memtracers_enabled(bool enabled);
+
+  // Counts the AMOs, LR/SCs and lost reservations of the hart; may be null
+  void set_amo_profiler(hart_amo_profiler_t* value) { amo_profiler = value; }
+
+  // Lets loads and stores go straight to the pages of map while the hart
+  // runs on physical memory
+  void set_bare_map(bare_map_t* map);
+
+  // How accesses to state shared between harts (AMOs, LR/SC and MMIO) are
+  // handled. SHARED_DEFER makes them throw shared_access_deferred_t before
+  // any side effect; SHARED_REPLAY performs them and records the physical
+  // range of the stores of the instruction, plain or by an AMO or successful
+  // SC.
+  enum shared_access_mode_t {
+    SHARED_DIRECT,
+    SHARED_DEFER,
+    SHARED_REPLAY
+  };
+  void set_shared_access_mode(shared_access_mode_t mode)
+  {
+    shared_access_mode = mode;
+  }
+  bool shared_access_pending()
+  {
+    bool pending = shared_access_deferred;
+    shared_access_deferred = false;
+    return pending;
+  }
+  // The physical address and size of the stores replayed since the last
+  // call, or -1
+  reg_t take_replay_store(reg_t* len)
+  {
+    reg_t paddr = replay_store_paddr;
+    *len = replay_store_len;
+    replay_store_paddr = reg_t(-1);
+    return paddr;
+  }
 
   int is_dirty_enabled()
   {
@@ -347,11 +547,25 @@ private:
   processor_t* proc;
   memtracer_list_t tracer;
   reg_t load_reservation_address;
+  hart_amo_profiler_t* amo_profiler;
   uint16_t fetch_temp;
 
+  shared_access_mode_t shared_access_mode;
+  bool shared_access_deferred;
+  reg_t replay_store_paddr;
+  reg_t replay_store_len;
+  void shared_access(reg_t vaddr, reg_t len, bool store);
+
   // implement an instruction cache for simulator performance
   icache_entry_t icache[ICACHE_ENTRIES];
 
+  // cache of decoded basic blocks, and the physical pages they were built
+  // from; stores to those pages take the slow path to invalidate blocks
+  insn_block_t block_cache[BLOCK_CACHE_ENTRIES];
+  std::unordered_set<reg_t> code_pages;
+  insn_block_t* refill_block(reg_t addr, insn_block_t* block);
+  void invalidate_code(reg_t addr, reg_t paddr, reg_t len);
+
   // implement a TLB for simulator performance
   static const reg_t TLB_ENTRIES = 256;
   // If a TLB tag has TLB_CHECK_TRIGGERS set, then the MMU must check for a
@@ -362,6 +576,16 @@ private:
   reg_t tlb_load_tag[TLB_ENTRIES];
   reg_t tlb_store_tag[TLB_ENTRIES];
 
+  // Bypass the TLB while addresses are physical. flush_tlb() turns the
+  // bypass off, as the state it depends on is about to change, and the next
+  // slow path re-checks it.
+  bare_map_t* bare_map;
+  bool bare_load;
+  bool bare_store;
+  bool bare_stale;
+  reg_t bare_addr_mask;
+  void update_bare();
+
   // finish translation on a TLB miss and update the TLB
   tlb_entry_t refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type);
   const char* fill_from_mmio(reg_t vaddr, reg_t paddr);
@@ -8,6 +8,9 @@
 #include "simif.h"
 #include "mmu.h"
 #include "disasm.h"
+#include "checkpoint.h"
+#include "func_profiler.h"
+#include "bbv.h"
 #include <cinttypes>
 #include <cmath>
 #include <cstdlib>
@@ -22,12 +25,14 @@
 #define STATE state
 
 processor_t::processor_t(const char* isa, const char* priv, const char* varch,
-                         simif_t* sim, uint32_t id, bool halt_on_reset,
-                         FILE* log_file)
+                         simif_t* sim, uint32_t id, bool halt_on_reset)
   : debug(false), halt_request(HR_NONE), sim(sim), ext(NULL), id(id), xlen(0),
-  histogram_enabled(false), log_commits_enabled(false),
-  log_file(log_file), halt_on_reset(halt_on_reset),
-  extension_table(256, false), last_pc(1), executions(1)
+  histogram_enabled(false), profiler(NULL), bbv(NULL),
+  log_commits_enabled(false), log_commits_paused(false),
+  dasm_trace_enabled(false), trace(NULL), halt_on_reset(halt_on_reset),
+  extension_table(256, false), rstvec(DEFAULT_RSTVEC), wfi_sleeps(false),
+  wfi_parked(false),
+  wake_ups(0), last_pc(1), executions(1)
 {
   VU.p = this;
 
@@ -66,8 +71,8 @@ processor_t::~processor_t()
 static void bad_option_string(const char *option, const char *value,
                               const char *msg)
 {
-  fprintf(stderr, "error: bad %s option '%s'. %s\n", option, value, msg);
-  abort();
+  throw std::invalid_argument(std::string("bad ") + option +
+                              " option '" + value + "'. " + msg);
 }
 
 static void bad_isa_string(const char* isa, const char* msg)
@@ -77,8 +82,7 @@ static void bad_isa_string(const char* isa, const char* msg)
 
 static void bad_priv_string(const char* priv)
 {
-  fprintf(stderr, "error: bad --priv option %s\n", priv);
-  abort();
+  throw std::invalid_argument(std::string("bad --priv option ") + priv);
 }
 
 static void bad_varch_string(const char* varch, const char *msg)
@@ -244,7 +248,9 @@ void processor_t::parse_isa_string(const char* str)
           end++;
 
         auto ext_str = std::string(ext, end - ext);
-        if (ext_str != "dummy")
+        // The Xpulpimg instructions are part of the base set here, so
+        // Xpulpimg only marks the ISA string as the compiler's -march does
+        if (ext_str != "dummy" && ext_str != "pulpimg")
           register_extension(find_extension(ext_str.c_str())());
 
         p = end;
@@ -357,6 +363,11 @@ void state_t::reset(reg_t max_isa)
   fflags = 0;
   frm = 0;
   serialized = false;
+  trace = 0;
+
+  memset(this->lpstart, 0, sizeof(this->lpstart));
+  memset(this->lpend, 0, sizeof(this->lpend));
+  memset(this->lpcount, 0, sizeof(this->lpcount));
 
 #ifdef RISCV_ENABLE_COMMITLOG
   log_reg_write.clear();
@@ -431,28 +442,24 @@ void processor_t::set_histogram(bool value)
   histogram_enabled = value;
 #ifndef RISCV_ENABLE_HISTOGRAM
   if (value) {
-    fprintf(stderr, "PC Histogram support has not been properly enabled;");
-    fprintf(stderr, " please re-build the riscv-isa-sim project using \"configure --enable-histogram\".\n");
-    abort();
+    throw std::runtime_error("PC Histogram support has not been properly "
+                             "enabled; please re-build the riscv-isa-sim "
+                             "project using \"configure --enable-histogram\".");
   }
 #endif
 }
 
-#ifdef RISCV_ENABLE_COMMITLOG
-void processor_t::enable_log_commits()
-{
-  log_commits_enabled = true;
-}
-#endif
-
 void processor_t::reset()
 {
   state.reset(max_isa);
+  state.pc = rstvec;
 
   state.mideleg = supports_extension('H') ? MIDELEG_FORCED_MASK : 0;
 
   state.dcsr.halt = halt_on_reset;
   halt_on_reset = false;
+  wfi_parked = false;
+  wake_ups = 0;
   set_csr(CSR_MSTATUS, state.mstatus);
   VU.reset();
 
@@ -483,23 +490,125 @@ static int ctz(reg_t val)
 void processor_t::set_pmp_num(reg_t n)
 {
   // check the number of pmp is in a reasonable range
-  if (n > state.max_pmp) {
-    fprintf(stderr, "error: bad number of pmp regions: '%ld' from the dtb\n", (unsigned long)n);
-    abort();
-  }
+  if (n > state.max_pmp)
+    throw std::invalid_argument("bad number of pmp regions: '" +
+                                std::to_string(n) + "' from the dtb");
   n_pmp = n;
 }
 
 void processor_t::set_pmp_granularity(reg_t gran) {
   // check the pmp granularity is set from dtb(!=0) and is power of 2
-  if (gran < (1 << PMP_SHIFT) || (gran & (gran - 1)) != 0) {
-    fprintf(stderr, "error: bad pmp granularity '%ld' from the dtb\n", (unsigned long)gran);
-    abort();
-  }
+  if (gran < (1 << PMP_SHIFT) || (gran & (gran - 1)) != 0)
+    throw std::invalid_argument("bad pmp granularity '" +
+                                std::to_string(gran) + "' from the dtb");
 
   lg_pmp_granularity = ctz(gran);
 }
 
+void processor_t::wake_up()
+{
+  if (wfi_parked)
+    wfi_parked = false;
+  else if (wake_ups < MAX_WAKE_UPS)
+    wake_ups++;
+}
+
+void processor_t::checkpoint(checkpoint_t& c)
+{
+  c.section("HART");
+  c.check(id, "hart id");
+  c.check(max_isa, "ISA");
+  c.check(VU.VLEN, "VLEN");
+
+  c.io(state.pc);
+  c.io(state.XPR);
+  c.io(state.FPR);
+  c.io(state.prv);
+  c.io(state.v);
+  c.io(state.misa);
+  c.io(state.mstatus);
+  c.io(state.mepc);
+  c.io(state.mtval);
+  c.io(state.mscratch);
+  c.io(state.mtvec);
+  c.io(state.mcause);
+  c.io(state.minstret);
+  c.io(state.mie);
+  c.io(state.mip);
+  c.io(state.medeleg);
+  c.io(state.mideleg);
+  c.io(state.mcounteren);
+  c.io(state.scounteren);
+  c.io(state.sepc);
+  c.io(state.stval);
+  c.io(state.sscratch);
+  c.io(state.stvec);
+  c.io(state.satp);
+  c.io(state.scause);
+  c.io(state.mtval2);
+  c.io(state.mtinst);
+  c.io(state.hstatus);
+  c.io(state.hideleg);
+  c.io(state.hedeleg);
+  c.io(state.hcounteren);
+  c.io(state.htval);
+  c.io(state.htinst);
+  c.io(state.hgatp);
+  c.io(state.vsstatus);
+  c.io(state.vstvec);
+  c.io(state.vsscratch);
+  c.io(state.vsepc);
+  c.io(state.vscause);
+  c.io(state.vstval);
+  c.io(state.vsatp);
+  c.io(state.dpc);
+  c.io(state.dscratch0);
+  c.io(state.dscratch1);
+  c.io(state.dcsr);
+  c.io(state.tselect);
+  c.io(state.mcontrol);
+  c.io(state.tdata2);
+  c.io(state.debug_mode);
+  c.io(state.pmpcfg);
+  c.io(state.pmpaddr);
+  c.io(state.fflags);
+  c.io(state.frm);
+  c.io(state.serialized);
+  c.io(state.single_step);
+  c.io(state.trace);
+  c.io(state.lpstart);
+  c.io(state.lpend);
+  c.io(state.lpcount);
+  c.io(xlen);
+  c.io(wfi_parked);
+  c.io(wake_ups);
+
+  c.io(VU.vstart);
+  c.io(VU.vxrm);
+  c.io(VU.vxsat);
+  c.io(VU.vl);
+  c.io(VU.vtype);
+  c.io(VU.vlenb);
+  c.io(VU.vma);
+  c.io(VU.vta);
+  c.io(VU.vediv);
+  c.io(VU.vsew);
+  c.io(VU.vflmul);
+  c.io(VU.vlmax);
+  c.io(VU.vill);
+  c.io(VU.vstart_alu);
+  c.io(VU.setvl_count);
+  if (VU.reg_file)
+    c.bytes(VU.reg_file, NVPR * (VU.VLEN / 8));
+
+  if (!c.saving()) {
+    // Translations, decoded blocks and reservations were made for the old
+    // state of memory
+    mmu->flush_tlb();
+    mmu->yield_load_reservation();
+  }
+}
+
 void processor_t::take_interrupt(reg_t pending_interrupts)
 {
   reg_t enabled_interrupts, deleg, status, mie, m_enabled;
@@ -644,11 +753,11 @@ void processor_t::enter_debug_mode(uint8_t cause)
 void processor_t::take_trap(trap_t& t, reg_t epc)
 {
   if (debug) {
-    fprintf(log_file, "core %3d: exception %s, epc 0x%016" PRIx64 "\n",
-            id, t.name(), epc);
+    trace->printf("core %3d: exception %s, epc 0x%016" PRIx64 "\n",
+                  id, t.name(), epc);
     if (t.has_tval())
-      fprintf(log_file, "core %3d:           tval 0x%016" PRIx64 "\n",
-              id, t.get_tval());
+      trace->printf("core %3d:           tval 0x%016" PRIx64 "\n",
+                    id, t.get_tval());
   }
 
   if (state.debug_mode) {
@@ -737,27 +846,19 @@ void processor_t::take_trap(trap_t& t, reg_t epc)
     set_csr(CSR_MSTATUS, s);
     set_privilege(PRV_M);
   }
+
+  if (profiler)
+    profiler->trap(state.pc);
+  if (bbv)
+    bbv->trap(state.pc);
 }
 
 void processor_t::disasm(insn_t insn)
 {
+  // The writer formats the line; repeats of an instruction are only counted
   uint64_t bits = insn.bits() & ((1ULL << (8 * insn_length(insn.bits()))) - 1);
   if (last_pc != state.pc || last_bits != bits) {
-
-#ifdef RISCV_ENABLE_COMMITLOG
-    const char* sym = get_symbol(state.pc);
-    if (sym != nullptr)
-    {
-      fprintf(log_file, "core %3d: >>>>  %s\n", id, sym);
-    }
-#endif
-
-    if (executions != 1) {
-      fprintf(log_file, "core %3d: Executed %" PRIx64 " times\n", id, executions);
-    }
-
-    fprintf(log_file, "core %3d: 0x%016" PRIx64 " (0x%08" PRIx64 ") %s\n",
-            id, state.pc, bits, disassembler->disassemble(insn).c_str());
+    trace->disasm(state.pc, bits, executions);
     last_pc = state.pc;
     last_bits = bits;
     executions = 1;
@@ -1219,6 +1320,17 @@ void processor_t::set_csr(int which, reg_t val)
       dirty_vs_state;
       VU.vxrm = val & 0x3ul;
       break;
+    case CSR_TRACE:
+#ifdef RISCV_ENABLE_COMMITLOG
+      // The operands are only stashed while tracing, so the instruction
+      // that starts the trace is logged without them
+      if (!state.trace && (val & 1))
+        state.last_inst_opa = state.last_inst_opb = 0;
+#endif
+      state.trace = val & 1;
+      if (sim)
+        sim->trace_written(id, state.trace);
+      break;
   }
 
 #if defined(RISCV_ENABLE_COMMITLOG)
@@ -1299,6 +1411,7 @@ void processor_t::set_csr(int which, reg_t val)
     case CSR_DPC:
     case CSR_DSCRATCH0:
     case CSR_DSCRATCH1:
+    case CSR_TRACE:
       LOG_CSR(which);
       break;
   }
@@ -1640,6 +1753,7 @@ reg_t processor_t::get_csr(int which, insn_t insn, bool write, bool peek)
       if (!supports_extension('V'))
         break;
       ret(VU.vlenb);
+    case CSR_TRACE: ret(state.trace);
   }
 
 #undef ret
@@ -1689,21 +1803,8 @@ insn_func_t processor_t::decode_insn(insn_t insn)
   insn_desc_t desc = opcode_cache[idx];
 
   if (unlikely(insn.bits() != desc.match)) {
-    // fall back to linear search
-    insn_desc_t* p = &instructions[0];
-    while ((insn.bits() & p->mask) != p->match)
-      p++;
-    desc = *p;
-
-    if (p->mask != 0 && p > &instructions[0]) {
-      if (p->match != (p-1)->match && p->match != (p+1)->match) {
-        // move to front of opcode list to reduce miss penalty
-        while (--p >= &instructions[0])
-          *(p+1) = *p;
-        instructions[0] = desc;
-      }
-    }
-
+    // fall back to the decode tree
+    desc = instructions[decode_tree.lookup(insn.bits())];
     opcode_cache[idx] = desc;
     opcode_cache[idx].match = insn.bits();
   }
@@ -1726,6 +1827,7 @@ void processor_t::build_opcode_map()
     }
   };
   std::sort(instructions.begin(), instructions.end(), cmp());
+  decode_tree.build(instructions);
 
   for (size_t i = 0; i < OPCODE_CACHE_SIZE; i++)
     opcode_cache[i] = {0, 0, &illegal_instruction, &illegal_instruction};
@@ -6,10 +6,14 @@
 #include "config.h"
 #include "devices.h"
 #include "trap.h"
+#include "commit_log.h"
+#include "trace_writer.h"
+#include "decode_tree.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <memory>
 #include <cassert>
 #include "debug_rom_defines.h"
 
@@ -20,6 +24,9 @@ class simif_t;
 class trap_t;
 class extension_t;
 class disassembler_t;
+class checkpoint_t;
+class hart_profiler_t;
+class hart_bbv_t;
 
 struct insn_desc_t
 {
@@ -215,6 +222,15 @@ struct state_t
   uint32_t frm;
   bool serialized; // whether timer CSRs are in a well-defined state
 
+  reg_t trace; // MemPool's trace CSR, marks the region of interest
+
+  // Xpulp hardware loops. Loop i repeats the instructions from lpstart[i]
+  // up to lpend[i] (exclusive) while lpcount[i] iterations are left.
+  static const int num_hwloops = 2;
+  reg_t lpstart[num_hwloops];
+  reg_t lpend[num_hwloops];
+  reg_t lpcount[num_hwloops];
+
   // When true, execute a single instruction and then enter debug mode.  This
   // can only be set by executing dret.
   enum {
@@ -230,6 +246,8 @@ struct state_t
   reg_t last_inst_priv;
   int last_inst_xlen;
   int last_inst_flen;
+  reg_t last_inst_opa; // rs1 and rs2 before the instruction, for the dasm trace
+  reg_t last_inst_opb;
 #endif
 };
 
@@ -259,18 +277,58 @@ class processor_t : public abstract_device_t
 {
 public:
   processor_t(const char* isa, const char* priv, const char* varch,
-              simif_t* sim, uint32_t id, bool halt_on_reset,
-              FILE *log_file);
+              simif_t* sim, uint32_t id, bool halt_on_reset);
   ~processor_t();
 
   void set_debug(bool value);
   void set_histogram(bool value);
+  void set_profiler(hart_profiler_t* value) { profiler = value; }
+  void set_bbv(hart_bbv_t* value) { bbv = value; }
+  // The log, the commit log and the dasm trace go through value
+  void set_trace(hart_trace_t* value) { trace = value; }
+  hart_trace_t* get_trace() { return trace; }
 #ifdef RISCV_ENABLE_COMMITLOG
-  void enable_log_commits();
-  bool get_log_commits_enabled() const { return log_commits_enabled; }
+  void enable_log_commits() { log_commits_enabled = true; }
+  // Trace the instructions retired while the trace CSR is set
+  void enable_dasm_trace() { dasm_trace_enabled = true; }
+  // Whether the current instruction goes to the dasm trace
+  bool get_dasm_trace_enabled() const {
+    return dasm_trace_enabled && state.trace && !log_commits_paused;
+  }
+  void pause_log_commits(bool paused) { log_commits_paused = paused; }
+  // Where the commit record of the current instruction goes (TRACE_TO_*)
+  unsigned get_commit_log_dest() const {
+    if (log_commits_paused)
+      return 0;
+    return (log_commits_enabled ? TRACE_TO_LOG : 0) |
+           (dasm_trace_enabled && state.trace ? TRACE_TO_DASM : 0);
+  }
 #endif
   void reset();
-  void step(size_t n); // run for n cycles
+  void set_reset_vector(reg_t addr) { rstvec = addr; reset(); }
+  // Saves or restores the architectural state of the hart
+  void checkpoint(checkpoint_t& c);
+  // Runs for up to n cycles and returns the instructions retired, which are
+  // fewer if the hart traps, waits or stops in front of a deferred access
+  size_t step(size_t n);
+  // With sleeping wfi (as on MemPool's Snitch cores), wfi parks the hart
+  // until wake_up() is called or an enabled interrupt becomes pending. A
+  // wake-up that arrives while the hart is awake lets its next wfi fall
+  // through; up to MAX_WAKE_UPS of them are remembered.
+  void set_wfi_sleeps(bool value) { wfi_sleeps = value; }
+  void wake_up();
+  bool sleeping() const { return wfi_parked; }
+
+  // Hardware loops: an instruction that falls through to the end of a loop
+  // with iterations left continues at its start. Loop 0 is the inner one.
+  bool hwloops_active() const { return state.lpcount[0] | state.lpcount[1]; }
+  reg_t hwloop_next(reg_t npc)
+  {
+    for (int i = 0; i < state.num_hwloops; i++)
+      if (state.lpcount[i] && npc == state.lpend[i] && --state.lpcount[i])
+        return state.lpstart[i];
+    return npc;
+  }
   void set_csr(int which, reg_t val);
   reg_t get_csr(int which, insn_t insn, bool write, bool peek = 0);
   reg_t get_csr(int which) { return get_csr(which, insn_t(0), false, true); }
@@ -303,8 +361,7 @@ public:
   void set_virt(bool);
   void update_histogram(reg_t pc);
   const disassembler_t* get_disassembler() { return disassembler; }
-
-  FILE *get_log_file() { return log_file; }
+  uint32_t get_id() const { return id; }
 
   void register_insn(insn_desc_t);
   void register_extension(extension_t*);
@@ -423,13 +480,24 @@ private:
   reg_t max_isa;
   std::string isa_string;
   bool histogram_enabled;
+  hart_profiler_t* profiler;
+  hart_bbv_t* bbv;
   bool log_commits_enabled;
-  FILE *log_file;
+  bool log_commits_paused;
+  bool dasm_trace_enabled;
+  hart_trace_t* trace;
   bool halt_on_reset;
   std::vector<bool> extension_table;
+
+  reg_t rstvec;
+  static const unsigned MAX_WAKE_UPS = 7;
+  bool wfi_sleeps;
+  bool wfi_parked;
+  unsigned wake_ups;
   
 
   std::vector<insn_desc_t> instructions;
+  decode_tree_t decode_tree;
   std::map<reg_t,uint64_t> pc_histogram;
 
   static const size_t OPCODE_CACHE_SIZE = 8191;
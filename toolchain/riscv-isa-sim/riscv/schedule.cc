@@ -0,0 +1,116 @@
+// See LICENSE for license details.
+
+#include "schedule.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+schedule_t::schedule_t(size_t nprocs, size_t max_slice)
+  : nprocs(nprocs), max_slice(max_slice), turn(0), random(false),
+    record_file(NULL), replay_file(NULL)
+{
+}
+
+schedule_t::~schedule_t()
+{
+  if (record_file)
+    fclose(record_file);
+  if (replay_file)
+    fclose(replay_file);
+}
+
+void schedule_t::set_seed(uint64_t seed)
+{
+  random = true;
+  rng.seed(seed);
+}
+
+void schedule_t::record(const char* path)
+{
+  record_file = fopen(path, "wb");
+  if (!record_file)
+    throw std::runtime_error(std::string("can't open schedule `") + path +
+                             "': " + strerror(errno));
+
+  schedule_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SCHEDULE_MAGIC, sizeof(header.magic));
+  header.version = SCHEDULE_VERSION;
+  header.nprocs = nprocs;
+  if (fwrite(&header, sizeof(header), 1, record_file) != 1)
+    throw std::runtime_error(std::string("can't write schedule `") + path + "'");
+}
+
+void schedule_t::replay(const char* path)
+{
+  replay_path = path;
+  replay_file = fopen(path, "rb");
+  if (!replay_file)
+    throw std::runtime_error("can't open schedule `" + replay_path + "': " +
+                             strerror(errno));
+
+  schedule_header_t header;
+  if (fread(&header, sizeof(header), 1, replay_file) != 1 ||
+      memcmp(header.magic, SCHEDULE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SCHEDULE_VERSION)
+    throw std::runtime_error("`" + replay_path +
+                             "' is not a schedule of this version of Spike");
+  if (header.nprocs != nprocs)
+    throw std::runtime_error("schedule `" + replay_path + "' has " +
+                             std::to_string(header.nprocs) + " harts, not " +
+                             std::to_string(nprocs));
+}
+
+void schedule_t::next(size_t* hart, size_t* steps)
+{
+  if (replay_file && !read_slice(hart, steps)) {
+    fprintf(stderr, "schedule `%s' ended; the harts take turns from here\n",
+            replay_path.c_str());
+    fclose(replay_file);
+    replay_file = NULL;
+    random = false;
+  }
+
+  if (!replay_file) {
+    if (random) {
+      // Plain modulo keeps the schedule of a seed independent of the host's
+      // standard library
+      *hart = rng() % nprocs;
+      *steps = rng() % max_slice + 1;
+    } else {
+      *hart = turn;
+      *steps = max_slice;
+      turn = (turn + 1) % nprocs;
+    }
+  }
+
+  if (record_file)
+    write_slice(*hart, *steps);
+}
+
+bool schedule_t::read_slice(size_t* hart, size_t* steps)
+{
+  uint64_t slice = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(replay_file);
+    if (c == EOF)
+      return false;
+    slice |= uint64_t(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      *hart = slice % nprocs;
+      *steps = slice / nprocs + 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+void schedule_t::write_slice(size_t hart, size_t steps)
+{
+  uint64_t slice = uint64_t(steps - 1) * nprocs + hart;
+  do {
+    uint8_t c = slice & 0x7f;
+    slice >>= 7;
+    fputc(c | (slice ? 0x80 : 0), record_file);
+  } while (slice);
+}
@@ -0,0 +1,64 @@
+// See LICENSE for license details.
+#ifndef _RISCV_SCHEDULE_H
+#define _RISCV_SCHEDULE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+// The order in which a serial run steps the harts
+//
+// A schedule is a sequence of slices, each of which runs one hart for a
+// number of steps. Without a seed the harts take turns in slices of
+// max_slice steps, as sim_t does by default. With a seed every slice runs a
+// random hart for 1 to max_slice steps, so different seeds explore
+// interleavings that the fixed schedule never produces. The same seed gives
+// the same schedule on every host.
+//
+// The slices can be recorded to a file and replayed from it, which repeats
+// the run exactly. A schedule file starts with a schedule_header_t; each
+// slice follows as one LEB128 number, (steps - 1) * nprocs + hart. Once a
+// replayed schedule is used up, the harts take turns again.
+//
+// All errors throw std::runtime_error.
+
+#define SCHEDULE_MAGIC "SPIKESCH"
+#define SCHEDULE_VERSION 1
+
+struct schedule_header_t
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t nprocs;
+};
+
+class schedule_t
+{
+public:
+  schedule_t(size_t nprocs, size_t max_slice);
+  ~schedule_t();
+
+  void set_seed(uint64_t seed);
+  void record(const char* path);
+  void replay(const char* path);
+
+  // Picks the next slice
+  void next(size_t* hart, size_t* steps);
+
+private:
+  size_t nprocs;
+  size_t max_slice;
+  size_t turn;
+  bool random;
+  std::mt19937_64 rng;
+  FILE* record_file;
+  FILE* replay_file;
+  std::string replay_path;
+
+  bool read_slice(size_t* hart, size_t* steps);
+  void write_slice(size_t hart, size_t steps);
+};
+
+#endif
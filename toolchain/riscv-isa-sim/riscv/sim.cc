@@ -5,6 +5,7 @@
 #include "dts.h"
 #include "remote_bitbang.h"
 #include "byteorder.h"
+#include "checkpoint.h"
 #include <fstream>
 #include <map>
 #include <iostream>
@@ -44,18 +45,30 @@ sim_t::sim_t(const char* isa, const char* priv, const char* varch,
     initrd_end(initrd_end),
     bootargs(bootargs),
     start_pc(start_pc),
+    rstvec(DEFAULT_RSTVEC),
     dtb_file(dtb_file ? dtb_file : ""),
     dtb_enabled(dtb_enabled),
     log_file(log_path),
+    quantum(INTERLEAVE),
+    checkpoint_insns(0),
+    checkpoint_requested(false),
+    fast_forward_insns(0),
+    window_insns(0),
+    detailed(true),
+    slice_steps(INTERLEAVE),
+    round_steps(0),
     current_step(0),
     current_proc(0),
+    steps_per_hart(0),
     debug(false),
     histogram_enabled(false),
     log(false),
+    map_elf(false),
     remote_bitbang(NULL),
     debug_module(this, dm_config)
 {
-  signal(SIGINT, &handle_signal);
+  if (signal_handlers_enabled())
+    signal(SIGINT, &handle_signal);
 
   for (auto& x : mems)
     bus.add_device(x.first, x.second);
@@ -68,19 +81,21 @@ sim_t::sim_t(const char* isa, const char* priv, const char* varch,
   debug_mmu = new mmu_t(this, NULL);
 
   if (! (hartids.empty() || hartids.size() == nprocs)) {
-      std::cerr << "Number of specified hartids ("
-                << hartids.size()
-                << ") doesn't match number of processors ("
-                << nprocs << ").\n";
-      exit(1);
+      throw std::invalid_argument("Number of specified hartids (" +
+                                  std::to_string(hartids.size()) +
+                                  ") doesn't match number of processors (" +
+                                  std::to_string(nprocs) + ").");
   }
 
   for (size_t i = 0; i < nprocs; i++) {
     int hart_id = hartids.empty() ? i : hartids[i];
-    procs[i] = new processor_t(isa, priv, varch, this, hart_id, halted,
-                               log_file.get());
+    procs[i] = new processor_t(isa, priv, varch, this, hart_id, halted);
   }
 
+  trace_writer.reset(new trace_writer_t(procs, log_file.get()));
+  for (size_t i = 0; i < nprocs; i++)
+    procs[i]->set_trace(trace_writer->get_hart(i));
+
   make_dtb();
 
   clint.reset(new clint_t(procs, CPU_HZ / INSNS_PER_RTC_TICK, real_time_clint));
@@ -103,6 +118,8 @@ sim_t::sim_t(const char* isa, const char* priv, const char* varch,
 
 sim_t::~sim_t()
 {
+  hart_pool.reset();
+  trace_writer.reset();
   for (size_t i = 0; i < procs.size(); i++)
     delete procs[i];
   delete debug_mmu;
@@ -117,13 +134,19 @@ void sim_t::main()
 {
   if (!debug && log)
     set_procs_debug(true);
+  if (fast_forward_insns > steps_per_hart)
+    set_detailed(false);
 
   while (!done())
   {
     if (debug || ctrlc_pressed)
       interactive();
+    else if (hart_pool)
+      step_parallel();
     else
       step(INTERLEAVE);
+    if (checkpoint_requested)
+      save_checkpoint();
     if (remote_bitbang) {
       remote_bitbang->tick();
     }
@@ -134,24 +157,65 @@ int sim_t::run()
 {
   host = context_t::current();
   target.init(sim_thread_main, this);
-  return htif_t::run();
+  int exit_code = htif_t::run();
+  trace_writer->flush();
+
+  if (tcdm_profiler)
+    tcdm_profiler->print_report(tcdm_profile->get(), [this](reg_t addr, reg_t* start) {
+      return get_symbol_before(addr, start);
+    });
+  if (amo_profiler)
+    amo_profiler->print_report(amo_profile->get(), [this](reg_t addr, reg_t* start) {
+      return get_symbol_before(addr, start);
+    });
+  if (mempool_cache)
+    mempool_cache->print_report(stdout);
+  if (bbv_profiler)
+    bbv_profiler->finish();
+  if (func_profiler) {
+    try {
+      func_profiler->write(func_profile_prefix);
+    } catch (std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+  return exit_code;
 }
 
 void sim_t::step(size_t n)
 {
   for (size_t i = 0, steps = 0; i < n; i += steps)
   {
-    steps = std::min(n - i, INTERLEAVE - current_step);
+    if (schedule && current_step == 0) {
+      size_t last_proc = current_proc;
+      schedule->next(&current_proc, &slice_steps);
+      // Another hart may have written the reserved address meanwhile
+      if (current_proc != last_proc)
+        procs[last_proc]->get_mmu()->yield_load_reservation();
+    }
+
+    steps = std::min(n - i, slice_steps - current_step);
     procs[current_proc]->step(steps);
 
     current_step += steps;
-    if (current_step == INTERLEAVE)
+    if (current_step == slice_steps)
     {
       current_step = 0;
-      procs[current_proc]->get_mmu()->yield_load_reservation();
-      if (++current_proc == procs.size()) {
-        current_proc = 0;
-        clint->increment(INTERLEAVE / INSNS_PER_RTC_TICK);
+      if (schedule) {
+        // The harts advance unevenly; keep time by the steps of all of them
+        round_steps += slice_steps;
+        if (round_steps >= INTERLEAVE * procs.size()) {
+          round_steps -= INTERLEAVE * procs.size();
+          clint->increment(INTERLEAVE / INSNS_PER_RTC_TICK);
+          count_steps(INTERLEAVE);
+        }
+      } else {
+        procs[current_proc]->get_mmu()->yield_load_reservation();
+        if (++current_proc == procs.size()) {
+          current_proc = 0;
+          clint->increment(INTERLEAVE / INSNS_PER_RTC_TICK);
+          count_steps(INTERLEAVE);
+        }
       }
 
       host->switch_to();
@@ -159,6 +223,190 @@ void sim_t::step(size_t n)
   }
 }
 
+void sim_t::step_parallel()
+{
+  hart_pool->run(quantum);
+  clint->increment(quantum / INSNS_PER_RTC_TICK);
+  count_steps(quantum);
+  host->switch_to();
+}
+
+void sim_t::count_steps(size_t n)
+{
+  steps_per_hart += n;
+  if (checkpoint_insns && steps_per_hart >= checkpoint_insns)
+    checkpoint_requested = !checkpoint_path.empty();
+  if (!detailed && steps_per_hart >= fast_forward_insns)
+    set_detailed(true);
+}
+
+void sim_t::set_detailed(bool value)
+{
+  detailed = value;
+  for (size_t i = 0; i < procs.size(); i++) {
+    processor_t* p = procs[i];
+    p->get_mmu()->set_memtracers_enabled(value);
+    p->set_profiler(value && func_profiler ? func_profiler->get_hart(i) : NULL);
+    p->get_mmu()->set_amo_profiler(value && amo_profiler ? amo_profiler->get_hart(i) : NULL);
+    p->set_histogram(value && histogram_enabled);
+#ifdef RISCV_ENABLE_COMMITLOG
+    p->pause_log_commits(!value);
+#endif
+    if (log && !debug)
+      p->set_debug(value);
+  }
+}
+
+void sim_t::configure_bbv(const char* prefix, reg_t interval)
+{
+  bbv_profiler.reset(new bbv_profiler_t(procs, prefix, interval));
+  for (size_t i = 0; i < procs.size(); i++)
+    procs[i]->set_bbv(bbv_profiler->get_hart(i));
+}
+
+void sim_t::configure_sampling(reg_t fast_forward, reg_t window)
+{
+  fast_forward_insns = fast_forward;
+  window_insns = window;
+}
+
+void sim_t::configure_schedule(size_t max_slice, const uint64_t* seed,
+                                const char* record_path, const char* replay_path)
+{
+  if (hart_pool)
+    throw std::invalid_argument("a schedule can't be used with --threads or "
+                                "--deterministic");
+  if (!checkpoint_path.empty() || !restore_path.empty())
+    throw std::invalid_argument("a schedule can't be used with checkpoints");
+
+  schedule.reset(new schedule_t(procs.size(), max_slice ? max_slice : size_t(INTERLEAVE)));
+  if (seed)
+    schedule->set_seed(*seed);
+  if (replay_path)
+    schedule->replay(replay_path);
+  if (record_path)
+    schedule->record(record_path);
+}
+
+void sim_t::configure_parallel(size_t nthreads, size_t quantum, bool ordered)
+{
+  this->quantum = quantum ? quantum : size_t(INTERLEAVE);
+  if (nthreads > 1 || ordered)
+    hart_pool.reset(new hart_pool_t(procs, nthreads, ordered));
+  else
+    hart_pool.reset();
+}
+
+void sim_t::configure_mempool(size_t num_groups, size_t num_cores_per_tile,
+                              size_t banking_factor, size_t seq_mem_size)
+{
+  mempool_ctrl.reset(new mempool_ctrl_t(procs, num_groups, num_cores_per_tile,
+                                        MEMPOOL_TCDM_BASE,
+                                        procs.size() * banking_factor * MEMPOOL_BANK_SIZE));
+  tcdm_map.reset(new tcdm_map_t(procs.size(), num_groups, num_cores_per_tile,
+                                banking_factor, seq_mem_size,
+                                MEMPOOL_TCDM_BASE, MEMPOOL_BANK_SIZE));
+  mempool_uart.reset(new mempool_uart_t());
+  bus.add_device(MEMPOOL_CTRL_BASE, mempool_ctrl.get());
+  bus.add_device(MEMPOOL_UART_BASE, mempool_uart.get());
+
+  // The TCDM starts at address 0, where the debug module and the boot ROM
+  // usually sit. Give its memory back the place of the debug module and
+  // boot from where MemPool's boot ROM lives instead.
+  for (auto& x : mems)
+    bus.add_device(x.first, x.second);
+  rstvec = MEMPOOL_BOOT_ADDR;
+  for (auto p : procs)
+    p->set_reset_vector(rstvec);
+}
+
+void sim_t::configure_tcdm_profiler(const char* path)
+{
+  if (!tcdm_map)
+    throw std::invalid_argument("the TCDM profiler requires --mempool");
+  tcdm_profile.reset(new log_file_t(path));
+  tcdm_profiler.reset(new tcdm_profiler_t(*tcdm_map, procs));
+}
+
+void sim_t::configure_mempool_cache(const char* icache, const char* ro_cache)
+{
+  if (!tcdm_map)
+    throw std::invalid_argument("the cache models require --mempool");
+  mempool_cache.reset(new mempool_cache_t(*tcdm_map, *mempool_ctrl, procs,
+                                          icache, ro_cache));
+}
+
+void sim_t::configure_func_profiler(const char* prefix)
+{
+  func_profile_prefix = prefix;
+  func_profiler.reset(new func_profiler_t(procs));
+  for (size_t i = 0; i < procs.size(); i++)
+    procs[i]->set_profiler(func_profiler->get_hart(i));
+}
+
+void sim_t::configure_amo_profiler(const char* path)
+{
+  amo_profile.reset(new log_file_t(path));
+  amo_profiler.reset(new amo_profiler_t(procs));
+  for (size_t i = 0; i < procs.size(); i++)
+    procs[i]->get_mmu()->set_amo_profiler(amo_profiler->get_hart(i));
+}
+
+void sim_t::configure_checkpoint(const char* path, reg_t insns)
+{
+  checkpoint_path = path;
+  checkpoint_insns = insns;
+}
+
+void sim_t::trace_written(unsigned id, reg_t val)
+{
+  if (val && !checkpoint_insns && !checkpoint_path.empty())
+    checkpoint_requested = true;
+}
+
+void sim_t::checkpoint(checkpoint_t& c)
+{
+  c.section("SIM ");
+  c.check(procs.size(), "harts");
+  c.io(current_step);
+  c.io(current_proc);
+  c.io(steps_per_hart);
+
+  for (auto p : procs)
+    p->checkpoint(c);
+
+  for (auto& x : mems) {
+    c.section("MEM ");
+    c.check(x.first, "a memory at");
+    c.check(x.second->size(), "a memory of size");
+    c.memory(x.second->contents(), x.second->size());
+  }
+
+  clint->checkpoint(c);
+  if (mempool_ctrl)
+    mempool_ctrl->checkpoint(c);
+  c.section("END ");
+}
+
+void sim_t::save_checkpoint()
+{
+  checkpoint_requested = false;
+  try {
+    checkpoint_t c(checkpoint_path.c_str(), checkpoint_t::SAVE);
+    checkpoint(c);
+  } catch (std::runtime_error& e) {
+    // This runs on the target context; idle() throws it on the host's
+    checkpoint_error = e.what();
+  }
+  checkpoint_path.clear();
+}
+
+void sim_t::restore_checkpoint()
+{
+  checkpoint_t c(restore_path.c_str(), checkpoint_t::RESTORE);
+  checkpoint(c);
+}
+
 void sim_t::set_debug(bool value)
 {
   debug = value;
@@ -172,7 +420,8 @@ void sim_t::set_histogram(bool value)
   }
 }
 
-void sim_t::configure_log(bool enable_log, bool enable_commitlog)
+void sim_t::configure_log(bool enable_log, bool enable_commitlog,
+                          bool binary_commitlog)
 {
   log = enable_log;
 
@@ -180,18 +429,33 @@ void sim_t::configure_log(bool enable_log, bool enable_commitlog)
     return;
 
 #ifndef RISCV_ENABLE_COMMITLOG
-  fputs("Commit logging support has not been properly enabled; "
-        "please re-build the riscv-isa-sim project using "
-        "\"configure --enable-commitlog\".\n",
-        stderr);
-  abort();
+  throw std::runtime_error("Commit logging support has not been properly "
+                           "enabled; please re-build the riscv-isa-sim project "
+                           "using \"configure --enable-commitlog\".");
 #else
+  if (binary_commitlog)
+    commit_log_write_header(log_file.get());
+  trace_writer->set_binary(binary_commitlog);
   for (processor_t *proc : procs) {
     proc->enable_log_commits();
   }
 #endif
 }
 
+void sim_t::configure_dasm_trace(const char* dir)
+{
+#ifndef RISCV_ENABLE_COMMITLOG
+  throw std::runtime_error("Tracing to dasm files requires commit logging "
+                           "support; please re-build the riscv-isa-sim project "
+                           "using \"configure --enable-commitlog\".");
+#else
+  trace_writer->set_dasm_dir(dir);
+  for (processor_t *proc : procs) {
+    proc->enable_dasm_trace();
+  }
+#endif
+}
+
 void sim_t::set_procs_debug(bool value)
 {
   for (size_t i=0; i< procs.size(); i++)
@@ -221,10 +485,8 @@ void sim_t::make_dtb()
 {
   if (!dtb_file.empty()) {
     std::ifstream fin(dtb_file.c_str(), std::ios::binary);
-    if (!fin.good()) {
-      std::cerr << "can't find dtb file: " << dtb_file << std::endl;
-      exit(-1);
-    }
+    if (!fin.good())
+      throw std::runtime_error("can't find dtb file: " + dtb_file);
 
     std::stringstream strstream;
     strstream << fin.rdbuf();
@@ -262,10 +524,8 @@ void sim_t::set_rom()
   std::string dtb;
   if (!dtb_file.empty()) {
     std::ifstream fin(dtb_file.c_str(), std::ios::binary);
-    if (!fin.good()) {
-      std::cerr << "can't find dtb file: " << dtb_file << std::endl;
-      exit(-1);
-    }
+    if (!fin.good())
+      throw std::runtime_error("can't find dtb file: " + dtb_file);
 
     std::stringstream strstream;
     strstream << fin.rdbuf();
@@ -281,7 +541,7 @@ void sim_t::set_rom()
   rom.resize((rom.size() + align - 1) / align * align);
 
   boot_rom.reset(new rom_device_t(rom));
-  bus.add_device(DEFAULT_RSTVEC, boot_rom.get());
+  bus.add_device(rstvec, boot_rom.get());
 }
 
 char* sim_t::addr_to_mem(reg_t addr) {
@@ -294,6 +554,37 @@ char* sim_t::addr_to_mem(reg_t addr) {
   return NULL;
 }
 
+void sim_t::map_memories()
+{
+  reg_t end = 0;
+  for (auto& m : mems)
+    end = std::max(end, m.first + m.second->size());
+  if (boot_rom)
+    end = std::max(end, rstvec + boot_rom->contents().size());
+  bare_map.reset(new bare_map_t(end));
+
+  // Only whole pages that no device shadows
+  for (auto& m : mems) {
+    for (reg_t paddr = (m.first + PGSIZE - 1) & PGMASK;
+         paddr + PGSIZE <= m.first + m.second->size(); paddr += PGSIZE) {
+      char* host = addr_to_mem(paddr);
+      if (host && addr_to_mem(paddr + PGSIZE - 1) == host + PGSIZE - 1)
+        bare_map->map(paddr, host, true);
+    }
+  }
+
+  // The boot ROM can be read directly, but its stores must fault
+  if (boot_rom && (rstvec & (PGSIZE - 1)) == 0) {
+    char* host = const_cast<char*>(boot_rom->contents().data());
+    for (reg_t off = 0; off + PGSIZE <= boot_rom->contents().size(); off += PGSIZE)
+      if (bus.find_device(rstvec + off + PGSIZE - 1).second == boot_rom.get())
+        bare_map->map(rstvec + off, host + off, false);
+  }
+
+  for (auto p : procs)
+    p->get_mmu()->set_bare_map(bare_map.get());
+}
+
 const char* sim_t::get_symbol(uint64_t addr)
 {
   return htif_t::get_symbol(addr);
@@ -305,11 +596,24 @@ void sim_t::reset()
 {
   if (dtb_enabled)
     set_rom();
+  map_memories();
+  if (func_profiler)
+    func_profiler->set_symbols(get_symbols());
+  if (!restore_path.empty())
+    restore_checkpoint();
 }
 
 void sim_t::idle()
 {
   target.switch_to();
+
+  if (!checkpoint_error.empty())
+    throw std::runtime_error(checkpoint_error);
+
+  if (mempool_ctrl && mempool_ctrl->eoc_valid())
+    set_exit_code(mempool_ctrl->eoc());
+  else if (window_insns && steps_per_hart >= fast_forward_insns + window_insns)
+    set_exit_code(0);
 }
 
 void sim_t::read_chunk(addr_t taddr, size_t len, void* dst)
@@ -327,6 +631,42 @@ void sim_t::write_chunk(addr_t taddr, size_t len, const void* src)
   debug_mmu->store_uint64(taddr, from_le(data));
 }
 
+void sim_t::clear_chunk(addr_t taddr, size_t len)
+{
+  reg_t offset;
+  if (mem_t* mem = find_mem(taddr, len, &offset))
+    mem->zero(offset, len);
+  else
+    htif_t::clear_chunk(taddr, len);
+}
+
+bool sim_t::map_chunk(addr_t taddr, size_t len, int fd, off_t offset)
+{
+  if (!map_elf)
+    return false;
+
+  reg_t mem_offset;
+  mem_t* mem = find_mem(taddr, len, &mem_offset);
+  return mem && mem->map_file(mem_offset, len, fd, offset);
+}
+
+mem_t* sim_t::find_mem(reg_t addr, size_t len, reg_t* offset)
+{
+  if (len == 0 || addr + len < addr || !paddr_ok(addr + len - 1))
+    return NULL;
+
+  auto desc = bus.find_device(addr);
+  auto mem = dynamic_cast<mem_t*>(desc.second);
+  if (!mem || addr - desc.first >= mem->size() ||
+      len > mem->size() - (addr - desc.first))
+    return NULL;
+  if (bus.find_device(addr + len - 1).second != mem)
+    return NULL;
+
+  *offset = addr - desc.first;
+  return mem;
+}
+
 void sim_t::proc_reset(unsigned id)
 {
   debug_module.proc_reset(id);
@@ -5,18 +5,29 @@
 
 #include "debug_module.h"
 #include "devices.h"
+#include "hart_pool.h"
 #include "log_file.h"
 #include "processor.h"
 #include "simif.h"
+#include "tcdm_map.h"
+#include "tcdm_profiler.h"
+#include "mempool_cache.h"
+#include "func_profiler.h"
+#include "amo_profiler.h"
+#include "bbv.h"
+#include "trace_writer.h"
+#include "schedule.h"
 
 #include <fesvr/htif.h>
 #include <fesvr/context.h>
+#include <atomic>
 #include <vector>
 #include <string>
 #include <memory>
 #include <sys/types.h>
 
 class mmu_t;
+class bare_map_t;
 class remote_bitbang_t;
 
 // this class encapsulates the processors and memory in a RISC-V machine.
@@ -37,14 +48,103 @@ public:
   int run();
   void set_debug(bool value);
   void set_histogram(bool value);
+  // Whether the ELF loader maps whole pages of the file instead of copying
+  // them, which is only safe while the file does not change
+  void set_map_elf(bool value) { map_elf = value; }
 
   // Configure logging
   //
   // If enable_log is true, an instruction trace will be generated. If
   // enable_commitlog is true, so will the commit results (if this
   // build was configured without support for commit logging, the
-  // function will print an error message and abort).
-  void configure_log(bool enable_log, bool enable_commitlog);
+  // function throws std::runtime_error). With
+  // binary_commitlog, the commit log is written in the binary format of
+  // commit_log.h instead of as text.
+  void configure_log(bool enable_log, bool enable_commitlog,
+                     bool binary_commitlog = false);
+
+  // Trace to one file per hart as the RTL does
+  //
+  // While the trace CSR is set, the instructions each hart retires are
+  // written to dir/trace_hart_0x<mhartid>.dasm in the format of the Snitch
+  // tracer, for spike-dasm and gen_trace.py. Needs commit logging support.
+  void configure_dasm_trace(const char* dir);
+
+  // Configure parallel execution
+  //
+  // With nthreads > 1 the harts are split across nthreads host threads, which
+  // synchronize every quantum instructions. If ordered is true, the same
+  // schedule is executed on a single host thread, which makes the run
+  // reproducible (see hart_pool_t).
+  void configure_parallel(size_t nthreads, size_t quantum, bool ordered);
+
+  // Model the MemPool platform
+  //
+  // Attaches the control registers and the fake UART of a MemPool cluster
+  // with num_groups groups of tiles of num_cores_per_tile cores each, and
+  // gives the harts sleeping wfi semantics. The simulation ends when the
+  // program writes the eoc register. The first seq_mem_size bytes of each
+  // core's TCDM share form its tile's sequential region.
+  void configure_mempool(size_t num_groups, size_t num_cores_per_tile,
+                         size_t banking_factor, size_t seq_mem_size);
+
+  // Profile the locality of TCDM accesses
+  //
+  // Requires the MemPool platform. The report is written to path when the
+  // simulation ends.
+  void configure_tcdm_profiler(const char* path);
+
+  // Model the instruction and read-only caches of MemPool
+  //
+  // Requires the MemPool platform. See mempool_cache_t for the geometries;
+  // either may be null. The statistics are printed when the simulation ends.
+  void configure_mempool_cache(const char* icache, const char* ro_cache);
+
+  // Profile the functions the harts execute
+  //
+  // Writes the folded stacks of each counter of func_profiler_t to
+  // <prefix>.<counter>.folded when the simulation ends.
+  void configure_func_profiler(const char* prefix);
+
+  // Profile the contention for atomics
+  //
+  // The report of amo_profiler_t is written to path when the simulation
+  // ends.
+  void configure_amo_profiler(const char* path);
+
+  // Save and restore checkpoints
+  //
+  // A checkpoint holds the harts, the memories and the devices. It is saved
+  // to path once: after every hart took insns steps or, if insns is 0, when
+  // the program first sets the trace CSR (as mempool_start_benchmark does).
+  // A restored checkpoint replaces the state right after the program was
+  // loaded, so the simulation must be configured as when it was saved.
+  void configure_checkpoint(const char* path, reg_t insns);
+  void configure_restore(const char* path) { restore_path = path; }
+
+  // Sampled simulation
+  //
+  // configure_bbv writes the basic-block vectors of every interval
+  // instructions of each hart to <prefix>.<hart>.bb (see bbv_profiler_t),
+  // from which SimPoint picks the representative intervals.
+  //
+  // configure_sampling runs the first fast_forward steps of every hart with
+  // the log, the commit log, the memtracers (cache models and profilers)
+  // and the function profiler off, then turns them on for a detailed window
+  // of window steps, after which the simulation ends. A window of 0 lasts
+  // until the program exits. Both are counted in whole interleaves or
+  // quanta of steps.
+  void configure_bbv(const char* prefix, reg_t interval);
+  void configure_sampling(reg_t fast_forward, reg_t window);
+
+  // Explore, record and replay the interleaving of the harts
+  //
+  // Replaces the fixed interleave of a serial run with a schedule_t whose
+  // slices last at most max_slice steps (INTERLEAVE if 0). A seed draws a
+  // random schedule; record_path, if not null, logs the slices and
+  // replay_path, if not null, repeats the slices of a recorded run.
+  void configure_schedule(size_t max_slice, const uint64_t* seed,
+                          const char* record_path, const char* replay_path);
 
   void set_procs_debug(bool value);
   void set_remote_bitbang(remote_bitbang_t* remote_bitbang) {
@@ -56,6 +156,7 @@ public:
 
   // Callback for processors to let the simulation know they were reset.
   void proc_reset(unsigned id);
+  void trace_written(unsigned id, reg_t val);
 
 private:
   std::vector<std::pair<reg_t, mem_t*>> mems;
@@ -66,6 +167,7 @@ private:
   reg_t initrd_end;
   const char* bootargs;
   reg_t start_pc;
+  reg_t rstvec;
   std::string dts;
   std::string dtb;
   std::string dtb_file;
@@ -73,18 +175,52 @@ private:
   std::unique_ptr<rom_device_t> boot_rom;
   std::unique_ptr<clint_t> clint;
   bus_t bus;
+  std::unique_ptr<bare_map_t> bare_map; // the memories by physical page
   log_file_t log_file;
+  std::unique_ptr<trace_writer_t> trace_writer; // formats the logs off-thread
+  std::unique_ptr<hart_pool_t> hart_pool;
+  size_t quantum;
+  std::unique_ptr<mempool_ctrl_t> mempool_ctrl;
+  std::unique_ptr<mempool_uart_t> mempool_uart;
+  std::unique_ptr<tcdm_map_t> tcdm_map;
+  std::unique_ptr<tcdm_profiler_t> tcdm_profiler;
+  std::unique_ptr<log_file_t> tcdm_profile;
+  std::unique_ptr<mempool_cache_t> mempool_cache;
+  std::unique_ptr<func_profiler_t> func_profiler;
+  std::string func_profile_prefix;
+  std::unique_ptr<amo_profiler_t> amo_profiler;
+  std::unique_ptr<log_file_t> amo_profile;
+  std::string checkpoint_path;
+  reg_t checkpoint_insns;
+  std::atomic<bool> checkpoint_requested;
+  std::string checkpoint_error;
+  std::string restore_path;
+  std::unique_ptr<bbv_profiler_t> bbv_profiler;
+  reg_t fast_forward_insns;
+  reg_t window_insns;
+  bool detailed;
+  std::unique_ptr<schedule_t> schedule;
+  size_t slice_steps; // length of the current slice of the schedule
+  size_t round_steps; // steps of the schedule since the clint last ticked
 
   processor_t* get_core(const std::string& i);
   void step(size_t n); // step through simulation
+  void step_parallel(); // step all harts through one quantum
+  void count_steps(size_t n); // every hart took n more steps
+  void set_detailed(bool value);
+  void checkpoint(checkpoint_t& c);
+  void save_checkpoint();
+  void restore_checkpoint();
   static const size_t INTERLEAVE = 5000;
   static const size_t INSNS_PER_RTC_TICK = 100; // 10 MHz clock for 1 BIPS core
   static const size_t CPU_HZ = 1000000000; // 1GHz CPU
   size_t current_step;
   size_t current_proc;
+  reg_t steps_per_hart; // steps every hart has taken so far
   bool debug;
   bool histogram_enabled; // provide a histogram of PCs
   bool log;
+  bool map_elf;
   remote_bitbang_t* remote_bitbang;
 
   // memory-mapped I/O routines
@@ -93,6 +229,7 @@ private:
   bool mmio_store(reg_t addr, size_t len, const uint8_t* bytes);
   void make_dtb();
   void set_rom();
+  void map_memories();
 
   const char* get_symbol(uint64_t addr);
 
@@ -136,6 +273,11 @@ private:
   void idle();
   void read_chunk(addr_t taddr, size_t len, void* dst);
   void write_chunk(addr_t taddr, size_t len, const void* src);
+  void clear_chunk(addr_t taddr, size_t len);
+  bool map_chunk(addr_t taddr, size_t len, int fd, off_t offset);
+  // the memory that holds all of [addr, addr + len), and the offset of addr
+  // in it, unless a device shadows part of the range
+  mem_t* find_mem(reg_t addr, size_t len, reg_t* offset);
   size_t chunk_align() { return 8; }
   size_t chunk_max_size() { return 8; }
 
@@ -16,6 +16,9 @@ public:
   virtual bool mmio_store(reg_t addr, size_t len, const uint8_t* bytes) = 0;
   // Callback for processors to let the simulation know they were reset.
   virtual void proc_reset(unsigned id) = 0;
+  // Callback for processors to let the simulation know they wrote the
+  // trace CSR, which MemPool programs use to mark their region of interest.
+  virtual void trace_written(unsigned id, reg_t val) {}
 
   virtual const char* get_symbol(uint64_t addr) = 0;
 
@@ -0,0 +1,102 @@
+// See LICENSE for license details.
+#ifndef _RISCV_TCDM_MAP_H
+#define _RISCV_TCDM_MAP_H
+
+#include "decode.h"
+#include <stdexcept>
+
+// Address map of the MemPool TCDM.
+//
+// The TCDM starts at base and is word-interleaved over all banks of the
+// cluster: consecutive words go to consecutive banks of a tile, and
+// consecutive rows of a tile's banks go to consecutive tiles. The first
+// seq_mem_size bytes of every core are remapped by address_scrambler.sv so
+// that each tile owns a contiguous sequential region at the bottom of the
+// TCDM.
+class tcdm_map_t
+{
+public:
+  enum region_t { OTHER, SEQUENTIAL, INTERLEAVED };
+
+  tcdm_map_t(size_t num_cores, size_t num_groups, size_t num_cores_per_tile,
+             size_t banking_factor, size_t seq_mem_size, reg_t base,
+             reg_t bank_size)
+    : base(base), num_cores_per_tile(num_cores_per_tile)
+  {
+    num_tiles = num_cores / num_cores_per_tile;
+    num_tiles_per_group = num_tiles / num_groups;
+    num_banks_per_tile = num_cores_per_tile * banking_factor;
+    seq_size_per_tile = num_cores_per_tile * seq_mem_size;
+    size = num_tiles * num_banks_per_tile * bank_size;
+
+    if (!is_pow2(num_tiles) || !is_pow2(num_tiles_per_group) ||
+        !is_pow2(num_banks_per_tile) || num_banks_per_tile < 2)
+      throw std::invalid_argument("the number of tiles and banks per tile must be powers of two");
+    if (seq_mem_size && (!is_pow2(seq_size_per_tile) ||
+                         seq_size_per_tile % (4 * num_banks_per_tile) != 0))
+      throw std::invalid_argument("the sequential region of a tile must be a power of two and span all its banks");
+
+    bank_bits = ctz(num_banks_per_tile) + 2;
+    tile_bits = ctz(num_tiles);
+    seq_bits = seq_mem_size ? ctz(seq_size_per_tile) : 0;
+  }
+
+  size_t get_num_tiles() const { return num_tiles; }
+  size_t get_num_groups() const { return num_tiles / num_tiles_per_group; }
+  size_t get_num_banks() const { return num_tiles * num_banks_per_tile; }
+  size_t get_num_banks_per_tile() const { return num_banks_per_tile; }
+  reg_t get_base() const { return base; }
+  reg_t get_size() const { return size; }
+
+  bool contains(reg_t addr) const { return addr - base < size; }
+
+  region_t region(reg_t addr) const
+  {
+    if (!contains(addr))
+      return OTHER;
+    return addr - base < num_tiles * seq_size_per_tile ? SEQUENTIAL : INTERLEAVED;
+  }
+
+  // Offset of addr in the interleaved TCDM after address_scrambler.sv
+  reg_t scramble(reg_t addr) const
+  {
+    reg_t offset = addr - base;
+    if (num_tiles < 2 || seq_bits == 0 || offset >= num_tiles * seq_size_per_tile)
+      return offset;
+    reg_t scramble_mask = (reg_t(1) << (seq_bits - bank_bits)) - 1;
+    reg_t tile_id = (offset >> seq_bits) & (num_tiles - 1);
+    reg_t row = (offset >> bank_bits) & scramble_mask;
+    reg_t low = offset & ((reg_t(1) << bank_bits) - 1);
+    reg_t high = offset >> (seq_bits + tile_bits) << (seq_bits + tile_bits);
+    return high | row << (bank_bits + tile_bits) | tile_id << bank_bits | low;
+  }
+
+  // Global index of the bank that holds addr, which must be in the TCDM
+  size_t bank(reg_t addr) const
+  {
+    reg_t offset = scramble(addr);
+    size_t tile = (offset >> bank_bits) & (num_tiles - 1);
+    return tile * num_banks_per_tile + ((offset >> 2) & (num_banks_per_tile - 1));
+  }
+
+  size_t tile_of_bank(size_t bank) const { return bank / num_banks_per_tile; }
+  size_t tile_of_hart(size_t hartid) const { return hartid / num_cores_per_tile; }
+  size_t group_of_tile(size_t tile) const { return tile / num_tiles_per_group; }
+
+private:
+  reg_t base;
+  reg_t size;
+  size_t num_cores_per_tile;
+  size_t num_tiles;
+  size_t num_tiles_per_group;
+  size_t num_banks_per_tile;
+  reg_t seq_size_per_tile;
+  unsigned bank_bits;  // byte offset and bank within a tile
+  unsigned tile_bits;
+  unsigned seq_bits;
+
+  static bool is_pow2(reg_t x) { return x && !(x & (x - 1)); }
+  static unsigned ctz(reg_t x) { unsigned n = 0; while (!(x & 1)) x >>= 1, n++; return n; }
+};
+
+#endif
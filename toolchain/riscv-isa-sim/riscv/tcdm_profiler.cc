@@ -0,0 +1,204 @@
+// See LICENSE for license details.
+
+#include "tcdm_profiler.h"
+#include "processor.h"
+#include "mmu.h"
+#include <algorithm>
+#include <cinttypes>
+#include <map>
+#include <string>
+
+uint64_t tcdm_profiler_t::counts_t::total() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i < NUM_LOCALITIES; i++)
+    n += loads[i] + stores[i];
+  return n;
+}
+
+tcdm_profiler_t::hart_tracer_t::hart_tracer_t(const tcdm_map_t& map,
+                                              processor_t* proc, size_t hartid)
+  : counts(), regions(), banks(map.get_num_banks()), map(map), proc(proc),
+    tile(map.tile_of_hart(hartid)), group(map.group_of_tile(tile))
+{
+}
+
+bool tcdm_profiler_t::hart_tracer_t::interested_in_range(uint64_t begin, uint64_t end, access_type type)
+{
+  return type != FETCH && begin < map.get_base() + map.get_size() &&
+         end > map.get_base();
+}
+
+void tcdm_profiler_t::hart_tracer_t::trace(uint64_t addr, size_t bytes, access_type type)
+{
+  if (type == FETCH)
+    return;
+
+  tcdm_map_t::region_t region = map.region(addr);
+  regions[region]++;
+  if (region == tcdm_map_t::OTHER)
+    return;
+
+  size_t bank = map.bank(addr);
+  size_t bank_tile = map.tile_of_bank(bank);
+  locality_t locality = bank_tile == tile ? TILE_LOCAL :
+                        map.group_of_tile(bank_tile) == group ? GROUP_LOCAL :
+                        REMOTE;
+  banks[bank]++;
+
+  // RV32 PCs are kept sign-extended, the symbols are not
+  reg_t pc = proc->get_state()->pc;
+  if (proc->get_xlen() == 32)
+    pc = (uint32_t)pc;
+  counts_t& pc_counts = pcs[pc];
+  if (type == STORE) {
+    counts.stores[locality]++;
+    pc_counts.stores[locality]++;
+  } else {
+    counts.loads[locality]++;
+    pc_counts.loads[locality]++;
+  }
+}
+
+tcdm_profiler_t::tcdm_profiler_t(const tcdm_map_t& map,
+                                 const std::vector<processor_t*>& procs)
+  : map(map), procs(procs)
+{
+  for (size_t i = 0; i < procs.size(); i++) {
+    tracers.emplace_back(new hart_tracer_t(map, procs[i], i));
+    procs[i]->get_mmu()->register_memtracer(tracers.back().get());
+  }
+}
+
+static void print_counts(FILE* out, const char* name, uint64_t loads,
+                         uint64_t stores, const uint64_t* by_locality)
+{
+  uint64_t total = loads + stores;
+  fprintf(out, "%-24s %12" PRIu64 " %12" PRIu64, name, loads, stores);
+  for (size_t i = 0; i < tcdm_profiler_t::NUM_LOCALITIES; i++)
+    fprintf(out, " %12" PRIu64 " %5.1f%%", by_locality[i],
+            total ? 100.0 * by_locality[i] / total : 0.0);
+  fprintf(out, "\n");
+}
+
+static void print_header(FILE* out, const char* first)
+{
+  fprintf(out, "%-24s %12s %12s %20s %20s %20s\n", first, "loads", "stores",
+          "tile-local", "group-local", "remote");
+}
+
+void tcdm_profiler_t::print_harts(FILE* out) const
+{
+  uint64_t sum[NUM_LOCALITIES] = {}, loads = 0, stores = 0;
+  uint64_t regions[3] = {};
+
+  print_header(out, "hart");
+  for (size_t i = 0; i < tracers.size(); i++) {
+    const counts_t& c = tracers[i]->counts;
+    uint64_t l = 0, s = 0, by_locality[NUM_LOCALITIES];
+    for (size_t j = 0; j < NUM_LOCALITIES; j++) {
+      by_locality[j] = c.loads[j] + c.stores[j];
+      sum[j] += by_locality[j];
+      l += c.loads[j];
+      s += c.stores[j];
+    }
+    loads += l;
+    stores += s;
+    for (size_t j = 0; j < 3; j++)
+      regions[j] += tracers[i]->regions[j];
+    print_counts(out, std::to_string(i).c_str(), l, s, by_locality);
+  }
+  print_counts(out, "total", loads, stores, sum);
+
+  fprintf(out, "\n%" PRIu64 " sequential, %" PRIu64 " interleaved and %"
+          PRIu64 " other accesses\n", regions[tcdm_map_t::SEQUENTIAL],
+          regions[tcdm_map_t::INTERLEAVED], regions[tcdm_map_t::OTHER]);
+}
+
+void tcdm_profiler_t::print_functions(FILE* out, const symbolizer_t& symbolize) const
+{
+  std::map<std::string, counts_t> functions;
+  for (auto& t : tracers) {
+    for (auto& pc : t->pcs) {
+      reg_t start;
+      const char* name = symbolize(pc.first, &start);
+      counts_t& c = functions[name ? name : "[unknown]"];
+      for (size_t i = 0; i < NUM_LOCALITIES; i++) {
+        c.loads[i] += pc.second.loads[i];
+        c.stores[i] += pc.second.stores[i];
+      }
+    }
+  }
+
+  std::vector<std::pair<std::string, counts_t>> sorted(functions.begin(), functions.end());
+  std::stable_sort(sorted.begin(), sorted.end(), [](
+      const std::pair<std::string, counts_t>& a,
+      const std::pair<std::string, counts_t>& b) {
+    return a.second.total() > b.second.total();
+  });
+
+  print_header(out, "function");
+  for (auto& f : sorted) {
+    uint64_t loads = 0, stores = 0, by_locality[NUM_LOCALITIES];
+    for (size_t i = 0; i < NUM_LOCALITIES; i++) {
+      by_locality[i] = f.second.loads[i] + f.second.stores[i];
+      loads += f.second.loads[i];
+      stores += f.second.stores[i];
+    }
+    print_counts(out, f.first.c_str(), loads, stores, by_locality);
+  }
+}
+
+void tcdm_profiler_t::print_banks(FILE* out) const
+{
+  static const char shades[] = " .:-=+*#%@";
+  const size_t num_shades = sizeof(shades) - 2;
+
+  std::vector<uint64_t> banks(map.get_num_banks());
+  for (auto& t : tracers)
+    for (size_t i = 0; i < banks.size(); i++)
+      banks[i] += t->banks[i];
+
+  uint64_t total = 0, max = 0;
+  for (auto n : banks) {
+    total += n;
+    max = std::max(max, n);
+  }
+
+  // One row per tile, one column per bank, darker is hotter
+  size_t per_tile = map.get_num_banks_per_tile();
+  fprintf(out, "bank heatmap (' ' idle to '@' %" PRIu64 " accesses)\n", max);
+  for (size_t tile = 0; tile < map.get_num_tiles(); tile++) {
+    fprintf(out, "tile %4zu |", tile);
+    for (size_t i = tile * per_tile; i < (tile + 1) * per_tile; i++)
+      fputc(shades[max ? (banks[i] * num_shades + max - 1) / max : 0], out);
+    fprintf(out, "|\n");
+  }
+
+  std::vector<size_t> hottest(banks.size());
+  for (size_t i = 0; i < hottest.size(); i++)
+    hottest[i] = i;
+  std::stable_sort(hottest.begin(), hottest.end(), [&](size_t a, size_t b) {
+    return banks[a] > banks[b];
+  });
+
+  fprintf(out, "\n%-8s %8s %12s %7s\n", "bank", "tile", "accesses", "share");
+  for (size_t i = 0; i < std::min<size_t>(16, hottest.size()); i++) {
+    size_t bank = hottest[i];
+    if (banks[bank] == 0)
+      break;
+    fprintf(out, "%-8zu %8zu %12" PRIu64 " %6.2f%%\n", bank,
+            map.tile_of_bank(bank), banks[bank], 100.0 * banks[bank] / total);
+  }
+}
+
+void tcdm_profiler_t::print_report(FILE* out, const symbolizer_t& symbolize) const
+{
+  fprintf(out, "TCDM accesses of %zu harts, %zu tiles, %zu banks\n\n",
+          procs.size(), map.get_num_tiles(), map.get_num_banks());
+  print_harts(out);
+  fprintf(out, "\n");
+  print_functions(out, symbolize);
+  fprintf(out, "\n");
+  print_banks(out);
+}
@@ -0,0 +1,70 @@
+// See LICENSE for license details.
+#ifndef _RISCV_TCDM_PROFILER_H
+#define _RISCV_TCDM_PROFILER_H
+
+#include "memtracer.h"
+#include "tcdm_map.h"
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class processor_t;
+
+// Classifies the TCDM accesses of every hart by where the accessed bank sits
+// relative to the hart: in its own tile, in another tile of its group, or in
+// another group. This is the classification hardware/scripts/gen_trace.py
+// derives from an RTL trace, available after a run of the ISA simulator.
+//
+// Each hart gets its own memtracer, so harts stepped on different host
+// threads never share counters.
+class tcdm_profiler_t
+{
+public:
+  enum locality_t { TILE_LOCAL, GROUP_LOCAL, REMOTE, NUM_LOCALITIES };
+
+  // Looks up the symbol at or below an address and returns its name
+  typedef std::function<const char*(reg_t addr, reg_t* start)> symbolizer_t;
+
+  tcdm_profiler_t(const tcdm_map_t& map, const std::vector<processor_t*>& procs);
+
+  void print_report(FILE* out, const symbolizer_t& symbolize) const;
+
+private:
+  struct counts_t
+  {
+    uint64_t loads[NUM_LOCALITIES];
+    uint64_t stores[NUM_LOCALITIES];
+    uint64_t total() const;
+  };
+
+  class hart_tracer_t : public memtracer_t
+  {
+  public:
+    hart_tracer_t(const tcdm_map_t& map, processor_t* proc, size_t hartid);
+    bool interested_in_range(uint64_t begin, uint64_t end, access_type type);
+    void trace(uint64_t addr, size_t bytes, access_type type);
+
+    counts_t counts;
+    uint64_t regions[3];
+    std::vector<uint64_t> banks;
+    std::unordered_map<reg_t, counts_t> pcs;
+
+  private:
+    const tcdm_map_t& map;
+    processor_t* proc;
+    size_t tile;
+    size_t group;
+  };
+
+  const tcdm_map_t& map;
+  const std::vector<processor_t*>& procs;
+  std::vector<std::unique_ptr<hart_tracer_t>> tracers;
+
+  void print_harts(FILE* out) const;
+  void print_functions(FILE* out, const symbolizer_t& symbolize) const;
+  void print_banks(FILE* out) const;
+};
+
+#endif
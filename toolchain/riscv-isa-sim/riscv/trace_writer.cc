@@ -0,0 +1,275 @@
+// See LICENSE for license details.
+
+#include "trace_writer.h"
+#include "commit_log.h"
+#include "disasm.h"
+#include "processor.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstring>
+
+hart_trace_t::hart_trace_t(trace_writer_t* writer, size_t index)
+  : writer(writer), index(index), record_start(0),
+    free_buffers(NUM_BUFFERS - 1), dasm_cycle(0)
+{
+  // Records are small, so a buffer rarely outgrows this
+  buf.reserve(BUFFER_SIZE + 4096);
+  for (auto& b : free_buffers)
+    b.reserve(BUFFER_SIZE + 4096);
+}
+
+void hart_trace_t::printf(const char* fmt, ...)
+{
+  char text[256];
+  va_list ap, retry;
+  va_start(ap, fmt);
+  va_copy(retry, ap);
+  int len = std::max(0, vsnprintf(text, sizeof(text), fmt, ap));
+  va_end(ap);
+
+  std::vector<uint8_t>& rec = begin_record(TRACE_TEXT, TRACE_TO_LOG);
+  if (len < (int)sizeof(text)) {
+    rec.insert(rec.end(), text, text + len);
+  } else {
+    // Longer lines are formatted again, straight into the record
+    size_t start = rec.size();
+    rec.resize(start + len + 1);
+    vsnprintf((char*)&rec[start], len + 1, fmt, retry);
+    rec.resize(start + len);
+  }
+  va_end(retry);
+  end_record();
+}
+
+void hart_trace_t::disasm(reg_t pc, uint64_t bits, uint64_t executions)
+{
+  trace_disasm_t d = {pc, bits, executions};
+  std::vector<uint8_t>& rec = begin_record(TRACE_DISASM, TRACE_TO_LOG);
+  rec.insert(rec.end(), (uint8_t*)&d, (uint8_t*)(&d + 1));
+  end_record();
+}
+
+void hart_trace_t::submit()
+{
+  writer->submit(this);
+}
+
+trace_writer_t::trace_writer_t(const std::vector<processor_t*>& procs,
+                               FILE* log)
+  : procs(procs), log(log), binary(false), busy(false), stopping(false)
+{
+  for (size_t i = 0; i < procs.size(); i++)
+    harts.emplace_back(new hart_trace_t(this, i));
+  thread = std::thread(&trace_writer_t::run, this);
+}
+
+trace_writer_t::~trace_writer_t()
+{
+  flush();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  work_ready.notify_one();
+  thread.join();
+}
+
+void trace_writer_t::set_dasm_dir(const char* dir)
+{
+  for (size_t i = 0; i < harts.size(); i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "/trace_hart_0x%08x.dasm", procs[i]->get_id());
+    harts[i]->dasm_file.reset(new log_file_t((std::string(dir) + name).c_str()));
+  }
+}
+
+void trace_writer_t::submit(hart_trace_t* hart)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  buffer_free.wait(guard, [hart] { return !hart->free_buffers.empty(); });
+  queue.emplace_back(hart, std::move(hart->buf));
+  hart->buf = std::move(hart->free_buffers.back());
+  hart->free_buffers.pop_back();
+  work_ready.notify_one();
+}
+
+void trace_writer_t::flush()
+{
+  for (auto& h : harts)
+    if (!h->buf.empty())
+      submit(h.get());
+
+  std::unique_lock<std::mutex> guard(lock);
+  buffer_free.wait(guard, [this] { return queue.empty() && !busy; });
+  fflush(log);
+  for (auto& h : harts)
+    if (h->dasm_file)
+      fflush(h->dasm_file->get());
+}
+
+void trace_writer_t::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    work_ready.wait(guard, [this] { return stopping || !queue.empty(); });
+    if (queue.empty())
+      return;
+
+    auto item = std::move(queue.front());
+    queue.pop_front();
+    busy = true;
+    guard.unlock();
+
+    write(item.first, item.second);
+    item.second.clear();
+
+    guard.lock();
+    busy = false;
+    item.first->free_buffers.push_back(std::move(item.second));
+    buffer_free.notify_all();
+  }
+}
+
+void trace_writer_t::write(hart_trace_t* hart, const std::vector<uint8_t>& buf)
+{
+  for (size_t pos = 0; pos < buf.size(); ) {
+    trace_record_t rec;
+    memcpy(&rec, &buf[pos], sizeof(rec));
+    const uint8_t* payload = &buf[pos + sizeof(rec)];
+    pos += sizeof(rec) + rec.size;
+
+    switch (rec.kind) {
+      case TRACE_TEXT:
+        if (!binary)
+          fwrite(payload, 1, rec.size, log);
+        break;
+      case TRACE_DISASM: {
+        trace_disasm_t d;
+        memcpy(&d, payload, sizeof(d));
+        if (!binary)
+          write_disasm(hart, d);
+        break;
+      }
+      case TRACE_COMMIT: {
+        trace_commit_t c;
+        memcpy(&c, payload, sizeof(c));
+        const uint8_t* commit = payload + sizeof(c);
+        if ((rec.dest & TRACE_TO_LOG) && binary)
+          fwrite(commit, 1, rec.size - sizeof(c), log);
+        else if (rec.dest & TRACE_TO_LOG)
+          commit_log_print(log, commit);
+        if ((rec.dest & TRACE_TO_DASM) && hart->dasm_file)
+          write_dasm(hart, c, commit);
+        break;
+      }
+    }
+  }
+}
+
+void trace_writer_t::write_disasm(hart_trace_t* hart, const trace_disasm_t& d)
+{
+  processor_t* p = procs[hart->index];
+  int id = p->get_id();
+
+#ifdef RISCV_ENABLE_COMMITLOG
+  if (const char* sym = p->get_symbol(d.pc))
+    fprintf(log, "core %3d: >>>>  %s\n", id, sym);
+#endif
+
+  if (d.executions != 1)
+    fprintf(log, "core %3d: Executed %" PRIx64 " times\n", id, d.executions);
+
+  // Disassembling is slow and programs run few distinct instructions
+  auto it = hart->disasm_cache.find(d.bits);
+  if (it == hart->disasm_cache.end()) {
+    // Sign-extend the bits as the fetch does
+    int shift = 64 - 8 * insn_length(d.bits);
+    insn_t insn((int64_t)(d.bits << shift) >> shift);
+    it = hart->disasm_cache.emplace(d.bits,
+      p->get_disassembler()->disassemble(insn)).first;
+  }
+  fprintf(log, "core %3d: 0x%016" PRIx64 " (0x%08" PRIx64 ") %s\n",
+          id, d.pc, d.bits, it->second.c_str());
+}
+
+// Fills in the decode, operand and load/store information of the Snitch
+// tracer from what Spike knows about a retired instruction. Spike does not
+// stall, so the stall counters stay 0, and loads retire in the cycle they
+// issue.
+void trace_writer_t::write_dasm(hart_trace_t* hart, const trace_commit_t& c,
+                                const uint8_t* rec)
+{
+  commit_log_insn_t insn;
+  memcpy(&insn, rec, sizeof(insn));
+  rec += sizeof(insn) + (insn.vec ? sizeof(commit_log_vec_t) : 0);
+
+  bool write_rd = false;
+  uint64_t writeback = 0;
+  for (unsigned i = 0; i < insn.nregs; i++) {
+    commit_log_reg_write_t reg;
+    memcpy(&reg, rec, sizeof(reg));
+    rec += sizeof(reg);
+    if ((reg.key & 0xf) == 0) {
+      write_rd = true;
+      memcpy(&writeback, rec, std::min<size_t>(reg.width / 8, sizeof(writeback)));
+    }
+    rec += reg.width / 8;
+  }
+
+  commit_log_load_t load = {0};
+  if (insn.nloads)
+    memcpy(&load, rec, sizeof(load));
+  rec += insn.nloads * sizeof(commit_log_load_t);
+  commit_log_store_t store = {0, 0, 0};
+  if (insn.nstores)
+    memcpy(&store, rec, sizeof(store));
+
+  uint32_t bits = insn.bits;
+  unsigned opcode = bits & 0x7f;
+  bool rvc = insn.length == 2;
+  unsigned rd = rvc ? 0 : (bits >> 7) & 0x1f;
+  unsigned rs1 = rvc ? 0 : (bits >> 15) & 0x1f;
+  unsigned rs2 = rvc ? 0 : (bits >> 20) & 0x1f;
+  bool is_csr = opcode == 0x73 && ((bits >> 12) & 0x3) != 0;
+  bool is_amo = opcode == 0x2f;
+  bool is_load = insn.nloads != 0;
+  bool is_store = insn.nstores != 0 && !is_load;
+  bool is_branch = opcode == 0x63;
+  bool reads_rs1 = !rvc && opcode != 0x37 && opcode != 0x17 &&
+                   opcode != 0x6f && !(is_csr && (bits & (1 << 14)));
+  bool reads_rs2 = !rvc && (opcode == 0x33 || opcode == 0x3b ||
+                   opcode == 0x23 || is_branch || (is_amo && (bits >> 27) != 0x2));
+
+  unsigned opb_select = is_csr ? 8 : reads_rs2 ? 1 : 0;
+  uint64_t opb = is_csr ? writeback : c.opb;
+  uint64_t alu_result = is_load ? load.addr :
+                        is_store ? store.addr :
+                        is_branch ? c.npc != insn.pc + insn.length :
+                        writeback;
+  bool retire_load = is_load && write_rd;
+
+  FILE* f = hart->dasm_file->get();
+  uint64_t cycle = ++hart->dasm_cycle;
+  fprintf(f, "%10" PRIu64 " %8" PRIu64 " 0x%08" PRIx32 " DASM(%08" PRIx32 ") #; {",
+          cycle, cycle, (uint32_t)insn.pc, bits);
+  fprintf(f, "'source': 0x%08x, 'stall': 0x0, 'stall_tot': 0x%08x, "
+          "'stall_ins': 0x%08x, 'stall_raw': 0x%08x, 'stall_lsu': 0x%08x, "
+          "'stall_acc': 0x%08x, ", 0, 0, 0, 0, 0, 0);
+  fprintf(f, "'rs1': 0x%08x, 'rs2': 0x%08x, 'rd': 0x%08x, 'is_load': 0x%x, "
+          "'is_store': 0x%x, 'is_branch': 0x%x, 'pc_d': 0x%08" PRIx32 ", ",
+          rs1, rs2, rd, is_load, is_store, is_branch, (uint32_t)c.npc);
+  fprintf(f, "'opa': 0x%08" PRIx32 ", 'opb': 0x%08" PRIx32 ", "
+          "'opa_select': 0x%x, 'opb_select': 0x%x, 'opc_select': 0x0, "
+          "'write_rd': 0x%x, 'csr_addr': 0x%03x, ",
+          (uint32_t)c.opa, (uint32_t)opb, reads_rs1, opb_select,
+          write_rd && !is_load, is_csr ? bits >> 20 : 0);
+  fprintf(f, "'writeback': 0x%08" PRIx32 ", 'gpr_rdata_1': 0x%08" PRIx32 ", "
+          "'gpr_rdata_2': 0x%08x, 'ls_size': 0x%x, 'ld_result_32': 0x%08" PRIx32 ", "
+          "'lsu_rd': 0x%02x, 'retire_load': 0x%x, 'alu_result': 0x%08" PRIx32 ", ",
+          (uint32_t)writeback, (uint32_t)store.value, 0, (bits >> 12) & 0x3,
+          retire_load ? (uint32_t)writeback : 0, retire_load ? rd : 0, retire_load,
+          (uint32_t)alu_result);
+  fprintf(f, "'ls_amo': 0x%x, 'retire_acc': 0x0, 'acc_pid': 0x00, "
+          "'acc_pdata_32': 0x%08x, }\n", is_amo, 0);
+}
@@ -0,0 +1,151 @@
+// See LICENSE for license details.
+#ifndef _RISCV_TRACE_WRITER_H
+#define _RISCV_TRACE_WRITER_H
+
+#include "decode.h"
+#include "log_file.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class processor_t;
+class trace_writer_t;
+
+// A hart's trace buffer holds records, each a trace_record_t followed by
+// size bytes of payload:
+//  - TRACE_TEXT: text to print as is
+//  - TRACE_DISASM: a trace_disasm_t, printed as --log does
+//  - TRACE_COMMIT: a trace_commit_t and a commit log record (commit_log.h)
+enum trace_record_kind_t {
+  TRACE_TEXT,
+  TRACE_DISASM,
+  TRACE_COMMIT
+};
+
+// Where a record goes
+enum {
+  TRACE_TO_LOG = 1,  // the log file
+  TRACE_TO_DASM = 2  // the hart's trace_hart_<id>.dasm file
+};
+
+struct trace_record_t
+{
+  uint8_t kind;
+  uint8_t dest;
+  uint16_t reserved;
+  uint32_t size;
+};
+
+struct trace_disasm_t
+{
+  uint64_t pc;
+  uint64_t bits;
+  uint64_t executions; // of the previous instruction
+};
+
+struct trace_commit_t
+{
+  uint64_t npc;
+  uint64_t opa; // rs1 and rs2 before the instruction executed
+  uint64_t opb;
+};
+
+// The records of one hart. Only the thread that steps the hart appends to
+// them, so appending takes no lock; full buffers go to the writer.
+class hart_trace_t
+{
+public:
+  // Starts a record and returns the buffer to append its payload to
+  std::vector<uint8_t>& begin_record(uint8_t kind, uint8_t dest)
+  {
+    record_start = buf.size();
+    trace_record_t rec = {kind, dest, 0, 0};
+    buf.insert(buf.end(), (uint8_t*)&rec, (uint8_t*)(&rec + 1));
+    return buf;
+  }
+
+  void end_record()
+  {
+    ((trace_record_t*)&buf[record_start])->size =
+      buf.size() - record_start - sizeof(trace_record_t);
+    if (buf.size() >= BUFFER_SIZE)
+      submit();
+  }
+
+  void printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+  void disasm(reg_t pc, uint64_t bits, uint64_t executions);
+
+private:
+  static const size_t BUFFER_SIZE = 64 << 10;
+  static const size_t NUM_BUFFERS = 3;
+
+  friend class trace_writer_t;
+  hart_trace_t(trace_writer_t* writer, size_t index);
+  void submit();
+
+  trace_writer_t* writer;
+  size_t index;
+  std::vector<uint8_t> buf;
+  size_t record_start;
+  std::vector<std::vector<uint8_t>> free_buffers; // guarded by the writer
+  std::unique_ptr<log_file_t> dasm_file;
+  uint64_t dasm_cycle;
+  std::unordered_map<uint64_t, std::string> disasm_cache; // by the writer
+};
+
+// Formats and writes the logs of the harts on a background thread
+//
+// The records of the harts go to the log file, where the buffers of
+// different harts interleave, or, with set_dasm_dir(), to one file per hart
+// in the format of the Snitch tracer in hardware/src/mempool_cc.sv, which
+// spike-dasm and hardware/scripts/gen_trace.py read. In those files the
+// cycle is the number of instructions the hart retired while traced.
+class trace_writer_t
+{
+public:
+  trace_writer_t(const std::vector<processor_t*>& procs, FILE* log);
+  ~trace_writer_t();
+
+  hart_trace_t* get_hart(size_t i) { return harts[i].get(); }
+
+  // Write commit records to the log in the binary format of commit_log.h;
+  // the other records are left out then
+  void set_binary(bool value) { binary = value; }
+  // Write hart i's traced instructions to dir/trace_hart_0x<mhartid>.dasm
+  void set_dasm_dir(const char* dir);
+
+  // Writes everything the harts logged so far. The harts must not run.
+  void flush();
+
+private:
+  friend class hart_trace_t;
+
+  const std::vector<processor_t*>& procs;
+  FILE* log;
+  bool binary;
+  std::vector<std::unique_ptr<hart_trace_t>> harts;
+
+  std::mutex lock;
+  std::condition_variable work_ready;
+  std::condition_variable buffer_free;
+  std::deque<std::pair<hart_trace_t*, std::vector<uint8_t>>> queue;
+  bool busy;
+  bool stopping;
+  std::thread thread;
+
+  void submit(hart_trace_t* hart);
+  void run();
+  void write(hart_trace_t* hart, const std::vector<uint8_t>& buf);
+  void write_disasm(hart_trace_t* hart, const trace_disasm_t& d);
+  void write_dasm(hart_trace_t* hart, const trace_commit_t& c,
+                  const uint8_t* rec);
+};
+
+#endif
@@ -0,0 +1,373 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_XPULP_SIMD_H
+#define _RISCV_XPULP_SIMD_H
+
+// Packed-SIMD helpers for the Xpulpimg pv.* instructions.
+//
+// Every helper works on the 32-bit register layout of Xpulpimg: four bytes
+// (_b) or two halfwords (_h), lane 0 in the least significant bits. Lane
+// arithmetic wraps. Where the host offers a matching instruction (SSE2,
+// SSSE3, SSE4.1, AVX2 or NEON) it is used, everything else falls back to
+// SWAR code on the 32-bit word, which keeps all lanes in one host register
+// instead of extracting and reinserting them one by one.
+
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define SIMD_B_LSB  0x01010101u
+#define SIMD_B_MSB  0x80808080u
+#define SIMD_H_LSB  0x00010001u
+#define SIMD_H_MSB  0x80008000u
+
+// Replicate the low byte/halfword of x into every lane
+inline uint32_t simd_splat_b(uint32_t x) { return (x & 0xFF) * SIMD_B_LSB; }
+inline uint32_t simd_splat_h(uint32_t x) { return (x & 0xFFFF) * SIMD_H_LSB; }
+
+#if defined(__SSE2__)
+inline __m128i simd_to_vec(uint32_t x) { return _mm_cvtsi32_si128(x); }
+inline uint32_t simd_from_vec(__m128i x) { return _mm_cvtsi128_si32(x); }
+#endif
+
+// Add, subtract: carries must not cross lane boundaries
+inline uint32_t simd_add_b(uint32_t a, uint32_t b)
+{
+  return ((a & ~SIMD_B_MSB) + (b & ~SIMD_B_MSB)) ^ ((a ^ b) & SIMD_B_MSB);
+}
+
+inline uint32_t simd_add_h(uint32_t a, uint32_t b)
+{
+  return ((a & ~SIMD_H_MSB) + (b & ~SIMD_H_MSB)) ^ ((a ^ b) & SIMD_H_MSB);
+}
+
+inline uint32_t simd_sub_b(uint32_t a, uint32_t b)
+{
+  return ((a | SIMD_B_MSB) - (b & ~SIMD_B_MSB)) ^ ((a ^ ~b) & SIMD_B_MSB);
+}
+
+inline uint32_t simd_sub_h(uint32_t a, uint32_t b)
+{
+  return ((a | SIMD_H_MSB) - (b & ~SIMD_H_MSB)) ^ ((a ^ ~b) & SIMD_H_MSB);
+}
+
+// Average: the lane sum wraps before it is halved
+inline uint32_t simd_avg_b(uint32_t a, uint32_t b)
+{
+  uint32_t s = simd_add_b(a, b);
+  return ((s >> 1) & ~SIMD_B_MSB) | (s & SIMD_B_MSB);
+}
+
+inline uint32_t simd_avg_h(uint32_t a, uint32_t b)
+{
+  uint32_t s = simd_add_h(a, b);
+  return ((s >> 1) & ~SIMD_H_MSB) | (s & SIMD_H_MSB);
+}
+
+inline uint32_t simd_avgu_b(uint32_t a, uint32_t b)
+{
+  return (simd_add_b(a, b) >> 1) & ~SIMD_B_MSB;
+}
+
+inline uint32_t simd_avgu_h(uint32_t a, uint32_t b)
+{
+  return (simd_add_h(a, b) >> 1) & ~SIMD_H_MSB;
+}
+
+// Minimum, maximum. SSE2 only has unsigned byte and signed halfword
+// compares; the other two are reached by flipping the lane sign bits.
+#if defined(__SSE2__)
+#define SIMD_MINMAX(name, op, bias)                                         \
+  inline uint32_t simd_##name(uint32_t a, uint32_t b)                       \
+  {                                                                         \
+    return simd_from_vec(op(simd_to_vec(a ^ bias), simd_to_vec(b ^ bias)))  \
+           ^ bias;                                                          \
+  }
+SIMD_MINMAX(max_b,  _mm_max_epu8,  SIMD_B_MSB)
+SIMD_MINMAX(min_b,  _mm_min_epu8,  SIMD_B_MSB)
+SIMD_MINMAX(maxu_b, _mm_max_epu8,  0)
+SIMD_MINMAX(minu_b, _mm_min_epu8,  0)
+SIMD_MINMAX(max_h,  _mm_max_epi16, 0)
+SIMD_MINMAX(min_h,  _mm_min_epi16, 0)
+SIMD_MINMAX(maxu_h, _mm_max_epi16, SIMD_H_MSB)
+SIMD_MINMAX(minu_h, _mm_min_epi16, SIMD_H_MSB)
+#undef SIMD_MINMAX
+#elif defined(__ARM_NEON)
+#define SIMD_MINMAX(name, op, to_lanes, from_lanes)                         \
+  inline uint32_t simd_##name(uint32_t a, uint32_t b)                       \
+  {                                                                         \
+    return vget_lane_u32(from_lanes(op(to_lanes(vcreate_u32(a)),            \
+                                       to_lanes(vcreate_u32(b)))), 0);      \
+  }
+SIMD_MINMAX(max_b,  vmax_s8,  vreinterpret_s8_u32,  vreinterpret_u32_s8)
+SIMD_MINMAX(min_b,  vmin_s8,  vreinterpret_s8_u32,  vreinterpret_u32_s8)
+SIMD_MINMAX(maxu_b, vmax_u8,  vreinterpret_u8_u32,  vreinterpret_u32_u8)
+SIMD_MINMAX(minu_b, vmin_u8,  vreinterpret_u8_u32,  vreinterpret_u32_u8)
+SIMD_MINMAX(max_h,  vmax_s16, vreinterpret_s16_u32, vreinterpret_u32_s16)
+SIMD_MINMAX(min_h,  vmin_s16, vreinterpret_s16_u32, vreinterpret_u32_s16)
+SIMD_MINMAX(maxu_h, vmax_u16, vreinterpret_u16_u32, vreinterpret_u32_u16)
+SIMD_MINMAX(minu_h, vmin_u16, vreinterpret_u16_u32, vreinterpret_u32_u16)
+#undef SIMD_MINMAX
+#else
+#define SIMD_MINMAX(name, lane_t, bits, cmp)                                \
+  inline uint32_t simd_##name(uint32_t a, uint32_t b)                       \
+  {                                                                         \
+    uint32_t r = 0;                                                         \
+    for (int i = 0; i < 32; i += bits) {                                    \
+      lane_t x = lane_t(a >> i), y = lane_t(b >> i);                        \
+      r |= (uint32_t)(uint##bits##_t)(x cmp y ? x : y) << i;                \
+    }                                                                       \
+    return r;                                                               \
+  }
+SIMD_MINMAX(max_b,  int8_t,   8,  >)
+SIMD_MINMAX(min_b,  int8_t,   8,  <)
+SIMD_MINMAX(maxu_b, uint8_t,  8,  >)
+SIMD_MINMAX(minu_b, uint8_t,  8,  <)
+SIMD_MINMAX(max_h,  int16_t,  16, >)
+SIMD_MINMAX(min_h,  int16_t,  16, <)
+SIMD_MINMAX(maxu_h, uint16_t, 16, >)
+SIMD_MINMAX(minu_h, uint16_t, 16, <)
+#undef SIMD_MINMAX
+#endif
+
+// Absolute value; abs(-128) wraps to -128
+inline uint32_t simd_abs_b(uint32_t a)
+{
+#if defined(__SSSE3__)
+  return simd_from_vec(_mm_abs_epi8(simd_to_vec(a)));
+#else
+  return simd_max_b(a, simd_sub_b(0, a));
+#endif
+}
+
+inline uint32_t simd_abs_h(uint32_t a)
+{
+#if defined(__SSSE3__)
+  return simd_from_vec(_mm_abs_epi16(simd_to_vec(a)));
+#else
+  return simd_max_h(a, simd_sub_h(0, a));
+#endif
+}
+
+// Shifts by the same amount in every lane
+inline uint32_t simd_sll_b(uint32_t a, unsigned s)
+{
+  s &= 0x7;
+  return (a << s) & simd_splat_b(0xFF << s);
+}
+
+inline uint32_t simd_sll_h(uint32_t a, unsigned s)
+{
+  s &= 0xF;
+  return (a << s) & simd_splat_h(0xFFFF << s);
+}
+
+inline uint32_t simd_srl_b(uint32_t a, unsigned s)
+{
+  s &= 0x7;
+  return (a >> s) & simd_splat_b(0xFF >> s);
+}
+
+inline uint32_t simd_srl_h(uint32_t a, unsigned s)
+{
+  s &= 0xF;
+  return (a >> s) & simd_splat_h(0xFFFF >> s);
+}
+
+inline uint32_t simd_sra_b(uint32_t a, unsigned s)
+{
+  s &= 0x7;
+  uint32_t neg = ((a >> 7) & SIMD_B_LSB) * 0xFF;
+  return simd_srl_b(a, s) | (neg & ~simd_splat_b(0xFF >> s));
+}
+
+inline uint32_t simd_sra_h(uint32_t a, unsigned s)
+{
+  s &= 0xF;
+  uint32_t neg = ((a >> 15) & SIMD_H_LSB) * 0xFFFF;
+  return simd_srl_h(a, s) | (neg & ~simd_splat_h(0xFFFF >> s));
+}
+
+// Shifts by a per-lane amount taken from the matching lane of b. Only AVX2
+// has variable lane shifts, on 32-bit lanes; the bytes are widened to them.
+#if defined(__AVX2__)
+inline uint32_t simd_narrow_b(__m128i x)
+{
+  x = _mm_and_si128(x, _mm_set1_epi32(0xFF));
+  return simd_from_vec(_mm_packus_epi16(_mm_packus_epi32(x, x), x));
+}
+
+inline uint32_t simd_sllv_b(uint32_t a, uint32_t b)
+{
+  __m128i s = _mm_and_si128(_mm_cvtepu8_epi32(simd_to_vec(b)),
+                            _mm_set1_epi32(0x7));
+  return simd_narrow_b(_mm_sllv_epi32(_mm_cvtepu8_epi32(simd_to_vec(a)), s));
+}
+
+inline uint32_t simd_srlv_b(uint32_t a, uint32_t b)
+{
+  __m128i s = _mm_and_si128(_mm_cvtepu8_epi32(simd_to_vec(b)),
+                            _mm_set1_epi32(0x7));
+  return simd_narrow_b(_mm_srlv_epi32(_mm_cvtepu8_epi32(simd_to_vec(a)), s));
+}
+
+inline uint32_t simd_srav_b(uint32_t a, uint32_t b)
+{
+  __m128i s = _mm_and_si128(_mm_cvtepu8_epi32(simd_to_vec(b)),
+                            _mm_set1_epi32(0x7));
+  return simd_narrow_b(_mm_srav_epi32(_mm_cvtepi8_epi32(simd_to_vec(a)), s));
+}
+#else
+#define SIMD_SHIFTV_B(name, lane_t, op)                                     \
+  inline uint32_t simd_##name(uint32_t a, uint32_t b)                       \
+  {                                                                         \
+    uint32_t r = 0;                                                         \
+    for (int i = 0; i < 32; i += 8)                                         \
+      r |= (uint32_t)(uint8_t)(lane_t(a >> i) op ((b >> i) & 0x7)) << i;    \
+    return r;                                                               \
+  }
+SIMD_SHIFTV_B(sllv_b, uint8_t, <<)
+SIMD_SHIFTV_B(srlv_b, uint8_t, >>)
+SIMD_SHIFTV_B(srav_b, int8_t,  >>)
+#undef SIMD_SHIFTV_B
+#endif
+
+inline uint32_t simd_sllv_h(uint32_t a, uint32_t b)
+{
+  return ((uint16_t)(a << (b & 0xF))) |
+         ((uint32_t)(uint16_t)((a >> 16) << ((b >> 16) & 0xF)) << 16);
+}
+
+inline uint32_t simd_srlv_h(uint32_t a, uint32_t b)
+{
+  return ((uint16_t)a >> (b & 0xF)) |
+         ((uint32_t)((a >> 16) >> ((b >> 16) & 0xF)) << 16);
+}
+
+inline uint32_t simd_srav_h(uint32_t a, uint32_t b)
+{
+  return (uint16_t)((int16_t)a >> (b & 0xF)) |
+         ((uint32_t)(uint16_t)((int16_t)(a >> 16) >> ((b >> 16) & 0xF)) << 16);
+}
+
+// Dot products, accumulated modulo 2^32. The byte forms map onto a widening
+// multiply-add; for halfwords two scalar multiplies are already optimal.
+inline uint32_t simd_dotsp_b(uint32_t a, uint32_t b)
+{
+#if defined(__SSE4_1__)
+  __m128i p = _mm_madd_epi16(_mm_cvtepi8_epi16(simd_to_vec(a)),
+                             _mm_cvtepi8_epi16(simd_to_vec(b)));
+  return simd_from_vec(_mm_add_epi32(p, _mm_srli_epi64(p, 32)));
+#elif defined(__SSE2__)
+  __m128i x = simd_to_vec(a), y = simd_to_vec(b);
+  __m128i p = _mm_madd_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8),
+                             _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8));
+  return simd_from_vec(_mm_add_epi32(p, _mm_srli_epi64(p, 32)));
+#elif defined(__ARM_NEON)
+  int16x8_t p = vmull_s8(vreinterpret_s8_u32(vcreate_u32(a)),
+                         vreinterpret_s8_u32(vcreate_u32(b)));
+  return vgetq_lane_s64(vpaddlq_s32(vpaddlq_s16(p)), 0);
+#else
+  return int8_t(a) * int8_t(b) + int8_t(a >> 8) * int8_t(b >> 8) +
+         int8_t(a >> 16) * int8_t(b >> 16) + int8_t(a >> 24) * int8_t(b >> 24);
+#endif
+}
+
+inline uint32_t simd_dotup_b(uint32_t a, uint32_t b)
+{
+#if defined(__SSE2__)
+  __m128i z = _mm_setzero_si128();
+  __m128i p = _mm_madd_epi16(_mm_unpacklo_epi8(simd_to_vec(a), z),
+                             _mm_unpacklo_epi8(simd_to_vec(b), z));
+  return simd_from_vec(_mm_add_epi32(p, _mm_srli_epi64(p, 32)));
+#elif defined(__ARM_NEON)
+  uint16x8_t p = vmull_u8(vreinterpret_u8_u32(vcreate_u32(a)),
+                          vreinterpret_u8_u32(vcreate_u32(b)));
+  return vgetq_lane_u64(vpaddlq_u32(vpaddlq_u16(p)), 0);
+#else
+  return uint8_t(a) * uint8_t(b) + uint8_t(a >> 8) * uint8_t(b >> 8) +
+         uint8_t(a >> 16) * uint8_t(b >> 16) +
+         uint8_t(a >> 24) * uint8_t(b >> 24);
+#endif
+}
+
+inline uint32_t simd_dotusp_b(uint32_t a, uint32_t b)
+{
+#if defined(__SSE2__)
+  __m128i x = simd_to_vec(a), y = simd_to_vec(b);
+  __m128i p = _mm_madd_epi16(_mm_unpacklo_epi8(x, _mm_setzero_si128()),
+                             _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8));
+  return simd_from_vec(_mm_add_epi32(p, _mm_srli_epi64(p, 32)));
+#elif defined(__ARM_NEON)
+  int16x8_t x = vreinterpretq_s16_u16(
+    vmovl_u8(vreinterpret_u8_u32(vcreate_u32(a))));
+  int16x8_t p = vmulq_s16(x, vmovl_s8(vreinterpret_s8_u32(vcreate_u32(b))));
+  return vgetq_lane_s64(vpaddlq_s32(vpaddlq_s16(p)), 0);
+#else
+  return uint8_t(a) * int8_t(b) + uint8_t(a >> 8) * int8_t(b >> 8) +
+         uint8_t(a >> 16) * int8_t(b >> 16) +
+         uint8_t(a >> 24) * int8_t(b >> 24);
+#endif
+}
+
+inline uint32_t simd_dotsp_h(uint32_t a, uint32_t b)
+{
+  return (uint32_t)(int16_t(a) * int16_t(b)) +
+         (uint32_t)(int16_t(a >> 16) * int16_t(b >> 16));
+}
+
+inline uint32_t simd_dotup_h(uint32_t a, uint32_t b)
+{
+  return uint32_t(uint16_t(a)) * uint16_t(b) +
+         uint32_t(a >> 16) * (b >> 16);
+}
+
+inline uint32_t simd_dotusp_h(uint32_t a, uint32_t b)
+{
+  return uint32_t(uint16_t(a)) * uint32_t(int32_t(int16_t(b))) +
+         uint32_t(a >> 16) * uint32_t(int32_t(int16_t(b >> 16)));
+}
+
+// Shuffle: each lane of sel picks a lane of a (select bit set) or of d
+inline uint32_t simd_shuffle2_b(uint32_t d, uint32_t a, uint32_t sel)
+{
+#if defined(__SSSE3__)
+  // Table holds d in bytes 0-3 and a in bytes 4-7; index bit 2 picks a
+  __m128i t = _mm_unpacklo_epi32(simd_to_vec(d), simd_to_vec(a));
+  __m128i i = _mm_and_si128(simd_to_vec(sel), _mm_set1_epi8(0x07));
+  return simd_from_vec(_mm_shuffle_epi8(t, i));
+#elif defined(__ARM_NEON)
+  uint8x8_t t = vreinterpret_u8_u64(vcreate_u64(d | (uint64_t)a << 32));
+  uint8x8_t i = vand_u8(vreinterpret_u8_u32(vcreate_u32(sel)), vdup_n_u8(7));
+  return vget_lane_u32(vreinterpret_u32_u8(vtbl1_u8(t, i)), 0);
+#else
+  uint64_t t = d | (uint64_t)a << 32;
+  uint32_t r = 0;
+  for (int i = 0; i < 32; i += 8)
+    r |= (uint32_t)(uint8_t)(t >> (8 * ((sel >> i) & 0x7))) << i;
+  return r;
+#endif
+}
+
+inline uint32_t simd_shuffle2_h(uint32_t d, uint32_t a, uint32_t sel)
+{
+  uint64_t t = d | (uint64_t)a << 32;
+  return (uint16_t)(t >> (16 * (sel & 0x3))) |
+         ((uint32_t)(uint16_t)(t >> (16 * ((sel >> 16) & 0x3))) << 16);
+}
+
+#endif
@@ -50,8 +50,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 #include "softfloat_types.h"
 
+/* Spike may step harts on several host threads, each with its own rounding
+   mode and exception flags. */
 #ifndef THREAD_LOCAL
-#define THREAD_LOCAL
+#define THREAD_LOCAL __thread
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,122 @@
+// See LICENSE for license details.
+
+// Measures how fast the disassembler builds its decode table and looks up
+// instructions. The stream is the instruction words recorded in the given
+// trace files, as DASM(...) operands, replayed until --insns instructions
+// were looked up. At most the first MAX_STREAM words of the traces are
+// recorded. Without trace files, it is a random mix of every encoding of
+// encoding.h with random operands.
+
+#include "trace_io.h"
+#include "disasm.h"
+#include "encoding.h"
+#include "fesvr/option_parser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 128 MiB of instruction words
+static const size_t MAX_STREAM = 1 << 24;
+
+static void record(const char* path, std::vector<insn_bits_t>& stream)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    exit(1);
+  }
+  for_each_line_chunk(fd, [&](const char* p, const char* end) {
+    static const char prefix[] = "DASM(";
+    while ((p = (const char*)memmem(p, end - p, prefix, strlen(prefix)))) {
+      p += strlen(prefix);
+      char* q;
+      insn_bits_t bits = strtoull(p, &q, 16);
+      if (q != p && *q == ')')
+        stream.push_back(bits);
+    }
+    return stream.size() < MAX_STREAM;
+  });
+  close(fd);
+}
+
+static void synthesize(std::vector<insn_bits_t>& stream, size_t size)
+{
+  struct encoding_t { uint32_t match, mask; };
+  static const encoding_t encodings[] = {
+    #define DECLARE_INSN(code, match, mask) {match, mask},
+    #include "encoding.h"
+    #undef DECLARE_INSN
+  };
+  const size_t n = sizeof(encodings) / sizeof(encodings[0]);
+
+  uint64_t x = 88172645463325252ULL;
+  for (size_t i = 0; i < size; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    const encoding_t& e = encodings[(x >> 32) % n];
+    insn_bits_t bits = e.match | ((uint32_t)x & ~e.mask);
+    stream.push_back(insn_t(bits).bits());
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int xlen = 32;
+  size_t insns = 100000000;
+  size_t builds = 100;
+
+  option_parser_t parser;
+  parser.help([]{
+    fprintf(stderr, "usage: dasm-bench [--xlen=<32|64>] [--insns=<n>] "
+            "[--builds=<n>] [<trace file>...]\n");
+    exit(1);
+  });
+  parser.option(0, "xlen", 1, [&](const char* s){xlen = atoi(s);});
+  parser.option(0, "insns", 1, [&](const char* s){insns = strtoull(s, 0, 0);});
+  parser.option(0, "builds", 1, [&](const char* s){builds = strtoull(s, 0, 0);});
+  const char* const* files = parser.parse(argv);
+
+  std::vector<insn_bits_t> stream;
+  for (; *files && stream.size() < MAX_STREAM; files++)
+    record(*files, stream);
+  bool recorded = !stream.empty();
+  if (!recorded)
+    synthesize(stream, 1 << 20);
+  std::unordered_set<insn_bits_t> distinct(stream.begin(), stream.end());
+  printf("%-8s %12zu insns, %s%s\n", "stream", stream.size(),
+         recorded ? "recorded" : "synthesized",
+         stream.size() >= MAX_STREAM ? ", capped" : "");
+
+  // Every Spike hart has its own disassembler, so building one must be cheap
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < builds; i++) {
+    disassembler_t disassembler(xlen);
+    disassembler.lookup(insn_t(0));
+  }
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  printf("%-8s %12zu disassemblers %8.3f ms each\n", "build", builds,
+         builds ? secs.count() * 1e3 / builds : 0.);
+
+  disassembler_t disassembler(xlen);
+  disassembler.lookup(insn_t(0));
+  size_t unknown = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t done = 0; done < insns; ) {
+    size_t n = std::min(stream.size(), insns - done);
+    for (size_t i = 0; i < n; i++)
+      unknown += disassembler.lookup(insn_t(stream[i])) == NULL;
+    done += n;
+  }
+  secs = std::chrono::steady_clock::now() - start;
+  printf("%-8s %12zu insns %8.3f s %8.2f MIPS (%zu distinct, %zu unknown)\n",
+         "lookup", insns, secs.count(), insns / secs.count() / 1e6,
+         distinct.size(), unknown);
+  return 0;
+}
@@ -0,0 +1,1071 @@
+// See LICENSE for license details.
+
+// Annotates the traces of MemPool's Snitch harts and computes their
+// performance metrics, like hardware/scripts/gen_trace.py, of which it
+// produces the exact output. Takes the .dasm files of the RTL tracer (or
+// the output of spike-dasm on them), disassembles them on the fly and
+// processes the harts in parallel.
+
+#include "trace_io.h"
+#include "disasm.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fesvr/option_parser.h>
+using namespace std;
+
+static void help()
+{
+  fprintf(stderr, "usage: snitch-trace [options] [<trace file>...]\n");
+  fprintf(stderr, "Reads stdin and writes stdout if no trace file is given\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --isa=<name>             RISC-V ISA string [default RV32IMA]\n");
+  fprintf(stderr, "  -h, --help               Print this help message\n");
+  fprintf(stderr, "  -o<dir>, --out-dir=<dir> Write <name without .dasm>.trace to <dir>\n");
+  fprintf(stderr, "                             [default: next to each trace file]\n");
+  fprintf(stderr, "  -j<n>, --jobs=<n>        Process <n> trace files at once [default: all host CPUs]\n");
+  fprintf(stderr, "  -c<file>, --csv=<file>   Append the metrics of every section to <file>\n");
+  fprintf(stderr, "  -s, --saddr              Use signed decimal (not unsigned hex) for small addresses\n");
+  fprintf(stderr, "  -a, --allkeys            Include performance metrics measured to compute others\n");
+  fprintf(stderr, "  -p, --permissive         Ignore some state-related issues when they occur\n");
+  exit(1);
+}
+
+// -------------------- Tracer configuration --------------------
+
+// Below this absolute value: use signed int representation. Above:
+// unsigned 32-bit hex
+static const int64_t max_signed_int_lit = 0xffff;
+
+// Performance keys which only serve to compute other metrics: omit on printing
+static const char* const perf_eval_keys_omit[] = {
+  "section", "core", "start", "end", "snitch_load_latency",
+  "snitch_load_region", "snitch_load_tile", "snitch_store_region",
+  "snitch_store_tile",
+};
+
+// Columns of the CSV, as gen_trace.py writes them (with its duplicates)
+static const char* const csv_keys[] = {
+  "core", "section", "start", "end", "cycles", "snitch_loads",
+  "snitch_stores", "snitch_avg_load_latency", "snitch_occupancy",
+  "snitch_load_latency", "total_ipc", "snitch_issues", "stall_tot",
+  "stall_ins", "stall_raw", "stall_raw_lsu", "stall_raw_acc", "stall_lsu",
+  "stall_acc", "stall_wfi", "seq_loads_local", "seq_loads_global",
+  "itl_loads_local", "itl_loads_global", "seq_latency_local",
+  "seq_latency_global", "itl_latency_local", "itl_latency_global",
+  "snitch_load_latency", "snitch_load_region", "snitch_load_tile",
+  "snitch_store_region", "snitch_store_region", "snitch_store_tile",
+  "seq_stores_local", "seq_stores_global", "itl_stores_local",
+  "itl_stores_global",
+};
+
+static const char* const reg_abi_names[] = {
+  "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1",
+  "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7",
+  "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+  "t3", "t4", "t5", "t6",
+};
+
+static const char* const ls_sizes[] = {"Byte", "Half", "Word", "Doub"};
+
+enum { OPER_GPR = 1, OPER_CSR = 8 };
+
+enum { REGION_OTHER, REGION_SEQUENTIAL, REGION_INTERLEAVED };
+
+enum raw_type_t { RAW_LSU, RAW_ACC, NUM_RAW_TYPES };
+static const char* const raw_types[] = {"lsu", "acc"};
+
+// ----------------- Architecture info -----------------
+
+struct arch_t
+{
+  double num_tiles;
+  int64_t seq_mem_size;
+  double tcdm_size;
+
+  // Same variables as gen_trace.py
+  arch_t()
+  {
+    const char* cores = getenv("num_cores");
+    const char* seq = getenv("seq_mem_size");
+    num_tiles = (cores ? atoll(cores) : 256) / 4.0;
+    seq_mem_size = 4 * (seq ? atoll(seq) : 1024);
+    tcdm_size = 16 * 1024 * num_tiles;
+  }
+
+  void addr_to_meta(int64_t address, int* region, int64_t* tile) const
+  {
+    *region = REGION_OTHER;
+    *tile = -1;
+    if (address < seq_mem_size * num_tiles) {
+      // Local memory
+      *region = REGION_SEQUENTIAL;
+      *tile = floor_div(address, seq_mem_size);
+    } else if (address < tcdm_size) {
+      // Interleaved memory
+      *region = REGION_INTERLEAVED;
+      double t = fmod((double)floor_div(address, 64), num_tiles);
+      *tile = (int64_t)(t < 0 ? t + num_tiles : t);
+    }
+  }
+
+  static int64_t floor_div(int64_t a, int64_t b)
+  {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+  }
+};
+
+// -------------------- Literal formatting --------------------
+
+// Python's repr() of a float: the shortest digits that round-trip, in fixed
+// notation for exponents in [-4, 16)
+static string py_float(double f)
+{
+  if (std::isnan(f))
+    return "nan";
+  if (std::isinf(f))
+    return f < 0 ? "-inf" : "inf";
+
+  char buf[40];
+  for (int prec = 1; prec <= 17; prec++) {
+    snprintf(buf, sizeof(buf), "%.*e", prec - 1, f);
+    if (strtod(buf, NULL) == f)
+      break;
+  }
+  // buf is [-]d[.ddd]e[+-]xx
+  string s(buf);
+  bool neg = s[0] == '-';
+  size_t e = s.find('e');
+  int exp = atoi(s.c_str() + e + 1);
+  string digits;
+  for (size_t i = neg; i < e; i++)
+    if (s[i] != '.')
+      digits += s[i];
+  while (digits.size() > 1 && digits.back() == '0')
+    digits.pop_back();
+
+  string out = neg ? "-" : "";
+  if (exp >= -4 && exp < 16) {
+    if (exp < 0) {
+      out += "0." + string(-exp - 1, '0') + digits;
+    } else if ((size_t)exp + 1 >= digits.size()) {
+      out += digits + string(exp + 1 - digits.size(), '0') + ".0";
+    } else {
+      out += digits.substr(0, exp + 1) + "." + digits.substr(exp + 1);
+    }
+  } else {
+    out += digits.substr(0, 1);
+    if (digits.size() > 1)
+      out += "." + digits.substr(1);
+    snprintf(buf, sizeof(buf), "e%c%02d", exp < 0 ? '-' : '+', abs(exp));
+    out += buf;
+  }
+  return out;
+}
+
+static string flt_fmt(double f, int width)
+{
+  // If default literal shorter: use it
+  string s = py_float(f);
+  if ((int)s.size() - 1 <= width)
+    return s;
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", width, f);
+  return buf;
+}
+
+static string int_lit(int64_t num, bool force_hex = false)
+{
+  uint32_t u = (uint32_t)num;
+  int32_t s = (int32_t)u;
+  char buf[16];
+  if (force_hex || llabs(s) > max_signed_int_lit)
+    snprintf(buf, sizeof(buf), "0x%08" PRIx32, u);
+  else
+    snprintf(buf, sizeof(buf), "%" PRId32, s);
+  return buf;
+}
+
+// Python's str.format() padding
+static string ljust(const string& s, size_t width)
+{
+  return s.size() >= width ? s : s + string(width - s.size(), ' ');
+}
+
+static string rjust(const string& s, size_t width)
+{
+  return s.size() >= width ? s : string(width - s.size(), ' ') + s;
+}
+
+// -------------------- Performance metrics --------------------
+
+// A value of a section's metrics. Missing keys read as the integer 0, like
+// gen_trace.py's defaultdict(int).
+struct value_t
+{
+  enum kind_t { INT, FLOAT, NONE, LIST } kind = INT;
+  int64_t i = 0;
+  double f = 0;
+  vector<int64_t> list;
+
+  static value_t none() { value_t v; v.kind = NONE; return v; }
+  static value_t real(double f) { value_t v; v.kind = FLOAT; v.f = f; return v; }
+  static value_t integer(int64_t i) { value_t v; v.i = i; return v; }
+
+  string str() const
+  {
+    switch (kind) {
+      case INT: return to_string(i);
+      case FLOAT: return py_float(f);
+      case NONE: return "None";
+      case LIST: break;
+    }
+    string s = "[";
+    for (size_t j = 0; j < list.size(); j++)
+      s += (j ? ", " : "") + to_string(list[j]);
+    return s + "]";
+  }
+};
+
+typedef map<string, value_t> section_t;
+
+static double mean(const vector<int64_t>& v, const vector<bool>* mask = NULL)
+{
+  double sum = 0;
+  size_t n = 0;
+  for (size_t i = 0; i < v.size(); i++) {
+    if (mask && !(*mask)[i])
+      continue;
+    sum += v[i];
+    n++;
+  }
+  return n ? sum / n : NAN;
+}
+
+// -------------------- Annotation --------------------
+
+enum annot_key_t {
+  K_SOURCE, K_STALL, K_STALL_TOT, K_STALL_INS, K_STALL_RAW, K_STALL_LSU,
+  K_STALL_ACC, K_RS1, K_RS2, K_RD, K_IS_LOAD, K_IS_STORE, K_IS_BRANCH,
+  K_PC_D, K_OPA, K_OPB, K_OPA_SELECT, K_OPB_SELECT, K_OPC_SELECT,
+  K_WRITE_RD, K_CSR_ADDR, K_WRITEBACK, K_GPR_RDATA_1, K_GPR_RDATA_2,
+  K_LS_SIZE, K_LD_RESULT_32, K_LSU_RD, K_RETIRE_LOAD, K_ALU_RESULT,
+  K_LS_AMO, K_RETIRE_ACC, K_ACC_PID, K_ACC_PDATA_32, NUM_KEYS
+};
+
+static const char* const key_names[] = {
+  "source", "stall", "stall_tot", "stall_ins", "stall_raw", "stall_lsu",
+  "stall_acc", "rs1", "rs2", "rd", "is_load", "is_store", "is_branch",
+  "pc_d", "opa", "opb", "opa_select", "opb_select", "opc_select",
+  "write_rd", "csr_addr", "writeback", "gpr_rdata_1", "gpr_rdata_2",
+  "ls_size", "ld_result_32", "lsu_rd", "retire_load", "alu_result",
+  "ls_amo", "retire_acc", "acc_pid", "acc_pdata_32",
+};
+
+// The '#;' annotations of a line. A value with X bits keeps its text.
+struct extras_t
+{
+  int64_t val[NUM_KEYS];
+  string xs[NUM_KEYS];
+
+  int64_t operator[](annot_key_t k) const { return val[k]; }
+};
+
+static int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Reads "{'key': 0x..., ...}" the way gen_trace.py's regexes do: a value is
+// its leading hex digits, or its text if it starts with an X
+static void read_annotations(const char* p, const char* end, extras_t& extras)
+{
+  for (int k = 0; k < NUM_KEYS; k++) {
+    extras.val[k] = 0;
+    extras.xs[k].clear();
+  }
+
+  int next_key = 0;
+  while ((p = (const char*)memchr(p, '\'', end - p)) != NULL) {
+    const char* key = ++p;
+    const char* key_end = (const char*)memchr(p, '\'', end - p);
+    if (!key_end)
+      break;
+    p = key_end + 1;
+    while (p < end && isspace(*p))
+      p++;
+    if (p == end || *p != ':')
+      continue;
+    p++;
+    while (p < end && isspace(*p))
+      p++;
+    if (end - p < 3 || p[0] != '0' || p[1] != 'x')
+      continue;
+    p += 2;
+
+    // The tracer writes the keys in order: try the next one first
+    size_t len = key_end - key;
+    auto is_key = [&](int k) {
+      return strncmp(key_names[k], key, len) == 0 && key_names[k][len] == '\0';
+    };
+    int k = next_key < NUM_KEYS && is_key(next_key) ? next_key : 0;
+    while (k < NUM_KEYS && !is_key(k))
+      k++;
+    next_key = k + 1;
+
+    int64_t v = 0;
+    const char* digits = p;
+    for (int d; p < end && (d = hex_digit(*p)) >= 0; p++)
+      v = v << 4 | d;
+    if (p != digits) {
+      if (k < NUM_KEYS)
+        extras.val[k] = v;
+      continue;
+    }
+    while (p < end && (hex_digit(*p) >= 0 || *p == 'x' || *p == 'X'))
+      p++;
+    if (p != digits && k < NUM_KEYS) {
+      // Truthy, like a non-empty string
+      extras.val[k] = 1;
+      extras.xs[k] = "0x" + string(digits, p);
+    }
+  }
+}
+
+class trace_analyzer_t
+{
+public:
+  trace_analyzer_t(const arch_t& arch, bool force_hex_addr, bool permissive,
+                   string& err)
+    : arch(arch), force_hex_addr(force_hex_addr), permissive(permissive),
+      err(err), last_time(0), last_cycle(0), prev_wfi_time(0), section(0),
+      failed(false)
+  {
+    for (int k = 0; k < NUM_RAW_TYPES; k++)
+      retired_reg[k] = -1;
+    perf_metrics.emplace_back();
+    perf_metrics.back()["start"] = value_t::none();
+  }
+
+  // Annotates the lines in [p, end) to out. Returns false on a fatal error.
+  bool process(const char* p, const char* end, string& out);
+  // Appends the metrics of the sections to out and their CSV rows to csv
+  void finish(const string& name, int64_t core_id, bool all_keys,
+              const char* csv_path, string& out, string& csv);
+
+private:
+  const arch_t& arch;
+  bool force_hex_addr;
+  bool permissive;
+  // Warnings and errors, reported once the trace is done
+  string& err;
+
+  int64_t last_time, last_cycle;
+  int64_t prev_wfi_time;
+  int64_t retired_reg[NUM_RAW_TYPES];
+  // One FIFO of in-flight loads (issue cycle, address) per GPR, in the order
+  // the GPRs were first loaded or written back
+  typedef deque<pair<int64_t, int64_t>> wb_fifo_t;
+  vector<pair<int64_t, wb_fifo_t>> gpr_wb_info;
+  vector<section_t> perf_metrics;
+  int64_t section;
+  extras_t extras;
+  bool failed;
+
+  string int_lit_of(annot_key_t k, bool force_hex = false)
+  {
+    if (!extras.xs[k].empty()) {
+      err += "WARNING: Trace contains Xs!\n";
+      return extras.xs[k];
+    }
+    return int_lit(extras[k], force_hex);
+  }
+  wb_fifo_t& gpr_wb_fifo(int64_t reg)
+  {
+    for (auto& kv : gpr_wb_info)
+      if (kv.first == reg)
+        return kv.second;
+    gpr_wb_info.emplace_back(reg, wb_fifo_t());
+    return gpr_wb_info.back().second;
+  }
+  string reg_name(int64_t r) const
+  {
+    return r >= 0 && r < 32 ? reg_abi_names[r] : "x" + to_string(r);
+  }
+
+  string annotate_snitch(int64_t cycle, int64_t pc);
+  bool annotate_line(const char* line, const char* end, string& out);
+  void eval_perf_metrics(int64_t core_id);
+  string fmt_perf_metrics(size_t idx, bool omit_keys);
+  string sanity_check_perf_metrics(size_t idx);
+};
+
+string trace_analyzer_t::annotate_snitch(int64_t cycle, int64_t pc)
+{
+  section_t& pm = perf_metrics.back();
+  // Compound annotations in datapath order
+  vector<string> ret;
+  // Remember if we had a potential RAW stall
+  int64_t raw_stall[NUM_RAW_TYPES] = {0, 0};
+  // Add start time if this is this section's first instruction
+  if (pm["start"].kind == value_t::NONE)
+    pm["start"] = value_t::integer(cycle - extras[K_STALL_TOT]);
+  // Regular linear datapath operation
+  if (!extras[K_STALL]) {
+    // Check whether a register that is accessed was retired earlier
+    for (int k = 0; k < NUM_RAW_TYPES; k++)
+      for (annot_key_t reg : {K_RS1, K_RS2, K_RD})
+        if (extras[reg] == retired_reg[k])
+          raw_stall[k] = retired_reg[k];
+    // Check whether we read opc from rd
+    if (extras[K_OPC_SELECT] == OPER_GPR && extras[K_RD] != 0)
+      ret.push_back(ljust(reg_name(extras[K_RD]), 3) + " = " + int_lit_of(K_GPR_RDATA_2));
+    // Check whether we read opa from rs1
+    if (extras[K_OPA_SELECT] == OPER_GPR && extras[K_RS1] != 0)
+      ret.push_back(ljust(reg_name(extras[K_RS1]), 3) + " = " + int_lit_of(K_OPA));
+    // Check whether we read opb from rs2
+    if (extras[K_OPB_SELECT] == OPER_GPR && extras[K_RS2] != 0)
+      ret.push_back(ljust(reg_name(extras[K_RS2]), 3) + " = " + int_lit_of(K_OPB));
+    // CSR (always operand b)
+    if (extras[K_OPB_SELECT] == OPER_CSR) {
+      int64_t csr_addr = extras[K_CSR_ADDR];
+      string csr_name;
+      switch (csr_addr) {
+        case 0xb00: csr_name = "mcycle"; break;
+        case 0xb02: csr_name = "minstret"; break;
+        case 0xf14: csr_name = "mhartid"; break;
+        case 0x7d0: csr_name = "trace"; break;
+        case 0x7d1: csr_name = "stacklimit"; break;
+        default: {
+          char buf[32];
+          snprintf(buf, sizeof(buf), "csr@%" PRIx64, csr_addr);
+          csr_name = buf;
+        }
+      }
+      ret.push_back(csr_name + " = " + int_lit_of(K_OPB));
+    }
+    // Load / Store
+    if (extras[K_IS_LOAD]) {
+      pm["snitch_loads"].i++;
+      gpr_wb_fifo(extras[K_RD]).emplace_front(cycle, extras[K_ALU_RESULT]);
+      ret.push_back(ljust(reg_name(extras[K_RD]), 3) + " <~~ " +
+                    ls_sizes[extras[K_LS_SIZE] & 3] + "[" +
+                    int_lit_of(K_ALU_RESULT, force_hex_addr) + "]");
+    } else if (extras[K_IS_STORE]) {
+      pm["snitch_stores"].i++;
+      ret.push_back(int_lit_of(K_GPR_RDATA_1) + " ~~> " +
+                    ls_sizes[extras[K_LS_SIZE] & 3] + "[" +
+                    int_lit_of(K_ALU_RESULT, force_hex_addr) + "]");
+      int region;
+      int64_t tile;
+      arch.addr_to_meta(extras[K_ALU_RESULT], &region, &tile);
+      value_t& regions = pm["snitch_store_region"];
+      value_t& tiles = pm["snitch_store_tile"];
+      regions.kind = tiles.kind = value_t::LIST;
+      regions.list.push_back(region);
+      tiles.list.push_back(tile);
+    } else if (extras[K_IS_BRANCH]) {
+      // Branches: all reg-reg ops
+      ret.push_back(extras[K_ALU_RESULT] ? "taken" : "not taken");
+    }
+    // Datapath (ALU / Jump Target / Bypass) register writeback
+    if (extras[K_WRITE_RD] && extras[K_RD] != 0)
+      ret.push_back("(wrb) " + ljust(reg_name(extras[K_RD]), 3) + " <-- " +
+                    int_lit_of(K_WRITEBACK));
+  }
+  // Retired loads and accelerator (includes FPU) data: can come back on
+  // stall and during other ops
+  if (extras[K_RETIRE_LOAD]) {
+    wb_fifo_t& fifo = gpr_wb_fifo(extras[K_LSU_RD]);
+    if (!fifo.empty()) {
+      int64_t start_time = fifo.back().first, address = fifo.back().second;
+      fifo.pop_back();
+      int region;
+      int64_t tile;
+      arch.addr_to_meta(address, &region, &tile);
+      value_t& latencies = pm["snitch_load_latency"];
+      value_t& regions = pm["snitch_load_region"];
+      value_t& tiles = pm["snitch_load_tile"];
+      latencies.kind = regions.kind = tiles.kind = value_t::LIST;
+      latencies.list.push_back(cycle - start_time);
+      regions.list.push_back(region);
+      tiles.list.push_back(tile);
+    } else {
+      err += string(permissive ? "WARNING" : "FATAL") + ": In cycle " +
+             to_string(cycle) + ", LSU attempts writeback to " +
+             reg_name(extras[K_LSU_RD]) + ", but none in flight.\n";
+      if (!permissive) {
+        failed = true;
+        return "";
+      }
+    }
+    ret.push_back("(lsu) " + ljust(reg_name(extras[K_LSU_RD]), 3) + " <-- " +
+                  int_lit_of(K_LD_RESULT_32));
+    retired_reg[RAW_LSU] = extras[K_LSU_RD];
+  }
+  if (extras[K_RETIRE_ACC] && extras[K_ACC_PID] != 0) {
+    ret.push_back("(acc) " + ljust(reg_name(extras[K_ACC_PID]), 3) + " <-- " +
+                  int_lit_of(K_ACC_PDATA_32));
+    retired_reg[RAW_ACC] = extras[K_ACC_PID];
+  }
+  // Any kind of PC change: Branch, Jump, etc.
+  if (!extras[K_STALL] && extras[K_PC_D] != pc + 4)
+    ret.push_back("goto " + int_lit_of(K_PC_D));
+  // Count stalls, but only in cycles that execute an instruction
+  if (!extras[K_STALL]) {
+    if (extras[K_STALL_TOT]) {
+      ret.push_back("// stall " + to_string(extras[K_STALL_TOT]) + " cycles");
+      pm["stall_tot"].i += extras[K_STALL_TOT];
+      if (extras[K_STALL_INS]) {
+        pm["stall_ins"].i += extras[K_STALL_INS];
+        ret.push_back("(" + to_string(extras[K_STALL_INS]) + " ins)");
+      }
+      if (extras[K_STALL_RAW]) {
+        pm["stall_raw"].i += extras[K_STALL_RAW];
+        ret.push_back("(" + to_string(extras[K_STALL_RAW]) + " raw");
+        for (int k = 0; k < NUM_RAW_TYPES; k++) {
+          if (raw_stall[k] > 0) {
+            ret.push_back(string(raw_types[k]) + ":" + reg_name(raw_stall[k]) + ")");
+            pm[string("stall_raw_") + raw_types[k]].i += extras[K_STALL_RAW];
+          }
+        }
+      }
+      if (extras[K_STALL_LSU]) {
+        pm["stall_lsu"].i += extras[K_STALL_LSU];
+        ret.push_back("(" + to_string(extras[K_STALL_LSU]) + " lsu)");
+      }
+      if (extras[K_STALL_ACC]) {
+        pm["stall_acc"].i += extras[K_STALL_ACC];
+        ret.push_back("(" + to_string(extras[K_STALL_ACC]) + " acc)");
+      }
+      if (prev_wfi_time != 0) {
+        pm["stall_wfi"].i += cycle - prev_wfi_time - 1;
+        ret.push_back("(" + to_string(cycle - prev_wfi_time - 1) + " wfi)");
+      }
+    } else if (extras[K_STALL_INS] || extras[K_STALL_RAW] ||
+               extras[K_STALL_LSU] || extras[K_STALL_ACC]) {
+      ret.push_back("// Missed specific stall!!!");
+    } else if (cycle - last_cycle > 1) {
+      // Check if we did not skip a cycle, otherwise we probably had a
+      // undetected stall
+      ret.push_back("// Potentially missed stall cycle (" +
+                    to_string(cycle - last_cycle - 1) + " cycles)!!!");
+    }
+    // Reset the retired registers, since we executed an instruction
+    for (int k = 0; k < NUM_RAW_TYPES; k++)
+      retired_reg[k] = -1;
+  }
+
+  // Return comma-delimited list
+  string s;
+  for (size_t i = 0; i < ret.size(); i++)
+    s += (i ? ", " : "") + ret[i];
+  return s;
+}
+
+static bool parse_int(const char*& p, const char* end, int64_t* v)
+{
+  const char* start = p;
+  *v = 0;
+  while (p < end && isdigit(*p))
+    *v = *v * 10 + (*p++ - '0');
+  return p != start;
+}
+
+static bool skip_space(const char*& p, const char* end)
+{
+  const char* start = p;
+  while (p < end && isspace(*p))
+    p++;
+  return p != start;
+}
+
+// Matches (\d+)\s+(\d+)\s+(0x[0-9A-Fa-fz]+)\s+([^#;]*)(\s*#;\s*(.*))? at
+// the first run of digits of the line
+bool trace_analyzer_t::annotate_line(const char* line, const char* end,
+                                     string& out)
+{
+  const char* p = line;
+  while (p < end && !isdigit(*p))
+    p++;
+  int64_t time, cycle;
+  bool ok = parse_int(p, end, &time) && skip_space(p, end) &&
+            parse_int(p, end, &cycle) && skip_space(p, end);
+  const char* pc_str = p;
+  ok = ok && end - p > 2 && p[0] == '0' && p[1] == 'x' &&
+       (hex_digit(p[2]) >= 0 || p[2] == 'z');
+  if (ok) {
+    p += 2;
+    while (p < end && (hex_digit(*p) >= 0 || *p == 'z'))
+      p++;
+  }
+  const char* pc_end = p;
+  if (!ok || !skip_space(p, end)) {
+    err += "Not a valid trace line:\n" + string(line, end) + "\n";
+    failed = true;
+    return false;
+  }
+  const char* insn = p;
+  while (p < end && *p != '#' && *p != ';')
+    p++;
+  const char* insn_end = p;
+  const char* extras_str = NULL;
+  if (end - p >= 2 && p[0] == '#' && p[1] == ';') {
+    p += 2;
+    skip_space(p, end);
+    extras_str = p;
+  }
+
+  bool show_time_info = time != last_time || cycle != last_cycle;
+  string time_str = show_time_info ? to_string(time) : "";
+  string cycle_str = show_time_info ? to_string(cycle) : "";
+  string pc(pc_str, pc_end), insn_s(insn, insn_end);
+  string prefix = rjust(time_str, 8) + " " + rjust(cycle_str, 8) + " ";
+
+  // Vanilla trace
+  if (!extras_str || extras_str == end) {
+    out += prefix + rjust(pc, 10) + " " + ljust(insn_s, 30) + "\n";
+    last_time = time;
+    last_cycle = cycle;
+    prev_wfi_time = 0;
+    return true;
+  }
+
+  // Annotated trace
+  read_annotations(extras_str, end, extras);
+  string annot = annotate_snitch(cycle, strtoll(pc.c_str(), NULL, 16));
+  if (failed)
+    return false;
+  if (extras[K_STALL]) {
+    insn_s.clear();
+    pc.clear();
+  } else {
+    perf_metrics.back()["snitch_issues"].i++;
+  }
+  // Omit empty trace lines (due to double stalls, performance measures)
+  bool empty = insn_s.empty() && annot.empty();
+  if (!empty) {
+    out += prefix + rjust(pc, 10) + " " + ljust(insn_s, 30) + " #; " + annot + "\n";
+    last_time = time;
+    last_cycle = cycle;
+  }
+  // If wfi, remember when we went to sleep
+  size_t b = insn_s.find_first_not_of(" \t\n\r\f\v");
+  size_t e = insn_s.find_last_not_of(" \t\n\r\f\v");
+  bool wfi = b != string::npos && insn_s.compare(b, e - b + 1, "wfi") == 0;
+  prev_wfi_time = wfi ? last_cycle : 0;
+  return true;
+}
+
+bool trace_analyzer_t::process(const char* p, const char* end, string& out)
+{
+  while (p < end) {
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    const char* line_end = nl ? nl : end;
+    // gen_trace.py strips newlines off both ends
+    const char* line = p;
+    while (line < line_end && *line == '\n')
+      line++;
+    p = nl ? nl + 1 : end;
+    if (line == line_end)
+      continue;
+
+    if (!annotate_line(line, line_end, out))
+      return false;
+
+    if (perf_metrics[0]["start"].kind == value_t::NONE)
+      perf_metrics[0]["start"] = value_t::integer(last_cycle);
+    // Start a new benchmark section after 'csrw trace' instruction
+    size_t len = line_end - line;
+    if (memmem(line, len, "trace", 5) || memmem(line, len, "mcycle", 6)) {
+      perf_metrics.back()["end"] = value_t::integer(last_cycle);
+      perf_metrics.emplace_back();
+      perf_metrics.back()["section"] = value_t::integer(section);
+      perf_metrics.back()["start"] = value_t::none();
+      section++;
+    }
+  }
+  return true;
+}
+
+void trace_analyzer_t::eval_perf_metrics(int64_t core_id)
+{
+  int64_t tile_id = arch_t::floor_div(core_id, 4);
+  for (auto& seg : perf_metrics) {
+    int64_t cycles = seg["end"].i - seg["start"].i + 1;
+    // Snitch
+    value_t& latency = seg["snitch_load_latency"];
+    seg["snitch_avg_load_latency"] =
+      value_t::real(latency.kind == value_t::LIST ? mean(latency.list) : latency.i);
+    int64_t issues = seg["snitch_issues"].i;
+    seg["snitch_occupancy"] = cycles ? value_t::real((double)issues / cycles)
+                                     : value_t::none();
+    seg["cycles"] = value_t::integer(cycles);
+    seg["total_ipc"] = seg["snitch_occupancy"];
+    // Detailed load/store info
+    if (seg["snitch_loads"].i > 0) {
+      const vector<int64_t>& regions = seg["snitch_load_region"].list;
+      const vector<int64_t>& tiles = seg["snitch_load_tile"].list;
+      const vector<int64_t>& latencies = seg["snitch_load_latency"].list;
+      vector<bool> masks[4];
+      for (size_t i = 0; i < regions.size(); i++) {
+        bool seq = regions[i] == REGION_SEQUENTIAL;
+        bool itl = regions[i] == REGION_INTERLEAVED;
+        bool local = tiles[i] == tile_id;
+        masks[0].push_back(seq && local);
+        masks[1].push_back(seq && !local);
+        masks[2].push_back(itl && local);
+        masks[3].push_back(itl && !local);
+      }
+      static const char* const counts[] = {
+        "seq_loads_local", "seq_loads_global", "itl_loads_local", "itl_loads_global"};
+      static const char* const latency_keys[] = {
+        "seq_latency_local", "seq_latency_global", "itl_latency_local",
+        "itl_latency_global"};
+      for (int m = 0; m < 4; m++) {
+        int64_t n = 0;
+        for (bool b : masks[m])
+          n += b;
+        seg[counts[m]] = value_t::integer(n);
+        seg[latency_keys[m]] = value_t::real(mean(latencies, &masks[m]));
+      }
+    }
+    if (seg["snitch_stores"].i > 0) {
+      const vector<int64_t>& regions = seg["snitch_store_region"].list;
+      const vector<int64_t>& tiles = seg["snitch_store_tile"].list;
+      int64_t n[4] = {0, 0, 0, 0};
+      for (size_t i = 0; i < regions.size(); i++) {
+        bool local = tiles[i] == tile_id;
+        if (regions[i] == REGION_SEQUENTIAL)
+          n[local ? 0 : 1]++;
+        else if (regions[i] == REGION_INTERLEAVED)
+          n[local ? 2 : 3]++;
+      }
+      seg["seq_stores_local"] = value_t::integer(n[0]);
+      seg["seq_stores_global"] = value_t::integer(n[1]);
+      seg["itl_stores_local"] = value_t::integer(n[2]);
+      seg["itl_stores_global"] = value_t::integer(n[3]);
+    }
+  }
+}
+
+string trace_analyzer_t::fmt_perf_metrics(size_t idx, bool omit_keys)
+{
+  section_t& seg = perf_metrics[idx];
+  string ret = "Performance metrics for section " + to_string(idx) + " @ (" +
+               seg["start"].str() + ", " + seg["end"].str() + "):";
+  for (auto& kv : seg) {
+    if (omit_keys &&
+        find_if(begin(perf_eval_keys_omit), end(perf_eval_keys_omit),
+                [&](const char* k) { return kv.first == k; }) !=
+          end(perf_eval_keys_omit))
+      continue;
+    const value_t& v = kv.second;
+    string val;
+    switch (v.kind) {
+      case value_t::NONE: val = "None"; break;
+      case value_t::FLOAT: val = flt_fmt(v.f, 4); break;
+      case value_t::INT: val = int_lit(v.i); break;
+      case value_t::LIST: val = v.str(); break;
+    }
+    ret += "\n" + ljust(kv.first, 40) + rjust(val, 10);
+  }
+  return ret;
+}
+
+string trace_analyzer_t::sanity_check_perf_metrics(size_t idx)
+{
+  section_t& pm = perf_metrics[idx];
+  auto get = [&](const char* k) {
+    auto it = pm.find(k);
+    return it == pm.end() ? 0 : it->second.i;
+  };
+  int64_t raw = 0, total = 0, cycles = 0;
+  // Sum up RAW stalls
+  int64_t sum_raw = get("stall_raw_acc") + get("stall_raw_lsu");
+  if (sum_raw != get("stall_raw"))
+    raw = sum_raw;
+  // Sum up all stalls
+  int64_t sum_tot = get("stall_ins") + get("stall_lsu") + get("stall_raw") +
+                    get("stall_wfi");
+  if (sum_tot != get("stall_tot"))
+    total = sum_tot;
+  // Sum up all cycles
+  int64_t sum_cycle = get("stall_tot") + get("snitch_issues");
+  if (sum_cycle != get("cycles"))
+    cycles = sum_cycle;
+  if (!raw && !total && !cycles)
+    return "";
+
+  string ret = "Sanity check failed!";
+  if (raw)
+    ret += "\nraw_stalls do not add up. Sum is " + to_string(raw);
+  if (total)
+    ret += "\ntotal_stalls do not add up. Sum is " + to_string(total);
+  if (cycles)
+    ret += "\ncycles do not add up. Sum is " + to_string(cycles);
+  return ret;
+}
+
+// A field the way Python's csv module writes it
+static string csv_field(const section_t& seg, const char* key)
+{
+  auto it = seg.find(key);
+  if (it == seg.end() || it->second.kind == value_t::NONE)
+    return "";
+  string s = it->second.str();
+  if (s.find_first_of(",\"\r\n") != string::npos) {
+    string q = "\"";
+    for (char c : s)
+      q += c == '"' ? string("\"\"") : string(1, c);
+    return q + "\"";
+  }
+  return s;
+}
+
+void trace_analyzer_t::finish(const string& name, int64_t core_id,
+                              bool all_keys, const char* csv_path, string& out,
+                              string& csv)
+{
+  perf_metrics.back()["end"] = value_t::integer(last_cycle);
+  // Remove last empty entry
+  if (perf_metrics.back()["start"].kind == value_t::NONE)
+    perf_metrics.pop_back();
+  if (perf_metrics.empty() || perf_metrics[0]["start"].kind == value_t::NONE) {
+    err += "WARNING: Empty trace file (" + name + ").\n";
+    return;
+  }
+
+  // Compute metrics
+  eval_perf_metrics(core_id);
+  // Add metadata
+  for (auto& seg : perf_metrics)
+    seg["core"] = value_t::integer(core_id);
+  // Emit metrics
+  out += "\n## Performance metrics\n";
+  for (size_t idx = 0; idx < perf_metrics.size(); idx++) {
+    out += "\n" + fmt_perf_metrics(idx, !all_keys) + "\n";
+    string sanity_check = sanity_check_perf_metrics(idx);
+    if (!sanity_check.empty())
+      out += "\n" + sanity_check + "\n";
+    perf_metrics[idx]["section"] = value_t::integer(idx);
+  }
+  // Write metrics to CSV
+  if (csv_path) {
+    for (auto& seg : perf_metrics) {
+      for (size_t k = 0; k < sizeof(csv_keys) / sizeof(csv_keys[0]); k++)
+        csv += (k ? "," : "") + csv_field(seg, csv_keys[k]);
+      csv += "\r\n";
+    }
+    out += string("\nWrote performance metrics to ") + csv_path + "\n\n";
+  }
+  // Check for any loose ends and warn before exiting
+  bool warn_trip = false;
+  for (auto& kv : gpr_wb_info) {
+    if (!kv.second.empty()) {
+      warn_trip = true;
+      err += "WARNING: " + to_string(kv.second.size()) +
+             " transactions still in flight for " + reg_name(kv.first) + ".\n";
+    }
+  }
+  if (warn_trip)
+    err += "WARNING: Inconsistent final state; performance metrics may "
+           "be inaccurate. Is this trace complete?\n";
+}
+
+// -------------------- Main --------------------
+
+struct options_t
+{
+  const char* out_dir = NULL;
+  const char* csv = NULL;
+  bool saddr = false;
+  bool allkeys = false;
+  bool permissive = false;
+};
+
+// The hart's id from the first hex, or else decimal, number in the name
+static int64_t core_id_of(const string& path)
+{
+  string name = path.substr(path.rfind('/') + 1);
+  for (size_t i = 0; i + 2 < name.size(); i++)
+    if (name[i] == '0' && name[i + 1] == 'x' && hex_digit(name[i + 2]) >= 0)
+      return strtoll(name.c_str() + i, NULL, 16);
+  for (size_t i = 0; i < name.size(); i++)
+    if (isdigit(name[i]))
+      return strtoll(name.c_str() + i, NULL, 10);
+  return -1;
+}
+
+// The trace of one hart: its annotated trace and CSV rows
+struct job_t
+{
+  string in_path;
+  string csv;
+  string err;
+  bool ok = true;
+};
+
+static void analyze(const disassembler_t* disassembler, const arch_t& arch,
+                    const options_t& opts, const char* csv_path, int in,
+                    int out, int64_t core_id, job_t& job)
+{
+  dasm_converter_t converter(disassembler);
+  trace_analyzer_t analyzer(arch, !opts.saddr, opts.permissive, job.err);
+  string converted, annotated;
+  bool ok = true;
+  bool read_ok = for_each_line_chunk(in, [&](const char* begin, const char* end) {
+    converted.clear();
+    annotated.clear();
+    converter.convert(begin, end, converted);
+    ok = analyzer.process(converted.data(), converted.data() + converted.size(),
+                          annotated);
+    if (!write_all(out, annotated)) {
+      job.err += "Cannot write the trace of " + job.in_path + "\n";
+      ok = false;
+    }
+    return ok;
+  });
+  if (!read_ok) {
+    job.err += "Cannot read " + job.in_path + "\n";
+    ok = false;
+  }
+  if (!ok) {
+    job.ok = false;
+    return;
+  }
+
+  annotated.clear();
+  analyzer.finish(job.in_path, core_id, opts.allkeys, csv_path, annotated,
+                  job.csv);
+  if (!write_all(out, annotated))
+    job.ok = false;
+}
+
+int main(int argc, char** argv)
+{
+  const char* isa = "RV32IMA";
+  unsigned jobs = 0;
+  options_t opts;
+
+  option_parser_t parser;
+  parser.help(&help);
+  parser.option('h', "help", 0, [&](const char* s){help();});
+  parser.option(0, "isa", 1, [&](const char* s){isa = s;});
+  parser.option('o', "out-dir", 1, [&](const char* s){opts.out_dir = s;});
+  parser.option('j', "jobs", 1, [&](const char* s){jobs = atoi(s);});
+  parser.option('c', "csv", 1, [&](const char* s){opts.csv = s;});
+  parser.option('s', "saddr", 0, [&](const char* s){opts.saddr = true;});
+  parser.option('a', "allkeys", 0, [&](const char* s){opts.allkeys = true;});
+  parser.option('p', "permissive", 0, [&](const char* s){opts.permissive = true;});
+  const char* const* files = parser.parse(argv);
+
+  std::string lowercase;
+  for (const char *p = isa; *p; p++)
+    lowercase += std::tolower(*p);
+  int xlen;
+  if (lowercase.compare(0, 4, "rv32") == 0) {
+    xlen = 32;
+  } else if (lowercase.compare(0, 4, "rv64") == 0) {
+    xlen = 64;
+  } else {
+    fprintf(stderr, "bad ISA string: %s\n", isa);
+    return 1;
+  }
+  disassembler_t disassembler(xlen);
+  arch_t arch;
+
+  vector<job_t> hart_jobs;
+  for (; *files; files++) {
+    hart_jobs.emplace_back();
+    hart_jobs.back().in_path = *files;
+  }
+
+  // A CSV without a directory goes next to the (first) trace
+  string csv_path;
+  if (opts.csv) {
+    csv_path = opts.csv;
+    if (csv_path.find('/') == string::npos && !hart_jobs.empty()) {
+      const string& in = hart_jobs[0].in_path;
+      size_t slash = in.rfind('/');
+      if (slash != string::npos)
+        csv_path = in.substr(0, slash) + "/" + csv_path;
+    }
+  }
+  const char* csv = opts.csv ? csv_path.c_str() : NULL;
+
+  if (hart_jobs.empty()) {
+    job_t job;
+    job.in_path = "<stdin>";
+    analyze(&disassembler, arch, opts, csv, STDIN_FILENO, STDOUT_FILENO, -1, job);
+    hart_jobs.push_back(job);
+  } else {
+    vector<string> inputs;
+    for (auto& job : hart_jobs)
+      inputs.push_back(job.in_path);
+    run_file_jobs(inputs, jobs, [&](size_t i) {
+      job_t& job = hart_jobs[i];
+      string out_path = trace_output_path(job.in_path, opts.out_dir, ".trace");
+      int in = open(job.in_path.c_str(), O_RDONLY);
+      if (in < 0) {
+        job.err += job.in_path + ": " + strerror(errno) + "\n";
+        job.ok = false;
+        return;
+      }
+      int out = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (out < 0) {
+        job.err += out_path + ": " + strerror(errno) + "\n";
+        job.ok = false;
+        close(in);
+        return;
+      }
+      analyze(&disassembler, arch, opts, csv, in, out, core_id_of(job.in_path), job);
+      close(in);
+      if (close(out) != 0)
+        job.ok = false;
+    });
+  }
+
+  // Report and append the CSV rows in the order of the traces
+  bool ok = true;
+  string rows;
+  for (auto& job : hart_jobs) {
+    fputs(job.err.c_str(), stderr);
+    rows += job.csv;
+    ok &= job.ok;
+  }
+  if (csv && !rows.empty()) {
+    struct stat st;
+    bool write_header = stat(csv, &st) != 0;
+    FILE* f = fopen(csv, "a");
+    if (!f) {
+      perror(csv);
+      return 1;
+    }
+    if (write_header) {
+      for (size_t k = 0; k < sizeof(csv_keys) / sizeof(csv_keys[0]); k++)
+        fprintf(f, "%s%s", k ? "," : "", csv_keys[k]);
+      fputs("\r\n", f);
+    }
+    fwrite(rows.data(), 1, rows.size(), f);
+    ok &= fclose(f) == 0;
+  }
+
+  return ok ? 0 : 1;
+}
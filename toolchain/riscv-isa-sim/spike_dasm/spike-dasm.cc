@@ -5,27 +5,99 @@
 // in its input, then replaces them with the disassembly
 // enclosed hexadecimal number, interpreted as a RISC-V
 // instruction.
+//
+// Given trace files, it converts them in parallel, one file per thread,
+// and writes each to <out-dir>/<name without .dasm>.
 
+#include "trace_io.h"
 #include "disasm.h"
 #include "extension.h"
+#include <atomic>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
 #include <fesvr/option_parser.h>
 using namespace std;
 
+static void help()
+{
+  fprintf(stderr, "usage: spike-dasm [options] [<trace file>...]\n");
+  fprintf(stderr, "Reads stdin and writes stdout if no trace file is given\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --isa=<name>             RISC-V ISA string [default %s]\n", DEFAULT_ISA);
+#ifdef HAVE_DLOPEN
+  fprintf(stderr, "  --extension=<name>       Disassemble the instructions of extension <name>\n");
+#endif
+  fprintf(stderr, "  -h, --help               Print this help message\n");
+  fprintf(stderr, "  -o<dir>, --out-dir=<dir> Write the converted trace files to <dir>\n");
+  fprintf(stderr, "                             [default: next to each trace file]\n");
+  fprintf(stderr, "  -j<n>, --jobs=<n>        Convert <n> trace files at once [default: all host CPUs]\n");
+  exit(1);
+}
+
+static bool convert(dasm_converter_t& converter, int in, int out)
+{
+  string converted;
+  bool ok = true;
+  bool read_ok = for_each_line_chunk(in, [&](const char* begin, const char* end) {
+    converted.clear();
+    converter.convert(begin, end, converted);
+    return ok = write_all(out, converted);
+  });
+  return read_ok && ok;
+}
+
+static bool convert_file(dasm_converter_t& converter, const string& in_path,
+                         const char* out_dir)
+{
+  // Never overwrite the input
+  string out_path = trace_output_path(in_path, out_dir, "");
+  if (out_path == in_path)
+    out_path += ".s";
+
+  int in = open(in_path.c_str(), O_RDONLY);
+  if (in < 0) {
+    perror(in_path.c_str());
+    return false;
+  }
+  int out = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    perror(out_path.c_str());
+    close(in);
+    return false;
+  }
+
+  bool ok = convert(converter, in, out);
+  if (!ok)
+    perror(out_path.c_str());
+  close(in);
+  if (close(out) != 0) {
+    perror(out_path.c_str());
+    ok = false;
+  }
+  return ok;
+}
+
 int main(int argc, char** argv)
 {
-  string s;
   const char* isa = DEFAULT_ISA;
+  const char* out_dir = NULL;
+  unsigned jobs = 0;
 
   std::function<extension_t*()> extension;
   option_parser_t parser;
+  parser.help(&help);
+  parser.option('h', "help", 0, [&](const char* s){help();});
 #ifdef HAVE_DLOPEN
   parser.option(0, "extension", 1, [&](const char* s){extension = find_extension(s);});
 #endif
   parser.option(0, "isa", 1, [&](const char* s){isa = s;});
-  parser.parse(argv);
+  parser.option('o', "out-dir", 1, [&](const char* s){out_dir = s;});
+  parser.option('j', "jobs", 1, [&](const char* s){jobs = atoi(s);});
+  const char* const* files = parser.parse(argv);
 
   std::string lowercase;
   for (const char *p = isa; *p; p++)
@@ -48,36 +120,26 @@ int main(int argc, char** argv)
     }
   }
 
-  while (getline(cin, s))
-  {
-    for (size_t pos = 0; (pos = s.find("DASM(", pos)) != string::npos; )
-    {
-      size_t start = pos;
-
-      pos += strlen("DASM(");
-
-      if (s[pos] == '0' && (s[pos+1] == 'x' || s[pos+1] == 'X'))
-        pos += 2;
-
-      if (!isxdigit(s[pos]))
-        continue;
-
-      char* endp;
-      int64_t bits = strtoull(&s[pos], &endp, 16);
-      if (*endp != ')')
-        continue;
-
-      size_t nbits = 4 * (endp - &s[pos]);
-      if (nbits < 64)
-        bits = bits << (64 - nbits) >> (64 - nbits);
-
-      string dis = disassembler->disassemble(bits);
-      s = s.substr(0, start) + dis + s.substr(endp - &s[0] + 1);
-      pos = start + dis.length();
+  if (!*files) {
+    dasm_converter_t converter(disassembler);
+    if (!convert(converter, STDIN_FILENO, STDOUT_FILENO)) {
+      perror(argv[0]);
+      return 1;
     }
-
-    cout << s << '\n';
+    return 0;
   }
 
-  return 0;
+  // Lookups in the disassembler are read-only; each file gets its own memo
+  // of the instruction words it has seen
+  vector<string> inputs;
+  for (; *files; files++)
+    inputs.push_back(*files);
+  atomic<bool> failed(false);
+  run_file_jobs(inputs, jobs, [&](size_t i) {
+    dasm_converter_t converter(disassembler);
+    if (!convert_file(converter, inputs[i], out_dir))
+      failed = true;
+  });
+
+  return failed ? 1 : 0;
 }
@@ -0,0 +1,200 @@
+// See LICENSE for license details.
+
+#include "trace_io.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const string& dasm_converter_t::disassemble(uint64_t bits)
+{
+  auto it = memo.find(bits);
+  if (it == memo.end())
+    it = memo.emplace(bits, disassembler->disassemble(bits)).first;
+  return it->second;
+}
+
+static int hex_value(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+void dasm_converter_t::convert(const char* p, const char* end, string& out)
+{
+  static const char prefix[] = "DASM(";
+  static const size_t prefix_len = strlen(prefix);
+
+  while (p < end) {
+    const char* match = (const char*)memmem(p, end - p, prefix, prefix_len);
+    if (!match) {
+      out.append(p, end);
+      break;
+    }
+
+    const char* q = match + prefix_len;
+    if (end - q >= 2 && q[0] == '0' && (q[1] == 'x' || q[1] == 'X'))
+      q += 2;
+
+    // Like strtoull: too many digits saturate
+    const char* digits = q;
+    uint64_t bits = 0;
+    bool overflow = false;
+    for (int v; q < end && (v = hex_value(*q)) >= 0; q++) {
+      overflow |= bits >> 60 != 0;
+      bits = bits << 4 | v;
+    }
+    if (q == digits || q == end || *q != ')') {
+      // Not an instruction: keep it and search on after the match
+      out.append(p, digits);
+      p = digits;
+      continue;
+    }
+    if (overflow)
+      bits = UINT64_MAX;
+
+    size_t nbits = 4 * (q - digits);
+    if (nbits < 64)
+      bits = (uint64_t)((int64_t)bits << (64 - nbits) >> (64 - nbits));
+
+    out.append(p, match);
+    out += disassemble(bits);
+    p = q + 1;
+  }
+
+  if (!out.empty() && out.back() != '\n')
+    out += '\n';
+}
+
+
+static bool for_each_read_chunk(int fd, const function<bool(const char*, const char*)>& chunk)
+{
+  vector<char> buf(trace_chunk_size);
+  size_t have = 0;
+
+  while (true) {
+    ssize_t n = read(fd, buf.data() + have, buf.size() - have);
+    if (n < 0)
+      return false;
+    have += n;
+
+    // Hand out whole lines only, unless the input ended or a line fills the
+    // whole buffer
+    const char* begin = buf.data();
+    const char* stop = begin + have;
+    if (n != 0) {
+      const char* nl = (const char*)memrchr(begin, '\n', have);
+      stop = nl ? nl + 1 : begin;
+    }
+    if (stop == begin && have == buf.size()) {
+      buf.resize(buf.size() * 2);
+      continue;
+    }
+
+    if (stop != begin && !chunk(begin, stop))
+      return true;
+    have -= stop - begin;
+    memmove(buf.data(), stop, have);
+    if (n == 0)
+      return true;
+  }
+}
+
+bool for_each_line_chunk(int fd, const function<bool(const char*, const char*)>& chunk)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    return false;
+
+  size_t size = st.st_size;
+  if (!S_ISREG(st.st_mode) || size == 0)
+    return for_each_read_chunk(fd, chunk);
+  void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    return for_each_read_chunk(fd, chunk);
+
+  madvise(map, size, MADV_SEQUENTIAL);
+  const char* p = (const char*)map;
+  const char* end = p + size;
+  while (p < end) {
+    // Cut after the last newline of the chunk, or after the first one past
+    // it if a line is longer than a chunk
+    const char* stop = end;
+    if ((size_t)(end - p) > trace_chunk_size) {
+      const char* nl = (const char*)memrchr(p, '\n', trace_chunk_size);
+      if (!nl)
+        nl = (const char*)memchr(p + trace_chunk_size, '\n',
+                                 end - p - trace_chunk_size);
+      stop = nl ? nl + 1 : end;
+    }
+    if (!chunk(p, stop))
+      break;
+    p = stop;
+  }
+  munmap(map, size);
+  return true;
+}
+
+bool write_all(int fd, const string& s)
+{
+  for (size_t done = 0; done < s.size(); ) {
+    ssize_t n = write(fd, s.data() + done, s.size() - done);
+    if (n < 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+string trace_output_path(const string& in, const char* out_dir, const char* suffix)
+{
+  size_t slash = in.rfind('/');
+  string dir = slash == string::npos ? "." : in.substr(0, slash);
+  string name = slash == string::npos ? in : in.substr(slash + 1);
+
+  static const string dasm = ".dasm";
+  if (name.size() > dasm.size() &&
+      name.compare(name.size() - dasm.size(), dasm.size(), dasm) == 0)
+    name.resize(name.size() - dasm.size());
+  return string(out_dir ? out_dir : dir.c_str()) + "/" + name + suffix;
+}
+
+void run_file_jobs(const vector<string>& files, unsigned jobs,
+                   const function<void(size_t)>& job)
+{
+  // Largest first, so that no thread starts a long file last
+  vector<pair<off_t, size_t>> order;
+  for (size_t i = 0; i < files.size(); i++) {
+    struct stat st;
+    order.emplace_back(stat(files[i].c_str(), &st) == 0 ? st.st_size : 0, i);
+  }
+  stable_sort(order.begin(), order.end(),
+              [](const pair<off_t, size_t>& a, const pair<off_t, size_t>& b) {
+                return a.first > b.first;
+              });
+
+  if (jobs == 0)
+    jobs = max(1u, thread::hardware_concurrency());
+  jobs = min<size_t>(jobs, files.size());
+
+  atomic<size_t> next(0);
+  vector<thread> threads;
+  for (unsigned i = 0; i < jobs; i++) {
+    threads.emplace_back([&]() {
+      for (size_t j; (j = next++) < order.size(); )
+        job(order[j].second);
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+}
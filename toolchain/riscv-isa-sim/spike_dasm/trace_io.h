@@ -0,0 +1,50 @@
+// See LICENSE for license details.
+#ifndef _SPIKE_DASM_TRACE_IO_H
+#define _SPIKE_DASM_TRACE_IO_H
+
+#include "disasm.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Replaces the DASM(...) in trace lines, disassembling each instruction word
+// once. Not thread-safe: use one per thread.
+class dasm_converter_t
+{
+public:
+  dasm_converter_t(const disassembler_t* disassembler)
+    : disassembler(disassembler) {}
+
+  // Appends the conversion of the lines in [p, end) to out. The last line
+  // gets a newline if it has none.
+  void convert(const char* p, const char* end, std::string& out);
+
+private:
+  const disassembler_t* disassembler;
+  std::unordered_map<uint64_t, std::string> memo;
+
+  const std::string& disassemble(uint64_t bits);
+};
+
+// Input is handed out and output written in chunks of about this size
+const size_t trace_chunk_size = 4 << 20;
+
+// Calls chunk with consecutive runs of whole lines of fd until it returns
+// false. Regular files are mapped, anything else is read.
+bool for_each_line_chunk(int fd, const std::function<bool(const char* begin,
+                                                          const char* end)>& chunk);
+
+bool write_all(int fd, const std::string& s);
+
+// <out_dir, or the directory of in>/<name of in without .dasm><suffix>
+std::string trace_output_path(const std::string& in, const char* out_dir,
+                              const char* suffix);
+
+// Runs job(i) for every file on up to jobs threads (0: all host CPUs),
+// largest file first
+void run_file_jobs(const std::vector<std::string>& files, unsigned jobs,
+                   const std::function<void(size_t i)>& job);
+
+#endif
@@ -0,0 +1,49 @@
+// See LICENSE for license details.
+
+// This little program turns binary commit logs written by
+//   spike --log-commits --log-binary --log=<name>
+// back into the text format of --log-commits.
+
+#include "commit_log.h"
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+static int decode(const char* name, FILE* in)
+{
+  commit_log_header_t header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      !commit_log_reader_t::check_header(header)) {
+    fprintf(stderr, "%s: not a binary commit log\n", name);
+    return 1;
+  }
+
+  commit_log_reader_t reader(in);
+  try {
+    while (const uint8_t* rec = reader.next())
+      commit_log_print(stdout, rec);
+  } catch (std::runtime_error& e) {
+    fprintf(stderr, "%s: %s\n", name, e.what());
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc == 1)
+    return decode("<stdin>", stdin);
+
+  for (int i = 1; i < argc; i++) {
+    FILE* in = fopen(argv[i], "rb");
+    if (!in) {
+      perror(argv[i]);
+      return 1;
+    }
+    int ret = decode(argv[i], in);
+    fclose(in);
+    if (ret)
+      return ret;
+  }
+  return 0;
+}
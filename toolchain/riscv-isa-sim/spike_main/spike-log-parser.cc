@@ -1,60 +1,757 @@
 // See LICENSE for license details.
 
-// This little program finds occurrences of strings like
+// This program computes the instruction mix of every core from the commit
+// log of spike --log-commits, in text or binary (--log-binary) form. Every
+// write to the trace CSR, as by mempool_start_benchmark and
+// mempool_stop_benchmark, starts a new section of the core that did it.
+// Each section counts its instructions by mnemonic and by class, and its
+// loads, stores and atomics by the TCDM region they access (with --mempool).
+// The log is parsed in chunks on several threads.
+//
+// Logs of spike -l, with lines like
 //   core   0: 0x000000008000c36c (0xfe843783) ld      a5, -24(s0)
-// in its inputs, then output the RISC-V instruction with the disassembly
-// enclosed hexadecimal number.
+// are counted too if they hold no commit lines. Their loads, stores and
+// atomics are classified by opcode, but the regions they access are unknown.
+// With --names, it prints the mnemonic of every instruction instead.
 
-#include <iostream>
-#include <string>
+#include <algorithm>
+#include <cinttypes>
 #include <cstdint>
-#include <regex>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "fesvr/option_parser.h"
 
 #include "disasm.h"
 #include "extension.h"
+#include "commit_log.h"
+#include "devices.h"
+#include "tcdm_map.h"
 
 using namespace std;
 
+enum insn_class_t { SCALAR, SIMD, BRANCH, LOAD, STORE, AMO, NUM_CLASSES };
+static const char* const class_names[NUM_CLASSES] = {
+  "scalar", "simd", "branch", "load", "store", "amo"
+};
+
+// Indexed by tcdm_map_t::region_t
+static const int NUM_REGIONS = 3;
+static const char* const region_names[NUM_REGIONS] = {
+  "other", "sequential", "interleaved"
+};
+
+enum access_t { ACCESS_LOAD, ACCESS_STORE, ACCESS_AMO, NUM_ACCESSES };
+static const char* const access_names[NUM_ACCESSES] = {
+  "load", "store", "amo"
+};
+
+static const size_t CHUNK_SIZE = 4 << 20;
+
+// The trace value of the first section of a core, or of a section whose
+// value the log does not tell
+static const int64_t NO_TRACE = -1;
+
+struct section_t
+{
+  int64_t trace;
+  uint64_t insns;
+  uint64_t classes[NUM_CLASSES];
+  uint64_t accesses[NUM_ACCESSES][NUM_REGIONS];
+  unordered_map<const disasm_insn_t*, uint64_t> mnemonics;
+
+  explicit section_t(int64_t trace = NO_TRACE) : trace(trace), insns(0)
+  {
+    memset(classes, 0, sizeof(classes));
+    memset(accesses, 0, sizeof(accesses));
+  }
+
+  void add(const section_t& other)
+  {
+    insns += other.insns;
+    for (int i = 0; i < NUM_CLASSES; i++)
+      classes[i] += other.classes[i];
+    for (int i = 0; i < NUM_ACCESSES; i++)
+      for (int j = 0; j < NUM_REGIONS; j++)
+        accesses[i][j] += other.accesses[i][j];
+    for (auto& m : other.mnemonics)
+      mnemonics[m.first] += m.second;
+  }
+};
+
+// The sections of every core, by hartid
+typedef map<uint32_t, vector<section_t>> core_sections_t;
+
+static bool is_branch(uint64_t bits, int xlen)
+{
+  if ((bits & 3) == 3) {
+    unsigned opcode = bits & 0x7f;
+    return opcode == 0x63 || opcode == 0x67 || opcode == 0x6f;
+  }
+
+  unsigned funct3 = bits >> 13 & 7;
+  switch (bits & 3) {
+  case 1:  // c.jal (RV32 only), c.j, c.beqz, c.bnez
+    return (funct3 == 1 && xlen == 32) || funct3 >= 5;
+  case 2:  // c.jr, c.jalr
+    return funct3 == 4 && (bits >> 2 & 0x1f) == 0 && (bits >> 7 & 0x1f) != 0;
+  }
+  return false;
+}
+
+// Whether the instruction is a load, a store or an atomic, by its opcode, so
+// that logs without memory accesses classify them too; SCALAR otherwise
+static insn_class_t memory_class(uint64_t bits)
+{
+  if ((bits & 3) == 3) {
+    switch (bits & 0x7f) {
+    case 0x03:  // LOAD
+    case 0x07:  // LOAD-FP, vector loads
+    case 0x0b:  // Xpulpimg post-increment loads
+      return LOAD;
+    case 0x23:  // STORE
+    case 0x27:  // STORE-FP, vector stores
+    case 0x2b:  // Xpulpimg post-increment stores
+      return STORE;
+    case 0x2f:  // AMO, lr, sc
+      return AMO;
+    }
+    return SCALAR;
+  }
+
+  // Quadrants 0 and 2: funct3 1-3 load, 5-7 store
+  unsigned funct3 = bits >> 13 & 7;
+  if ((bits & 3) == 1 || funct3 == 0 || funct3 == 4)
+    return SCALAR;
+  return funct3 < 4 ? LOAD : STORE;
+}
+
+// Whether the instruction writes the trace CSR; sets the value it writes if
+// the encoding tells
+static bool writes_trace(uint64_t bits, int64_t& value)
+{
+  if ((bits & 0x7f) != 0x73 || bits >> 20 != CSR_TRACE)
+    return false;
+  unsigned funct3 = bits >> 12 & 7;
+  unsigned rs1 = bits >> 15 & 0x1f;
+  value = funct3 == 5 ? rs1 : NO_TRACE;  // csrrwi
+  // csrrs and csrrc with x0 or a zero immediate only read
+  return (funct3 & 3) == 1 || ((funct3 & 3) != 0 && rs1 != 0);
+}
+
+static bool parse_hex(const char*& p, const char* end, uint64_t& value)
+{
+  if (end - p < 3 || p[0] != '0' || p[1] != 'x')
+    return false;
+  const char* digits = p += 2;
+  for (value = 0; p < end; p++) {
+    char c = *p;
+    if (c >= '0' && c <= '9')
+      value = value << 4 | (c - '0');
+    else if (c >= 'a' && c <= 'f')
+      value = value << 4 | (c - 'a' + 10);
+    else
+      break;
+  }
+  return p != digits;
+}
+
+static void skip_spaces(const char*& p, const char* end)
+{
+  while (p < end && *p == ' ')
+    p++;
+}
+
+// Parses "core <hartid>: [<priv> ]0x<pc> (0x<bits>)". Commit lines have the
+// privilege level, lines of spike -l do not. Returns where the rest of the
+// line starts, or NULL if it is no such line.
+static const char* parse_core_line(const char* p, const char* end,
+                                   uint32_t& hartid, uint64_t& bits,
+                                   bool& commit)
+{
+  if (end - p < 4 || memcmp(p, "core", 4) != 0)
+    return NULL;
+  p += 4;
+  skip_spaces(p, end);
+  const char* digits = p;
+  for (hartid = 0; p < end && *p >= '0' && *p <= '9'; p++)
+    hartid = hartid * 10 + (*p - '0');
+  if (p == digits || p == end || *p++ != ':')
+    return NULL;
+  skip_spaces(p, end);
+
+  commit = end - p >= 2 && *p >= '0' && *p <= '9' && p[1] == ' ';
+  if (commit)
+    p += 2;
+  uint64_t pc;
+  if (!parse_hex(p, end, pc))
+    return NULL;
+  skip_spaces(p, end);
+  if (p == end || *p++ != '(' || !parse_hex(p, end, bits) ||
+      p == end || *p++ != ')')
+    return NULL;
+  return p;
+}
+
+// Counts the instructions of a chunk of the log. The first section of every
+// core continues its section from the chunk before.
+class chunk_parser_t
+{
+public:
+  chunk_parser_t(const disassembler_t* disassembler, const tcdm_map_t* map,
+                 int xlen, bool names, bool disasm_lines)
+    : disassembler(disassembler), map(map), xlen(xlen), names(names),
+      disasm_lines(disasm_lines)
+  {
+    trace_token = "c" + to_string(CSR_TRACE) + "_trace";
+  }
+
+  core_sections_t sections;
+  string name_list;
+
+  void parse_text(const char* p, const char* end)
+  {
+    while (p < end) {
+      const char* eol = (const char*)memchr(p, '\n', end - p);
+      if (!eol)
+        eol = end;
+      parse_line(p, eol);
+      p = eol + 1;
+    }
+  }
+
+  void parse_binary(const uint8_t* p, const uint8_t* end)
+  {
+    while (p < end) {
+      size_t size = commit_log_record_size(p, end - p);
+      if (!size)
+        throw runtime_error("commit log ends in the middle of a record");
+      parse_record(p);
+      p += size;
+    }
+  }
+
+private:
+  const disassembler_t* disassembler;
+  const tcdm_map_t* map;
+  int xlen;
+  bool names;
+  bool disasm_lines;
+  string trace_token;
+  vector<uint64_t> loads;
+  vector<uint64_t> stores;
+
+  void parse_line(const char* p, const char* end)
+  {
+    uint32_t hartid;
+    uint64_t bits;
+    bool commit;
+    p = parse_core_line(p, end, hartid, bits, commit);
+    if (!p || (!commit && !disasm_lines))
+      return;
+
+    // The register writes come first, then the loads as "mem <addr>" and
+    // the stores as "mem <addr> <value>"
+    loads.clear();
+    stores.clear();
+    bool trace_logged = false;
+    uint64_t trace = 0;
+    while (commit && p < end) {
+      skip_spaces(p, end);
+      const char* token = p;
+      while (p < end && *p != ' ')
+        p++;
+      size_t len = p - token;
+      uint64_t value;
+      if (len == 3 && memcmp(token, "mem", 3) == 0) {
+        skip_spaces(p, end);
+        if (!parse_hex(p, end, value))
+          break;
+        skip_spaces(p, end);
+        uint64_t data;
+        if (parse_hex(p, end, data))
+          stores.push_back(value);
+        else
+          loads.push_back(value);
+      } else if (len == trace_token.size() &&
+                 memcmp(token, trace_token.data(), len) == 0) {
+        skip_spaces(p, end);
+        trace_logged = parse_hex(p, end, trace);
+      }
+    }
+
+    retire(hartid, bits, trace_logged, trace);
+  }
+
+  void parse_record(const uint8_t* rec)
+  {
+    commit_log_insn_t insn;
+    memcpy(&insn, rec, sizeof(insn));
+    rec += sizeof(insn) + (insn.vec ? sizeof(commit_log_vec_t) : 0);
+
+    bool trace_logged = false;
+    uint64_t trace = 0;
+    for (unsigned i = 0; i < insn.nregs; i++) {
+      commit_log_reg_write_t reg;
+      memcpy(&reg, rec, sizeof(reg));
+      rec += sizeof(reg);
+      if (reg.key == (CSR_TRACE << 4 | 4)) {
+        trace_logged = true;
+        memcpy(&trace, rec, min<size_t>(reg.width / 8, sizeof(trace)));
+      }
+      rec += reg.width / 8;
+    }
+
+    loads.clear();
+    stores.clear();
+    for (unsigned i = 0; i < insn.nloads; i++, rec += sizeof(commit_log_load_t)) {
+      commit_log_load_t load;
+      memcpy(&load, rec, sizeof(load));
+      loads.push_back(load.addr);
+    }
+    for (unsigned i = 0; i < insn.nstores; i++, rec += sizeof(commit_log_store_t)) {
+      commit_log_store_t store;
+      memcpy(&store, rec, sizeof(store));
+      stores.push_back(store.addr);
+    }
+
+    uint64_t bits = insn.bits;
+    if (insn.length < 8)
+      bits &= (uint64_t(1) << (insn.length * 8)) - 1;
+    retire(insn.hartid, bits, trace_logged, trace);
+  }
+
+  void retire(uint32_t hartid, uint64_t bits, bool trace_logged, uint64_t trace)
+  {
+    const disasm_insn_t* disasm = disassembler->lookup(bits);
+    if (names) {
+      name_list += disasm ? disasm->get_name() : "unknown_op";
+      name_list += '\n';
+      return;
+    }
+
+    vector<section_t>& core = sections[hartid];
+    if (core.empty())
+      core.emplace_back();
+    section_t& section = core.back();
+    section.insns++;
+    section.mnemonics[disasm]++;
+
+    // The opcode gives the class, the logged accesses only their regions.
+    // Atomics read and write, but count as a single access.
+    insn_class_t cls = memory_class(bits);
+    if (cls == AMO) {
+      if (!loads.empty() || !stores.empty())
+        section.accesses[ACCESS_AMO][region(loads.empty() ? stores[0] : loads[0])]++;
+    } else if (cls != SCALAR) {
+      for (uint64_t addr : loads)
+        section.accesses[ACCESS_LOAD][region(addr)]++;
+      for (uint64_t addr : stores)
+        section.accesses[ACCESS_STORE][region(addr)]++;
+    } else if (is_branch(bits, xlen)) {
+      cls = BRANCH;
+    } else if (disasm && strncmp(disasm->get_name(), "pv_", 3) == 0) {
+      cls = SIMD;
+    } else {
+      cls = SCALAR;
+    }
+    section.classes[cls]++;
+
+    int64_t value;
+    if (writes_trace(bits, value))
+      core.emplace_back(trace_logged ? (int64_t)trace : value);
+  }
+
+  int region(uint64_t addr) const
+  {
+    return map ? map->region(addr) : tcdm_map_t::OTHER;
+  }
+};
+
+static void merge(core_sections_t& cores, core_sections_t& chunk)
+{
+  for (auto& c : chunk) {
+    vector<section_t>& core = cores[c.first];
+    auto it = c.second.begin();
+    if (core.empty())
+      core.push_back(move(*it));
+    else
+      core.back().add(*it);
+    for (++it; it != c.second.end(); ++it)
+      core.push_back(move(*it));
+  }
+}
+
+// Whether a text log holds commit lines, judging by its first chunk. Logs of
+// spike -l --log-commits hold both kinds of lines for every instruction.
+static bool has_commit_lines(const string& chunk)
+{
+  const char* p = chunk.data();
+  const char* end = p + chunk.size();
+  bool core_lines = false;
+  while (p < end) {
+    const char* eol = (const char*)memchr(p, '\n', end - p);
+    if (!eol)
+      eol = end;
+    uint32_t hartid;
+    uint64_t bits;
+    bool commit;
+    if (parse_core_line(p, eol, hartid, bits, commit)) {
+      if (commit)
+        return true;
+      core_lines = true;
+    }
+    p = eol + 1;
+  }
+  return !core_lines;
+}
+
+// Reads the log in chunks of whole lines or records
+class log_reader_t
+{
+public:
+  log_reader_t(FILE* file) : file(file), binary(false)
+  {
+    commit_log_header_t header;
+    size_t got = fread(&header, 1, sizeof(header), file);
+    if (got == sizeof(header) && commit_log_reader_t::check_header(header)) {
+      binary = true;
+      records.reset(new commit_log_reader_t(file));
+    } else {
+      // The bytes read to look for the header start the text
+      pending.assign((const char*)&header, got);
+    }
+  }
+
+  bool is_binary() const { return binary; }
+
+  bool next(string& chunk)
+  {
+    chunk.clear();
+    if (binary) {
+      while (chunk.size() < CHUNK_SIZE) {
+        const uint8_t* rec = records->next();
+        if (!rec)
+          break;
+        chunk.append((const char*)rec, commit_log_record_size(rec, SIZE_MAX));
+      }
+      return !chunk.empty();
+    }
+
+    chunk.swap(pending);
+    size_t have = chunk.size();
+    chunk.resize(have + CHUNK_SIZE);
+    size_t got = fread(&chunk[have], 1, CHUNK_SIZE, file);
+    chunk.resize(have + got);
+    if (got != 0) {
+      size_t nl = chunk.rfind('\n');
+      if (nl != string::npos) {
+        pending.assign(chunk, nl + 1, string::npos);
+        chunk.resize(nl + 1);
+      }
+    }
+    return !chunk.empty();
+  }
+
+private:
+  FILE* file;
+  bool binary;
+  unique_ptr<commit_log_reader_t> records;
+  string pending;
+};
+
+static string mnemonic(const disasm_insn_t* disasm)
+{
+  if (!disasm)
+    return "unknown";
+  string name = disasm->get_name();
+  name = name.substr(0, name.find(' '));
+  replace(name.begin(), name.end(), '_', '.');
+  return name;
+}
+
+static void write_json(FILE* out, const core_sections_t& cores)
+{
+  fprintf(out, "{\n  \"cores\": [");
+  for (auto c = cores.begin(); c != cores.end(); ++c) {
+    fprintf(out, "%s\n    {\"core\": %" PRIu32 ", \"sections\": [",
+            c == cores.begin() ? "" : ",", c->first);
+    for (size_t i = 0; i < c->second.size(); i++) {
+      const section_t& s = c->second[i];
+      fprintf(out, "%s\n      {\"section\": %zu, \"trace\": ", i ? "," : "", i);
+      if (s.trace == NO_TRACE)
+        fprintf(out, "null");
+      else
+        fprintf(out, "%" PRId64, s.trace);
+      fprintf(out, ", \"insns\": %" PRIu64 ",\n       \"classes\": {", s.insns);
+      for (int j = 0; j < NUM_CLASSES; j++)
+        fprintf(out, "%s\"%s\": %" PRIu64, j ? ", " : "", class_names[j],
+                s.classes[j]);
+      fprintf(out, "},\n       \"accesses\": {");
+      for (int j = 0; j < NUM_ACCESSES; j++) {
+        fprintf(out, "%s\"%s\": {", j ? ", " : "", access_names[j]);
+        for (int k = 0; k < NUM_REGIONS; k++)
+          fprintf(out, "%s\"%s\": %" PRIu64, k ? ", " : "", region_names[k],
+                  s.accesses[j][k]);
+        fprintf(out, "}");
+      }
+
+      // Most frequent first
+      map<string, uint64_t> by_name;
+      for (auto& m : s.mnemonics)
+        by_name[mnemonic(m.first)] += m.second;
+      vector<pair<string, uint64_t>> sorted(by_name.begin(), by_name.end());
+      stable_sort(sorted.begin(), sorted.end(),
+                  [](const pair<string, uint64_t>& a, const pair<string, uint64_t>& b) {
+                    return a.second > b.second;
+                  });
+      fprintf(out, "},\n       \"mnemonics\": {");
+      for (size_t j = 0; j < sorted.size(); j++)
+        fprintf(out, "%s\"%s\": %" PRIu64, j ? ", " : "",
+                sorted[j].first.c_str(), sorted[j].second);
+      fprintf(out, "}}");
+    }
+    fprintf(out, "\n    ]}");
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+static void write_csv(FILE* out, const core_sections_t& cores)
+{
+  fprintf(out, "core,section,trace,insns");
+  for (int i = 0; i < NUM_CLASSES; i++)
+    fprintf(out, ",%s", class_names[i]);
+  for (int i = 0; i < NUM_ACCESSES; i++)
+    for (int j = 0; j < NUM_REGIONS; j++)
+      fprintf(out, ",%s_%s", access_names[i], region_names[j]);
+  fprintf(out, "\n");
+
+  for (auto& c : cores) {
+    for (size_t i = 0; i < c.second.size(); i++) {
+      const section_t& s = c.second[i];
+      fprintf(out, "%" PRIu32 ",%zu,", c.first, i);
+      if (s.trace != NO_TRACE)
+        fprintf(out, "%" PRId64, s.trace);
+      fprintf(out, ",%" PRIu64, s.insns);
+      for (int j = 0; j < NUM_CLASSES; j++)
+        fprintf(out, ",%" PRIu64, s.classes[j]);
+      for (int j = 0; j < NUM_ACCESSES; j++)
+        for (int k = 0; k < NUM_REGIONS; k++)
+          fprintf(out, ",%" PRIu64, s.accesses[j][k]);
+      fprintf(out, "\n");
+    }
+  }
+}
+
+// The mix of every section over all cores, assuming they go through the
+// same sections
+static void print_summary(FILE* out, const core_sections_t& cores)
+{
+  vector<section_t> sections;
+  for (auto& c : cores) {
+    if (sections.size() < c.second.size())
+      sections.resize(c.second.size());
+    for (size_t i = 0; i < c.second.size(); i++)
+      sections[i].add(c.second[i]);
+  }
+
+  fprintf(out, "%-8s %14s", "section", "insns");
+  for (int i = 0; i < NUM_CLASSES; i++)
+    fprintf(out, " %7s", class_names[i]);
+  for (int i = 0; i < NUM_REGIONS; i++)
+    fprintf(out, " %11s", region_names[i]);
+  fprintf(out, "\n");
+
+  for (size_t i = 0; i < sections.size(); i++) {
+    const section_t& s = sections[i];
+    fprintf(out, "%-8zu %14" PRIu64, i, s.insns);
+    for (int j = 0; j < NUM_CLASSES; j++)
+      fprintf(out, " %6.1f%%", s.insns ? 100. * s.classes[j] / s.insns : 0.);
+    uint64_t accesses = 0;
+    for (int j = 0; j < NUM_ACCESSES; j++)
+      for (int k = 0; k < NUM_REGIONS; k++)
+        accesses += s.accesses[j][k];
+    for (int k = 0; k < NUM_REGIONS; k++) {
+      uint64_t n = 0;
+      for (int j = 0; j < NUM_ACCESSES; j++)
+        n += s.accesses[j][k];
+      fprintf(out, " %10.1f%%", accesses ? 100. * n / accesses : 0.);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+static bool write_file(const char* path, void (*write)(FILE*, const core_sections_t&),
+                       const core_sections_t& cores)
+{
+  FILE* out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  write(out, cores);
+  if (fclose(out) != 0) {
+    perror(path);
+    return false;
+  }
+  return true;
+}
+
+static void help()
+{
+  fprintf(stderr, "usage: spike-log-parser [options] [<commit log>]\n");
+  fprintf(stderr, "Reads the commit log from stdin if none is given\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --isa=<name>          RISC-V ISA string [default %s]\n", DEFAULT_ISA);
+  fprintf(stderr, "  --extension=<name>    Disassemble the instructions of extension <name>\n");
+  fprintf(stderr, "  -h, --help            Print this help message\n");
+  fprintf(stderr, "  -j<n>, --jobs=<n>     Parse on <n> threads [default: all host CPUs]\n");
+  fprintf(stderr, "  --json=<name>         Write the sections of every core to <name>\n");
+  fprintf(stderr, "  --csv=<name>          Write the classes and accesses of the sections of\n");
+  fprintf(stderr, "                          every core to <name>\n");
+  fprintf(stderr, "  --names               Print the mnemonic of every instruction instead\n");
+  fprintf(stderr, "  -p<n>                 The log is of <n> cores [default 1]\n");
+  fprintf(stderr, "  --mempool=<G:T[:B]>   Classify the accesses by TCDM region for G groups\n");
+  fprintf(stderr, "                          of tiles with T cores each and a banking factor\n");
+  fprintf(stderr, "                          of B [default 4], as in spike\n");
+  fprintf(stderr, "  --seq-mem-size=<n>    Size of each core's sequential TCDM region in bytes\n");
+  fprintf(stderr, "                          with --mempool [default 1024]\n");
+  exit(1);
+}
+
 int main(int argc, char** argv)
 {
-  string s;
   const char* isa = DEFAULT_ISA;
+  const char* json = NULL;
+  const char* csv = NULL;
+  bool names = false;
+  unsigned jobs = 0;
+  size_t nprocs = 1;
+  size_t mempool_groups = 0;
+  size_t mempool_cores_per_tile = 0;
+  size_t mempool_banking_factor = 4;
+  size_t seq_mem_size = 1024;
 
   std::function<extension_t*()> extension;
   option_parser_t parser;
+  parser.help(&help);
+  parser.option('h', "help", 0, [&](const char* s){help();});
   parser.option(0, "extension", 1, [&](const char* s){extension = find_extension(s);});
   parser.option(0, "isa", 1, [&](const char* s){isa = s;});
-  parser.parse(argv);
+  parser.option('j', "jobs", 1, [&](const char* s){jobs = atoi(s);});
+  parser.option(0, "json", 1, [&](const char* s){json = s;});
+  parser.option(0, "csv", 1, [&](const char* s){csv = s;});
+  parser.option(0, "names", 0, [&](const char* s){names = true;});
+  parser.option('p', 0, 1, [&](const char* s){nprocs = strtoull(s, 0, 0);});
+  parser.option(0, "mempool", 1, [&](const char* s){
+    char* p;
+    mempool_groups = strtoull(s, &p, 0);
+    if (*p == ':')
+      mempool_cores_per_tile = strtoull(p + 1, &p, 0);
+    if (*p == ':')
+      mempool_banking_factor = strtoull(p + 1, &p, 0);
+    if (*p || !mempool_cores_per_tile || !mempool_banking_factor)
+      help();
+  });
+  parser.option(0, "seq-mem-size", 1, [&](const char* s){seq_mem_size = strtoull(s, 0, 0);});
+  const char* const* files = parser.parse(argv);
+  if (files[0] && files[1])
+    help();
 
-  processor_t p(isa, DEFAULT_PRIV, DEFAULT_VARCH, 0, 0, false, nullptr);
+  processor_t p(isa, DEFAULT_PRIV, DEFAULT_VARCH, 0, 0, false);
   if (extension) {
     p.register_extension(extension());
   }
+  const disassembler_t* disassembler = p.get_disassembler();
+
+  unique_ptr<tcdm_map_t> map;
+  if (mempool_groups) {
+    try {
+      map.reset(new tcdm_map_t(nprocs, mempool_groups, mempool_cores_per_tile,
+                               mempool_banking_factor, seq_mem_size,
+                               MEMPOOL_TCDM_BASE, MEMPOOL_BANK_SIZE));
+    } catch (std::invalid_argument& e) {
+      fprintf(stderr, "--mempool: %s\n", e.what());
+      return 1;
+    }
+  }
+
+  FILE* in = stdin;
+  if (files[0] && !(in = fopen(files[0], "rb"))) {
+    perror(files[0]);
+    return 1;
+  }
+  log_reader_t reader(in);
 
-  std::regex reg("^core\\s+\\d+:\\s+0x[0-9a-f]+\\s+\\(0x([0-9a-f]+)\\)", std::regex_constants::icase);
-  std::smatch m;
-  std::ssub_match sm ;
+  if (jobs == 0)
+    jobs = max(1u, thread::hardware_concurrency());
 
-  while (getline(cin,s)){
-    if (regex_search(s, m, reg)){
-      // the opcode string
-      string op = m[1].str();
-      uint32_t bit_num = op.size() * 4;
-      uint64_t opcode = strtoull(op.c_str(), nullptr, 16);
+  // Parse as many chunks at once as there are threads, then merge them in
+  // the order of the log
+  core_sections_t cores;
+  vector<string> chunks(jobs);
+  bool disasm_lines = false;
+  bool first = true;
+  try {
+    while (true) {
+      size_t n = 0;
+      while (n < jobs && reader.next(chunks[n]))
+        n++;
+      if (n == 0)
+        break;
+      if (first && !reader.is_binary())
+        disasm_lines = !has_commit_lines(chunks[0]);
+      first = false;
 
-      if (bit_num<64){
-          opcode = opcode << (64-bit_num) >> (64-bit_num);
-      }
+      vector<unique_ptr<chunk_parser_t>> parsers;
+      for (size_t i = 0; i < n; i++)
+        parsers.emplace_back(new chunk_parser_t(disassembler, map.get(), p.get_max_xlen(),
+                                                names, disasm_lines));
+      vector<string> errors(n);
+      auto parse = [&](size_t i) {
+        try {
+          if (reader.is_binary())
+            parsers[i]->parse_binary((const uint8_t*)chunks[i].data(),
+                                     (const uint8_t*)chunks[i].data() + chunks[i].size());
+          else
+            parsers[i]->parse_text(chunks[i].data(), chunks[i].data() + chunks[i].size());
+        } catch (std::runtime_error& e) {
+          errors[i] = e.what();
+        }
+      };
+      vector<thread> threads;
+      for (size_t i = 1; i < n; i++)
+        threads.emplace_back(parse, i);
+      parse(0);
+      for (auto& t : threads)
+        t.join();
 
-      const disasm_insn_t* disasm = p.get_disassembler()->lookup(opcode);
-      if (disasm) {
-          cout << disasm->get_name() << '\n';
-      } else {
-          cout << "unknown_op\n";
+      for (size_t i = 0; i < n; i++) {
+        if (!errors[i].empty())
+          throw std::runtime_error(errors[i]);
+        fwrite(parsers[i]->name_list.data(), 1, parsers[i]->name_list.size(), stdout);
+        merge(cores, parsers[i]->sections);
       }
     }
+  } catch (std::runtime_error& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
   }
+  if (in != stdin)
+    fclose(in);
 
+  if (names)
+    return 0;
+  if (json && !write_file(json, write_json, cores))
+    return 1;
+  if (csv && !write_file(csv, write_csv, cores))
+    return 1;
+  print_summary(stdout, cores);
   return 0;
 }
@@ -9,24 +9,87 @@
 #include <fesvr/option_parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include <vector>
 #include <string>
 #include <memory>
 #include <fstream>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 #include "../VERSION"
 
 static void help(int exit_code = 1)
 {
   fprintf(stderr, "Spike RISC-V ISA Simulator " SPIKE_VERSION "\n\n");
   fprintf(stderr, "usage: spike [host options] <target program> [target options]\n");
+  fprintf(stderr, "       spike --batch=<manifest> [--jobs=<n>] [--report=<file>]\n");
   fprintf(stderr, "Host Options:\n");
   fprintf(stderr, "  -p<n>                 Simulate <n> processors [default 1]\n");
+  fprintf(stderr, "  --threads=<n>         Step the processors on <n> host threads [default 1]\n");
+  fprintf(stderr, "  --quantum=<n>         Synchronize host threads every <n> instructions [default 5000]\n");
+  fprintf(stderr, "  --deterministic       Run the parallel schedule on one host thread,\n");
+  fprintf(stderr, "                          reproducing it exactly\n");
+  fprintf(stderr, "  --seed=<n>            Interleave the processors in slices of random\n");
+  fprintf(stderr, "                          length drawn from seed <n>\n");
+  fprintf(stderr, "  --slice=<n>           Run each processor at most <n> instructions at a\n");
+  fprintf(stderr, "                          time [default 5000]\n");
+  fprintf(stderr, "  --record-schedule=<name>\n");
+  fprintf(stderr, "                        Record the interleaving of the processors to <name>\n");
+  fprintf(stderr, "  --replay-schedule=<name>\n");
+  fprintf(stderr, "                        Interleave the processors as recorded in <name>\n");
   fprintf(stderr, "  -m<n>                 Provide <n> MiB of target memory [default 2048]\n");
   fprintf(stderr, "  -m<a:m,b:n,...>       Provide memory regions of size m and n bytes\n");
   fprintf(stderr, "                          at base addresses a and b (with 4 KiB alignment)\n");
+  fprintf(stderr, "  --map-elf             Map the page-aligned parts of the ELF segments into\n");
+  fprintf(stderr, "                          target memory copy-on-write instead of copying\n");
+  fprintf(stderr, "                          them; rebuilding or truncating the ELF while Spike\n");
+  fprintf(stderr, "                          runs then changes them or raises SIGBUS\n");
+  fprintf(stderr, "  --mempool=<G:T[:B]>   Model the MemPool control registers and UART for\n");
+  fprintf(stderr, "                          G groups of tiles with T cores each and a banking\n");
+  fprintf(stderr, "                          factor of B [default 4]; wfi sleeps until woken up\n");
+  fprintf(stderr, "  --seq-mem-size=<n>    Size of each core's sequential TCDM region in bytes\n");
+  fprintf(stderr, "                          with --mempool [default 1024]\n");
+  fprintf(stderr, "  --tcdm-prof=<name>    Write the locality of each hart's and function's\n");
+  fprintf(stderr, "                          TCDM accesses and a bank heatmap to <name>\n");
+  fprintf(stderr, "  --mempool-icache=<S>:<W>:<B>:<L>\n");
+  fprintf(stderr, "                        Model a per-tile L1 instruction cache with S sets,\n");
+  fprintf(stderr, "                          W ways and B-byte lines behind per-core L0\n");
+  fprintf(stderr, "                          caches of L lines, with --mempool (MemPool's\n");
+  fprintf(stderr, "                          is 32:2:32:4 for 4 cores per tile)\n");
+  fprintf(stderr, "  --mempool-ro-cache=<S>:<W>:<B>\n");
+  fprintf(stderr, "                        Model a per-group read-only cache in front of the\n");
+  fprintf(stderr, "                          L2 memory, with --mempool (MemPool's is 64:2:64)\n");
+  fprintf(stderr, "  --func-prof=<prefix>  Write the instructions, loads, stores, AMOs and\n");
+  fprintf(stderr, "                          wfis of each call stack as folded stacks to\n");
+  fprintf(stderr, "                          <prefix>.<counter>.folded\n");
+  fprintf(stderr, "  --amo-prof=<name>     Write the AMOs, LR/SCs, failed SCs and lost\n");
+  fprintf(stderr, "                          reservations of each hart and of the most\n");
+  fprintf(stderr, "                          contended addresses to <name>\n");
+  fprintf(stderr, "  --checkpoint=<name>   Save a checkpoint of the simulation to <name> when\n");
+  fprintf(stderr, "                          the program first sets the trace CSR\n");
+  fprintf(stderr, "  --checkpoint-at=<n>   Save the checkpoint after <n> instructions per hart\n");
+  fprintf(stderr, "                          instead\n");
+  fprintf(stderr, "  --restore=<name>      Resume from the checkpoint <name>, taken with the\n");
+  fprintf(stderr, "                          same options and program\n");
+  fprintf(stderr, "  --bbv=<prefix>        Write each hart's basic-block vectors for SimPoint\n");
+  fprintf(stderr, "                          to <prefix>.<hart>.bb\n");
+  fprintf(stderr, "  --bbv-interval=<n>    Instructions per basic-block vector [default 10000000]\n");
+  fprintf(stderr, "  --fast-forward=<n>    Run <n> instructions per hart with the logs, cache\n");
+  fprintf(stderr, "                          models and profilers off before turning them on\n");
+  fprintf(stderr, "  --window=<n>          End the simulation <n> instructions per hart after\n");
+  fprintf(stderr, "                          the fast-forward\n");
   fprintf(stderr, "  -d                    Interactive debug mode\n");
   fprintf(stderr, "  -g                    Track histogram of PCs\n");
   fprintf(stderr, "  -l                    Generate a log of execution\n");
+  fprintf(stderr, "  --log-binary          Write the --log-commits log in a binary format,\n");
+  fprintf(stderr, "                          which spike-log-decode turns back into text\n");
+  fprintf(stderr, "  --trace-dir=<dir>     Write what each hart retires while the trace CSR is\n");
+  fprintf(stderr, "                          set to <dir>/trace_hart_0x<id>.dasm, as the RTL does\n");
   fprintf(stderr, "  -h, --help            Print this help message\n");
   fprintf(stderr, "  -H                    Start halted, allowing a debugger to connect\n");
   fprintf(stderr, "  --isa=<name>          RISC-V ISA string [default %s]\n", DEFAULT_ISA);
@@ -66,6 +129,12 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  --dm-no-abstract-csr  Debug module won't support abstract to authenticate\n");
   fprintf(stderr, "  --dm-no-halt-groups   Debug module won't support halt groups\n");
   fprintf(stderr, "  --dm-no-impebreak     Debug module won't support implicit ebreak in program buffer\n");
+  fprintf(stderr, "Batch Options:\n");
+  fprintf(stderr, "  --batch=<manifest>    Run every line of <manifest>, the host options,\n");
+  fprintf(stderr, "                          target program and target options of one\n");
+  fprintf(stderr, "                          simulation, in this process ('#' starts a comment)\n");
+  fprintf(stderr, "  --jobs=<n>            Run <n> simulations at a time [default: host cores]\n");
+  fprintf(stderr, "  --report=<file>       Write the JSON report to <file> [default: stdout]\n");
 
   exit(exit_code);
 }
@@ -151,7 +220,7 @@ static std::vector<std::pair<reg_t, mem_t*>> make_mems(const char* arg)
   while (true) {
     auto base = strtoull(arg, &p, 0);
     if (!*p || *p != ':')
-      help();
+      throw std::invalid_argument("-m: expected <base>:<size>");
     auto size = strtoull(p + 1, &p, 0);
 
     // page-align base and size
@@ -162,7 +231,7 @@ static std::vector<std::pair<reg_t, mem_t*>> make_mems(const char* arg)
       size += PGSIZE - size % PGSIZE;
 
     if (base + size < base)
-      help();
+      throw std::invalid_argument("-m: memory wraps around");
 
     if (size != size0) {
       fprintf(stderr, "Warning: the memory at  [0x%llX, 0x%llX] has been realigned\n"
@@ -174,7 +243,7 @@ static std::vector<std::pair<reg_t, mem_t*>> make_mems(const char* arg)
     if (!*p)
       break;
     if (*p != ',')
-      help();
+      throw std::invalid_argument("-m: expected ',' between memories");
     arg = p + 1;
   }
 
@@ -182,7 +251,19 @@ static std::vector<std::pair<reg_t, mem_t*>> make_mems(const char* arg)
   return res;
 }
 
-int main(int argc, char** argv)
+// htif_t parses its arguments with getopt, which is not reentrant
+static std::mutex sim_construction_lock;
+
+// A batch job must not end the process, so it reports bad options by throwing
+static void batch_usage_error()
+{
+  throw std::invalid_argument("invalid options, see spike --help");
+}
+
+// Runs one simulation; returns its exit code and, if instret is not null,
+// the number of instructions its harts retired. A batch job throws instead
+// of exiting on errors.
+static int run_sim(int argc, char** argv, uint64_t* instret, bool batch)
 {
   bool debug = false;
   bool halted = false;
@@ -192,6 +273,30 @@ int main(int argc, char** argv)
   bool dtb_enabled = true;
   bool real_time_clint = false;
   size_t nprocs = 1;
+  size_t nthreads = 1;
+  size_t quantum = 0;
+  bool deterministic = false;
+  uint64_t seed = 0;
+  bool seeded = false;
+  size_t max_slice = 0;
+  const char* record_schedule = nullptr;
+  const char* replay_schedule = nullptr;
+  size_t mempool_groups = 0;
+  size_t mempool_cores_per_tile = 0;
+  size_t mempool_banking_factor = 4;
+  size_t seq_mem_size = 1024;
+  const char* tcdm_prof = nullptr;
+  const char* mempool_icache = nullptr;
+  const char* mempool_ro_cache = nullptr;
+  const char* func_prof = nullptr;
+  const char* amo_prof = nullptr;
+  const char* checkpoint = nullptr;
+  reg_t checkpoint_at = 0;
+  const char* restore = nullptr;
+  const char* bbv = nullptr;
+  reg_t bbv_interval = 10000000;
+  reg_t fast_forward = 0;
+  reg_t window = 0;
   const char* kernel = NULL;
   reg_t kernel_offset, kernel_size;
   size_t initrd_size;
@@ -204,8 +309,11 @@ int main(int argc, char** argv)
   std::unique_ptr<dcache_sim_t> dc;
   std::unique_ptr<cache_sim_t> l2;
   bool log_cache = false;
+  bool map_elf = false;
   bool log_commits = false;
+  bool log_binary = false;
   const char *log_path = nullptr;
+  const char *trace_dir = nullptr;
   std::function<extension_t*()> extension;
   const char* initrd = NULL;
   const char* isa = DEFAULT_ISA;
@@ -227,6 +335,24 @@ int main(int argc, char** argv)
   };
   std::vector<int> hartids;
 
+  auto usage = [&]() {
+    if (batch)
+      batch_usage_error();
+    help();
+  };
+
+  // Frees the memories and devices however the simulation ends
+  struct resources_t {
+    std::vector<std::pair<reg_t, mem_t*>>& mems;
+    std::vector<std::pair<reg_t, abstract_device_t*>>& devices;
+    ~resources_t() {
+      for (auto& mem : mems)
+        delete mem.second;
+      for (auto& device : devices)
+        delete device.second;
+    }
+  } resources = {mems, plugin_devices};
+
   auto const hartids_parser = [&](const char *s) {
     std::string const str(s);
     std::stringstream stream(str);
@@ -283,13 +409,55 @@ int main(int argc, char** argv)
   };
 
   option_parser_t parser;
-  parser.help(&suggest_help);
-  parser.option('h', "help", 0, [&](const char* s){help(0);});
+  parser.help(batch ? &batch_usage_error : &suggest_help);
+  parser.option('h', "help", 0, [&](const char* s){
+    if (batch)
+      batch_usage_error();
+    help(0);
+  });
   parser.option('d', 0, 0, [&](const char* s){debug = true;});
   parser.option('g', 0, 0, [&](const char* s){histogram = true;});
   parser.option('l', 0, 0, [&](const char* s){log = true;});
   parser.option('p', 0, 1, [&](const char* s){nprocs = atoi(s);});
-  parser.option('m', 0, 1, [&](const char* s){mems = make_mems(s);});
+  parser.option(0, "threads", 1, [&](const char* s){nthreads = atoi(s);});
+  parser.option(0, "quantum", 1, [&](const char* s){quantum = strtoull(s, 0, 0);});
+  parser.option(0, "deterministic", 0, [&](const char* s){deterministic = true;});
+  parser.option(0, "seed", 1, [&](const char* s){seed = strtoull(s, 0, 0); seeded = true;});
+  parser.option(0, "slice", 1, [&](const char* s){max_slice = strtoull(s, 0, 0);});
+  parser.option(0, "record-schedule", 1, [&](const char* s){record_schedule = s;});
+  parser.option(0, "replay-schedule", 1, [&](const char* s){replay_schedule = s;});
+  parser.option(0, "mempool", 1, [&](const char* s){
+    char* p;
+    mempool_groups = strtoull(s, &p, 0);
+    if (*p == ':')
+      mempool_cores_per_tile = strtoull(p + 1, &p, 0);
+    if (*p == ':')
+      mempool_banking_factor = strtoull(p + 1, &p, 0);
+    if (*p || !mempool_cores_per_tile || !mempool_banking_factor)
+      usage();
+  });
+  parser.option(0, "seq-mem-size", 1, [&](const char* s){seq_mem_size = strtoull(s, 0, 0);});
+  parser.option(0, "tcdm-prof", 1, [&](const char* s){tcdm_prof = s;});
+  parser.option(0, "mempool-icache", 1, [&](const char* s){mempool_icache = s;});
+  parser.option(0, "mempool-ro-cache", 1, [&](const char* s){mempool_ro_cache = s;});
+  parser.option(0, "func-prof", 1, [&](const char* s){func_prof = s;});
+  parser.option(0, "amo-prof", 1, [&](const char* s){amo_prof = s;});
+  parser.option(0, "checkpoint", 1, [&](const char* s){checkpoint = s;});
+  parser.option(0, "checkpoint-at", 1, [&](const char* s){checkpoint_at = strtoull(s, 0, 0);});
+  parser.option(0, "restore", 1, [&](const char* s){restore = s;});
+  parser.option(0, "bbv", 1, [&](const char* s){bbv = s;});
+  parser.option(0, "bbv-interval", 1, [&](const char* s){bbv_interval = strtoull(s, 0, 0);});
+  parser.option(0, "fast-forward", 1, [&](const char* s){fast_forward = strtoull(s, 0, 0);});
+  parser.option(0, "window", 1, [&](const char* s){window = strtoull(s, 0, 0);});
+  parser.option('m', 0, 1, [&](const char* s){
+    try {
+      mems = make_mems(s);
+    } catch (std::invalid_argument& e) {
+      fprintf(stderr, "%s\n", e.what());
+      usage();
+    }
+  });
+  parser.option(0, "map-elf", 0, [&](const char* s){map_elf = true;});
   // I wanted to use --halted, but for some reason that doesn't work.
   parser.option('H', 0, 0, [&](const char* s){halted = true;});
   parser.option(0, "rbb-port", 1, [&](const char* s){use_rbb = true; rbb_port = atoi(s);});
@@ -315,6 +483,8 @@ int main(int argc, char** argv)
     void *lib = dlopen(s, RTLD_NOW | RTLD_GLOBAL);
     if (lib == NULL) {
       fprintf(stderr, "Unable to load extlib '%s': %s\n", s, dlerror());
+      if (batch)
+        throw std::runtime_error(std::string("Unable to load extlib ") + s);
       exit(-1);
     }
   });
@@ -338,6 +508,10 @@ int main(int argc, char** argv)
       [&](const char* s){dm_config.support_haltgroups = false;});
   parser.option(0, "log-commits", 0,
                 [&](const char* s){log_commits = true;});
+  parser.option(0, "log-binary", 0,
+                [&](const char* s){log_binary = true;});
+  parser.option(0, "trace-dir", 1,
+                [&](const char* s){trace_dir = s;});
   parser.option(0, "log", 1,
                 [&](const char* s){log_path = s;});
 
@@ -347,7 +521,7 @@ int main(int argc, char** argv)
     mems = make_mems("2048");
 
   if (!*argv1)
-    help();
+    usage();
 
   if (kernel && check_file_exists(kernel)) {
     kernel_size = get_file_size(kernel);
@@ -375,9 +549,11 @@ int main(int argc, char** argv)
     }
   }
 
+  std::unique_lock<std::mutex> construction(sim_construction_lock);
   sim_t s(isa, priv, varch, nprocs, halted, real_time_clint,
       initrd_start, initrd_end, bootargs, start_pc, mems, plugin_devices, htif_args,
       std::move(hartids), dm_config, log_path, dtb_enabled, dtb_file);
+  construction.unlock();
   std::unique_ptr<remote_bitbang_t> remote_bitbang((remote_bitbang_t *) NULL);
   std::unique_ptr<jtag_dtm_t> jtag_dtm(
       new jtag_dtm_t(&s.debug_module, dmi_rti));
@@ -391,6 +567,12 @@ int main(int argc, char** argv)
     return 0;
   }
 
+  if (nthreads > 1 && (ic || dc || l2)) {
+    fprintf(stderr, "Cache models are shared between processors and cannot be "
+                    "used with --threads\n");
+    return 1;
+  }
+
   if (ic && l2) ic->set_miss_handler(&*l2);
   if (dc && l2) dc->set_miss_handler(&*l2);
   if (ic) ic->set_log(log_cache);
@@ -403,16 +585,236 @@ int main(int argc, char** argv)
   }
 
   s.set_debug(debug);
-  s.configure_log(log, log_commits);
+  if (log_binary && (log || !log_commits)) {
+    fprintf(stderr, "--log-binary requires --log-commits and excludes -l\n");
+    return 1;
+  }
+  s.configure_log(log, log_commits, log_binary);
+  if (trace_dir)
+    s.configure_dasm_trace(trace_dir);
   s.set_histogram(histogram);
+  s.set_map_elf(map_elf);
+  s.configure_parallel(nthreads, quantum, deterministic);
+  if (mempool_groups) {
+    try {
+      s.configure_mempool(mempool_groups, mempool_cores_per_tile,
+                          mempool_banking_factor, seq_mem_size);
+    } catch (std::invalid_argument& e) {
+      fprintf(stderr, "--mempool: %s\n", e.what());
+      return 1;
+    }
+  }
+  if (tcdm_prof) {
+    try {
+      s.configure_tcdm_profiler(tcdm_prof);
+    } catch (std::exception& e) {
+      fprintf(stderr, "--tcdm-prof: %s\n", e.what());
+      return 1;
+    }
+  }
+  if (mempool_icache || mempool_ro_cache) {
+    try {
+      s.configure_mempool_cache(mempool_icache, mempool_ro_cache);
+    } catch (std::invalid_argument& e) {
+      fprintf(stderr, "--mempool-icache/--mempool-ro-cache: %s\n", e.what());
+      return 1;
+    }
+  }
+  if (func_prof)
+    s.configure_func_profiler(func_prof);
+  if (amo_prof) {
+    try {
+      s.configure_amo_profiler(amo_prof);
+    } catch (std::exception& e) {
+      fprintf(stderr, "--amo-prof: %s\n", e.what());
+      return 1;
+    }
+  }
+  if (checkpoint_at && !checkpoint) {
+    fprintf(stderr, "--checkpoint-at requires --checkpoint\n");
+    return 1;
+  }
+  if (checkpoint)
+    s.configure_checkpoint(checkpoint, checkpoint_at);
+  if (restore)
+    s.configure_restore(restore);
+  if (bbv) {
+    try {
+      s.configure_bbv(bbv, bbv_interval);
+    } catch (std::exception& e) {
+      fprintf(stderr, "--bbv: %s\n", e.what());
+      return 1;
+    }
+  }
+  s.configure_sampling(fast_forward, window);
+  if (seeded || max_slice || record_schedule || replay_schedule) {
+    try {
+      s.configure_schedule(max_slice, seeded ? &seed : nullptr,
+                           record_schedule, replay_schedule);
+    } catch (std::exception& e) {
+      fprintf(stderr, "--seed/--slice/--record-schedule/--replay-schedule: %s\n",
+              e.what());
+      return 1;
+    }
+  }
 
   auto return_code = s.run();
 
-  for (auto& mem : mems)
-    delete mem.second;
-
-  for (auto& plugin_device : plugin_devices)
-    delete plugin_device.second;
+  if (instret) {
+    *instret = 0;
+    for (size_t i = 0; i < s.nprocs(); i++)
+      *instret += s.get_core(i)->get_state()->minstret;
+  }
 
   return return_code;
 }
+
+struct batch_job_t
+{
+  std::string command;
+  std::vector<std::string> args;
+  int exit_code;
+  std::string error;
+  uint64_t instret;
+  double seconds;
+};
+
+static std::string json_string(const std::string& s)
+{
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+static std::vector<batch_job_t> read_manifest(const char* path)
+{
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "can't open manifest `%s'\n", path);
+    exit(1);
+  }
+
+  std::vector<batch_job_t> jobs;
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    batch_job_t job = {};
+    job.args.push_back("spike");
+    for (std::string word; words >> word; ) {
+      job.command += (job.command.empty() ? "" : " ") + word;
+      job.args.push_back(word);
+    }
+    if (job.args.size() > 1)
+      jobs.push_back(job);
+  }
+  return jobs;
+}
+
+// Runs the simulations of a manifest on a pool of host threads. Each has
+// its own sim_t, so they share nothing but the host's stdout and stderr.
+static int run_batch(int argc, char** argv)
+{
+  const char* manifest = nullptr;
+  const char* report = nullptr;
+  size_t njobs = std::max(1u, std::thread::hardware_concurrency());
+
+  option_parser_t parser;
+  parser.help(&suggest_help);
+  parser.option('h', "help", 0, [&](const char* s){help(0);});
+  parser.option(0, "batch", 1, [&](const char* s){manifest = s;});
+  parser.option(0, "jobs", 1, [&](const char* s){njobs = std::max(1, atoi(s));});
+  parser.option(0, "report", 1, [&](const char* s){report = s;});
+  if (*parser.parse(argv))
+    help();
+
+  std::vector<batch_job_t> jobs = read_manifest(manifest);
+  std::atomic<size_t> next(0);
+  // A signal would end or interrupt every job at once
+  htif_t::set_signal_handlers(false);
+  auto start = std::chrono::steady_clock::now();
+
+  auto worker = [&]() {
+    for (size_t i; (i = next++) < jobs.size(); ) {
+      batch_job_t& job = jobs[i];
+      std::vector<char*> job_argv;
+      for (auto& arg : job.args)
+        job_argv.push_back(&arg[0]);
+      job_argv.push_back(nullptr);
+
+      auto job_start = std::chrono::steady_clock::now();
+      try {
+        job.exit_code = run_sim(job_argv.size() - 1, job_argv.data(),
+                                &job.instret, true);
+      } catch (const std::exception& e) {
+        job.exit_code = 1;
+        job.error = e.what();
+      }
+      job.seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - job_start).count();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(njobs, jobs.size()); i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  FILE* out = report ? fopen(report, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "can't open report `%s'\n", report);
+    return 1;
+  }
+
+  size_t failed = 0;
+  uint64_t instret = 0;
+  fprintf(out, "{\n  \"jobs\": [");
+  for (size_t i = 0; i < jobs.size(); i++) {
+    const batch_job_t& job = jobs[i];
+    failed += job.exit_code != 0;
+    instret += job.instret;
+    fprintf(out, "%s\n    {\"command\": %s, \"exit_code\": %d, ",
+            i ? "," : "", json_string(job.command).c_str(), job.exit_code);
+    if (!job.error.empty())
+      fprintf(out, "\"error\": %s, ", json_string(job.error).c_str());
+    fprintf(out, "\"instructions\": %" PRIu64 ", \"seconds\": %.3f}",
+            job.instret, job.seconds);
+  }
+  fprintf(out, "\n  ],\n  \"passed\": %zu,\n  \"failed\": %zu,\n"
+          "  \"instructions\": %" PRIu64 ",\n  \"seconds\": %.3f\n}\n",
+          jobs.size() - failed, failed, instret, seconds);
+  if (report)
+    fclose(out);
+
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+  for (int i = 1; i < argc && argv[i][0] == '-'; i++)
+    if (strcmp(argv[i], "--batch") == 0 || strncmp(argv[i], "--batch=", 8) == 0)
+      return run_batch(argc, argv);
+
+  try {
+    return run_sim(argc, argv, nullptr, false);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+}
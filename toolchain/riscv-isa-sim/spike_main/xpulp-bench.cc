@@ -0,0 +1,512 @@
+// See LICENSE for license details.
+
+// Measures how many instructions per second Spike executes on the inner
+// loops of the Xpulpimg int8 kernels in software/runtime/xpulp: the 2x4
+// unrolled matrix multiplication of mat_mul.h and the 3x3 convolution of
+// conv_2d.h. The loops are encoded here the way the compiler emits them,
+// so the benchmark needs no cross toolchain.
+//
+// It then runs the hardware-loop kernels of mat_mul.h and conv_2d.h on
+// whole matrices and images, checks their results and counts the
+// instructions they retire per output. The inline-assembly bodies are
+// encoded as written in the headers, the outer loops run on the host. Each
+// body runs once as an lp.setup loop and once closed by a branch on a
+// pointer it advances, which is the cheapest loop the compiler can emit
+// without hardware loops.
+
+#include "processor.h"
+#include "simif.h"
+#include "encoding.h"
+#include "fesvr/option_parser.h"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const reg_t MEM_BASE = 0x80000000;
+static const size_t MEM_SIZE = 0x10000;
+static const reg_t DATA_A = MEM_BASE + 0x1000;
+static const reg_t DATA_B = MEM_BASE + 0x2000;
+static const reg_t DATA_C = MEM_BASE + 0x3000;
+
+class bench_sim_t : public simif_t
+{
+public:
+  bench_sim_t() : mem(MEM_SIZE) {}
+
+  char* addr_to_mem(reg_t addr)
+  {
+    if (addr >= MEM_BASE && addr - MEM_BASE < mem.size())
+      return &mem[addr - MEM_BASE];
+    return NULL;
+  }
+  bool mmio_load(reg_t addr, size_t len, uint8_t* bytes) { return false; }
+  bool mmio_store(reg_t addr, size_t len, const uint8_t* bytes) { return false; }
+  void proc_reset(unsigned id) {}
+  const char* get_symbol(uint64_t addr) { return NULL; }
+
+  std::vector<char> mem;
+};
+
+// Instruction encoders
+static uint32_t r_type(uint32_t match, int rd, int rs1, int rs2)
+{
+  return match | rd << 7 | rs1 << 15 | rs2 << 20;
+}
+
+static uint32_t i_type(uint32_t match, int rd, int rs1, int32_t imm)
+{
+  return match | rd << 7 | rs1 << 15 | (imm & 0xFFF) << 20;
+}
+
+static uint32_t s_type(uint32_t match, int rs1, int rs2, int32_t imm)
+{
+  return match | (imm & 0x1F) << 7 | rs1 << 15 | rs2 << 20 |
+         ((imm >> 5) & 0x7F) << 25;
+}
+
+static uint32_t pv_imm6(uint32_t match, int rd, int rs1, uint32_t imm)
+{
+  return match | rd << 7 | rs1 << 15 | ((imm >> 1) & 0x1F) << 20 |
+         (imm & 1) << 25;
+}
+
+static uint32_t b_type(uint32_t match, int rs1, int rs2, int32_t offset)
+{
+  return match | ((offset >> 11) & 1) << 7 | ((offset >> 1) & 0xF) << 8 |
+         rs1 << 15 | rs2 << 20 | ((offset >> 5) & 0x3F) << 25 |
+         ((offset >> 12) & 1) << 31;
+}
+
+static uint32_t jal(int rd, int32_t offset)
+{
+  return MATCH_JAL | rd << 7 | ((offset >> 12) & 0xFF) << 12 |
+         ((offset >> 11) & 1) << 20 | ((offset >> 1) & 0x3FF) << 21 |
+         ((offset >> 20) & 1) << 31;
+}
+
+static uint32_t mv(int rd, int rs1) { return i_type(MATCH_ADDI, rd, rs1, 0); }
+
+// Closes the loop with a jump back to its first instruction
+static void close_loop(std::vector<uint32_t>& code)
+{
+  code.push_back(jal(0, -4 * (int32_t)code.size()));
+}
+
+// matmul_unrolled_2x4_pincr_asm_parallel_i8_xpulpv2, inner loop over N
+static std::vector<uint32_t> matmul_i8(processor_t* p)
+{
+  state_t* s = p->get_state();
+  s->XPR.write(5, DATA_A);     // addr_a
+  s->XPR.write(8, DATA_B);     // addr_b
+  s->XPR.write(6, 16);         // N == P
+  s->XPR.write(7, -12);        // N_decr
+  s->XPR.write(20, 0x05040100); // mask0
+  s->XPR.write(21, 0x07060302); // mask1
+  s->XPR.write(22, 0x06040200); // mask2
+  s->XPR.write(23, 0x07050301); // mask3
+
+  std::vector<uint32_t> c;
+  c.push_back(r_type(MATCH_P_LW_RRPOST, 10, 5, 6));
+  c.push_back(r_type(MATCH_P_LW_RRPOST, 11, 5, 7));
+  for (int t = 12; t <= 15; t++)
+    c.push_back(r_type(MATCH_P_LW_RRPOST, t, 8, 6));
+
+  // Transpose the chunk of B: temp4-7 in x16-x19, bVec0-3 in x24-x27
+  const int shuf[8][4] = {
+    {16, 12, 13, 20}, {17, 14, 15, 20}, {18, 12, 13, 21}, {19, 14, 15, 21},
+    {24, 16, 17, 22}, {25, 16, 17, 23}, {26, 18, 19, 22}, {27, 18, 19, 23},
+  };
+  for (auto& sh : shuf) {
+    c.push_back(mv(sh[0], sh[1]));
+    c.push_back(r_type(MATCH_PV_SHUFFLE2_B, sh[0], sh[2], sh[3]));
+  }
+
+  const int sum[8] = {28, 29, 30, 31, 3, 4, 9, 1};
+  for (int i = 0; i < 8; i++)
+    c.push_back(r_type(MATCH_PV_SDOTSP_B, sum[i], 10 + i / 4, 24 + i % 4));
+
+  // Rewind the pointers so the loop keeps working on the same chunk
+  c.push_back(i_type(MATCH_ADDI, 5, 5, -4));
+  c.push_back(i_type(MATCH_ADDI, 8, 8, -64));
+  close_loop(c);
+  return c;
+}
+
+// conv2d_3x3_unrolled2_i8_xpulpv2, inner loop over the rows
+static std::vector<uint32_t> conv2d_i8(processor_t* p)
+{
+  state_t* s = p->get_state();
+  s->XPR.write(5, DATA_A);     // input pointer
+  s->XPR.write(8, DATA_C);     // output pointer
+  s->XPR.write(10, 45);        // weight
+  s->XPR.write(11, 0x00030201); // coeff_0-2
+  s->XPR.write(12, 0x00060504);
+  s->XPR.write(13, 0x00090807);
+
+  std::vector<uint32_t> c;
+  c.push_back(r_type(MATCH_PV_DOTSP_B, 20, 14, 11));
+  c.push_back(r_type(MATCH_PV_DOTSP_B, 21, 17, 11));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, 20, 15, 12));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, 21, 18, 12));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, 20, 16, 13));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, 21, 19, 13));
+  c.push_back(r_type(MATCH_DIV, 22, 20, 10));
+  c.push_back(r_type(MATCH_DIV, 23, 21, 10));
+
+  // Load a new rod of four pixels and build the two new windows
+  c.push_back(i_type(MATCH_P_LBU_IRPOST, 24, 5, 1));
+  c.push_back(i_type(MATCH_P_LBU_IRPOST, 25, 5, 1));
+  c.push_back(i_type(MATCH_P_LBU_IRPOST, 26, 5, -1));
+  c.push_back(i_type(MATCH_P_LBU_IRPOST, 27, 5, -1));
+  c.push_back(mv(28, 24));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, 28, 25, 1));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, 28, 26, 2));
+  c.push_back(mv(29, 25));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, 29, 26, 1));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, 29, 27, 2));
+
+  // Move the windows one line down
+  const int window[6][2] = {
+    {14, 15}, {15, 16}, {16, 28}, {17, 18}, {18, 19}, {19, 29},
+  };
+  for (auto& w : window)
+    c.push_back(mv(w[0], w[1]));
+
+  c.push_back(s_type(MATCH_P_SW_IRPOST, 8, 22, 4));
+  c.push_back(s_type(MATCH_P_SW_IRPOST, 8, 23, -4));
+  close_loop(c);
+  return c;
+}
+
+static void run(const char* name,
+                  std::vector<uint32_t> (*kernel)(processor_t*),
+                  const char* isa, size_t insns)
+{
+  bench_sim_t sim;
+  for (size_t i = DATA_A - MEM_BASE; i < DATA_C - MEM_BASE; i++)
+    sim.mem[i] = (char)(i * 2654435761u >> 24);
+
+  processor_t p(isa, DEFAULT_PRIV, DEFAULT_VARCH, &sim, 0, false);
+  std::vector<uint32_t> code = kernel(&p);
+  memcpy(&sim.mem[0], code.data(), code.size() * sizeof(uint32_t));
+  p.get_state()->pc = MEM_BASE;
+
+  const size_t chunk = 5000;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t done = 0; done < insns; done += chunk)
+    p.step(chunk);
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+
+  // A trap would leave the hart spinning in the handler instead of the loop
+  if (p.get_state()->mcause != 0) {
+    fprintf(stderr, "%s: trapped with mcause %#" PRIx64 " at pc %#" PRIx64
+            "\n", name, p.get_state()->mcause, p.get_state()->mepc);
+    exit(1);
+  }
+
+  double mips = insns / secs.count() / 1e6;
+  printf("%-12s %2zu insns/iter %12zu insns %8.3f s %8.2f MIPS\n", name,
+         code.size(), insns, secs.count(), mips);
+}
+
+enum loop_kind_t { LOOP_BRANCH, LOOP_HW };
+
+// Runs the inner loops of a kernel, whose outer loops run on the host
+class kernel_sim_t
+{
+public:
+  kernel_sim_t(const char* isa)
+    : p(isa, DEFAULT_PRIV, DEFAULT_VARCH, &sim, 0, false), insns(0) {}
+
+  // Loads the body of an inner loop. With LOOP_HW it repeats on the count in
+  // x<count>, with LOOP_BRANCH until x<ptr> reaches x<end>. A wfi after the
+  // loop returns from processor_t::step.
+  void load(const std::vector<uint32_t>& body, loop_kind_t loop, int count,
+            int ptr, int end)
+  {
+    std::vector<uint32_t> c;
+    if (loop == LOOP_HW)
+      c.push_back(i_type(MATCH_LP_SETUP, 0, count, 2 * body.size() + 2));
+    c.insert(c.end(), body.begin(), body.end());
+    if (loop == LOOP_BRANCH)
+      c.push_back(b_type(MATCH_BNE, ptr, end, -4 * (int32_t)body.size()));
+    c.push_back(MATCH_WFI);
+    memcpy(&sim.mem[0], c.data(), c.size() * sizeof(uint32_t));
+    done = sext32(MEM_BASE + 4 * c.size());
+  }
+
+  // Runs the loaded loop on the registers set in the state. The PCs of
+  // RV32 are sign-extended, as the hardware loop compares them.
+  void call()
+  {
+    state_t* s = p.get_state();
+    reg_t start = s->minstret;
+    s->pc = sext32(MEM_BASE);
+    while (s->pc != done && s->mcause == 0)
+      p.step(5000);
+    insns += s->minstret - start;
+  }
+
+  void set(int reg, reg_t value) { p.get_state()->XPR.write(reg, value); }
+  int32_t get(int reg) { return p.get_state()->XPR[reg]; }
+  int8_t& byte(reg_t addr) { return (int8_t&)sim.mem[addr - MEM_BASE]; }
+  int32_t& word(reg_t addr) { return *(int32_t*)&sim.mem[addr - MEM_BASE]; }
+
+  bench_sim_t sim;
+  processor_t p;
+  reg_t done;
+  uint64_t insns; // retired by the inner loops; the wfi does not retire
+};
+
+static uint32_t pack(int8_t b0, int8_t b1, int8_t b2)
+{
+  return (uint8_t)b0 | (uint8_t)b1 << 8 | (uint8_t)b2 << 16;
+}
+
+// matmul_unrolled_2x4_i8_xpulpv2 on A (m x n) and B (n x p), returns the
+// outputs
+static size_t matmul_2x4_i8(kernel_sim_t& k, loop_kind_t loop)
+{
+  const uint32_t m = 16, n = 64, p = 16;
+  // MATMUL_2X4_I8_HWLOOP, with a0-a1 in x10-x11, t0-t5 in x12-x17,
+  // sum00-sum13 in x18-x25 and mask0-mask3 in x8, x9, x26 and x27
+  const int addr_a = 5, addr_b = 6, n_iter = 7, a_incr = 28, a_decr = 29,
+            b_incr = 30, end_a = 31;
+  const int a0 = 10, a1 = 11, t0 = 12, t1 = 13, t2 = 14, t3 = 15, t4 = 16,
+            t5 = 17, m0 = 8, m1 = 9, m2 = 26, m3 = 27;
+  const int sum[8] = {18, 19, 20, 21, 22, 23, 24, 25};
+  std::vector<uint32_t> c;
+  c.push_back(r_type(MATCH_P_LW_RRPOST, a0, addr_a, a_incr));
+  c.push_back(r_type(MATCH_P_LW_RRPOST, a1, addr_a, a_decr));
+  for (int t = t0; t <= t3; t++)
+    c.push_back(r_type(MATCH_P_LW_RRPOST, t, addr_b, b_incr));
+
+  // Transpose the chunk of B into t1, t4, t3 and t0, a move where the mask
+  // is -1
+  const int shuf[12][3] = {
+    {t4, t0, -1}, {t4, t1, m0}, {t5, t2, -1}, {t5, t3, m0},
+    {t0, t1, m1}, {t2, t3, m1}, {t1, t4, -1}, {t1, t5, m2},
+    {t4, t5, m3}, {t3, t0, -1}, {t3, t2, m2}, {t0, t2, m3},
+  };
+  for (auto& sh : shuf)
+    c.push_back(sh[2] < 0 ? mv(sh[0], sh[1])
+                : r_type(MATCH_PV_SHUFFLE2_B, sh[0], sh[1], sh[2]));
+
+  const int b_vec[4] = {t1, t4, t3, t0};
+  for (int i = 0; i < 8; i++)
+    c.push_back(r_type(MATCH_PV_SDOTSP_B, sum[i], i < 4 ? a0 : a1,
+                       b_vec[i % 4]));
+  k.load(c, loop, n_iter, addr_a, end_a);
+
+  k.set(a_incr, n);
+  k.set(a_decr, -(int)n + 4);
+  k.set(b_incr, p);
+  k.set(m0, 0x05040100);
+  k.set(m1, 0x07060302);
+  k.set(m2, 0x06040200);
+  k.set(m3, 0x07050301);
+  for (uint32_t i = 0; i < m / 2; i++) {
+    for (uint32_t j = 0; j < p / 4; j++) {
+      for (int s = 0; s < 8; s++)
+        k.set(sum[s], 0);
+      k.set(addr_a, DATA_A + i * 2 * n);
+      k.set(addr_b, DATA_B + j * 4);
+      k.set(n_iter, n / 4);
+      k.set(end_a, DATA_A + i * 2 * n + n);
+      k.call();
+      for (int s = 0; s < 8; s++)
+        k.word(DATA_C + 4 * ((i * 2 + s / 4) * p + j * 4 + s % 4)) =
+          k.get(sum[s]);
+    }
+  }
+
+  for (uint32_t i = 0; i < m; i++) {
+    for (uint32_t j = 0; j < p; j++) {
+      int32_t expected = 0;
+      for (uint32_t l = 0; l < n; l++)
+        expected += k.byte(DATA_A + i * n + l) * k.byte(DATA_B + l * p + j);
+      if (k.word(DATA_C + 4 * (i * p + j)) != expected)
+        return 0;
+    }
+  }
+  return m * p;
+}
+
+static const uint32_t IMG_R = 32, IMG_C = 32;
+static const uint8_t CONV_KERNEL[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+// Checks the interior of the output image of a 3x3 convolution in DATA_C
+static bool check_conv2d(kernel_sim_t& k)
+{
+  for (uint32_t r = 1; r < IMG_R - 1; r++) {
+    for (uint32_t c = 1; c < IMG_C - 1; c++) {
+      int32_t S = 0, weight = 0;
+      for (int i = 0; i < 9; i++) {
+        S += k.byte(DATA_A + (r - 1 + i / 3) * IMG_R + c - 1 + i % 3) *
+             CONV_KERNEL[i];
+        weight += CONV_KERNEL[i];
+      }
+      if (k.word(DATA_C + 4 * (r * IMG_R + c)) != S / weight)
+        return false;
+    }
+  }
+  return true;
+}
+
+// conv2d_3x3_unrolled_i8_xpulpv2, returns the outputs
+static size_t conv2d_3x3_i8(kernel_sim_t& k, loop_kind_t loop)
+{
+  const uint32_t R = IMG_R, C = IMG_C;
+  const int S = 10, img0 = 11, img1 = 12, img2 = 13, t0 = 14, t1 = 15,
+            t2 = 16, c0 = 17, c1 = 18, c2 = 19, w = 20, out_incr = 21,
+            in_incr = 22, addr_in = 5, addr_out = 6, n_iter = 7,
+            end_out = 31;
+  std::vector<uint32_t> c;
+  c.push_back(r_type(MATCH_PV_DOTSP_B, S, img0, c0));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, S, img1, c1));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, S, img2, c2));
+  c.push_back(r_type(MATCH_DIV, S, S, w));
+  c.push_back(r_type(MATCH_P_SW_RRPOST, out_incr, addr_out, S));
+  c.push_back(i_type(MATCH_P_LB_IRPOST, t0, addr_in, 1));
+  c.push_back(i_type(MATCH_P_LB_IRPOST, t1, addr_in, 1));
+  c.push_back(r_type(MATCH_P_LB_RRPOST, t2, addr_in, in_incr));
+  c.push_back(mv(img0, img1));
+  c.push_back(mv(img1, img2));
+  c.push_back(mv(img2, t0));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, img2, t1, 1));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, img2, t2, 2));
+  k.load(c, loop, n_iter, addr_out, end_out);
+
+  k.set(c0, pack(CONV_KERNEL[0], CONV_KERNEL[1], CONV_KERNEL[2]));
+  k.set(c1, pack(CONV_KERNEL[3], CONV_KERNEL[4], CONV_KERNEL[5]));
+  k.set(c2, pack(CONV_KERNEL[6], CONV_KERNEL[7], CONV_KERNEL[8]));
+  k.set(w, 45);
+  k.set(out_incr, R * 4);
+  k.set(in_incr, R - 2);
+  for (uint32_t col = 1; col < C - 1; col++) {
+    reg_t in = DATA_A + col - 1;
+    k.set(img0, pack(k.byte(in), k.byte(in + 1), k.byte(in + 2)));
+    k.set(img1, pack(k.byte(in + R), k.byte(in + R + 1), k.byte(in + R + 2)));
+    k.set(img2, pack(k.byte(in + 2 * R), k.byte(in + 2 * R + 1),
+                     k.byte(in + 2 * R + 2)));
+    k.set(addr_in, in + 3 * R);
+    k.set(addr_out, DATA_C + 4 * (R + col));
+    k.set(n_iter, R - 2);
+    k.set(end_out, DATA_C + 4 * (R + col) + (R - 2) * R * 4);
+    k.call();
+  }
+  return check_conv2d(k) ? (R - 2) * (C - 2) : 0;
+}
+
+// conv2d_3x3_unrolled2_i8_xpulpv2, returns the outputs
+static size_t conv2d_3x3_unrolled2_i8(kernel_sim_t& k, loop_kind_t loop)
+{
+  const uint32_t R = IMG_R, C = IMG_C;
+  const int S0 = 10, S1 = 11, img00 = 12, img10 = 13, img20 = 14,
+            img01 = 15, img11 = 16, img21 = 17, t0 = 18, t1 = 19, t2 = 20,
+            t3 = 21, c0 = 22, c1 = 23, c2 = 24, w = 25, out_incr = 26,
+            in_incr = 27, addr_in = 5, addr_out = 6, n_iter = 7,
+            end_out = 31;
+  std::vector<uint32_t> c;
+  c.push_back(r_type(MATCH_PV_DOTSP_B, S0, img00, c0));
+  c.push_back(r_type(MATCH_PV_DOTSP_B, S1, img01, c0));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, S0, img10, c1));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, S1, img11, c1));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, S0, img20, c2));
+  c.push_back(r_type(MATCH_PV_SDOTSP_B, S1, img21, c2));
+  c.push_back(r_type(MATCH_DIV, S0, S0, w));
+  c.push_back(r_type(MATCH_DIV, S1, S1, w));
+  c.push_back(s_type(MATCH_P_SW_IRPOST, addr_out, S0, 4));
+  c.push_back(r_type(MATCH_P_SW_RRPOST, out_incr, addr_out, S1));
+  c.push_back(i_type(MATCH_P_LB_IRPOST, t0, addr_in, 1));
+  c.push_back(i_type(MATCH_P_LB_IRPOST, t1, addr_in, 1));
+  c.push_back(i_type(MATCH_P_LB_IRPOST, t2, addr_in, 1));
+  c.push_back(r_type(MATCH_P_LB_RRPOST, t3, addr_in, in_incr));
+  c.push_back(mv(img00, img10));
+  c.push_back(mv(img10, img20));
+  c.push_back(mv(img20, t0));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, img20, t1, 1));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, img20, t2, 2));
+  c.push_back(mv(img01, img11));
+  c.push_back(mv(img11, img21));
+  c.push_back(mv(img21, t1));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, img21, t2, 1));
+  c.push_back(pv_imm6(MATCH_PV_INSERT_B, img21, t3, 2));
+  k.load(c, loop, n_iter, addr_out, end_out);
+
+  k.set(c0, pack(CONV_KERNEL[0], CONV_KERNEL[1], CONV_KERNEL[2]));
+  k.set(c1, pack(CONV_KERNEL[3], CONV_KERNEL[4], CONV_KERNEL[5]));
+  k.set(c2, pack(CONV_KERNEL[6], CONV_KERNEL[7], CONV_KERNEL[8]));
+  k.set(w, 45);
+  k.set(out_incr, R * 4 - 4);
+  k.set(in_incr, R - 3);
+  for (uint32_t col = 1; col < C / 2; col++) {
+    reg_t in = DATA_A + 2 * col - 2;
+    k.set(img00, pack(k.byte(in), k.byte(in + 1), k.byte(in + 2)));
+    k.set(img10, pack(k.byte(in + R), k.byte(in + R + 1), k.byte(in + R + 2)));
+    k.set(img20, pack(k.byte(in + 2 * R), k.byte(in + 2 * R + 1),
+                      k.byte(in + 2 * R + 2)));
+    k.set(img01, pack(k.byte(in + 1), k.byte(in + 2), k.byte(in + 3)));
+    k.set(img11, pack(k.byte(in + R + 1), k.byte(in + R + 2),
+                      k.byte(in + R + 3)));
+    k.set(img21, pack(k.byte(in + 2 * R + 1), k.byte(in + 2 * R + 2),
+                      k.byte(in + 2 * R + 3)));
+    k.set(addr_in, in + 3 * R);
+    k.set(addr_out, DATA_C + 4 * (R + 2 * col - 1));
+    k.set(n_iter, R - 2);
+    k.set(end_out, DATA_C + 4 * (R + 2 * col - 1) + (R - 2) * R * 4);
+    k.call();
+  }
+  return check_conv2d(k) ? (R - 2) * (C - 2) : 0;
+}
+
+static void compare(const char* name,
+                    size_t (*kernel)(kernel_sim_t&, loop_kind_t),
+                    const char* isa)
+{
+  uint64_t insns[2];
+  size_t outputs = 0;
+  for (int loop = LOOP_BRANCH; loop <= LOOP_HW; loop++) {
+    kernel_sim_t k(isa);
+    for (size_t i = DATA_A - MEM_BASE; i < DATA_C - MEM_BASE; i++)
+      k.sim.mem[i] = (char)(i * 2654435761u >> 24);
+    outputs = kernel(k, (loop_kind_t)loop);
+    if (k.p.get_state()->mcause != 0 || outputs == 0) {
+      fprintf(stderr, "%s: wrong result with %s\n", name,
+              loop == LOOP_HW ? "lp.setup" : "branch");
+      exit(1);
+    }
+    insns[loop] = k.insns;
+  }
+
+  printf("%-24s %5zu outputs %8.3f insns/output with a branch, %8.3f with "
+         "lp.setup (%+.1f%%)\n", name, outputs,
+         (double)insns[LOOP_BRANCH] / outputs, (double)insns[LOOP_HW] / outputs,
+         100.0 * ((double)insns[LOOP_HW] / insns[LOOP_BRANCH] - 1));
+}
+
+int main(int argc, char** argv)
+{
+  const char* isa = "RV32IMA";
+  size_t insns = 50000000;
+
+  option_parser_t parser;
+  parser.help([]{
+    fprintf(stderr, "usage: xpulp-bench [--isa=<name>] [--insns=<n>]\n");
+    exit(1);
+  });
+  parser.option(0, "isa", 1, [&](const char* s){isa = s;});
+  parser.option(0, "insns", 1, [&](const char* s){insns = strtoull(s, 0, 0);});
+  parser.parse(argv);
+
+  run("matmul_i8", matmul_i8, isa, insns);
+  run("conv2d_i8", conv2d_i8, isa, insns);
+
+  compare("matmul_2x4_i8", matmul_2x4_i8, isa);
+  compare("conv2d_3x3_i8", conv2d_3x3_i8, isa);
+  compare("conv2d_3x3_unrolled2_i8", conv2d_3x3_unrolled2_i8, isa);
+  return 0;
+}